@@ -54,6 +54,112 @@ class PresentMonDLL (object):
             ctypes.c_int64
         ]
 
+        # set consumer shards
+        self.SetConsumerShards = self.lib.SetConsumerShards
+        self.SetConsumerShards.restype = ctypes.c_int
+        self.SetConsumerShards.argtypes = [
+            ctypes.c_int64
+        ]
+
+        # set capture profile
+        self.SetCaptureProfile = self.lib.SetCaptureProfile
+        self.SetCaptureProfile.restype = ctypes.c_int
+        self.SetCaptureProfile.argtypes = [
+            ctypes.c_int64
+        ]
+
+        # set raw event capture file
+        self.SetCaptureFile = self.lib.SetCaptureFile
+        self.SetCaptureFile.restype = ctypes.c_int
+        self.SetCaptureFile.argtypes = [
+            ctypes.c_char_p
+        ]
+
+        # set session buffers
+        self.SetSessionBuffers = self.lib.SetSessionBuffers
+        self.SetSessionBuffers.restype = ctypes.c_int
+        self.SetSessionBuffers.argtypes = [
+            ctypes.c_int64,
+            ctypes.c_int64,
+            ctypes.c_int64,
+            ctypes.c_int64,
+            ctypes.c_int64
+        ]
+
+        # set history window
+        self.SetHistoryWindow = self.lib.SetHistoryWindow
+        self.SetHistoryWindow.restype = ctypes.c_int
+        self.SetHistoryWindow.argtypes = [
+            ctypes.c_int64,
+            ctypes.c_int64
+        ]
+
+        # set hitch detection
+        self.SetHitchDetection = self.lib.SetHitchDetection
+        self.SetHitchDetection.restype = ctypes.c_int
+        self.SetHitchDetection.argtypes = [
+            ctypes.c_double,
+            ctypes.c_double
+        ]
+
+        # analyze a recorded capture
+        self.AnalyzeCaptureFile = self.lib.AnalyzeCaptureFile
+        self.AnalyzeCaptureFile.restype = ctypes.c_int
+        self.AnalyzeCaptureFile.argtypes = [
+            ctypes.c_char_p,
+            ctypes.c_int64,
+            ctypes.c_int64,
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_int64)
+        ]
+
+        # get event loss stats
+        self.GetEventLossStats = self.lib.GetEventLossStats
+        self.GetEventLossStats.restype = ctypes.c_int
+        self.GetEventLossStats.argtypes = [
+            ndpointer (ctypes.c_uint64)
+        ]
+
+        # get swapchain stats
+        self.GetSwapChainStats = self.lib.GetSwapChainStats
+        self.GetSwapChainStats.restype = ctypes.c_int
+        self.GetSwapChainStats.argtypes = [
+            ctypes.c_int64,
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_int64)
+        ]
+
+        # get frame time percentiles
+        self.GetFrameTimePercentiles = self.lib.GetFrameTimePercentiles
+        self.GetFrameTimePercentiles.restype = ctypes.c_int
+        self.GetFrameTimePercentiles.argtypes = [
+            ctypes.c_int64,
+            ctypes.c_uint64,
+            ctypes.c_int64,
+            ctypes.c_int64,
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_double)
+        ]
+
+        # get display refresh
+        self.GetDisplayRefresh = self.lib.GetDisplayRefresh
+        self.GetDisplayRefresh.restype = ctypes.c_int
+        self.GetDisplayRefresh.argtypes = [
+            ctypes.c_int64,
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_int64)
+        ]
+
+        # get hitch events
+        self.GetHitchEvents = self.lib.GetHitchEvents
+        self.GetHitchEvents.restype = ctypes.c_int
+        self.GetHitchEvents.argtypes = [
+            ctypes.c_int64,
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_double),
+            ndpointer (ctypes.c_int64)
+        ]
+
         # get current data
         self.GetCurrentData = self.lib.GetCurrentData
         self.GetCurrentData.restype = ctypes.c_int64
@@ -141,3 +247,123 @@ def disable_fliprate_log ():
     res = PresentMonDLL.get_instance ().SetLogLevel (6)
     if res != PresentMonExitCodes.STATUS_OK.value:
         raise FpsInspectorError ('unable to enable fliprate log', res)
+
+def set_consumer_shards (num_shards):
+    res = PresentMonDLL.get_instance ().SetConsumerShards (num_shards)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set consumer shards', res)
+
+def set_capture_profile (runtime_only):
+    res = PresentMonDLL.get_instance ().SetCaptureProfile (1 if runtime_only else 0)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set capture profile', res)
+
+def set_capture_file (path):
+    res = PresentMonDLL.get_instance ().SetCaptureFile (path.encode ('utf-8') if path else None)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set capture file', res)
+
+def analyze_capture (path, num_threads = 0, max_swapchains = 256):
+    columns = ['ProcessId', 'SwapChainAddress', 'PresentCount', 'DisplayedCount', 'DurationMs', 'FPS',
+        'DisplayedFPS', 'LatencyMs']
+    stats_arr = numpy.zeros (max_swapchains*len (columns)).astype (numpy.float64)
+    current_size = numpy.zeros (1).astype (numpy.int64)
+
+    res = PresentMonDLL.get_instance ().AnalyzeCaptureFile (path.encode ('utf-8'), num_threads, max_swapchains, stats_arr, current_size)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to analyze capture', res)
+    count = current_size[0]
+    df = pandas.DataFrame (stats_arr[0:count*len (columns)].reshape (count, len (columns)), columns=columns)
+    for column in ['ProcessId', 'SwapChainAddress', 'PresentCount', 'DisplayedCount']:
+        df[column] = df[column].astype (numpy.uint64)
+    return df
+
+def set_session_buffers (buffer_size_kb = 0, min_buffers = 200, max_buffers = 0, flush_timer = 0, auto_tune = True):
+    res = PresentMonDLL.get_instance ().SetSessionBuffers (buffer_size_kb, min_buffers, max_buffers, flush_timer, 1 if auto_tune else 0)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set session buffers', res)
+
+def set_history_window (window_ms = 2000, budget_kb = 1024):
+    res = PresentMonDLL.get_instance ().SetHistoryWindow (window_ms, budget_kb)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set history window', res)
+
+def set_hitch_detection (factor = 2.0, margin_ms = 0.0):
+    res = PresentMonDLL.get_instance ().SetHitchDetection (factor, margin_ms)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to set hitch detection', res)
+
+def get_event_loss_stats ():
+    names = ['EventsLost', 'BuffersLost', 'PresentsDropped', 'ProcessEventsDropped',
+        'BufferSizeKB', 'MinimumBuffers', 'MaximumBuffers', 'FlushTimer', 'BufferRetunes']
+    stats = numpy.zeros (len (names)).astype (numpy.uint64)
+
+    res = PresentMonDLL.get_instance ().GetEventLossStats (stats)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to get event loss stats', res)
+    return dict (zip (names, [int (x) for x in stats]))
+
+def get_swapchain_stats (max_swapchains = 256):
+    columns = ['ProcessId', 'SwapChainAddress', 'FPS', 'DisplayedFPS', 'LatencyMs', 'CpuFrameTimeMs',
+        'PresentCount', 'DisplayedCount', 'RefreshPeriodMs', 'VsyncIntervals', 'MeanVsyncIntervals',
+        'MissedVsyncCount', 'DisplayJitterMs']
+    stats_arr = numpy.zeros (max_swapchains*len (columns)).astype (numpy.float64)
+    current_size = numpy.zeros (1).astype (numpy.int64)
+
+    res = PresentMonDLL.get_instance ().GetSwapChainStats (max_swapchains, stats_arr, current_size)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to get swapchain stats', res)
+    count = current_size[0]
+    df = pandas.DataFrame (stats_arr[0:count*len (columns)].reshape (count, len (columns)), columns=columns)
+    for column in ['ProcessId', 'SwapChainAddress', 'PresentCount', 'DisplayedCount', 'VsyncIntervals', 'MissedVsyncCount']:
+        df[column] = df[column].astype (numpy.uint64)
+    return df
+
+def get_display_refresh (max_displays = 16):
+    columns = ['VidPnTargetId', 'RefreshPeriodMs', 'RefreshRateHz', 'VsyncCount']
+    stats_arr = numpy.zeros (max_displays*len (columns)).astype (numpy.float64)
+    current_size = numpy.zeros (1).astype (numpy.int64)
+
+    res = PresentMonDLL.get_instance ().GetDisplayRefresh (max_displays, stats_arr, current_size)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to get display refresh', res)
+    count = current_size[0]
+    df = pandas.DataFrame (stats_arr[0:count*len (columns)].reshape (count, len (columns)), columns=columns)
+    for column in ['VidPnTargetId', 'VsyncCount']:
+        df[column] = df[column].astype (numpy.uint64)
+    return df
+
+def get_frametime_percentiles (process_id, swapchain_address, percentiles = (50, 95, 99, 99.9), window = False):
+    percentile_arr = numpy.array (percentiles).astype (numpy.float64)
+    frametime_arr = numpy.zeros (len (percentile_arr)).astype (numpy.float64)
+
+    res = PresentMonDLL.get_instance ().GetFrameTimePercentiles (process_id, swapchain_address, 1 if window else 0,
+        len (percentile_arr), percentile_arr, frametime_arr)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to get frame time percentiles', res)
+    return dict (zip (percentiles, frametime_arr))
+
+def get_low_fps (process_id, swapchain_address, window = False):
+    frametimes = get_frametime_percentiles (process_id, swapchain_address, (99, 99.9), window)
+    return {
+        '1% low': 1000. / frametimes[99] if frametimes[99] > 0 else 0.,
+        '0.1% low': 1000. / frametimes[99.9] if frametimes[99.9] > 0 else 0.
+    }
+
+def get_hitch_events (max_events = 4096):
+    columns = ['ProcessId', 'SwapChainAddress', 'DisplayInterval', 'IntervalMs', 'MedianMs'] + \
+        ['PrecedingMs%d' % i for i in range (8)]
+    hitch_arr = numpy.zeros (max_events*len (columns)).astype (numpy.float64)
+    time_arr = numpy.zeros (max_events).astype (numpy.float64)
+    current_size = numpy.zeros (1).astype (numpy.int64)
+
+    res = PresentMonDLL.get_instance ().GetHitchEvents (max_events, time_arr, hitch_arr, current_size)
+    if res != PresentMonExitCodes.STATUS_OK.value:
+        raise FpsInspectorError ('unable to get hitch events', res)
+    count = current_size[0]
+    df = pandas.DataFrame (hitch_arr[0:count*len (columns)].reshape (count, len (columns)), columns=columns)
+    for column in ['ProcessId', 'SwapChainAddress']:
+        df[column] = df[column].astype (numpy.uint64)
+    df['DisplayInterval'] = df['DisplayInterval'].astype (bool)
+    df['Timestamp'] = time_arr[0:count]
+    return df
@@ -52,6 +52,10 @@ struct DxgkMMIOFlipEventArgs : DxgkEventBase
 struct DxgkSyncDPCEventArgs : DxgkEventBase
 {
     uint32_t FlipSubmitSequence;
+    // VSyncDPC only; FrameQpcTime is 0 for HSyncDPC
+    uint32_t VidPnTargetId;
+    uint32_t FrameNumber;
+    uint64_t FrameQpcTime;
 };
 
 struct DxgkSubmitPresentHistoryEventArgs : DxgkEventBase
@@ -0,0 +1,350 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <stddef.h>
+#include <string.h>
+
+#include "EventCapture.hpp"
+
+namespace {
+
+char const EVENT_CAPTURE_MAGIC[8] = "PMEVCAP";
+
+// Version 1 records end where the version 2 members start.
+size_t const EVENT_CAPTURE_SCHEMA_V1_SIZE = offsetof(EventCaptureSchema, PointerSize);
+size_t const EVENT_CAPTURE_FIELD_V1_SIZE = offsetof(EventCaptureField, Kind);
+
+// Names are stored as UTF-16 regardless of the platform's wchar_t.
+void AppendUtf16(std::vector<uint16_t>* out, std::wstring const& s)
+{
+    for (auto c : s) {
+        out->push_back((uint16_t) c);
+    }
+}
+
+std::wstring ReadUtf16(uint8_t const* data, size_t length)
+{
+    std::wstring s;
+    s.reserve(length);
+    for (size_t i = 0; i < length; ++i) {
+        uint16_t c;
+        memcpy(&c, data + i * 2, 2);
+        s.push_back((wchar_t) c);
+    }
+    return s;
+}
+
+}
+
+EventCaptureWriter::~EventCaptureWriter()
+{
+    Close();
+}
+
+bool EventCaptureWriter::Open(char const* path, int64_t qpcFrequency)
+{
+    Close();
+
+    mFile = fopen(path, "wb");
+    if (mFile == nullptr) {
+        return false;
+    }
+
+    mBuffer.reserve(BUFFER_SIZE);
+    mWrittenSchemas.clear();
+    mEventCount = 0;
+    mFailedWrites = 0;
+
+    EventCaptureFileHeader header = {};
+    memcpy(header.Magic, EVENT_CAPTURE_MAGIC, sizeof(header.Magic));
+    header.Version = EVENT_CAPTURE_VERSION;
+    header.QpcFrequency = qpcFrequency;
+    Append(&header, sizeof(header));
+    return true;
+}
+
+void EventCaptureWriter::Close()
+{
+    if (mFile == nullptr) {
+        return;
+    }
+
+    FlushBuffer();
+    fclose(mFile);
+    mFile = nullptr;
+}
+
+void EventCaptureWriter::WriteSchema(uint64_t schemaKey, EventSchema const& schema, std::wstring const& taskName,
+                                     void const* traceLoggingMetadata, uint16_t traceLoggingMetadataLength)
+{
+    if (mFile == nullptr) {
+        return;
+    }
+
+    std::vector<uint16_t> taskNameUtf16;
+    AppendUtf16(&taskNameUtf16, taskName);
+
+    EventCaptureSchema record = {};
+    record.SchemaKey = schemaKey;
+    record.FixedSize = schema.mFixedSize;
+    record.Variable = (schema.mVariable ? EVENT_CAPTURE_SCHEMA_VARIABLE : 0) |
+                      (schema.IsLayoutEnded() ? EVENT_CAPTURE_SCHEMA_LAYOUT_ENDED : 0);
+    record.TaskNameLength = (uint16_t) taskNameUtf16.size();
+    record.TraceLoggingMetadataLength = traceLoggingMetadataLength;
+    record.FieldCount = (uint16_t) schema.mFields.size();
+    record.PointerSize = (uint8_t) schema.mPointerSize;
+
+    auto type = EventCaptureRecordType::Schema;
+    Append(&type, sizeof(type));
+    Append(&record, sizeof(record));
+    Append(taskNameUtf16.data(), taskNameUtf16.size() * 2);
+    Append(traceLoggingMetadata, traceLoggingMetadataLength);
+
+    std::vector<uint16_t> nameUtf16;
+    for (auto const& field : schema.mFields) {
+        nameUtf16.clear();
+        AppendUtf16(&nameUtf16, field.Name);
+
+        EventCaptureField f = {};
+        f.Offset = field.Offset;
+        f.Size = field.Size;
+        f.NameLength = (uint16_t) nameUtf16.size();
+        f.Kind = (uint8_t) field.Kind;
+        f.Count = field.Count;
+        f.CountIndex = field.CountIndex;
+        Append(&f, sizeof(f));
+        Append(nameUtf16.data(), nameUtf16.size() * 2);
+    }
+
+    mWrittenSchemas.emplace(schemaKey, true);
+}
+
+void EventCaptureWriter::WriteEvent(EventCaptureEvent const& event, void const* userData)
+{
+    if (mFile == nullptr) {
+        return;
+    }
+
+    auto type = EventCaptureRecordType::Event;
+    Append(&type, sizeof(type));
+    Append(&event, sizeof(event));
+    Append(userData, event.UserDataLength);
+    mEventCount += 1;
+}
+
+void EventCaptureWriter::Append(void const* data, size_t size)
+{
+    if (mBuffer.size() + size > BUFFER_SIZE) {
+        FlushBuffer();
+    }
+    mBuffer.insert(mBuffer.end(), (uint8_t const*) data, (uint8_t const*) data + size);
+}
+
+void EventCaptureWriter::FlushBuffer()
+{
+    if (!mBuffer.empty() && fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) != mBuffer.size()) {
+        mFailedWrites += 1;
+    }
+    mBuffer.clear();
+}
+
+bool EventCaptureReader::Open(char const* path)
+{
+    Close();
+
+    auto fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+
+    uint8_t chunk[1 << 16];
+    for (;;) {
+        auto n = fread(chunk, 1, sizeof(chunk), fp);
+        if (n == 0) {
+            break;
+        }
+        mData.insert(mData.end(), chunk, chunk + n);
+    }
+    fclose(fp);
+
+    auto header = Take(sizeof(mHeader));
+    if (header == nullptr) {
+        return false;
+    }
+    memcpy(&mHeader, header, sizeof(mHeader));
+    if (memcmp(mHeader.Magic, EVENT_CAPTURE_MAGIC, sizeof(mHeader.Magic)) != 0 || mHeader.Version < 1 || mHeader.Version > EVENT_CAPTURE_VERSION) {
+        mCorrupt = true;
+        return false;
+    }
+    return true;
+}
+
+bool EventCaptureReader::ReadHeader(char const* path, EventCaptureFileHeader* header)
+{
+    auto fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+    auto ok = fread(header, sizeof(*header), 1, fp) == 1;
+    fclose(fp);
+    return ok && memcmp(header->Magic, EVENT_CAPTURE_MAGIC, sizeof(header->Magic)) == 0 &&
+           header->Version >= 1 && header->Version <= EVENT_CAPTURE_VERSION;
+}
+
+void EventCaptureReader::Close()
+{
+    mData.clear();
+    mPos = 0;
+    mCorrupt = false;
+    mHeader = EventCaptureFileHeader();
+    mSchemas.clear();
+}
+
+uint8_t const* EventCaptureReader::Take(size_t size)
+{
+    if (mData.size() - mPos < size) {
+        mCorrupt = true;
+        return nullptr;
+    }
+    auto p = mData.data() + mPos;
+    mPos += size;
+    return p;
+}
+
+bool EventCaptureReader::ReadSchema()
+{
+    auto v1 = mHeader.Version == 1;
+    auto recordSize = v1 ? EVENT_CAPTURE_SCHEMA_V1_SIZE : sizeof(EventCaptureSchema);
+    auto p = Take(recordSize);
+    if (p == nullptr) {
+        return false;
+    }
+    EventCaptureSchema record = {};
+    memcpy(&record, p, recordSize);
+
+    CapturedSchema captured;
+
+    if ((p = Take(record.TaskNameLength * 2u)) == nullptr) {
+        return false;
+    }
+    captured.TaskName = ReadUtf16(p, record.TaskNameLength);
+
+    if ((p = Take(record.TraceLoggingMetadataLength)) == nullptr) {
+        return false;
+    }
+    captured.TraceLoggingMetadata.assign(p, p + record.TraceLoggingMetadataLength);
+
+    auto fieldSize = v1 ? EVENT_CAPTURE_FIELD_V1_SIZE : sizeof(EventCaptureField);
+    for (uint16_t i = 0; i < record.FieldCount; ++i) {
+        if ((p = Take(fieldSize)) == nullptr) {
+            return false;
+        }
+        EventCaptureField f = {};
+        memcpy(&f, p, fieldSize);
+        if ((p = Take(f.NameLength * 2u)) == nullptr) {
+            return false;
+        }
+        auto name = ReadUtf16(p, f.NameLength);
+
+        if (v1) {
+            // Version 1 only recorded fixed-offset scalars.
+            EventSchema::Field field;
+            field.Name = name;
+            field.Offset = f.Offset;
+            field.Size = f.Size;
+            field.Count = 1;
+            field.CountIndex = EventSchema::NO_FIELD;
+            field.Kind = EventSchema::FieldKind::Scalar;
+            captured.Schema.mFields.push_back(field);
+        } else {
+            // Offsets follow from the kinds and sizes; AddField() works them
+            // out again.
+            if (f.Kind > (uint8_t) EventSchema::FieldKind::WbemSid) {
+                mCorrupt = true;
+                return false;
+            }
+            captured.Schema.AddField(name.c_str(), (EventSchema::FieldKind) f.Kind, f.Size, f.Count, f.CountIndex);
+        }
+    }
+
+    if (v1) {
+        captured.Schema.mFixedSize = record.FixedSize;
+        if (record.Variable != 0) {
+            captured.Schema.EndLayout();
+        }
+    } else {
+        if (captured.Schema.mFields.size() != record.FieldCount || captured.Schema.mFixedSize != record.FixedSize) {
+            mCorrupt = true;
+            return false;
+        }
+        if (record.Variable & EVENT_CAPTURE_SCHEMA_LAYOUT_ENDED) {
+            captured.Schema.EndLayout();
+        }
+        captured.Schema.mPointerSize = record.PointerSize;
+    }
+
+    mSchemas[record.SchemaKey] = std::move(captured);
+    return true;
+}
+
+bool EventCaptureReader::Next(EventCaptureEvent const** event, void const** userData)
+{
+    while (mPos < mData.size()) {
+        auto type = (EventCaptureRecordType) mData[mPos++];
+        switch (type) {
+        case EventCaptureRecordType::Schema:
+            if (!ReadSchema()) {
+                return false;
+            }
+            break;
+
+        case EventCaptureRecordType::Event: {
+            auto p = Take(sizeof(EventCaptureEvent));
+            if (p == nullptr) {
+                return false;
+            }
+            // Records are unpadded, so copy the header out rather than point
+            // at it.
+            memcpy(&mEvent, p, sizeof(mEvent));
+            auto data = Take(mEvent.UserDataLength);
+            if (data == nullptr) {
+                return false;
+            }
+            *event = &mEvent;
+            *userData = data;
+            return true;
+        }
+
+        default:
+            mCorrupt = true;
+            return false;
+        }
+    }
+    return false;
+}
+
+CapturedSchema const* EventCaptureReader::FindSchema(uint64_t schemaKey) const
+{
+    auto ii = mSchemas.find(schemaKey);
+    return ii == mSchemas.end() ? nullptr : &ii->second;
+}
@@ -0,0 +1,188 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "EventSchema.hpp"
+
+// Raw event capture: the EVENT_HEADER fields PresentData looks at plus each
+// event's UserData, so a realtime session can be replayed later through the
+// consumers at full speed, on any platform.
+//
+// Payloads are decoded through EventSchema layouts, so the layout (and task
+// name) of every schema seen is stored once in the capture as well; replay
+// never needs TDH or the provider manifests.
+//
+// File layout, little endian and unpadded:
+//
+//   EventCaptureFileHeader
+//   { uint8_t EventCaptureRecordType, record }*
+//
+// where an Event record is an EventCaptureEvent followed by UserDataLength
+// bytes, and a Schema record is an EventCaptureSchema followed by
+//   TaskNameLength UTF-16 code units,
+//   TraceLoggingMetadataLength bytes,
+//   FieldCount x { EventCaptureField, NameLength UTF-16 code units }.
+// A schema record always precedes the first event that refers to it.
+//
+// Version 2 appended PointerSize to EventCaptureSchema and Kind, Count and
+// CountIndex to EventCaptureField so strings, SIDs and arrays are decoded
+// from the capture too; version 1 captures (fixed-offset scalars only) are
+// still read.
+//
+// This has no ETW dependencies; see EventReplay.hpp for the ETW side.
+
+enum {
+    EVENT_CAPTURE_VERSION = 2,
+};
+
+#pragma pack(push, 1)
+struct EventCaptureFileHeader {
+    char Magic[8];              // "PMEVCAP"
+    uint32_t Version;
+    uint32_t Reserved;
+    int64_t QpcFrequency;
+};
+
+enum class EventCaptureRecordType : uint8_t {
+    Event = 1,
+    Schema = 2,
+};
+
+struct EventCaptureEvent {
+    uint8_t ProviderId[16];
+    int64_t TimeStamp;
+    uint32_t ProcessId;
+    uint32_t ThreadId;
+    uint64_t SchemaKey;
+    uint16_t Flags;
+    uint16_t Id;
+    uint8_t Version;
+    uint8_t Opcode;
+    uint16_t Task;
+    uint16_t UserDataLength;
+};
+
+enum {
+    EVENT_CAPTURE_SCHEMA_VARIABLE     = 0x1,    // some field has no fixed offset or wasn't recorded
+    EVENT_CAPTURE_SCHEMA_LAYOUT_ENDED = 0x2,    // fields after the last one weren't recorded (v2)
+};
+
+struct EventCaptureSchema {
+    uint64_t SchemaKey;
+    uint32_t FixedSize;
+    uint8_t Variable;           // EVENT_CAPTURE_SCHEMA_* flags
+    uint16_t TaskNameLength;
+    uint16_t TraceLoggingMetadataLength;
+    uint16_t FieldCount;
+    uint8_t PointerSize;        // v2
+};
+
+struct EventCaptureField {
+    uint32_t Offset;
+    uint32_t Size;
+    uint16_t NameLength;
+    uint8_t Kind;               // v2: EventSchema::FieldKind
+    uint32_t Count;             // v2
+    int32_t CountIndex;         // v2
+};
+#pragma pack(pop)
+
+// A schema as read back from a capture.
+struct CapturedSchema {
+    EventSchema Schema;
+    std::wstring TaskName;
+    std::vector<uint8_t> TraceLoggingMetadata; // empty for manifest/classic events
+};
+
+struct EventCaptureWriter {
+    EventCaptureWriter() = default;
+    EventCaptureWriter(EventCaptureWriter const&) = delete;
+    EventCaptureWriter& operator=(EventCaptureWriter const&) = delete;
+    ~EventCaptureWriter();
+
+    bool Open(char const* path, int64_t qpcFrequency);
+    void Close();
+    bool IsOpen() const { return mFile != nullptr; }
+
+    // Schemas only need to be written once; WriteEvent() doesn't check.
+    bool HasSchema(uint64_t schemaKey) const { return mWrittenSchemas.find(schemaKey) != mWrittenSchemas.end(); }
+    void WriteSchema(uint64_t schemaKey, EventSchema const& schema, std::wstring const& taskName,
+                     void const* traceLoggingMetadata, uint16_t traceLoggingMetadataLength);
+    void WriteEvent(EventCaptureEvent const& event, void const* userData);
+
+    // Events written, and events lost to write errors.
+    uint64_t GetEventCount() const { return mEventCount; }
+    uint64_t GetFailedWriteCount() const { return mFailedWrites; }
+
+private:
+    enum { BUFFER_SIZE = 1 << 20 };
+
+    void Append(void const* data, size_t size);
+    void FlushBuffer();
+
+    FILE* mFile = nullptr;
+    std::vector<uint8_t> mBuffer;
+    std::unordered_map<uint64_t, bool> mWrittenSchemas;
+    uint64_t mEventCount = 0;
+    uint64_t mFailedWrites = 0;
+};
+
+// Reads a whole capture into memory and walks it; Next() hands out pointers
+// into that buffer, valid until the reader is closed or destroyed.
+struct EventCaptureReader {
+    bool Open(char const* path);
+    void Close();
+
+    // Read only the file header of a capture, e.g. for its QPC frequency.
+    static bool ReadHeader(char const* path, EventCaptureFileHeader* header);
+
+    int64_t GetQpcFrequency() const { return mHeader.QpcFrequency; }
+
+    // Return the next event, consuming any schema records before it.  Returns
+    // false at the end of the capture or if it is truncated/corrupt; the two
+    // are told apart with IsCorrupt().  *event is valid until the next call.
+    bool Next(EventCaptureEvent const** event, void const** userData);
+    bool IsCorrupt() const { return mCorrupt; }
+
+    // Schemas are available once an event referring to them was returned.
+    CapturedSchema const* FindSchema(uint64_t schemaKey) const;
+
+private:
+    bool ReadSchema();
+    uint8_t const* Take(size_t size);
+
+    std::vector<uint8_t> mData;
+    size_t mPos = 0;
+    EventCaptureEvent mEvent = {};
+    bool mCorrupt = false;
+    EventCaptureFileHeader mHeader = {};
+    std::unordered_map<uint64_t, CapturedSchema> mSchemas;
+};
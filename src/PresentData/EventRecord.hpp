@@ -0,0 +1,181 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+// The ETW event types the consumers and the capture/replay code use.  On
+// Windows they come from the SDK; elsewhere, where captures are replayed and
+// the tests run, a layout-compatible subset is defined here.  There is no TDH
+// off Windows: payloads are decoded through captured EventSchemas only.
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <evntcons.h> // must include after windows.h
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t     UCHAR;
+typedef uint8_t     BYTE;
+typedef uint8_t     BOOLEAN;
+typedef uint16_t    USHORT;
+typedef uint32_t    UINT;
+typedef uint32_t    ULONG;
+typedef uint32_t    DWORD;
+typedef int32_t     LONG;
+typedef int32_t     BOOL;
+typedef int32_t     HRESULT;
+typedef uint64_t    ULONGLONG;
+typedef uint64_t    ULONG64;
+typedef int64_t     LONGLONG;
+typedef void*       PVOID;
+
+#define TRUE 1
+#define FALSE 0
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        ULONG HighPart;
+    };
+    ULONGLONG QuadPart;
+} ULARGE_INTEGER;
+
+typedef struct tagRECT {
+    LONG left;
+    LONG top;
+    LONG right;
+    LONG bottom;
+} RECT;
+
+typedef struct _GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+} GUID;
+
+inline bool IsEqualGUID(GUID const& a, GUID const& b)
+{
+    return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+inline bool InlineIsEqualGUID(GUID const& a, GUID const& b)
+{
+    return IsEqualGUID(a, b);
+}
+
+typedef struct _EVENT_DESCRIPTOR {
+    USHORT Id;
+    UCHAR Version;
+    UCHAR Channel;
+    UCHAR Level;
+    UCHAR Opcode;
+    USHORT Task;
+    ULONGLONG Keyword;
+} EVENT_DESCRIPTOR;
+
+typedef struct _EVENT_HEADER {
+    USHORT Size;
+    USHORT HeaderType;
+    USHORT Flags;
+    USHORT EventProperty;
+    ULONG ThreadId;
+    ULONG ProcessId;
+    LARGE_INTEGER TimeStamp;
+    GUID ProviderId;
+    EVENT_DESCRIPTOR EventDescriptor;
+    union {
+        struct {
+            ULONG KernelTime;
+            ULONG UserTime;
+        };
+        ULONG64 ProcessorTime;
+    };
+    GUID ActivityId;
+} EVENT_HEADER, *PEVENT_HEADER;
+
+typedef struct _ETW_BUFFER_CONTEXT {
+    union {
+        struct {
+            UCHAR ProcessorNumber;
+            UCHAR Alignment;
+        };
+        USHORT ProcessorIndex;
+    };
+    USHORT LoggerId;
+} ETW_BUFFER_CONTEXT;
+
+typedef struct _EVENT_HEADER_EXTENDED_DATA_ITEM {
+    USHORT Reserved1;
+    USHORT ExtType;
+    USHORT Linkage : 1;
+    USHORT Reserved2 : 15;
+    USHORT DataSize;
+    ULONGLONG DataPtr;
+} EVENT_HEADER_EXTENDED_DATA_ITEM, *PEVENT_HEADER_EXTENDED_DATA_ITEM;
+
+typedef struct _EVENT_RECORD {
+    EVENT_HEADER EventHeader;
+    ETW_BUFFER_CONTEXT BufferContext;
+    USHORT ExtendedDataCount;
+    USHORT UserDataLength;
+    PEVENT_HEADER_EXTENDED_DATA_ITEM ExtendedData;
+    PVOID UserData;
+    PVOID UserContext;
+} EVENT_RECORD, *PEVENT_RECORD;
+
+#define EVENT_HEADER_FLAG_EXTENDED_INFO     0x0001
+#define EVENT_HEADER_FLAG_PRIVATE_SESSION   0x0002
+#define EVENT_HEADER_FLAG_STRING_ONLY       0x0004
+#define EVENT_HEADER_FLAG_TRACE_MESSAGE     0x0008
+#define EVENT_HEADER_FLAG_NO_CPUTIME        0x0010
+#define EVENT_HEADER_FLAG_32_BIT_HEADER     0x0020
+#define EVENT_HEADER_FLAG_64_BIT_HEADER     0x0040
+#define EVENT_HEADER_FLAG_CLASSIC_HEADER    0x0100
+
+#define EVENT_TRACE_TYPE_INFO       0x00
+#define EVENT_TRACE_TYPE_START      0x01
+#define EVENT_TRACE_TYPE_END        0x02
+#define EVENT_TRACE_TYPE_STOP       0x02
+#define EVENT_TRACE_TYPE_DC_START   0x03
+#define EVENT_TRACE_TYPE_DC_END     0x04
+
+#endif
+
+#ifndef EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL
+#define EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL 11
+#endif
@@ -0,0 +1,134 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <string.h>
+
+#include "EventReplay.hpp"
+#include "TraceConsumer.hpp"
+
+void HandleCaptureEvent(EVENT_RECORD* pEventRecord, EventCaptureWriter* writer)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    auto schemaKey = GetEventSchemaKey(pEventRecord);
+
+    if (!writer->HasSchema(schemaKey)) {
+        void const* tlMetadata = nullptr;
+        uint16_t tlMetadataLength = 0;
+        for (USHORT i = 0; i < pEventRecord->ExtendedDataCount; ++i) {
+            auto const& item = pEventRecord->ExtendedData[i];
+            if (item.ExtType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) {
+                tlMetadata = (void const*)(uintptr_t) item.DataPtr;
+                tlMetadataLength = item.DataSize;
+                break;
+            }
+        }
+        writer->WriteSchema(schemaKey, GetEventSchema(pEventRecord), GetEventTaskName(pEventRecord), tlMetadata, tlMetadataLength);
+    }
+
+    EventCaptureEvent event = {};
+    memcpy(event.ProviderId, &hdr.ProviderId, sizeof(event.ProviderId));
+    event.TimeStamp = hdr.TimeStamp.QuadPart;
+    event.ProcessId = hdr.ProcessId;
+    event.ThreadId = hdr.ThreadId;
+    event.SchemaKey = schemaKey;
+    event.Flags = hdr.Flags;
+    event.Id = hdr.EventDescriptor.Id;
+    event.Version = hdr.EventDescriptor.Version;
+    event.Opcode = hdr.EventDescriptor.Opcode;
+    event.Task = hdr.EventDescriptor.Task;
+    event.UserDataLength = pEventRecord->UserDataLength;
+    writer->WriteEvent(event, pEventRecord->UserData);
+}
+
+void EventReplayer::AddHandler(GUID const& providerId, ReplayHandlerFn handlerFn, void* handlerContext)
+{
+    Handler h;
+    h.ProviderId = providerId;
+    h.Fn = handlerFn;
+    h.Context = handlerContext;
+    mHandlers.push_back(h);
+}
+
+bool EventReplayer::Replay(char const* path)
+{
+    EventCaptureReader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+    mQpcFrequency = reader.GetQpcFrequency();
+
+    EventCaptureEvent const* event = nullptr;
+    void const* userData = nullptr;
+    while (reader.Next(&event, &userData)) {
+        ReplayEvent(reader, *event, userData);
+    }
+
+    // The schema pointers die with the reader.
+    mLastSchema = nullptr;
+    return !reader.IsCorrupt();
+}
+
+void EventReplayer::ReplayEvent(EventCaptureReader const& reader, EventCaptureEvent const& event, void const* userData)
+{
+    if (mLastSchema == nullptr || event.SchemaKey != mLastSchemaKey) {
+        mLastSchemaKey = event.SchemaKey;
+        mLastSchema = reader.FindSchema(mLastSchemaKey);
+        if (mLastSchema != nullptr && mSeededSchemas.insert(mLastSchemaKey).second) {
+            SeedEventSchema(mLastSchemaKey, mLastSchema->Schema, mLastSchema->TaskName);
+        }
+    }
+
+    EVENT_RECORD record = {};
+    auto& hdr = record.EventHeader;
+    hdr.Size = sizeof(EVENT_HEADER);
+    memcpy(&hdr.ProviderId, event.ProviderId, sizeof(hdr.ProviderId));
+    hdr.TimeStamp.QuadPart = event.TimeStamp;
+    hdr.ProcessId = event.ProcessId;
+    hdr.ThreadId = event.ThreadId;
+    hdr.Flags = event.Flags & ~EVENT_HEADER_FLAG_EXTENDED_INFO;
+    hdr.EventDescriptor.Id = event.Id;
+    hdr.EventDescriptor.Version = event.Version;
+    hdr.EventDescriptor.Opcode = event.Opcode;
+    hdr.EventDescriptor.Task = event.Task;
+    record.UserDataLength = event.UserDataLength;
+    record.UserData = const_cast<void*>(userData);
+
+    // Re-attach the TraceLogging metadata so the event hashes to the same
+    // schema key it was recorded with.
+    EVENT_HEADER_EXTENDED_DATA_ITEM tlItem = {};
+    if (mLastSchema != nullptr && !mLastSchema->TraceLoggingMetadata.empty()) {
+        tlItem.ExtType = EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL;
+        tlItem.DataSize = (USHORT) mLastSchema->TraceLoggingMetadata.size();
+        tlItem.DataPtr = (ULONGLONG)(uintptr_t) mLastSchema->TraceLoggingMetadata.data();
+        hdr.Flags |= EVENT_HEADER_FLAG_EXTENDED_INFO;
+        record.ExtendedDataCount = 1;
+        record.ExtendedData = &tlItem;
+    }
+
+    for (auto const& h : mHandlers) {
+        if (IsEqualGUID(h.ProviderId, hdr.ProviderId)) {
+            (*h.Fn)(&record, h.Context);
+        }
+    }
+    mEventCount += 1;
+}
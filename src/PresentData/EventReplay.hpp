@@ -0,0 +1,76 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+
+#include "EventCapture.hpp"
+#include "EventRecord.hpp"
+
+// Append every event it sees to writer.  Attach it to each provider of a
+// realtime session next to the consumers' own handlers; the first event of
+// each schema also records its layout and task name.
+void HandleCaptureEvent(EVENT_RECORD* pEventRecord, EventCaptureWriter* writer);
+
+typedef void (*ReplayHandlerFn)(EVENT_RECORD* pEventRecord, void* pContext);
+
+// Feeds a capture back through the same handler functions a TraceSession
+// would call (HandleDXGIEvent, HandleDHDEvent, ...), as fast as the handlers
+// go.  Captured schemas are installed with SeedEventSchema() first, so no
+// TDH lookups happen during replay.
+//
+// Replay runs on the calling thread; the schema caches are per thread, so an
+// EventReplayer must stay on one thread, and consumers that decode on other
+// threads (ShardedPMTraceConsumer) are not supported.
+struct EventReplayer {
+    // Handlers of one provider are called in the order they were added.
+    void AddHandler(GUID const& providerId, ReplayHandlerFn handlerFn, void* handlerContext);
+
+    // Returns false if the capture couldn't be opened or is corrupt; events
+    // before the corruption have been handled either way.
+    bool Replay(char const* path);
+
+    // Replay a single event read from reader, e.g. to replay a slice of an
+    // already loaded capture.
+    void ReplayEvent(EventCaptureReader const& reader, EventCaptureEvent const& event, void const* userData);
+
+    int64_t GetQpcFrequency() const { return mQpcFrequency; }
+    uint64_t GetEventCount() const { return mEventCount; }
+
+private:
+    struct Handler {
+        GUID ProviderId;
+        ReplayHandlerFn Fn;
+        void* Context;
+    };
+
+    std::vector<Handler> mHandlers;
+    std::unordered_set<uint64_t> mSeededSchemas;
+    uint64_t mLastSchemaKey = 0;
+    CapturedSchema const* mLastSchema = nullptr;
+    int64_t mQpcFrequency = 0;
+    uint64_t mEventCount = 0;
+};
@@ -0,0 +1,273 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <atomic>
+#include <string.h>
+#include <wchar.h>
+
+#include "EventSchema.hpp"
+
+namespace {
+
+std::atomic<uint32_t> nextFieldListId(0);
+
+}
+
+EventFieldList::EventFieldList(std::initializer_list<wchar_t const*> names)
+    : mNames(names)
+    , mId(nextFieldListId++)
+{
+}
+
+void EventSchema::AddProperty(wchar_t const* name, uint32_t size, uint32_t count)
+{
+    if (size == 0 || count == 0) {
+        EndLayout();
+    } else if (count == 1) {
+        AddField(name, FieldKind::Scalar, size);
+    } else {
+        AddField(name, FieldKind::FixedArray, size, count);
+    }
+}
+
+void EventSchema::AddField(wchar_t const* name, FieldKind kind, uint32_t size, uint32_t count, int32_t countIndex)
+{
+    if (mClosed) {
+        return;
+    }
+    if (kind == FieldKind::CountedArray &&
+        (countIndex < 0 || countIndex >= (int32_t) mFields.size() || mFields[countIndex].Kind != FieldKind::Scalar)) {
+        EndLayout();
+        return;
+    }
+
+    Field field;
+    field.Name = name;
+    field.Offset = mFirstVariable == NO_FIELD ? mFixedSize : VARIABLE_OFFSET;
+    field.Size = size;
+    field.Count = count;
+    field.CountIndex = countIndex;
+    field.Kind = kind;
+    mFields.push_back(field);
+
+    if (mFirstVariable != NO_FIELD) {
+        return;
+    }
+    switch (kind) {
+    case FieldKind::Scalar:     mFixedSize += size; break;
+    case FieldKind::FixedArray: mFixedSize += size * count; break;
+    default:
+        mFirstVariable = int32_t(mFields.size() - 1);
+        mVariable = true;
+        break;
+    }
+}
+
+EventSchema::Field const* EventSchema::FindField(wchar_t const* name) const
+{
+    for (auto const& field : mFields) {
+        if (wcscmp(field.Name.c_str(), name) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+int32_t const* EventSchema::Resolve(EventFieldList const& list) const
+{
+    if (list.mId >= mResolved.size()) {
+        mResolved.resize(list.mId + 1);
+    }
+
+    auto& indices = mResolved[list.mId];
+    if (indices.empty()) {
+        indices.reserve(list.mNames.size());
+        for (auto name : list.mNames) {
+            auto field = FindField(name);
+            indices.push_back(field == nullptr ? NO_FIELD : int32_t(field - mFields.data()));
+        }
+    }
+    return indices.data();
+}
+
+bool EventSchema::Extent(uint8_t const* data, uint32_t length, size_t index, uint32_t offset, uint32_t* size) const
+{
+    auto const& field = mFields[index];
+    uint32_t extent = 0;
+    switch (field.Kind) {
+    case FieldKind::Scalar:
+        extent = field.Size;
+        break;
+
+    case FieldKind::FixedArray:
+        extent = field.Size * field.Count;
+        break;
+
+    case FieldKind::CountedArray: {
+        uint64_t count = 0;
+        if (!ReadField(data, length, field.CountIndex, &count, sizeof(count)) || count > length) {
+            return false;
+        }
+        extent = field.Size * (uint32_t) count;
+        break;
+    }
+
+    // An unterminated string runs to the end of the payload.
+    case FieldKind::UnicodeString:
+        while (offset + extent + 2 <= length) {
+            extent += 2;
+            if (data[offset + extent - 2] == 0 && data[offset + extent - 1] == 0) {
+                break;
+            }
+        }
+        break;
+
+    case FieldKind::AnsiString:
+        while (offset + extent < length) {
+            extent += 1;
+            if (data[offset + extent - 1] == 0) {
+                break;
+            }
+        }
+        break;
+
+    case FieldKind::Sid:
+        if (offset + 8 > length) {
+            return false;
+        }
+        extent = 8 + 4 * data[offset + 1]; // SubAuthorityCount
+        break;
+
+    case FieldKind::WbemSid: {
+        if (offset + 4 > length) {
+            return false;
+        }
+        uint32_t token = 0;
+        memcpy(&token, data + offset, sizeof(token));
+        if (token == 0) {
+            extent = 4;
+            break;
+        }
+        auto tokenSize = 2 * mPointerSize;
+        if (offset + tokenSize + 8 > length) {
+            return false;
+        }
+        extent = tokenSize + 8 + 4 * data[offset + tokenSize + 1];
+        break;
+    }
+    }
+
+    if (offset > length || extent > length - offset) {
+        return false;
+    }
+    *size = extent;
+    return true;
+}
+
+bool EventSchema::Locate(void const* userData, uint32_t userDataLength, int32_t index, uint32_t* offset, uint32_t* size) const
+{
+    if (index == NO_FIELD) {
+        return false;
+    }
+
+    auto data = (uint8_t const*) userData;
+    auto fieldOffset = mFields[index].Offset;
+    if (fieldOffset == VARIABLE_OFFSET) {
+        // Walk the fields from the first variable-length one.
+        fieldOffset = mFixedSize;
+        for (auto i = mFirstVariable; i < index; ++i) {
+            uint32_t extent = 0;
+            if (!Extent(data, userDataLength, i, fieldOffset, &extent)) {
+                return false;
+            }
+            fieldOffset += extent;
+        }
+    }
+
+    *offset = fieldOffset;
+    return Extent(data, userDataLength, index, fieldOffset, size);
+}
+
+bool EventSchema::ReadField(void const* userData, uint32_t userDataLength, int32_t index, void* out, size_t outSize) const
+{
+    if (index == NO_FIELD) {
+        return false;
+    }
+
+    // Fast path: a scalar with a fixed offset.
+    auto const& field = mFields[index];
+    if (field.Kind != FieldKind::Scalar || field.Size > outSize) {
+        return false;
+    }
+    auto offset = field.Offset;
+    if (offset == VARIABLE_OFFSET) {
+        uint32_t size = 0;
+        if (!Locate(userData, userDataLength, index, &offset, &size)) {
+            return false;
+        }
+    } else if (offset + field.Size > userDataLength) {
+        return false;
+    }
+
+    memcpy(out, (uint8_t const*) userData + offset, field.Size);
+    memset((uint8_t*) out + field.Size, 0, outSize - field.Size);
+    return true;
+}
+
+bool EventSchema::ReadElement(void const* userData, uint32_t userDataLength, int32_t index, uint32_t elementIndex, void* out, size_t outSize) const
+{
+    if (index == NO_FIELD) {
+        return false;
+    }
+
+    auto const& field = mFields[index];
+    if ((field.Kind != FieldKind::FixedArray && field.Kind != FieldKind::CountedArray) || field.Size > outSize) {
+        return false;
+    }
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    if (!Locate(userData, userDataLength, index, &offset, &size) || elementIndex >= size / field.Size) {
+        return false;
+    }
+
+    memcpy(out, (uint8_t const*) userData + offset + elementIndex * field.Size, field.Size);
+    memset((uint8_t*) out + field.Size, 0, outSize - field.Size);
+    return true;
+}
+
+bool EventSchema::ReadBytes(void const* userData, uint32_t userDataLength, int32_t index, std::string* out) const
+{
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    if (!Locate(userData, userDataLength, index, &offset, &size)) {
+        return false;
+    }
+    out->assign((char const*) userData + offset, size);
+    return true;
+}
+
+bool EventSchema::Read(void const* userData, uint32_t userDataLength, wchar_t const* name, void* out, size_t outSize) const
+{
+    auto field = FindField(name);
+    return field != nullptr && ReadField(userData, userDataLength, int32_t(field - mFields.data()), out, outSize);
+}
@@ -0,0 +1,127 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Names of the fields a handler reads from one kind of event, so each schema
+// resolves them to field indices once (EventSchema::Resolve()) and the reads
+// go straight to the offsets.  Handlers index the list with an enum in the
+// same order.  Every list gets a process-wide id; declare them once, at
+// namespace scope or as function-local statics.
+struct EventFieldList {
+    EventFieldList(std::initializer_list<wchar_t const*> names);
+
+    std::vector<wchar_t const*> mNames;
+    uint32_t mId;
+};
+
+// Top-level field layout of one event schema (provider, event, version).
+// Fields are laid out back to back in UserData, so every field up to the
+// first variable-length one (string, SID, counted array) has a fixed offset
+// that only needs to be resolved once; the ones after it are found by
+// walking the variable-length fields of each event.  A field whose extent
+// can't be worked out from the payload (a struct, or a type this doesn't
+// know) ends the layout: it and the fields after it aren't recorded, and
+// callers fall back to TDH for them.
+//
+// This has no ETW dependencies so it can be exercised with synthetic payloads.
+struct EventSchema {
+    enum class FieldKind : uint8_t {
+        Scalar,         // Size bytes
+        FixedArray,     // Count elements of Size bytes
+        CountedArray,   // elements of Size bytes, as many as field CountIndex says
+        UnicodeString,  // null-terminated UTF-16
+        AnsiString,     // null-terminated bytes
+        Sid,            // SID: 8 bytes plus 4 per sub-authority
+        WbemSid,        // TOKEN_USER (two pointers, or 4 bytes if null) followed by a SID
+    };
+
+    struct Field {
+        std::wstring Name;
+        uint32_t Offset;    // VARIABLE_OFFSET if after a variable-length field
+        uint32_t Size;      // element size for arrays, 0 for strings and SIDs
+        uint32_t Count;     // for FixedArray
+        int32_t CountIndex; // for CountedArray
+        FieldKind Kind;
+    };
+
+    enum { NO_FIELD = -1 };
+    enum : uint32_t { VARIABLE_OFFSET = 0xffffffffu };
+
+    std::vector<Field> mFields;
+    uint32_t mFixedSize = 0;        // extent of the fields with fixed offsets
+    uint32_t mPointerSize = 8;      // for WbemSid
+    bool mVariable = false;         // some field has no fixed offset or wasn't recorded
+
+    // Append the next top-level property in declaration order.  A size of 0
+    // marks a property of unknown extent, which ends the layout.
+    void AddProperty(wchar_t const* name, uint32_t size, uint32_t count);
+
+    // Append the next top-level property of any kind.  countIndex is the
+    // index of an earlier scalar field holding a CountedArray's length.
+    void AddField(wchar_t const* name, FieldKind kind, uint32_t size, uint32_t count = 1, int32_t countIndex = NO_FIELD);
+
+    // A property of unknown extent: it and anything after it are not recorded.
+    void EndLayout() { mVariable = true; mClosed = true; }
+    bool IsLayoutEnded() const { return mClosed; }
+
+    Field const* FindField(wchar_t const* name) const;
+
+    // Index into mFields of each of the list's names, NO_FIELD for names
+    // this schema doesn't record.  Resolved on the first call for each list;
+    // the result stays valid for the schema's lifetime.
+    int32_t const* Resolve(EventFieldList const& list) const;
+
+    // Find field index in userData.  Returns false for NO_FIELD or if the
+    // field (or a variable-length field before it) runs past userDataLength.
+    bool Locate(void const* userData, uint32_t userDataLength, int32_t index, uint32_t* offset, uint32_t* size) const;
+
+    // Copy scalar field index out of userData into out, zero-extending to
+    // outSize.  Returns false if the field can't be located, isn't a scalar,
+    // or is larger than outSize.
+    bool ReadField(void const* userData, uint32_t userDataLength, int32_t index, void* out, size_t outSize) const;
+
+    // As ReadField(), for element elementIndex of an array field.
+    bool ReadElement(void const* userData, uint32_t userDataLength, int32_t index, uint32_t elementIndex, void* out, size_t outSize) const;
+
+    // The raw bytes of field index, including a string's terminator, as
+    // TdhGetProperty() returns them.
+    bool ReadBytes(void const* userData, uint32_t userDataLength, int32_t index, std::string* out) const;
+
+    // As ReadField(), looking the field up by name.
+    bool Read(void const* userData, uint32_t userDataLength, wchar_t const* name, void* out, size_t outSize) const;
+
+private:
+    // Extent of field index starting at offset, from the payload if needed.
+    bool Extent(uint8_t const* data, uint32_t length, size_t index, uint32_t offset, uint32_t* size) const;
+
+    int32_t mFirstVariable = NO_FIELD;  // first field without a fixed offset
+    bool mClosed = false;
+    mutable std::vector<std::vector<int32_t>> mResolved; // by EventFieldList::mId
+};
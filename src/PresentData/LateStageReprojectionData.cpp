@@ -25,19 +25,23 @@ SOFTWARE.
 #include <algorithm>
 
 enum {
-    MAX_HISTORY_TIME = 3000,
     LSR_TIMEOUT_THRESHOLD_TICKS = 10000, // 10 sec
-    MAX_LSRS_IN_DEQUE = 120 * (MAX_HISTORY_TIME / 1000)
 };
 
-void LateStageReprojectionData::PruneDeque(std::deque<LateStageReprojectionEvent> &lsrHistory, uint64_t perfFreq, uint32_t msTimeDiff, uint32_t maxHistLen) {
+void LateStageReprojectionData::PruneDeque(std::deque<LateStageReprojectionEvent> &lsrHistory, QpcClock const& clock, uint32_t msTimeDiff, uint32_t maxHistLen) {
     while (!lsrHistory.empty() &&
         (lsrHistory.size() > maxHistLen ||
-        ((double)(lsrHistory.back().QpcTime - lsrHistory.front().QpcTime) / perfFreq) * 1000 > msTimeDiff)) {
+        clock.toMs(lsrHistory.back().QpcTime - lsrHistory.front().QpcTime) > msTimeDiff)) {
         lsrHistory.pop_front();
     }
 }
 
+void LateStageReprojectionData::SetHistoryWindow(uint32_t historyTimeMs, uint32_t maxHistoryLength)
+{
+    mHistoryTimeMs = historyTimeMs;
+    mMaxHistoryLength = maxHistoryLength;
+}
+
 void LateStageReprojectionData::AddLateStageReprojection(LateStageReprojectionEvent& p)
 {
     if (LateStageReprojectionPresented(p.FinalState))
@@ -67,16 +71,16 @@ void LateStageReprojectionData::AddLateStageReprojection(LateStageReprojectionEv
     mLSRHistory.push_back(p);
 }
 
-void LateStageReprojectionData::UpdateLateStageReprojectionInfo(uint64_t now, uint64_t perfFreq)
+void LateStageReprojectionData::UpdateLateStageReprojectionInfo(uint64_t now, QpcClock const& clock)
 {
-    PruneDeque(mSourceHistory, perfFreq, MAX_HISTORY_TIME, MAX_LSRS_IN_DEQUE);
-    PruneDeque(mDisplayedLSRHistory, perfFreq, MAX_HISTORY_TIME, MAX_LSRS_IN_DEQUE);
-    PruneDeque(mLSRHistory, perfFreq, MAX_HISTORY_TIME, MAX_LSRS_IN_DEQUE);
+    PruneDeque(mSourceHistory, clock, mHistoryTimeMs, mMaxHistoryLength);
+    PruneDeque(mDisplayedLSRHistory, clock, mHistoryTimeMs, mMaxHistoryLength);
+    PruneDeque(mLSRHistory, clock, mHistoryTimeMs, mMaxHistoryLength);
 
     mLastUpdateTicks = now;
 }
 
-double LateStageReprojectionData::ComputeHistoryTime(const std::deque<LateStageReprojectionEvent>& lsrHistory, uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeHistoryTime(const std::deque<LateStageReprojectionEvent>& lsrHistory, QpcClock const& clock)
 {
     if (lsrHistory.size() < 2) {
         return 0.0;
@@ -84,7 +88,7 @@ double LateStageReprojectionData::ComputeHistoryTime(const std::deque<LateStageR
 
     auto start = lsrHistory.front().QpcTime;
     auto end = lsrHistory.back().QpcTime;
-    return double(end - start) / qpcFreq;
+    return clock.toSeconds(end - start);
 }
 
 size_t LateStageReprojectionData::ComputeHistorySize()
@@ -96,12 +100,12 @@ size_t LateStageReprojectionData::ComputeHistorySize()
     return mLSRHistory.size();
 }
 
-double LateStageReprojectionData::ComputeHistoryTime(uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeHistoryTime(QpcClock const& clock)
 {
-    return ComputeHistoryTime(mLSRHistory, qpcFreq);
+    return ComputeHistoryTime(mLSRHistory, clock);
 }
 
-double LateStageReprojectionData::ComputeFps(const std::deque<LateStageReprojectionEvent>& lsrHistory, uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeFps(const std::deque<LateStageReprojectionEvent>& lsrHistory, QpcClock const& clock)
 {
     if (lsrHistory.size() < 2) {
         return 0.0;
@@ -110,26 +114,26 @@ double LateStageReprojectionData::ComputeFps(const std::deque<LateStageReproject
     auto end = lsrHistory.back().QpcTime;
     auto count = lsrHistory.size() - 1;
 
-    double deltaT = double(end - start) / qpcFreq;
+    double deltaT = clock.toSeconds(end - start);
     return count / deltaT;
 }
 
-double LateStageReprojectionData::ComputeSourceFps(uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeSourceFps(QpcClock const& clock)
 {
-    return ComputeFps(mSourceHistory, qpcFreq);
+    return ComputeFps(mSourceHistory, clock);
 }
 
-double LateStageReprojectionData::ComputeDisplayedFps(uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeDisplayedFps(QpcClock const& clock)
 {
-    return ComputeFps(mDisplayedLSRHistory, qpcFreq);
+    return ComputeFps(mDisplayedLSRHistory, clock);
 }
 
-double LateStageReprojectionData::ComputeFps(uint64_t qpcFreq)
+double LateStageReprojectionData::ComputeFps(QpcClock const& clock)
 {
-    return ComputeFps(mLSRHistory, qpcFreq);
+    return ComputeFps(mLSRHistory, clock);
 }
 
-LateStageReprojectionRuntimeStats LateStageReprojectionData::ComputeRuntimeStats(uint64_t qpcFreq)
+LateStageReprojectionRuntimeStats LateStageReprojectionData::ComputeRuntimeStats(QpcClock const& clock)
 {
     LateStageReprojectionRuntimeStats stats = {};
     if (mLSRHistory.size() < 2) {
@@ -190,8 +194,8 @@ LateStageReprojectionRuntimeStats LateStageReprojectionData::ComputeRuntimeStats
     stats.mAppProcessId = mLSRHistory[count - 1].GetAppProcessId();
     stats.mLsrProcessId = mLSRHistory[count - 1].ProcessId;
 
-    stats.mAppSourceCpuRenderTimeInMs = 1000 * double(totalAppSourceCpuRenderTime) / qpcFreq;
-    stats.mAppSourceReleaseToLsrAcquireInMs = 1000 * double(totalAppSourceReleaseToLsrAcquireTime) / qpcFreq;
+    stats.mAppSourceCpuRenderTimeInMs = clock.toMs(totalAppSourceCpuRenderTime);
+    stats.mAppSourceReleaseToLsrAcquireInMs = clock.toMs(totalAppSourceReleaseToLsrAcquireTime);
 
     stats.mAppSourceReleaseToLsrAcquireInMs /= count;
     stats.mAppSourceCpuRenderTimeInMs /= count;
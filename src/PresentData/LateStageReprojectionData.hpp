@@ -26,6 +26,7 @@ SOFTWARE.
 #include <stdint.h>
 
 #include "MixedRealityTraceConsumer.hpp"
+#include "../Utils/inc/qpc_clock.h"
 
 struct LateStageReprojectionRuntimeStats {
     template <typename T>
@@ -83,24 +84,29 @@ struct LateStageReprojectionData {
     size_t mLifetimeLsrMissedFrames = 0;
     size_t mLifetimeAppMissedFrames = 0;
     uint64_t mLastUpdateTicks = 0;
+    uint32_t mHistoryTimeMs = 3000;
+    uint32_t mMaxHistoryLength = 120 * 3; // 120Hz HMD over the default window
     std::deque<LateStageReprojectionEvent> mLSRHistory;
     std::deque<LateStageReprojectionEvent> mDisplayedLSRHistory;
     std::deque<LateStageReprojectionEvent> mSourceHistory;
 
-    void PruneDeque(std::deque<LateStageReprojectionEvent>& lsrHistory, uint64_t perfFreq, uint32_t msTimeDiff, uint32_t maxHistLen);
+    void PruneDeque(std::deque<LateStageReprojectionEvent>& lsrHistory, QpcClock const& clock, uint32_t msTimeDiff, uint32_t maxHistLen);
+    // Same meaning as SwapChainData::SetHistoryWindow(), with the cap given
+    // as a number of LSRs per history.
+    void SetHistoryWindow(uint32_t historyTimeMs, uint32_t maxHistoryLength);
     void AddLateStageReprojection(LateStageReprojectionEvent& p);
-    void UpdateLateStageReprojectionInfo(uint64_t now, uint64_t perfFreq);
-    double ComputeHistoryTime(uint64_t qpcFreq);
-    double ComputeSourceFps(uint64_t qpcFreq);
-    double ComputeDisplayedFps(uint64_t qpcFreq);
-    double ComputeFps(uint64_t qpcFreq);
+    void UpdateLateStageReprojectionInfo(uint64_t now, QpcClock const& clock);
+    double ComputeHistoryTime(QpcClock const& clock);
+    double ComputeSourceFps(QpcClock const& clock);
+    double ComputeDisplayedFps(QpcClock const& clock);
+    double ComputeFps(QpcClock const& clock);
     size_t ComputeHistorySize();
-    LateStageReprojectionRuntimeStats ComputeRuntimeStats(uint64_t perfFreq);
+    LateStageReprojectionRuntimeStats ComputeRuntimeStats(QpcClock const& clock);
 
     bool IsStale(uint64_t now) const;
     bool HasData() const { return !mLSRHistory.empty(); }
 
 private:
-    double ComputeFps(const std::deque<LateStageReprojectionEvent>& lsrHistory, uint64_t qpcFreq);
-    double ComputeHistoryTime(const std::deque<LateStageReprojectionEvent>& lsrHistory, uint64_t qpcFreq);
+    double ComputeFps(const std::deque<LateStageReprojectionEvent>& lsrHistory, QpcClock const& clock);
+    double ComputeHistoryTime(const std::deque<LateStageReprojectionEvent>& lsrHistory, QpcClock const& clock);
 };
@@ -22,8 +22,6 @@ SOFTWARE.
 
 #define NOMINMAX
 #include <algorithm>
-#include <d3d9.h>
-#include <dxgi.h>
 
 #include "MixedRealityTraceConsumer.hpp"
 #include "TraceConsumer.hpp"
@@ -33,6 +31,39 @@ SOFTWARE.
 static bool gMixedRealityTraceConsumer_Exiting = false;
 #endif
 
+namespace {
+
+MREventTask LookupEventTask(std::wstring const& taskName)
+{
+    static const struct {
+        wchar_t const* Name;
+        MREventTask Task;
+    } tasks[] = {
+        { L"AcquireForRendering", MREventTask::AcquireForRendering },
+        { L"ReleaseFromRendering", MREventTask::ReleaseFromRendering },
+        { L"AcquireForPresentation", MREventTask::AcquireForPresentation },
+        { L"ReleaseFromPresentation", MREventTask::ReleaseFromPresentation },
+        { L"OasisPresentationSource", MREventTask::OasisPresentationSource },
+        { L"LsrThread_BeginLsrProcessing", MREventTask::LsrThread_BeginLsrProcessing },
+        { L"LsrThread_LatchedInput", MREventTask::LsrThread_LatchedInput },
+        { L"LsrThread_UnaccountedForVsyncsBetweenStatGathering", MREventTask::LsrThread_UnaccountedForVsyncsBetweenStatGathering },
+        { L"MissedPresentation", MREventTask::MissedPresentation },
+        { L"OnTimePresentationTiming", MREventTask::OnTimePresentationTiming },
+        { L"LatePresentationTiming", MREventTask::LatePresentationTiming },
+        { L"HolographicFrame", MREventTask::HolographicFrame },
+        { L"HolographicFrameMetadata_GetNewPoseForReprojection", MREventTask::HolographicFrameMetadata_GetNewPoseForReprojection },
+    };
+
+    for (auto const& t : tasks) {
+        if (taskName.compare(t.Name) == 0) {
+            return t.Task;
+        }
+    }
+    return MREventTask::Unknown;
+}
+
+}
+
 HolographicFrame::HolographicFrame(EVENT_HEADER const& hdr)
     : PresentId(0)
     , FrameId(0)
@@ -188,12 +219,83 @@ void MRTraceConsumer::HolographicFrameStop(std::shared_ptr<HolographicFrame> p)
     mHolographicFramesByPresentId.emplace(p->PresentId, p);
 }
 
+MREventTask MRTraceConsumer::GetEventTask(EVENT_RECORD* pEventRecord)
+{
+    // TraceLogging events all share id 0, so the schema key (which hashes in
+    // the TraceLogging metadata) is what tells them apart.
+    auto key = GetEventSchemaKey(pEventRecord);
+    auto ii = mEventTaskByKey.find(key);
+    if (ii != mEventTaskByKey.end()) {
+        return ii->second;
+    }
+
+    auto task = LookupEventTask(GetEventTaskName(pEventRecord));
+    mEventTaskByKey.emplace(key, task);
+    return task;
+}
+
+namespace {
+
+// The fields read from the per-frame LSR events, resolved to offsets once per
+// schema (see EventDataReader); each enum indexes the list below it.
+enum {
+    BeginLsrProcessing_SourcePtr,
+    BeginLsrProcessing_NewSourceLatched,
+    BeginLsrProcessing_TimeUntilVblankMs,
+    BeginLsrProcessing_TimeUntilPhotonsMiddleMs,
+    BeginLsrProcessing_PredictionSampleTimeToPhotonsVisibleMs,
+    BeginLsrProcessing_MispredictionMs,
+};
+EventFieldList const BeginLsrProcessingFields = {
+    L"SourcePtr",
+    L"NewSourceLatched",
+    L"TimeUntilVblankMs",
+    L"TimeUntilPhotonsMiddleMs",
+    L"PredictionSampleTimeToPhotonsVisibleMs",
+    L"MispredictionMs",
+};
+
+enum {
+    PresentationTiming_startLatchToCpuRenderFrameStartInMs,
+    PresentationTiming_threadWakeupToCpuRenderFrameStartInMs, // older name
+    PresentationTiming_cpuRenderFrameStartToHeadPoseCallbackStartInMs,
+    PresentationTiming_headPoseCallbackDurationInMs,
+    PresentationTiming_headPoseCallbackEndToInputLatchInMs,
+    PresentationTiming_inputLatchToGpuSubmissionInMs,
+    PresentationTiming_gpuSubmissionToGpuStartInMs,
+    PresentationTiming_gpuStartToGpuStopInMs,
+    PresentationTiming_gpuStopToCopyStartInMs,
+    PresentationTiming_copyStartToCopyStopInMs,
+    PresentationTiming_copyStopToVsyncInMs,
+    PresentationTiming_totalWakeupErrorMs,
+    PresentationTiming_wakeupErrorInMs,                       // older name
+    PresentationTiming_frameSubmittedOnSchedule,
+};
+EventFieldList const PresentationTimingFields = {
+    L"startLatchToCpuRenderFrameStartInMs",
+    L"threadWakeupToCpuRenderFrameStartInMs",
+    L"cpuRenderFrameStartToHeadPoseCallbackStartInMs",
+    L"headPoseCallbackDurationInMs",
+    L"headPoseCallbackEndToInputLatchInMs",
+    L"inputLatchToGpuSubmissionInMs",
+    L"gpuSubmissionToGpuStartInMs",
+    L"gpuStartToGpuStopInMs",
+    L"gpuStopToCopyStartInMs",
+    L"copyStartToCopyStopInMs",
+    L"copyStopToVsyncInMs",
+    L"totalWakeupErrorMs",
+    L"wakeupErrorInMs",
+    L"frameSubmittedOnSchedule",
+};
+
+}
+
 void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
 {
     auto const& hdr = pEventRecord->EventHeader;
-    const std::wstring taskName = GetEventTaskName(pEventRecord);
-
-    if (taskName.compare(L"AcquireForRendering") == 0)
+    switch (mrConsumer->GetEventTask(pEventRecord))
+    {
+    case MREventTask::AcquireForRendering:
     {
         const uint64_t ptr = GetEventData<uint64_t>(pEventRecord, L"thisPtr");
         auto sourceIter = mrConsumer->FindOrCreatePresentationSource(ptr);
@@ -203,20 +305,23 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
         sourceIter->second->ReleaseFromRenderingTime = 0;
         sourceIter->second->AcquireForPresentationTime = 0;
         sourceIter->second->ReleaseFromPresentationTime = 0;
+        break;
     }
-    else if (taskName.compare(L"ReleaseFromRendering") == 0)
+    case MREventTask::ReleaseFromRendering:
     {
         const uint64_t ptr = GetEventData<uint64_t>(pEventRecord, L"thisPtr");
         auto sourceIter = mrConsumer->FindOrCreatePresentationSource(ptr);
         sourceIter->second->ReleaseFromRenderingTime = *(uint64_t*)&hdr.TimeStamp;
+        break;
     }
-    else if (taskName.compare(L"AcquireForPresentation") == 0)
+    case MREventTask::AcquireForPresentation:
     {
         const uint64_t ptr = GetEventData<uint64_t>(pEventRecord, L"thisPtr");
         auto sourceIter = mrConsumer->FindOrCreatePresentationSource(ptr);
         sourceIter->second->AcquireForPresentationTime = *(uint64_t*)&hdr.TimeStamp;
+        break;
     }
-    else if (taskName.compare(L"ReleaseFromPresentation") == 0)
+    case MREventTask::ReleaseFromPresentation:
     {
         const uint64_t ptr = GetEventData<uint64_t>(pEventRecord, L"thisPtr");
         auto sourceIter = mrConsumer->FindOrCreatePresentationSource(ptr);
@@ -228,8 +333,9 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
         if (pEvent) {
             pEvent->Source = *sourceIter->second;
         }
+        break;
     }
-    else if (taskName.compare(L"OasisPresentationSource") == 0)
+    case MREventTask::OasisPresentationSource:
     {
         std::string eventType = GetEventData<std::string>(pEventRecord, L"EventType");
         eventType.pop_back(); // Pop the null-terminator so the compare works.
@@ -237,8 +343,9 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
             const uint64_t ptr = GetEventData<uint64_t>(pEventRecord, L"thisPtr");
             mrConsumer->CompletePresentationSource(ptr);
         }
+        break;
     }
-    else if (taskName.compare(L"LsrThread_BeginLsrProcessing") == 0)
+    case MREventTask::LsrThread_BeginLsrProcessing:
     {
         // Complete the last LSR.
         auto& pEvent = mrConsumer->mActiveLSR;
@@ -248,15 +355,17 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
 
         // Start a new LSR.
         pEvent = std::make_shared<LateStageReprojectionEvent>(hdr);
-        GetEventData(pEventRecord, L"SourcePtr", &pEvent->Source.Ptr);
-        GetEventData(pEventRecord, L"NewSourceLatched", &pEvent->NewSourceLatched);
-        GetEventData(pEventRecord, L"TimeUntilVblankMs", &pEvent->TimeUntilVsyncMs);
-        GetEventData(pEventRecord, L"TimeUntilPhotonsMiddleMs", &pEvent->TimeUntilPhotonsMiddleMs);
-        GetEventData(pEventRecord, L"PredictionSampleTimeToPhotonsVisibleMs", &pEvent->AppPredictionLatencyMs);
-        GetEventData(pEventRecord, L"MispredictionMs", &pEvent->AppMispredictionMs);
+        EventDataReader data(pEventRecord, BeginLsrProcessingFields);
+        data.Get(BeginLsrProcessing_SourcePtr, &pEvent->Source.Ptr);
+        data.Get(BeginLsrProcessing_NewSourceLatched, &pEvent->NewSourceLatched);
+        data.Get(BeginLsrProcessing_TimeUntilVblankMs, &pEvent->TimeUntilVsyncMs);
+        data.Get(BeginLsrProcessing_TimeUntilPhotonsMiddleMs, &pEvent->TimeUntilPhotonsMiddleMs);
+        data.Get(BeginLsrProcessing_PredictionSampleTimeToPhotonsVisibleMs, &pEvent->AppPredictionLatencyMs);
+        data.Get(BeginLsrProcessing_MispredictionMs, &pEvent->AppMispredictionMs);
         assert(pEvent->Source.Ptr != 0);
+        break;
     }
-    else if (taskName.compare(L"LsrThread_LatchedInput") == 0)
+    case MREventTask::LsrThread_LatchedInput:
     {
         // Update the active LSR.
         auto& pEvent = mrConsumer->mActiveLSR;
@@ -285,8 +394,9 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
                 }
             }
          }
+        break;
     }
-    else if (taskName.compare(L"LsrThread_UnaccountedForVsyncsBetweenStatGathering") == 0)
+    case MREventTask::LsrThread_UnaccountedForVsyncsBetweenStatGathering:
     {
         // Update the active LSR.
         auto& pEvent = mrConsumer->mActiveLSR;
@@ -296,8 +406,9 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
             assert(unaccountedForMissedVSyncCount >= 1);
             pEvent->MissedVsyncCount += unaccountedForMissedVSyncCount;
         }
+        break;
     }
-    else if (taskName.compare(L"MissedPresentation") == 0)
+    case MREventTask::MissedPresentation:
     {
         // Update the active LSR.
         auto& pEvent = mrConsumer->mActiveLSR;
@@ -308,34 +419,38 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
                 pEvent->MissedVsyncCount++;
             }
         }
+        break;
     }
-    else if (taskName.compare(L"OnTimePresentationTiming") == 0 || taskName.compare(L"LatePresentationTiming") == 0)
+    case MREventTask::OnTimePresentationTiming:
+    case MREventTask::LatePresentationTiming:
     {
         // Update the active LSR.
         auto& pEvent = mrConsumer->mActiveLSR;
         if (pEvent) {
+            EventDataReader data(pEventRecord, PresentationTimingFields);
+
             // Newer versions of the event have a different name, but we don't want to spew if we don't find it.
-            if (!GetEventData(pEventRecord, L"startLatchToCpuRenderFrameStartInMs", &pEvent->ThreadWakeupStartLatchToCpuRenderFrameStartInMs, false))
+            if (!data.Get(PresentationTiming_startLatchToCpuRenderFrameStartInMs, &pEvent->ThreadWakeupStartLatchToCpuRenderFrameStartInMs, false))
             {
-                GetEventData(pEventRecord, L"threadWakeupToCpuRenderFrameStartInMs", &pEvent->ThreadWakeupStartLatchToCpuRenderFrameStartInMs);
+                data.Get(PresentationTiming_threadWakeupToCpuRenderFrameStartInMs, &pEvent->ThreadWakeupStartLatchToCpuRenderFrameStartInMs);
             }
-            GetEventData(pEventRecord, L"cpuRenderFrameStartToHeadPoseCallbackStartInMs", &pEvent->CpuRenderFrameStartToHeadPoseCallbackStartInMs);
-            GetEventData(pEventRecord, L"headPoseCallbackDurationInMs", &pEvent->HeadPoseCallbackStartToHeadPoseCallbackStopInMs);
-            GetEventData(pEventRecord, L"headPoseCallbackEndToInputLatchInMs", &pEvent->HeadPoseCallbackStopToInputLatchInMs);
-            GetEventData(pEventRecord, L"inputLatchToGpuSubmissionInMs", &pEvent->InputLatchToGpuSubmissionInMs);
-            GetEventData(pEventRecord, L"gpuSubmissionToGpuStartInMs", &pEvent->GpuSubmissionToGpuStartInMs);
-            GetEventData(pEventRecord, L"gpuStartToGpuStopInMs", &pEvent->GpuStartToGpuStopInMs);
-            GetEventData(pEventRecord, L"gpuStopToCopyStartInMs", &pEvent->GpuStopToCopyStartInMs);
-            GetEventData(pEventRecord, L"copyStartToCopyStopInMs", &pEvent->CopyStartToCopyStopInMs);
-            GetEventData(pEventRecord, L"copyStopToVsyncInMs", &pEvent->CopyStopToVsyncInMs);
+            data.Get(PresentationTiming_cpuRenderFrameStartToHeadPoseCallbackStartInMs, &pEvent->CpuRenderFrameStartToHeadPoseCallbackStartInMs);
+            data.Get(PresentationTiming_headPoseCallbackDurationInMs, &pEvent->HeadPoseCallbackStartToHeadPoseCallbackStopInMs);
+            data.Get(PresentationTiming_headPoseCallbackEndToInputLatchInMs, &pEvent->HeadPoseCallbackStopToInputLatchInMs);
+            data.Get(PresentationTiming_inputLatchToGpuSubmissionInMs, &pEvent->InputLatchToGpuSubmissionInMs);
+            data.Get(PresentationTiming_gpuSubmissionToGpuStartInMs, &pEvent->GpuSubmissionToGpuStartInMs);
+            data.Get(PresentationTiming_gpuStartToGpuStopInMs, &pEvent->GpuStartToGpuStopInMs);
+            data.Get(PresentationTiming_gpuStopToCopyStartInMs, &pEvent->GpuStopToCopyStartInMs);
+            data.Get(PresentationTiming_copyStartToCopyStopInMs, &pEvent->CopyStartToCopyStopInMs);
+            data.Get(PresentationTiming_copyStopToVsyncInMs, &pEvent->CopyStopToVsyncInMs);
 
             // Newer versions of the event have a different name, but we don't want to spew if we don't find it.
-            if (!GetEventData(pEventRecord, L"totalWakeupErrorMs", &pEvent->TotalWakeupErrorMs, false))
+            if (!data.Get(PresentationTiming_totalWakeupErrorMs, &pEvent->TotalWakeupErrorMs, false))
             {
-                GetEventData(pEventRecord, L"wakeupErrorInMs", &pEvent->TotalWakeupErrorMs);
+                data.Get(PresentationTiming_wakeupErrorInMs, &pEvent->TotalWakeupErrorMs);
             }
 
-            const bool bFrameSubmittedOnSchedule = GetEventData<bool>(pEventRecord, L"frameSubmittedOnSchedule");
+            const bool bFrameSubmittedOnSchedule = data.Get<bool>(PresentationTiming_frameSubmittedOnSchedule);
             if (bFrameSubmittedOnSchedule) {
                 pEvent->FinalState = LateStageReprojectionResult::Presented;
             }
@@ -343,15 +458,19 @@ void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
                 pEvent->FinalState = (pEvent->MissedVsyncCount > 1) ? LateStageReprojectionResult::MissedMultiple : LateStageReprojectionResult::Missed;
             }
         }
+        break;
+    }
+    default:
+        break;
     }
 }
 
 void HandleSpectrumContinuousEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer)
 {
     auto const& hdr = pEventRecord->EventHeader;
-    const std::wstring taskName = GetEventTaskName(pEventRecord);
-
-    if (taskName.compare(L"HolographicFrame") == 0)
+    switch (mrConsumer->GetEventTask(pEventRecord))
+    {
+    case MREventTask::HolographicFrame:
     {
         // Ignore rehydrated frames.
         const bool bIsRehydration = GetEventData<bool>(pEventRecord, L"isRehydration");
@@ -388,8 +507,9 @@ void HandleSpectrumContinuousEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer*
             }
             }
         }
+        break;
     }
-    else if (taskName.compare(L"HolographicFrameMetadata_GetNewPoseForReprojection") == 0)
+    case MREventTask::HolographicFrameMetadata_GetNewPoseForReprojection:
     {
         // Link holographicFrameId -> presentId.
         const uint32_t holographicFrameId = GetEventData<uint32_t>(pEventRecord, L"holographicFrameId");
@@ -404,5 +524,9 @@ void HandleSpectrumContinuousEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer*
         if (frameIter->second->PresentId != 0 && frameIter->second->StopTime != 0) {
             mrConsumer->HolographicFrameStop(frameIter->second);
         }
+        break;
+    }
+    default:
+        break;
     }
 }
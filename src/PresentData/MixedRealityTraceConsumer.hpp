@@ -28,16 +28,13 @@ SOFTWARE.
 #include <mutex>
 #include <numeric>
 #include <set>
+#include <unordered_map>
 #include <vector>
-#include <windows.h>
-#include <evntcons.h> // must include after windows.h
 
 #include "PresentMonTraceConsumer.hpp"
 
-struct __declspec(uuid("{356e1338-04ad-420e-8b8a-a2eb678541cf}")) SPECTRUMCONTINUOUS_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{19d9d739-da0a-41a0-b97f-24ed27abc9fb}")) DHD_PROVIDER_GUID_HOLDER;
-static const auto SPECTRUMCONTINUOUS_PROVIDER_GUID = __uuidof(SPECTRUMCONTINUOUS_PROVIDER_GUID_HOLDER);
-static const auto DHD_PROVIDER_GUID = __uuidof(DHD_PROVIDER_GUID_HOLDER);
+static const GUID SPECTRUMCONTINUOUS_PROVIDER_GUID = { 0x356e1338, 0x04ad, 0x420e, { 0x8b, 0x8a, 0xa2, 0xeb, 0x67, 0x85, 0x41, 0xcf } };
+static const GUID DHD_PROVIDER_GUID = { 0x19d9d739, 0xda0a, 0x41a0, { 0xb9, 0x7f, 0x24, 0xed, 0x27, 0xab, 0xc9, 0xfb } };
 
 enum class HolographicFrameResult
 {
@@ -124,6 +121,8 @@ inline bool LateStageReprojectionMissed(LateStageReprojectionResult result)
     case LateStageReprojectionResult::Missed:
     case LateStageReprojectionResult::MissedMultiple:
         return true;
+    default:
+        break;
     }
 
     return false;
@@ -224,6 +223,29 @@ struct LateStageReprojectionEvent {
     }
 };
 
+// Task names of the DHD and SpectrumContinuous events handled below.
+enum class MREventTask : uint8_t
+{
+    Unknown,
+
+    // DHD
+    AcquireForRendering,
+    ReleaseFromRendering,
+    AcquireForPresentation,
+    ReleaseFromPresentation,
+    OasisPresentationSource,
+    LsrThread_BeginLsrProcessing,
+    LsrThread_LatchedInput,
+    LsrThread_UnaccountedForVsyncsBetweenStatGathering,
+    MissedPresentation,
+    OnTimePresentationTiming,
+    LatePresentationTiming,
+
+    // SpectrumContinuous
+    HolographicFrame,
+    HolographicFrameMetadata_GetNewPoseForReprojection,
+};
+
 struct MRTraceConsumer
 {
     MRTraceConsumer(bool simple) 
@@ -273,6 +295,12 @@ struct MRTraceConsumer
     
     void HolographicFrameStart(std::shared_ptr<HolographicFrame> p);
     void HolographicFrameStop(std::shared_ptr<HolographicFrame> p);
+
+    // Task name of the event, resolved through TDH only the first time each
+    // kind of event is seen.
+    MREventTask GetEventTask(EVENT_RECORD* pEventRecord);
+
+    std::unordered_map<uint64_t, MREventTask> mEventTaskByKey;
 };
 
 void HandleDHDEvent(EVENT_RECORD* pEventRecord, MRTraceConsumer* mrConsumer);
@@ -0,0 +1,214 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "ParallelAnalysis.hpp"
+#include "EventReplay.hpp"
+
+namespace {
+
+// Event headers are copied out since the reader only keeps the latest one.
+struct IndexedEvent {
+    EventCaptureEvent Event;
+    void const* UserData;
+};
+
+struct Chunk {
+    size_t FirstEvent;  // first event replayed, including warm-up
+    size_t EndEvent;    // one past the last event replayed, including the tail
+    uint64_t BeginTime; // presents with BeginTime <= QpcTime < EndTime are reported
+    uint64_t EndTime;
+    std::vector<CompletedFrame> Frames;
+    std::vector<std::shared_ptr<LateStageReprojectionEvent>> LSRs;
+};
+
+// How often to drain the consumer's output queues while replaying; well
+// below their capacity so nothing is dropped.
+enum { DRAIN_INTERVAL = 1024 };
+
+void AddHandlers(EventReplayer* replayer, PMTraceConsumer* pmConsumer, MRTraceConsumer* mrConsumer)
+{
+    struct {
+        GUID const* ProviderId;
+        PMEventHandlerFn Fn;
+    } const handlers[] = {
+        { &DXGI_PROVIDER_GUID,            &HandleDXGIEvent },
+        { &D3D9_PROVIDER_GUID,            &HandleD3D9Event },
+        { &DXGKRNL_PROVIDER_GUID,         &HandleDXGKEvent },
+        { &WIN32K_PROVIDER_GUID,          &HandleWin32kEvent },
+        { &DWM_PROVIDER_GUID,             &HandleDWMEvent },
+        { &Win7::DWM_PROVIDER_GUID,       &HandleDWMEvent },
+        { &NT_PROCESS_EVENT_GUID,         &HandleNTProcessEvent },
+        { &KERNEL_PROCESS_PROVIDER_GUID,  &HandleKernelProcessEvent },
+        { &Win7::DXGKBLT_GUID,            &Win7::HandleDxgkBlt },
+        { &Win7::DXGKFLIP_GUID,           &Win7::HandleDxgkFlip },
+        { &Win7::DXGKPRESENTHISTORY_GUID, &Win7::HandleDxgkPresentHistory },
+        { &Win7::DXGKQUEUEPACKET_GUID,    &Win7::HandleDxgkQueuePacket },
+        { &Win7::DXGKVSYNCDPC_GUID,       &Win7::HandleDxgkVSyncDPC },
+        { &Win7::DXGKMMIOFLIP_GUID,       &Win7::HandleDxgkMMIOFlip },
+    };
+    for (auto const& h : handlers) {
+        replayer->AddHandler(*h.ProviderId, (ReplayHandlerFn) h.Fn, pmConsumer);
+    }
+
+    if (mrConsumer != nullptr) {
+        replayer->AddHandler(DHD_PROVIDER_GUID, (ReplayHandlerFn) &HandleDHDEvent, mrConsumer);
+        replayer->AddHandler(SPECTRUMCONTINUOUS_PROVIDER_GUID, (ReplayHandlerFn) &HandleSpectrumContinuousEvent, mrConsumer);
+    }
+}
+
+void Drain(PMTraceConsumer* pmConsumer, MRTraceConsumer* mrConsumer, Chunk* chunk, std::vector<CompletedFrame>* scratch,
+           std::vector<NTProcessEvent>* processEvents, std::vector<std::shared_ptr<LateStageReprojectionEvent>>* lsrs)
+{
+    scratch->clear();
+    pmConsumer->DequeuePresents(*scratch);
+    for (auto const& frame : *scratch) {
+        if (frame.QpcTime >= chunk->BeginTime && frame.QpcTime < chunk->EndTime) {
+            chunk->Frames.push_back(frame);
+        }
+    }
+
+    processEvents->clear();
+    pmConsumer->DequeueProcessEvents(*processEvents);
+
+    if (mrConsumer != nullptr) {
+        lsrs->clear();
+        mrConsumer->DequeueLSRs(*lsrs);
+        for (auto const& lsr : *lsrs) {
+            if (lsr->QpcTime >= chunk->BeginTime && lsr->QpcTime < chunk->EndTime) {
+                chunk->LSRs.push_back(lsr);
+            }
+        }
+    }
+}
+
+void ReplayChunk(EventCaptureReader const& reader, std::vector<IndexedEvent> const& events, Chunk* chunk, bool mixedReality)
+{
+    PMTraceConsumer pmConsumer(false);
+    std::unique_ptr<MRTraceConsumer> mrConsumer(mixedReality ? new MRTraceConsumer(false) : nullptr);
+    EventReplayer replayer;
+    AddHandlers(&replayer, &pmConsumer, mrConsumer.get());
+
+    std::vector<CompletedFrame> scratch;
+    std::vector<NTProcessEvent> processEvents;
+    std::vector<std::shared_ptr<LateStageReprojectionEvent>> lsrs;
+    for (size_t i = chunk->FirstEvent; i < chunk->EndEvent; ++i) {
+        replayer.ReplayEvent(reader, events[i].Event, events[i].UserData);
+        if ((i - chunk->FirstEvent) % DRAIN_INTERVAL == DRAIN_INTERVAL - 1) {
+            Drain(&pmConsumer, mrConsumer.get(), chunk, &scratch, &processEvents, &lsrs);
+        }
+    }
+    Drain(&pmConsumer, mrConsumer.get(), chunk, &scratch, &processEvents, &lsrs);
+}
+
+}
+
+bool AnalyzeCapture(char const* path, uint32_t threadCount, SwapChainFrames* out, double overlapSeconds, uint32_t chunkCount,
+                    LateStageReprojections* lsrOut)
+{
+    EventCaptureReader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+
+    // Index the whole capture up front; this also reads every schema, so the
+    // reader is only read from once the workers start.
+    std::vector<IndexedEvent> events;
+    EventCaptureEvent const* event;
+    void const* userData;
+    while (reader.Next(&event, &userData)) {
+        events.push_back({ *event, userData });
+    }
+    if (reader.IsCorrupt()) {
+        return false;
+    }
+    if (events.empty()) {
+        return true;
+    }
+
+    // Events are delivered in timestamp order, so chunk boundaries can be
+    // found by binary search.
+    auto timeOf = [](IndexedEvent const& ev) { return (uint64_t) ev.Event.TimeStamp; };
+    auto firstAtOrAfter = [&](uint64_t t) {
+        return (size_t) (std::lower_bound(events.begin(), events.end(), t,
+            [&](IndexedEvent const& ev, uint64_t time) { return timeOf(ev) < time; }) - events.begin());
+    };
+
+    auto firstTime = timeOf(events.front());
+    auto lastTime = timeOf(events.back());
+    auto span = lastTime - firstTime + 1;
+    auto overlap = (uint64_t) (overlapSeconds * (double) reader.GetQpcFrequency());
+
+    // Every chunk replays up to 2 * overlap more than its own range, so only
+    // cut more chunks than threads while they stay long next to the overlap.
+    if (threadCount <= 1) {
+        threadCount = 1;
+        chunkCount = 1;
+    } else if (chunkCount == 0) {
+        auto longChunks = overlap == 0 ? UINT64_MAX : span / (4 * overlap);
+        chunkCount = (uint32_t) std::max<uint64_t>(threadCount, std::min<uint64_t>(threadCount * 4, longChunks));
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        auto& chunk = chunks[i];
+        chunk.BeginTime = i == 0 ? 0 : firstTime + span * i / chunkCount;
+        chunk.EndTime = i == chunkCount - 1 ? UINT64_MAX : firstTime + span * (i + 1) / chunkCount;
+        chunk.FirstEvent = i == 0 ? 0 : firstAtOrAfter(chunk.BeginTime > overlap ? chunk.BeginTime - overlap : 0);
+        chunk.EndEvent = i == chunkCount - 1 ? events.size() : firstAtOrAfter(chunk.EndTime + overlap);
+    }
+
+    std::atomic<uint32_t> nextChunk(0);
+    auto worker = [&]() {
+        for (;;) {
+            auto i = nextChunk.fetch_add(1);
+            if (i >= chunkCount) {
+                break;
+            }
+            ReplayChunk(reader, events, &chunks[i], lsrOut != nullptr);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (auto const& chunk : chunks) {
+        for (auto const& frame : chunk.Frames) {
+            (*out)[std::make_pair(frame.ProcessId, frame.SwapChainAddress)].push_back(frame);
+        }
+        if (lsrOut != nullptr) {
+            lsrOut->insert(lsrOut->end(), chunk.LSRs.begin(), chunk.LSRs.end());
+        }
+    }
+    return true;
+}
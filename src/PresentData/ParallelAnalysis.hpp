@@ -0,0 +1,62 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "MixedRealityTraceConsumer.hpp"
+#include "PresentMonTraceConsumer.hpp"
+
+// Completed presents of a capture, keyed by (ProcessId, SwapChainAddress),
+// each in completion order.
+typedef std::map<std::pair<uint32_t, uint64_t>, std::vector<CompletedFrame>> SwapChainFrames;
+
+// Completed late stage reprojections of a capture, in completion order.
+typedef std::vector<std::shared_ptr<LateStageReprojectionEvent>> LateStageReprojections;
+
+// Runs a recorded capture (see EventCapture.hpp) through PMTraceConsumer on
+// threadCount threads.
+//
+// The capture is cut into time chunks, each replayed by its own consumer.
+// A chunk starts replaying overlapSeconds before its range to warm up the
+// correlation state of presents already in flight, and keeps replaying
+// overlapSeconds past its end so that its last presents can complete.  A
+// present is reported by the chunk its QpcTime falls in, which removes the
+// duplicates from the overlaps.  Presents on one swapchain complete in
+// order, so concatenating the chunks per swapchain gives the serial result
+// as long as no present takes longer than overlapSeconds to complete.
+//
+// If lsrOut isn't null, the Mixed Reality events are replayed through an
+// MRTraceConsumer per chunk as well, and its LSRs reported the same way.
+//
+// threadCount <= 1 replays the whole capture serially through a single
+// consumer.  chunkCount of 0 uses up to 4 chunks per thread to balance
+// uneven chunks, fewer if that would make them shorter than 4x the overlap.  Returns false if the capture couldn't be read or is corrupt.
+bool AnalyzeCapture(char const* path, uint32_t threadCount, SwapChainFrames* out,
+                    double overlapSeconds = 2.0, uint32_t chunkCount = 0,
+                    LateStageReprojections* lsrOut = nullptr);
@@ -22,36 +22,35 @@ SOFTWARE.
 
 #define NOMINMAX
 #include <algorithm>
-#include <d3d9.h>
-#include <dxgi.h>
+#include <ctype.h>
+#include <string.h>
 
 #include "PresentMonTraceConsumer.hpp"
 #include "TraceConsumer.hpp"
 #include "DxgkrnlEventStructs.hpp"
+#include "RuntimeConstants.hpp"
 
 PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
     : QpcTime(*(uint64_t*) &hdr.TimeStamp)
     , SwapChainAddress(0)
+    , TimeTaken(0)
+    , ReadyTime(0)
+    , ScreenTime(0)
     , SyncInterval(-1)
     , PresentFlags(0)
     , ProcessId(hdr.ProcessId)
+    , PlaneIndex(0)
+    , QueueSubmitSequence(0)
+    , RuntimeThread(hdr.ThreadId)
     , PresentMode(PresentMode::Unknown)
+    , FinalState(PresentResult::Unknown)
+    , Runtime(runtime)
     , SupportsTearing(false)
     , MMIO(false)
     , SeenDxgkPresent(false)
     , SeenWin32KEvents(false)
     , WasBatched(false)
     , DwmNotified(false)
-    , Runtime(runtime)
-    , TimeTaken(0)
-    , ReadyTime(0)
-    , ScreenTime(0)
-    , FinalState(PresentResult::Unknown)
-    , PlaneIndex(0)
-    , QueueSubmitSequence(0)
-    , RuntimeThread(hdr.ThreadId)
-    , Hwnd(0)
-    , TokenPtr(0)
     , Completed(false)
 {
 }
@@ -60,11 +59,91 @@ PresentEvent::PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime)
 static bool gPresentMonTraceConsumer_Exiting = false;
 #endif
 
+namespace {
+
+// The fields read from each event, resolved to offsets once per schema (see
+// EventDataReader); each enum indexes the list below it.
+enum { DXGIPresentStart_SwapChain, DXGIPresentStart_Flags, DXGIPresentStart_SyncInterval };
+EventFieldList const DXGIPresentStartFields = { L"pIDXGISwapChain", L"Flags", L"SyncInterval" };
+
+enum { PresentStop_Result };
+EventFieldList const PresentStopFields = { L"Result" };
+
+enum { D3D9PresentStart_SwapChain, D3D9PresentStart_Flags };
+EventFieldList const D3D9PresentStartFields = { L"pSwapchain", L"Flags" };
+
+enum { Flip_FlipInterval, Flip_MMIOFlip };
+EventFieldList const FlipFields = { L"FlipInterval", L"MMIOFlip" };
+
+enum { QueueSubmit_PacketType, QueueSubmit_SubmitSequence, QueueSubmit_bPresent, QueueSubmit_hContext };
+EventFieldList const QueueSubmitFields = { L"PacketType", L"SubmitSequence", L"bPresent", L"hContext" };
+
+enum { QueueComplete_SubmitSequence };
+EventFieldList const QueueCompleteFields = { L"SubmitSequence" };
+
+enum { MMIOFlip_FlipSubmitSequence, MMIOFlip_Flags };
+EventFieldList const MMIOFlipFields = { L"FlipSubmitSequence", L"Flags" };
+
+enum { MMIOFlipMPO_FlipSubmitSequence, MMIOFlipMPO_LayerIndex, MMIOFlipMPO_FlipEntryStatusAfterFlip };
+EventFieldList const MMIOFlipMPOFields = { L"FlipSubmitSequence", L"LayerIndex", L"FlipEntryStatusAfterFlip" };
+
+enum { HSyncDPC_FlipEntryCount, HSyncDPC_FlipSubmitSequence };
+EventFieldList const HSyncDPCFields = { L"FlipEntryCount", L"FlipSubmitSequence" };
+
+enum { VSyncDPC_FlipFenceId, VSyncDPC_VidPnTargetId, VSyncDPC_FrameNumber, VSyncDPC_FrameQPCTime };
+EventFieldList const VSyncDPCFields = { L"FlipFenceId", L"VidPnTargetId", L"FrameNumber", L"FrameQPCTime" };
+
+enum { DxgkPresent_hWindow };
+EventFieldList const DxgkPresentFields = { L"hWindow" };
+
+enum { PresentHistory_Token, PresentHistory_TokenData, PresentHistory_Model };
+EventFieldList const PresentHistoryFields = { L"Token", L"TokenData", L"Model" };
+
+enum { PropagatePresentHistory_Token };
+EventFieldList const PropagatePresentHistoryFields = { L"Token" };
+
+enum { Blit_hwnd, Blit_bRedirectedPresent };
+EventFieldList const BlitFields = { L"hwnd", L"bRedirectedPresent" };
+
+enum { TokenCompositionSurfaceObject_CompositionSurfaceLuid, TokenCompositionSurfaceObject_PresentCount, TokenCompositionSurfaceObject_BindId };
+EventFieldList const TokenCompositionSurfaceObjectFields = { L"CompositionSurfaceLuid", L"PresentCount", L"BindId" };
+
+enum { TokenStateChanged_CompositionSurfaceLuid, TokenStateChanged_PresentCount, TokenStateChanged_BindId, TokenStateChanged_NewState, TokenStateChanged_IndependentFlip };
+EventFieldList const TokenStateChangedFields = { L"CompositionSurfaceLuid", L"PresentCount", L"BindId", L"NewState", L"IndependentFlip" };
+
+enum { DwmFlipChain_ulFlipChain, DwmFlipChain_ulSerialNumber, DwmFlipChain_hwnd };
+EventFieldList const DwmFlipChainFields = { L"ulFlipChain", L"ulSerialNumber", L"hwnd" };
+
+enum { DwmSurfaceUpdate_luidSurface, DwmSurfaceUpdate_PresentCount, DwmSurfaceUpdate_bindId };
+EventFieldList const DwmSurfaceUpdateFields = { L"luidSurface", L"PresentCount", L"bindId" };
+
+}
+
 PresentEvent::~PresentEvent()
 {
     assert(Completed || gPresentMonTraceConsumer_Exiting);
 }
 
+CompletedFrame::CompletedFrame(PresentEvent const& p)
+    : QpcTime(p.QpcTime)
+    , SwapChainAddress(p.SwapChainAddress)
+    , TimeTaken(p.TimeTaken)
+    , ReadyTime(p.ReadyTime)
+    , ScreenTime(p.ScreenTime)
+    , ProcessId(p.ProcessId)
+    , SyncInterval(p.SyncInterval)
+    , PresentFlags(p.PresentFlags)
+    , PlaneIndex(p.PlaneIndex)
+    , PresentMode(p.PresentMode)
+    , FinalState(p.FinalState)
+    , Runtime(p.Runtime)
+    , SupportsTearing(p.SupportsTearing)
+    , MMIO(p.MMIO)
+    , WasBatched(p.WasBatched)
+    , DwmNotified(p.DwmNotified)
+{
+}
+
 PMTraceConsumer::~PMTraceConsumer()
 {
 #ifndef NDEBUG
@@ -74,13 +153,6 @@ PMTraceConsumer::~PMTraceConsumer()
 
 void HandleDXGIEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
-    enum {
-        DXGIPresent_Start = 42,
-        DXGIPresent_Stop,
-        DXGIPresentMPO_Start = 55,
-        DXGIPresentMPO_Stop = 56,
-    };
-
     auto const& hdr = pEventRecord->EventHeader;
     switch (hdr.EventDescriptor.Id)
     {
@@ -88,9 +160,10 @@ void HandleDXGIEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     case DXGIPresentMPO_Start:
     {
         PresentEvent event(hdr, Runtime::DXGI);
-        GetEventData(pEventRecord, L"pIDXGISwapChain", &event.SwapChainAddress);
-        GetEventData(pEventRecord, L"Flags",           &event.PresentFlags);
-        GetEventData(pEventRecord, L"SyncInterval",    &event.SyncInterval);
+        EventDataReader data(pEventRecord, DXGIPresentStartFields);
+        data.Get(DXGIPresentStart_SwapChain,    &event.SwapChainAddress);
+        data.Get(DXGIPresentStart_Flags,        &event.PresentFlags);
+        data.Get(DXGIPresentStart_SyncInterval, &event.SyncInterval);
 
         pmConsumer->RuntimePresentStart(event);
         break;
@@ -98,7 +171,7 @@ void HandleDXGIEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     case DXGIPresent_Stop:
     case DXGIPresentMPO_Stop:
     {
-        auto result = GetEventData<uint32_t>(pEventRecord, L"Result");
+        auto result = EventDataReader(pEventRecord, PresentStopFields).Get<uint32_t>(PresentStop_Result);
         bool AllowBatching = SUCCEEDED(result) && result != DXGI_STATUS_OCCLUDED && result != DXGI_STATUS_MODE_CHANGE_IN_PROGRESS && result != DXGI_STATUS_NO_DESKTOP_ACCESS;
         pmConsumer->RuntimePresentStop(hdr, AllowBatching);
         break;
@@ -122,7 +195,7 @@ void PMTraceConsumer::HandleDxgkBlt(DxgkBltEventArgs& args)
     eventIter->second->PresentMode = args.Present ?
         PresentMode::Composed_Copy_CPU_GDI : PresentMode::Hardware_Legacy_Copy_To_Front_Buffer;
     eventIter->second->SupportsTearing = !args.Present;
-    eventIter->second->Hwnd = args.Hwnd;
+    eventIter->second->Cold().Hwnd = args.Hwnd;
 }
 
 void PMTraceConsumer::HandleDxgkFlip(DxgkFlipEventArgs& args)
@@ -157,7 +230,9 @@ void PMTraceConsumer::HandleDxgkFlip(DxgkFlipEventArgs& args)
 
     // If this is the DWM thread, piggyback these pending presents on our fullscreen present
     if (args.pEventHeader->ThreadId == DwmPresentThreadId) {
-        std::swap(eventIter->second->DependentPresents, mPresentsWaitingForDWM);
+        if (!mPresentsWaitingForDWM.empty() || eventIter->second->mCold) {
+            std::swap(eventIter->second->Cold().DependentPresents, mPresentsWaitingForDWM);
+        }
         DwmPresentThreadId = 0;
     }
 }
@@ -254,8 +329,42 @@ void PMTraceConsumer::HandleDxgkMMIOFlip(DxgkMMIOFlipEventArgs& args)
     }
 }
 
+void PMTraceConsumer::UpdateDisplayRefresh(uint32_t vidPnTargetId, uint32_t frameNumber, uint64_t frameQpc)
+{
+    // There are only a few displays, so a linear search beats a map.
+    size_t i = 0;
+    while (i < mDisplays.size() && mDisplays[i].VidPnTargetId != vidPnTargetId) {
+        ++i;
+    }
+    auto newDisplay = i == mDisplays.size();
+    if (newDisplay) {
+        if (i == MAX_DISPLAYS) {
+            return;
+        }
+        mDisplays.push_back(DisplayRefresh());
+    }
+
+    auto& display = mDisplays[i];
+    if (!newDisplay && frameNumber > display.LastFrameNumber && frameQpc > display.LastFrameQpc) {
+        // FrameNumber counts every vsync, so the period is exact even when
+        // DPCs were skipped in between.
+        auto vsyncs = frameNumber - display.LastFrameNumber;
+        auto period = double(frameQpc - display.LastFrameQpc) / vsyncs;
+        display.PeriodTicks = display.PeriodTicks == 0.0 ? period : display.PeriodTicks + (period - display.PeriodTicks) / 16;
+        display.VsyncCount += vsyncs;
+    }
+    display.VidPnTargetId = vidPnTargetId;
+    display.LastFrameNumber = frameNumber;
+    display.LastFrameQpc = frameQpc;
+    mPublishedDisplays.store(i, display);
+}
+
 void PMTraceConsumer::HandleDxgkSyncDPC(DxgkSyncDPCEventArgs& args)
 {
+    if (args.FrameQpcTime != 0) {
+        UpdateDisplayRefresh(args.VidPnTargetId, args.FrameNumber, args.FrameQpcTime);
+    }
+
     // The VSyncDPC/HSyncDPC contains a field telling us what flipped to screen.
     // This is the way to track completion of a fullscreen present.
     auto eventIter = mPresentsBySubmitSequence.find(args.FlipSubmitSequence);
@@ -278,7 +387,7 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(DxgkSubmitPresentH
     auto eventIter = FindOrCreatePresent(*args.pEventHeader);
 
     // Check if we might have retrieved a 'stuck' present from a previous frame.
-    if (eventIter->second->TokenPtr != 0) {
+    if (eventIter->second->GetTokenPtr() != 0) {
         // It's already progressed further but didn't complete, ignore it and create a new one.
         mPresentByThreadId.erase(eventIter);
         eventIter = FindOrCreatePresent(*args.pEventHeader);
@@ -287,7 +396,7 @@ void PMTraceConsumer::HandleDxgkSubmitPresentHistoryEventArgs(DxgkSubmitPresentH
     eventIter->second->ReadyTime = eventIter->second->ScreenTime = 0;
     eventIter->second->SupportsTearing = false;
     eventIter->second->FinalState = PresentResult::Unknown;
-    eventIter->second->TokenPtr = args.Token;
+    eventIter->second->Cold().TokenPtr = args.Token;
 
     if (eventIter->second->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer)
     {
@@ -341,7 +450,7 @@ void PMTraceConsumer::HandleDxgkPropagatePresentHistoryEventArgs(DxgkPropagatePr
     if (eventIter->second->PresentMode == PresentMode::Composed_Copy_GPU_GDI) {
         // Manipulate the map here
         // When DWM is ready to present, we'll query for the most recent blt targeting this window and take it out of the map
-        mPresentByWindow[eventIter->second->Hwnd] = eventIter->second;
+        mPresentByWindow[eventIter->second->GetHwnd()] = eventIter->second;
     }
 
     mDxgKrnlPresentHistoryTokens.erase(eventIter);
@@ -365,24 +474,27 @@ static PresentMode D3DKMT_TokenModel_ToPresentMode(D3DKMT_PRESENT_MODEL Model)
 
 void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
-    enum {
-        DxgKrnl_Flip = 168,
-        DxgKrnl_FlipMPO = 252,
-        DxgKrnl_QueueSubmit = 178,
-        DxgKrnl_QueueComplete = 180,
-        DxgKrnl_MMIOFlip = 116,
-        DxgKrnl_MMIOFlipMPO = 259,
-        DxgKrnl_HSyncDPC = 382,
-        DxgKrnl_VSyncDPC = 17,
-        DxgKrnl_Present = 184,
-        DxgKrnl_PresentHistoryDetailed = 215,
-        DxgKrnl_SubmitPresentHistory = 171,
-        DxgKrnl_PropagatePresentHistory = 172,
-        DxgKrnl_Blit = 166,
-    };
-
     auto const& hdr = pEventRecord->EventHeader;
 
+    // Events raised on the presenting thread can only start or advance a
+    // present of the raising process.  Completion events (queue complete,
+    // MMIO flip, sync DPCs, history propagation) are keyed lookups and are
+    // left alone.
+    switch (hdr.EventDescriptor.Id)
+    {
+    case DxgKrnl_Flip:
+    case DxgKrnl_FlipMPO:
+    case DxgKrnl_QueueSubmit:
+    case DxgKrnl_Present:
+    case DxgKrnl_PresentHistoryDetailed:
+    case DxgKrnl_SubmitPresentHistory:
+    case DxgKrnl_Blit:
+        if (!pmConsumer->IsTrackedProcess(hdr.ProcessId)) {
+            return;
+        }
+        break;
+    }
+
     uint64_t EventTime = *(uint64_t*)&hdr.TimeStamp;
 
     switch (hdr.EventDescriptor.Id)
@@ -394,8 +506,9 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         Args.pEventHeader = &hdr;
         Args.FlipInterval = -1;
         if (hdr.EventDescriptor.Id == DxgKrnl_Flip) {
-            Args.FlipInterval = GetEventData<uint32_t>(pEventRecord, L"FlipInterval");
-            Args.MMIO = GetEventData<BOOL>(pEventRecord, L"MMIOFlip") != 0;
+            EventDataReader data(pEventRecord, FlipFields);
+            Args.FlipInterval = data.Get<uint32_t>(Flip_FlipInterval);
+            Args.MMIO = data.Get<BOOL>(Flip_MMIOFlip) != 0;
         }
         else {
             Args.MMIO = true; // All MPO flips are MMIO
@@ -407,10 +520,11 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkQueueSubmitEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.PacketType = GetEventData<DxgKrnl_QueueSubmit_Type>(pEventRecord, L"PacketType");
-        Args.SubmitSequence = GetEventData<uint32_t>(pEventRecord, L"SubmitSequence");
-        Args.Present = GetEventData<BOOL>(pEventRecord, L"bPresent") != 0;
-        Args.Context = GetEventData<uint64_t>(pEventRecord, L"hContext");
+        EventDataReader data(pEventRecord, QueueSubmitFields);
+        Args.PacketType = data.Get<DxgKrnl_QueueSubmit_Type>(QueueSubmit_PacketType);
+        Args.SubmitSequence = data.Get<uint32_t>(QueueSubmit_SubmitSequence);
+        Args.Present = data.Get<BOOL>(QueueSubmit_bPresent) != 0;
+        Args.Context = data.Get<uint64_t>(QueueSubmit_hContext);
         Args.SupportsDxgkPresentEvent = true;
         pmConsumer->HandleDxgkQueueSubmit(Args);
         break;
@@ -419,7 +533,7 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkQueueCompleteEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.SubmitSequence = GetEventData<uint32_t>(pEventRecord, L"SubmitSequence");
+        Args.SubmitSequence = EventDataReader(pEventRecord, QueueCompleteFields).Get<uint32_t>(QueueComplete_SubmitSequence);
         pmConsumer->HandleDxgkQueueComplete(Args);
         break;
     }
@@ -427,8 +541,9 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkMMIOFlipEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.FlipSubmitSequence = GetEventData<uint32_t>(pEventRecord, L"FlipSubmitSequence");
-        Args.Flags = GetEventData<DxgKrnl_MMIOFlip_Flags>(pEventRecord, L"Flags");
+        EventDataReader data(pEventRecord, MMIOFlipFields);
+        Args.FlipSubmitSequence = data.Get<uint32_t>(MMIOFlip_FlipSubmitSequence);
+        Args.Flags = data.Get<DxgKrnl_MMIOFlip_Flags>(MMIOFlip_Flags);
         pmConsumer->HandleDxgkMMIOFlip(Args);
         break;
     }
@@ -436,7 +551,8 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         // See above for more info about this packet.
         // Note: Event does not exist on Win7
-        auto FlipFenceId = GetEventData<uint64_t>(pEventRecord, L"FlipSubmitSequence");
+        EventDataReader data(pEventRecord, MMIOFlipMPOFields);
+        auto FlipFenceId = data.Get<uint64_t>(MMIOFlipMPO_FlipSubmitSequence);
         uint32_t FlipSubmitSequence = (uint32_t)(FlipFenceId >> 32u);
 
         auto eventIter = pmConsumer->mPresentsBySubmitSequence.find(FlipSubmitSequence);
@@ -447,7 +563,7 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         // Avoid double-marking a single present packet coming from the MPO API
         if (eventIter->second->ReadyTime == 0) {
             eventIter->second->ReadyTime = EventTime;
-            eventIter->second->PlaneIndex = GetEventData<uint32_t>(pEventRecord, L"LayerIndex");
+            eventIter->second->PlaneIndex = data.Get<uint32_t>(MMIOFlipMPO_LayerIndex);
         }
 
         if (eventIter->second->PresentMode == PresentMode::Hardware_Independent_Flip ||
@@ -464,7 +580,7 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
                 // There are others, but they're more complicated to deal with.
             };
 
-            auto FlipEntryStatusAfterFlip = GetEventData<DxgKrnl_MMIOFlipMPO_FlipEntryStatus>(pEventRecord, L"FlipEntryStatusAfterFlip");
+            auto FlipEntryStatusAfterFlip = data.Get<DxgKrnl_MMIOFlipMPO_FlipEntryStatus>(MMIOFlipMPO_FlipEntryStatusAfterFlip);
             if (FlipEntryStatusAfterFlip != DxgKrnl_MMIOFlipMPO_FlipEntryStatus::FlipWaitVSync &&
                 FlipEntryStatusAfterFlip != DxgKrnl_MMIOFlipMPO_FlipEntryStatus::FlipWaitHSync) {
                 eventIter->second->FinalState = PresentResult::Presented;
@@ -487,10 +603,11 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         // integrated graphics
         // MMIOFlipMPO [EntryStatus:FlipWaitHSync] ->HSync DPC
 
-        auto FlipCount = GetEventData<uint32_t>(pEventRecord, L"FlipEntryCount");
+        EventDataReader data(pEventRecord, HSyncDPCFields);
+        auto FlipCount = data.Get<uint32_t>(HSyncDPC_FlipEntryCount);
         for (uint32_t i = 0; i < FlipCount; i++)
         {
-            auto FlipId = GetEventDataFromArray<uint64_t>(pEventRecord, L"FlipSubmitSequence", i);
+            auto FlipId = data.GetArrayElement<uint64_t>(HSyncDPC_FlipSubmitSequence, i);
             DxgkSyncDPCEventArgs Args = {};
             Args.pEventHeader = &hdr;
             Args.FlipSubmitSequence = (uint32_t)(FlipId >> 32u);
@@ -500,11 +617,15 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     }
     case DxgKrnl_VSyncDPC:
     {
-        auto FlipFenceId = GetEventData<uint64_t>(pEventRecord, L"FlipFenceId");
+        EventDataReader data(pEventRecord, VSyncDPCFields);
+        auto FlipFenceId = data.Get<uint64_t>(VSyncDPC_FlipFenceId);
 
         DxgkSyncDPCEventArgs Args = {};
         Args.pEventHeader = &hdr;
         Args.FlipSubmitSequence = (uint32_t)(FlipFenceId >> 32u);
+        Args.VidPnTargetId = data.Get<uint32_t>(VSyncDPC_VidPnTargetId);
+        Args.FrameNumber = data.Get<uint32_t>(VSyncDPC_FrameNumber);
+        Args.FrameQpcTime = data.Get<uint64_t>(VSyncDPC_FrameQPCTime);
         pmConsumer->HandleDxgkSyncDPC(Args);
         break;
     }
@@ -519,8 +640,8 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         }
 
         eventIter->second->SeenDxgkPresent = true;
-        if (eventIter->second->Hwnd == 0) {
-            eventIter->second->Hwnd = GetEventData<uint64_t>(pEventRecord, L"hWindow");
+        if (eventIter->second->GetHwnd() == 0) {
+            eventIter->second->Cold().Hwnd = EventDataReader(pEventRecord, DxgkPresentFields).Get<uint64_t>(DxgkPresent_hWindow);
         }
 
         if (eventIter->second->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer &&
@@ -544,9 +665,10 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkSubmitPresentHistoryEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.Token = GetEventData<uint64_t>(pEventRecord, L"Token");
-        Args.TokenData = GetEventData<uint64_t>(pEventRecord, L"TokenData");
-        auto KMTPresentModel = GetEventData<D3DKMT_PRESENT_MODEL>(pEventRecord, L"Model");
+        EventDataReader data(pEventRecord, PresentHistoryFields);
+        Args.Token = data.Get<uint64_t>(PresentHistory_Token);
+        Args.TokenData = data.Get<uint64_t>(PresentHistory_TokenData);
+        auto KMTPresentModel = data.Get<D3DKMT_PRESENT_MODEL>(PresentHistory_Model);
         Args.KnownPresentMode = D3DKMT_TokenModel_ToPresentMode(KMTPresentModel);
         if (KMTPresentModel != D3DKMT_PM_REDIRECTED_GDI)
         {
@@ -558,7 +680,7 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkPropagatePresentHistoryEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.Token = GetEventData<uint64_t>(pEventRecord, L"Token");
+        Args.Token = EventDataReader(pEventRecord, PropagatePresentHistoryFields).Get<uint64_t>(PropagatePresentHistory_Token);
         pmConsumer->HandleDxgkPropagatePresentHistoryEventArgs(Args);
         break;
     }
@@ -566,8 +688,9 @@ void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
         DxgkBltEventArgs Args = {};
         Args.pEventHeader = &hdr;
-        Args.Hwnd = GetEventData<uint64_t>(pEventRecord, L"hwnd");
-        Args.Present = GetEventData<uint32_t>(pEventRecord, L"bRedirectedPresent") != 0;
+        EventDataReader data(pEventRecord, BlitFields);
+        Args.Hwnd = data.Get<uint64_t>(Blit_hwnd);
+        Args.Present = data.Get<uint32_t>(Blit_bRedirectedPresent) != 0;
         pmConsumer->HandleDxgkBlt(Args);
         break;
     }
@@ -578,6 +701,10 @@ namespace Win7
 {
 void HandleDxgkBlt(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
+    if (!pmConsumer->IsTrackedProcess(pEventRecord->EventHeader.ProcessId)) {
+        return;
+    }
+
     DxgkBltEventArgs Args = {};
     Args.pEventHeader = &pEventRecord->EventHeader;
     auto pBltEvent = reinterpret_cast<DXGKETW_BLTEVENT*>(pEventRecord->UserData);
@@ -588,6 +715,10 @@ void HandleDxgkBlt(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 
 void HandleDxgkFlip(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
+    if (!pmConsumer->IsTrackedProcess(pEventRecord->EventHeader.ProcessId)) {
+        return;
+    }
+
     DxgkFlipEventArgs Args = {};
     Args.pEventHeader = &pEventRecord->EventHeader;
     auto pFlipEvent = reinterpret_cast<DXGKETW_FLIPEVENT*>(pEventRecord->UserData);
@@ -601,6 +732,9 @@ void HandleDxgkPresentHistory(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmCon
     auto pPresentHistoryEvent = reinterpret_cast<DXGKETW_PRESENTHISTORYEVENT*>(pEventRecord->UserData);
     if (pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_START)
     {
+        if (!pmConsumer->IsTrackedProcess(pEventRecord->EventHeader.ProcessId)) {
+            return;
+        }
         DxgkSubmitPresentHistoryEventArgs Args = {};
         Args.pEventHeader = &pEventRecord->EventHeader;
         Args.KnownPresentMode = PresentMode::Unknown;
@@ -620,6 +754,9 @@ void HandleDxgkQueuePacket(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsum
 {
     if (pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_START)
     {
+        if (!pmConsumer->IsTrackedProcess(pEventRecord->EventHeader.ProcessId)) {
+            return;
+        }
         DxgkQueueSubmitEventArgs Args = {};
         Args.pEventHeader = &pEventRecord->EventHeader;
         auto pSubmitEvent = reinterpret_cast<DXGKETW_QUEUESUBMITEVENT*>(pEventRecord->UserData);
@@ -655,6 +792,9 @@ void HandleDxgkVSyncDPC(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     Args.pEventHeader = &pEventRecord->EventHeader;
     auto pVSyncDPCEvent = reinterpret_cast<DXGKETW_SCHEDULER_VSYNC_DPC*>(pEventRecord->UserData);
     Args.FlipSubmitSequence = (uint32_t)(pVSyncDPCEvent->FlipFenceId.QuadPart >> 32u);
+    Args.VidPnTargetId = pVSyncDPCEvent->VidPnTargetId;
+    Args.FrameNumber = pVSyncDPCEvent->FrameNumber;
+    Args.FrameQpcTime = (uint64_t) pVSyncDPCEvent->FrameQPCTime;
     pmConsumer->HandleDxgkSyncDPC(Args);
 }
 
@@ -680,11 +820,6 @@ void HandleDxgkMMIOFlip(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 
 void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
-    enum {
-        Win32K_TokenCompositionSurfaceObject = 201,
-        Win32K_TokenStateChanged = 301,
-    };
-
     auto const& hdr = pEventRecord->EventHeader;
 
     uint64_t EventTime = *(uint64_t*)&hdr.TimeStamp;
@@ -693,6 +828,9 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     {
     case Win32K_TokenCompositionSurfaceObject:
     {
+        if (!pmConsumer->IsTrackedProcess(hdr.ProcessId)) {
+            return;
+        }
         auto eventIter = pmConsumer->FindOrCreatePresent(hdr);
 
         // Check if we might have retrieved a 'stuck' present from a previous frame.
@@ -704,17 +842,19 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         eventIter->second->PresentMode = PresentMode::Composed_Flip;
         eventIter->second->SeenWin32KEvents = true;
 
-        PMTraceConsumer::Win32KPresentHistoryTokenKey key(GetEventData<uint64_t>(pEventRecord, L"CompositionSurfaceLuid"),
-            GetEventData<uint64_t>(pEventRecord, L"PresentCount"),
-            GetEventData<uint64_t>(pEventRecord, L"BindId"));
+        EventDataReader data(pEventRecord, TokenCompositionSurfaceObjectFields);
+        PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(TokenCompositionSurfaceObject_CompositionSurfaceLuid),
+            data.Get<uint64_t>(TokenCompositionSurfaceObject_PresentCount),
+            data.Get<uint64_t>(TokenCompositionSurfaceObject_BindId));
         pmConsumer->mWin32KPresentHistoryTokens[key] = eventIter->second;
         break;
     }
     case Win32K_TokenStateChanged:
     {
-        PMTraceConsumer::Win32KPresentHistoryTokenKey key(GetEventData<uint64_t>(pEventRecord, L"CompositionSurfaceLuid"),
-            GetEventData<uint32_t>(pEventRecord, L"PresentCount"),
-            GetEventData<uint64_t>(pEventRecord, L"BindId"));
+        EventDataReader data(pEventRecord, TokenStateChangedFields);
+        PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(TokenStateChanged_CompositionSurfaceLuid),
+            data.Get<uint32_t>(TokenStateChanged_PresentCount),
+            data.Get<uint64_t>(TokenStateChanged_BindId));
         auto eventIter = pmConsumer->mWin32KPresentHistoryTokens.find(key);
         if (eventIter == pmConsumer->mWin32KPresentHistoryTokens.end()) {
             return;
@@ -728,16 +868,16 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         };
 
         auto &event = *eventIter->second;
-        auto state = GetEventData<TokenState>(pEventRecord, L"NewState");
+        auto state = data.Get<TokenState>(TokenStateChanged_NewState);
         switch (state)
         {
         case TokenState::InFrame:
         {
             // InFrame = composition is starting
-            if (event.Hwnd) {
-                auto hWndIter = pmConsumer->mPresentByWindow.find(event.Hwnd);
+            if (event.GetHwnd()) {
+                auto hWndIter = pmConsumer->mPresentByWindow.find(event.GetHwnd());
                 if (hWndIter == pmConsumer->mPresentByWindow.end()) {
-                    pmConsumer->mPresentByWindow.emplace(event.Hwnd, eventIter->second);
+                    pmConsumer->mPresentByWindow.emplace(event.GetHwnd(), eventIter->second);
                 }
                 else if (hWndIter->second != eventIter->second) {
                     hWndIter->second->FinalState = PresentResult::Discarded;
@@ -745,7 +885,7 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
                 }
             }
 
-            bool iFlip = GetEventData<BOOL>(pEventRecord, L"IndependentFlip") != 0;
+            bool iFlip = data.Get<BOOL>(TokenStateChanged_IndependentFlip) != 0;
             if (iFlip && event.PresentMode == PresentMode::Composed_Flip) {
                 event.PresentMode = PresentMode::Hardware_Independent_Flip;
             }
@@ -766,8 +906,8 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
                     event.FinalState = PresentResult::Presented;
                 }
             }
-            if (event.Hwnd) {
-                pmConsumer->mPresentByWindow.erase(event.Hwnd);
+            if (event.GetHwnd()) {
+                pmConsumer->mPresentByWindow.erase(event.GetHwnd());
             }
             break;
         }
@@ -798,16 +938,9 @@ void HandleWin32kEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 
 void HandleDWMEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
-    enum {
-        DWM_GetPresentHistory = 64,
-        DWM_Schedule_Present_Start = 15,
-        DWM_FlipChain_Pending = 69,
-        DWM_FlipChain_Complete = 70,
-        DWM_FlipChain_Dirty = 101,
-        DWM_Schedule_SurfaceUpdate = 196,
-    };
-
     auto& hdr = pEventRecord->EventHeader;
+    pmConsumer->mDwmProcessId = hdr.ProcessId;
+
     switch (hdr.EventDescriptor.Id)
     {
     case DWM_GetPresentHistory:
@@ -840,8 +973,9 @@ void HandleDWMEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         }
         // As it turns out, the 64-bit token data from the PHT submission is actually two 32-bit data chunks,		
         // corresponding to a "flip chain" id and present id		
-        uint32_t flipChainId = (uint32_t)GetEventData<uint64_t>(pEventRecord, L"ulFlipChain");
-        uint32_t serialNumber = (uint32_t)GetEventData<uint64_t>(pEventRecord, L"ulSerialNumber");
+        EventDataReader data(pEventRecord, DwmFlipChainFields);
+        uint32_t flipChainId = (uint32_t)data.Get<uint64_t>(DwmFlipChain_ulFlipChain);
+        uint32_t serialNumber = (uint32_t)data.Get<uint64_t>(DwmFlipChain_ulSerialNumber);
         uint64_t token = ((uint64_t)flipChainId << 32ull) | serialNumber;
         auto flipIter = pmConsumer->mDxgKrnlPresentHistoryTokens.find(token);
         if (flipIter == pmConsumer->mDxgKrnlPresentHistoryTokens.end()) {
@@ -849,7 +983,7 @@ void HandleDWMEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
         }
 
         // Watch for multiple legacy blits completing against the same window		
-        auto hWnd = GetEventData<uint64_t>(pEventRecord, L"hwnd");
+        auto hWnd = data.Get<uint64_t>(DwmFlipChain_hwnd);
         pmConsumer->mPresentByWindow[hWnd] = flipIter->second;
         flipIter->second->DwmNotified = true;
         pmConsumer->mPresentsByLegacyBlitToken.erase(flipIter);
@@ -857,9 +991,10 @@ void HandleDWMEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     }
     case DWM_Schedule_SurfaceUpdate:
     {
-        PMTraceConsumer::Win32KPresentHistoryTokenKey key(GetEventData<uint64_t>(pEventRecord, L"luidSurface"),
-                                                          GetEventData<uint64_t>(pEventRecord, L"PresentCount"),
-                                                          GetEventData<uint64_t>(pEventRecord, L"bindId"));
+        EventDataReader data(pEventRecord, DwmSurfaceUpdateFields);
+        PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(DwmSurfaceUpdate_luidSurface),
+                                                          data.Get<uint64_t>(DwmSurfaceUpdate_PresentCount),
+                                                          data.Get<uint64_t>(DwmSurfaceUpdate_bindId));
         auto eventIter = pmConsumer->mWin32KPresentHistoryTokens.find(key);
         if (eventIter != pmConsumer->mWin32KPresentHistoryTokens.end()) {
             eventIter->second->DwmNotified = true;
@@ -871,19 +1006,15 @@ void HandleDWMEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 
 void HandleD3D9Event(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
 {
-    enum {
-        D3D9PresentStart = 1,
-        D3D9PresentStop,
-    };
-
     auto const& hdr = pEventRecord->EventHeader;
     switch (hdr.EventDescriptor.Id)
     {
     case D3D9PresentStart:
     {
         PresentEvent event(hdr, Runtime::D3D9);
-        GetEventData(pEventRecord, L"pSwapchain", &event.SwapChainAddress);
-        uint32_t D3D9Flags = GetEventData<uint32_t>(pEventRecord, L"Flags");
+        EventDataReader data(pEventRecord, D3D9PresentStartFields);
+        data.Get(D3D9PresentStart_SwapChain, &event.SwapChainAddress);
+        uint32_t D3D9Flags = data.Get<uint32_t>(D3D9PresentStart_Flags);
         event.PresentFlags =
             ((D3D9Flags & D3DPRESENT_DONOTFLIP) ? DXGI_PRESENT_DO_NOT_SEQUENCE : 0) |
             ((D3D9Flags & D3DPRESENT_DONOTWAIT) ? DXGI_PRESENT_DO_NOT_WAIT : 0) |
@@ -897,7 +1028,7 @@ void HandleD3D9Event(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
     }
     case D3D9PresentStop:
     {
-        auto result = GetEventData<uint32_t>(pEventRecord, L"Result");
+        auto result = EventDataReader(pEventRecord, PresentStopFields).Get<uint32_t>(PresentStop_Result);
         bool AllowBatching = SUCCEEDED(result) && result != S_PRESENT_OCCLUDED;
         pmConsumer->RuntimePresentStop(hdr, AllowBatching);
         break;
@@ -914,25 +1045,27 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> p)
     }
 
     // Complete all other presents that were riding along with this one (i.e. this one came from DWM)
-    for (auto& p2 : p->DependentPresents) {
-        p2->ScreenTime = p->ScreenTime;
-        p2->FinalState = PresentResult::Presented;
-        CompletePresent(p2);
+    if (p->mCold) {
+        for (auto& p2 : p->mCold->DependentPresents) {
+            p2->ScreenTime = p->ScreenTime;
+            p2->FinalState = PresentResult::Presented;
+            CompletePresent(p2);
+        }
+        p->mCold->DependentPresents.clear();
     }
-    p->DependentPresents.clear();
 
     // Remove it from any tracking maps that it may have been inserted into
     if (p->QueueSubmitSequence != 0) {
         mPresentsBySubmitSequence.erase(p->QueueSubmitSequence);
     }
-    if (p->Hwnd != 0) {
-        auto hWndIter = mPresentByWindow.find(p->Hwnd);
+    if (p->GetHwnd() != 0) {
+        auto hWndIter = mPresentByWindow.find(p->GetHwnd());
         if (hWndIter != mPresentByWindow.end() && hWndIter->second == p) {
             mPresentByWindow.erase(hWndIter);
         }
     }
-    if (p->TokenPtr != 0) {
-        auto iter = mDxgKrnlPresentHistoryTokens.find(p->TokenPtr);
+    if (p->GetTokenPtr() != 0) {
+        auto iter = mDxgKrnlPresentHistoryTokens.find(p->GetTokenPtr());
         if (iter != mDxgKrnlPresentHistoryTokens.end() && iter->second == p) {
             mDxgKrnlPresentHistoryTokens.erase(iter);
         }
@@ -953,9 +1086,10 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> p)
 
     p->Completed = true;
     if (*presentIter == p) {
-        auto lock = scoped_lock(mMutex);
         while (presentIter != presentDeque.end() && presentIter->get()->Completed) {
-            mCompletedPresents.push_back(*presentIter);
+            if (!mCompletedPresents.push(CompletedFrame(**presentIter))) {
+                mDroppedPresents.fetch_add(1, std::memory_order_relaxed);
+            }
             presentDeque.pop_front();
             presentIter = presentDeque.begin();
         }
@@ -1003,17 +1137,19 @@ void PMTraceConsumer::RuntimePresentStart(PresentEvent &event)
         return;
     }
 
-    auto pEvent = std::make_shared<PresentEvent>(event);
-    mPresentByThreadId[event.RuntimeThread] = pEvent;
+    // event is moved from here on; read everything from *pEvent.
+    auto pEvent = std::make_shared<PresentEvent>(std::move(event));
+    mPresentByThreadId[pEvent->RuntimeThread] = pEvent;
 
-    auto& processMap = mPresentsByProcess[event.ProcessId];
-    processMap.emplace(event.QpcTime, pEvent);
+    auto& processMap = mPresentsByProcess[pEvent->ProcessId];
+    processMap.emplace(pEvent->QpcTime, pEvent);
 
-    auto& processSwapChainDeque = mPresentsByProcessAndSwapChain[std::make_tuple(event.ProcessId, event.SwapChainAddress)];
+    auto& processSwapChainDeque = mPresentsByProcessAndSwapChain[std::make_tuple(pEvent->ProcessId, pEvent->SwapChainAddress)];
     processSwapChainDeque.emplace_back(pEvent);
 
-    // Set the caller's local event instance to completed so the assert
-    // in ~PresentEvent() doesn't fire when it is destructed.
+    // This write to the moved-from event is deliberate: the caller still
+    // destructs it, the defaulted move left its Completed false, and the
+    // assert in ~PresentEvent() would fire.  Only *pEvent is tracked.
     event.Completed = true;
 }
 
@@ -1036,26 +1172,140 @@ void PMTraceConsumer::RuntimePresentStop(EVENT_HEADER const& hdr, bool AllowPres
     mPresentByThreadId.erase(eventIter);
 }
 
+// Whether a process event's image file name (possibly followed by its
+// terminator) is DWM's.
+static bool IsDwmImageFileName(std::string const& imageFileName)
+{
+    static char const dwm[] = "dwm.exe";
+    auto name = imageFileName.c_str();
+    for (size_t i = 0; i < sizeof(dwm); ++i) {
+        if (tolower((unsigned char) name[i]) != dwm[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void HandleNTProcessEvent(PEVENT_RECORD pEventRecord, PMTraceConsumer* pmConsumer)
 {
     NTProcessEvent event;
+    event.Timestamp = *(uint64_t*) &pEventRecord->EventHeader.TimeStamp;
 
     switch (pEventRecord->EventHeader.EventDescriptor.Opcode) {
     case EVENT_TRACE_TYPE_START:
+        if (!pmConsumer->UseProcessEventSource(PMTraceConsumer::ProcessEventSource::NT)) {
+            return;
+        }
+        // fall through
     case EVENT_TRACE_TYPE_DC_START:
         GetEventData(pEventRecord, L"ProcessId",     &event.ProcessId);
         GetEventData(pEventRecord, L"ImageFileName", &event.ImageFileName);
+        if (IsDwmImageFileName(event.ImageFileName)) {
+            pmConsumer->mDwmProcessId = event.ProcessId;
+        }
         break;
 
     case EVENT_TRACE_TYPE_END:
+        if (!pmConsumer->UseProcessEventSource(PMTraceConsumer::ProcessEventSource::NT)) {
+            return;
+        }
+        // fall through
     case EVENT_TRACE_TYPE_DC_END:
         GetEventData(pEventRecord, L"ProcessId", &event.ProcessId);
         break;
     }
 
-    {
-        auto lock = scoped_lock(pmConsumer->mNTProcessEventMutex);
-        pmConsumer->mNTProcessEvents.emplace_back(event);
+    if (!pmConsumer->mNTProcessEvents.push(std::move(event))) {
+        pmConsumer->mDroppedProcessEvents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+namespace {
+
+// The part of a UTF-16 (little-endian, possibly null-terminated) path after
+// its last backslash, as UTF-8.  Done by hand rather than with
+// WideCharToMultiByte() so captures decode the same off Windows, where
+// wchar_t isn't UTF-16.
+std::string Utf16FileNameToUtf8(std::string const& bytes)
+{
+    std::vector<uint16_t> units(bytes.size() / 2);
+    memcpy(units.data(), bytes.data(), units.size() * 2);
+    size_t end = 0;
+    while (end < units.size() && units[end] != 0) {
+        end += 1;
+    }
+    size_t begin = end;
+    while (begin > 0 && units[begin - 1] != L'\\') {
+        begin -= 1;
+    }
+
+    std::string utf8;
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t c = units[i];
+        if (c >= 0xd800 && c < 0xdc00 && i + 1 < end && units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (units[i + 1] - 0xdc00);
+            i += 1;
+        } else if (c >= 0xd800 && c < 0xe000) {
+            c = 0xfffd; // unpaired surrogate
+        }
+
+        if (c < 0x80) {
+            utf8 += (char) c;
+        } else if (c < 0x800) {
+            utf8 += (char) (0xc0 | (c >> 6));
+            utf8 += (char) (0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            utf8 += (char) (0xe0 | (c >> 12));
+            utf8 += (char) (0x80 | ((c >> 6) & 0x3f));
+            utf8 += (char) (0x80 | (c & 0x3f));
+        } else {
+            utf8 += (char) (0xf0 | (c >> 18));
+            utf8 += (char) (0x80 | ((c >> 12) & 0x3f));
+            utf8 += (char) (0x80 | ((c >> 6) & 0x3f));
+            utf8 += (char) (0x80 | (c & 0x3f));
+        }
+    }
+    return utf8;
+}
+
+}
+
+void HandleKernelProcessEvent(PEVENT_RECORD pEventRecord, PMTraceConsumer* pmConsumer)
+{
+    auto id = pEventRecord->EventHeader.EventDescriptor.Id;
+    if ((id != KernelProcess_ProcessStart && id != KernelProcess_ProcessStop) ||
+        !pmConsumer->UseProcessEventSource(PMTraceConsumer::ProcessEventSource::KernelProcess)) {
+        return;
+    }
+
+    NTProcessEvent event;
+    event.Timestamp = *(uint64_t*) &pEventRecord->EventHeader.TimeStamp;
+
+    switch (id) {
+    case KernelProcess_ProcessStart: {
+        GetEventData(pEventRecord, L"ProcessID", &event.ProcessId);
+
+        // ImageName is the full NT path, UTF-16; keep the file name, as
+        // QueryFullProcessImageName() + PathFindFileName() would give.
+        std::string bytes;
+        GetEventData(pEventRecord, L"ImageName", &bytes);
+        event.ImageFileName = Utf16FileNameToUtf8(bytes);
+        if (event.ImageFileName.empty()) {
+            event.ImageFileName = "<error>";
+        } else if (IsDwmImageFileName(event.ImageFileName)) {
+            pmConsumer->mDwmProcessId = event.ProcessId;
+        }
+        break;
+    }
+    case KernelProcess_ProcessStop:
+        GetEventData(pEventRecord, L"ProcessID", &event.ProcessId);
+        break;
+    default:
+        return;
+    }
+
+    if (!pmConsumer->mNTProcessEvents.push(std::move(event))) {
+        pmConsumer->mDroppedProcessEvents.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
@@ -22,48 +22,92 @@ SOFTWARE.
 
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <set>
+#include <type_traits>
 #include <vector>
-#include <windows.h>
-#include <evntcons.h> // must include after windows.h
-
-struct __declspec(uuid("{CA11C036-0102-4A2D-A6AD-F03CFED5D3C9}")) DXGI_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{802ec45a-1e99-4b83-9920-87c98277ba9d}")) DXGKRNL_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{8c416c79-d49b-4f01-a467-e56d3aa8234c}")) WIN32K_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{9e9bba3c-2e38-40cb-99f4-9e8281425164}")) DWM_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{783ACA0A-790E-4d7f-8451-AA850511C6B9}")) D3D9_PROVIDER_GUID_HOLDER;
-struct __declspec(uuid("{3d6fa8d0-fe05-11d0-9dda-00c04fd7ba7c}")) NT_PROCESS_EVENT_GUID_HOLDER;
-static const auto DXGI_PROVIDER_GUID = __uuidof(DXGI_PROVIDER_GUID_HOLDER);
-static const auto DXGKRNL_PROVIDER_GUID = __uuidof(DXGKRNL_PROVIDER_GUID_HOLDER);
-static const auto WIN32K_PROVIDER_GUID = __uuidof(WIN32K_PROVIDER_GUID_HOLDER);
-static const auto DWM_PROVIDER_GUID = __uuidof(DWM_PROVIDER_GUID_HOLDER);
-static const auto D3D9_PROVIDER_GUID = __uuidof(D3D9_PROVIDER_GUID_HOLDER);
-static const auto NT_PROCESS_EVENT_GUID = __uuidof(NT_PROCESS_EVENT_GUID_HOLDER);
+
+#include "EventRecord.hpp"
+#include "../Utils/inc/seqlock.h"
+#include "../Utils/inc/spsc_queue.h"
+
+static const GUID DXGI_PROVIDER_GUID = { 0xca11c036, 0x0102, 0x4a2d, { 0xa6, 0xad, 0xf0, 0x3c, 0xfe, 0xd5, 0xd3, 0xc9 } };
+static const GUID DXGKRNL_PROVIDER_GUID = { 0x802ec45a, 0x1e99, 0x4b83, { 0x99, 0x20, 0x87, 0xc9, 0x82, 0x77, 0xba, 0x9d } };
+static const GUID WIN32K_PROVIDER_GUID = { 0x8c416c79, 0xd49b, 0x4f01, { 0xa4, 0x67, 0xe5, 0x6d, 0x3a, 0xa8, 0x23, 0x4c } };
+static const GUID DWM_PROVIDER_GUID = { 0x9e9bba3c, 0x2e38, 0x40cb, { 0x99, 0xf4, 0x9e, 0x82, 0x81, 0x42, 0x51, 0x64 } };
+static const GUID D3D9_PROVIDER_GUID = { 0x783aca0a, 0x790e, 0x4d7f, { 0x84, 0x51, 0xaa, 0x85, 0x05, 0x11, 0xc6, 0xb9 } };
+static const GUID NT_PROCESS_EVENT_GUID = { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+static const GUID KERNEL_PROCESS_PROVIDER_GUID = { 0x22fb2cd6, 0x0e7b, 0x422b, { 0xa0, 0xc7, 0x2f, 0xad, 0x1f, 0xd0, 0xe7, 0x16 } };
 
 // These are only for Win7 support
 namespace Win7
 {
-    struct __declspec(uuid("{65cd4c8a-0848-4583-92a0-31c0fbaf00c0}")) DXGKRNL_PROVIDER_GUID_HOLDER;
-    struct __declspec(uuid("{069f67f2-c380-4a65-8a61-071cd4a87275}")) DXGKBLT_GUID_HOLDER;
-    struct __declspec(uuid("{22412531-670b-4cd3-81d1-e709c154ae3d}")) DXGKFLIP_GUID_HOLDER;
-    struct __declspec(uuid("{c19f763a-c0c1-479d-9f74-22abfc3a5f0a}")) DXGKPRESENTHISTORY_GUID_HOLDER;
-    struct __declspec(uuid("{295e0d8e-51ec-43b8-9cc6-9f79331d27d6}")) DXGKQUEUEPACKET_GUID_HOLDER;
-    struct __declspec(uuid("{5ccf1378-6b2c-4c0f-bd56-8eeb9e4c5c77}")) DXGKVSYNCDPC_GUID_HOLDER;
-    struct __declspec(uuid("{547820fe-5666-4b41-93dc-6cfd5dea28cc}")) DXGKMMIOFLIP_GUID_HOLDER;
-    struct __declspec(uuid("{8c9dd1ad-e6e5-4b07-b455-684a9d879900}")) DWM_PROVIDER_GUID_HOLDER;
-    static const auto DXGKRNL_PROVIDER_GUID = __uuidof(DXGKRNL_PROVIDER_GUID_HOLDER);
-    static const auto DXGKBLT_GUID = __uuidof(DXGKBLT_GUID_HOLDER);
-    static const auto DXGKFLIP_GUID = __uuidof(DXGKFLIP_GUID_HOLDER);
-    static const auto DXGKPRESENTHISTORY_GUID = __uuidof(DXGKPRESENTHISTORY_GUID_HOLDER);
-    static const auto DXGKQUEUEPACKET_GUID = __uuidof(DXGKQUEUEPACKET_GUID_HOLDER);
-    static const auto DXGKVSYNCDPC_GUID = __uuidof(DXGKVSYNCDPC_GUID_HOLDER);
-    static const auto DXGKMMIOFLIP_GUID = __uuidof(DXGKMMIOFLIP_GUID_HOLDER);
-    static const auto DWM_PROVIDER_GUID = __uuidof(DWM_PROVIDER_GUID_HOLDER);
+    static const GUID DXGKRNL_PROVIDER_GUID = { 0x65cd4c8a, 0x0848, 0x4583, { 0x92, 0xa0, 0x31, 0xc0, 0xfb, 0xaf, 0x00, 0xc0 } };
+    static const GUID DXGKBLT_GUID = { 0x069f67f2, 0xc380, 0x4a65, { 0x8a, 0x61, 0x07, 0x1c, 0xd4, 0xa8, 0x72, 0x75 } };
+    static const GUID DXGKFLIP_GUID = { 0x22412531, 0x670b, 0x4cd3, { 0x81, 0xd1, 0xe7, 0x09, 0xc1, 0x54, 0xae, 0x3d } };
+    static const GUID DXGKPRESENTHISTORY_GUID = { 0xc19f763a, 0xc0c1, 0x479d, { 0x9f, 0x74, 0x22, 0xab, 0xfc, 0x3a, 0x5f, 0x0a } };
+    static const GUID DXGKQUEUEPACKET_GUID = { 0x295e0d8e, 0x51ec, 0x43b8, { 0x9c, 0xc6, 0x9f, 0x79, 0x33, 0x1d, 0x27, 0xd6 } };
+    static const GUID DXGKVSYNCDPC_GUID = { 0x5ccf1378, 0x6b2c, 0x4c0f, { 0xbd, 0x56, 0x8e, 0xeb, 0x9e, 0x4c, 0x5c, 0x77 } };
+    static const GUID DXGKMMIOFLIP_GUID = { 0x547820fe, 0x5666, 0x4b41, { 0x93, 0xdc, 0x6c, 0xfd, 0x5d, 0xea, 0x28, 0xcc } };
+    static const GUID DWM_PROVIDER_GUID = { 0x8c9dd1ad, 0xe6e5, 0x4b07, { 0xb4, 0x55, 0x68, 0x4a, 0x9d, 0x87, 0x99, 0x00 } };
+};
+
+// Event ids handled for each of the manifest-based providers above.
+enum {
+    DXGIPresent_Start = 42,
+    DXGIPresent_Stop,
+    DXGIPresentMPO_Start = 55,
+    DXGIPresentMPO_Stop = 56,
+};
+
+enum {
+    D3D9PresentStart = 1,
+    D3D9PresentStop,
+};
+
+enum {
+    DxgKrnl_Flip = 168,
+    DxgKrnl_FlipMPO = 252,
+    DxgKrnl_QueueSubmit = 178,
+    DxgKrnl_QueueComplete = 180,
+    DxgKrnl_MMIOFlip = 116,
+    DxgKrnl_MMIOFlipMPO = 259,
+    DxgKrnl_HSyncDPC = 382,
+    DxgKrnl_VSyncDPC = 17,
+    DxgKrnl_Present = 184,
+    DxgKrnl_PresentHistoryDetailed = 215,
+    DxgKrnl_SubmitPresentHistory = 171,
+    DxgKrnl_PropagatePresentHistory = 172,
+    DxgKrnl_Blit = 166,
+};
+
+// Microsoft-Windows-Kernel-Process; unlike the classic NT process events it
+// can be enabled in a regular realtime session.
+enum {
+    KERNEL_PROCESS_KEYWORD_PROCESS = 0x10,
+    KernelProcess_ProcessStart = 1,
+    KernelProcess_ProcessStop = 2,
+};
+
+enum {
+    Win32K_TokenCompositionSurfaceObject = 201,
+    Win32K_TokenStateChanged = 301,
+};
+
+enum {
+    DWM_GetPresentHistory = 64,
+    DWM_Schedule_Present_Start = 15,
+    DWM_FlipChain_Pending = 69,
+    DWM_FlipChain_Complete = 70,
+    DWM_FlipChain_Dirty = 101,
+    DWM_Schedule_SurfaceUpdate = 196,
 };
 
 // Forward-declare structs that will be used by both modern and legacy dxgkrnl events.
@@ -81,7 +125,7 @@ template <typename mutex_t> std::unique_lock<mutex_t> scoped_lock(mutex_t &m)
     return std::unique_lock<mutex_t>(m);
 }
 
-enum class PresentMode
+enum class PresentMode : uint8_t
 {
     Unknown,
     Hardware_Legacy_Flip,
@@ -95,12 +139,12 @@ enum class PresentMode
     Hardware_Composed_Independent_Flip,
 };
 
-enum class PresentResult
+enum class PresentResult : uint8_t
 {
     Unknown, Presented, Discarded, Error
 };
 
-enum class Runtime
+enum class Runtime : uint8_t
 {
     DXGI, D3D9, Other
 };
@@ -108,25 +152,24 @@ enum class Runtime
 struct NTProcessEvent {
     uint32_t ProcessId;
     std::string ImageFileName;  // If ImageFileName.empty(), then event is that process ending
+    uint64_t Timestamp;
+};
+
+struct PresentEvent;
+
+// State only needed by windowed and DWM presents, allocated on first use.
+struct PresentEventCold {
+    uint64_t Hwnd = 0;
+    uint64_t TokenPtr = 0;
+    std::deque<std::shared_ptr<PresentEvent>> DependentPresents;
 };
 
+// Fields are ordered by size so the struct packs without padding holes; the
+// flags are bitfields sharing a single byte.
 struct PresentEvent {
     // Available from DXGI Present
     uint64_t QpcTime;
     uint64_t SwapChainAddress;
-    int32_t SyncInterval;
-    uint32_t PresentFlags;
-    uint32_t ProcessId;
-
-    PresentMode PresentMode;
-    bool SupportsTearing;
-    bool MMIO;
-    bool SeenDxgkPresent;
-    bool SeenWin32KEvents;
-    bool WasBatched;
-    bool DwmNotified;
-
-    Runtime Runtime;
 
     // Time spent in DXGI Present call
     uint64_t TimeTaken;
@@ -136,33 +179,120 @@ struct PresentEvent {
 
     // Timestamp of "complete" state (data on screen or discarded)
     uint64_t ScreenTime;
-    PresentResult FinalState;
+
+    int32_t SyncInterval;
+    uint32_t PresentFlags;
+    uint32_t ProcessId;
     uint32_t PlaneIndex;
 
     // Additional transient state
     uint32_t QueueSubmitSequence;
     uint32_t RuntimeThread;
-    uint64_t Hwnd;
-    uint64_t TokenPtr;
-    std::deque<std::shared_ptr<PresentEvent>> DependentPresents;
-    bool Completed;
+
+    ::PresentMode PresentMode;
+    PresentResult FinalState;
+    ::Runtime Runtime;
+
+    bool SupportsTearing : 1;
+    bool MMIO : 1;
+    bool SeenDxgkPresent : 1;
+    bool SeenWin32KEvents : 1;
+    bool WasBatched : 1;
+    bool DwmNotified : 1;
+    bool Completed : 1;
+
+    std::unique_ptr<PresentEventCold> mCold;
 
     PresentEvent(EVENT_HEADER const& hdr, ::Runtime runtime);
+    PresentEvent(PresentEvent&& other) = default;
     ~PresentEvent();
+
+    PresentEventCold& Cold()
+    {
+        if (!mCold) {
+            mCold.reset(new PresentEventCold);
+        }
+        return *mCold;
+    }
+    uint64_t GetHwnd() const { return mCold ? mCold->Hwnd : 0; }
+    uint64_t GetTokenPtr() const { return mCold ? mCold->TokenPtr : 0; }
+};
+
+static_assert(sizeof(PresentEvent) <= 80, "PresentEvent hot fields grew");
+
+// The part of a completed PresentEvent that the consumer thread needs.  This
+// is what gets handed off and stored in the swapchain histories, so it is kept
+// trivially copyable and within a cache line.
+struct CompletedFrame {
+    uint64_t QpcTime;
+    uint64_t SwapChainAddress;
+    uint64_t TimeTaken;
+    uint64_t ReadyTime;
+    uint64_t ScreenTime;
+    uint32_t ProcessId;
+    int32_t SyncInterval;
+    uint32_t PresentFlags;
+    uint32_t PlaneIndex;
+    ::PresentMode PresentMode;
+    PresentResult FinalState;
+    ::Runtime Runtime;
+    bool SupportsTearing;
+    bool MMIO;
+    bool WasBatched;
+    bool DwmNotified;
+
+    CompletedFrame() = default;
+    explicit CompletedFrame(PresentEvent const& p);
+};
+
+static_assert(std::is_trivially_copyable<CompletedFrame>::value, "CompletedFrame must be trivially copyable");
+static_assert(sizeof(CompletedFrame) <= 64, "CompletedFrame should fit in a cache line");
+
+// Refresh cadence of one display (VidPn target), from its VSyncDPC events.
+struct DisplayRefresh {
+    uint64_t LastFrameQpc;
+    uint64_t VsyncCount;        // vsyncs counted since first seen, from FrameNumber
+    double PeriodTicks;         // smoothed QPC ticks per vsync
+    uint32_t VidPnTargetId;
+    uint32_t LastFrameNumber;
 };
 
 struct PMTraceConsumer
 {
-    PMTraceConsumer(bool simple) : mSimpleMode(simple) { }
+    enum {
+        COMPLETED_PRESENT_QUEUE_SIZE = 1 << 14,
+        PROCESS_EVENT_QUEUE_SIZE = 1 << 10,
+    };
+
+    PMTraceConsumer(bool simple)
+        : mSimpleMode(simple)
+        , mCompletedPresents(COMPLETED_PRESENT_QUEUE_SIZE)
+        , mDroppedPresents(0)
+        , mNTProcessEvents(PROCESS_EVENT_QUEUE_SIZE)
+        , mDroppedProcessEvents(0)
+    { }
     ~PMTraceConsumer();
 
     bool mSimpleMode;
 
-    std::mutex mMutex;
+    // When non-zero, only this process's presents (and DWM's, which windowed
+    // presents complete through) are tracked: kernel events raised on any
+    // other process's present path are dropped before they are decoded.
+    uint32_t mTargetProcessId = 0;
+    uint32_t mDwmProcessId = 0; // seeded by the caller, then learned from DWM's events and process starts
+
+    bool IsTrackedProcess(uint32_t processId) const
+    {
+        return mTargetProcessId == 0 || processId == mTargetProcessId || processId == mDwmProcessId;
+    }
+
     // A set of presents that are "completed":
     // They progressed as far as they can through the pipeline before being either discarded or hitting the screen.
-    // These will be handed off to the consumer thread.
-    std::vector<std::shared_ptr<PresentEvent>> mCompletedPresents;
+    // These will be handed off to the consumer thread.  The ETW thread is the
+    // only producer and never waits on the consumer: if the queue is full the
+    // present is dropped and counted in mDroppedPresents.
+    SPSCQueue<CompletedFrame> mCompletedPresents;
+    std::atomic<uint64_t> mDroppedPresents;
 
     // A high-level description of the sequence of events for each present type, ignoring runtime end:
     // Hardware Legacy Flip:
@@ -240,32 +370,73 @@ struct PMTraceConsumer
     // Yet another unique way of tracking present history tokens, this time from DxgKrnl -> DWM, only for legacy blit
     std::map<uint64_t, std::shared_ptr<PresentEvent>> mPresentsByLegacyBlitToken;
 
-    // Process events
-    std::mutex mNTProcessEventMutex;
-    std::vector<NTProcessEvent> mNTProcessEvents;
+    // Process events, handed off the same way as mCompletedPresents
+    SPSCQueue<NTProcessEvent> mNTProcessEvents;
+    std::atomic<uint64_t> mDroppedProcessEvents;
 
-    bool DequeueProcessEvents(std::vector<NTProcessEvent>& outProcessEvents)
+    // Live process starts and ends are taken from a single provider: with
+    // both the NT process events and Kernel-Process enabled, every process
+    // would otherwise start twice, at slightly different times, and look
+    // like a reused process id.  The first provider to deliver one is used.
+    // The NT rundown (DC_START/DC_END) has no Kernel-Process counterpart
+    // and is always used.
+    enum class ProcessEventSource : uint8_t { Unknown, NT, KernelProcess };
+    ProcessEventSource mProcessEventSource = ProcessEventSource::Unknown;
+
+    bool UseProcessEventSource(ProcessEventSource source)
     {
-        if (mNTProcessEvents.empty()) {
-            return false;
+        if (mProcessEventSource == ProcessEventSource::Unknown) {
+            mProcessEventSource = source;
         }
+        return mProcessEventSource == source;
+    }
 
-        auto lock = scoped_lock(mNTProcessEventMutex);
-        outProcessEvents.swap(mNTProcessEvents);
-        return true;
+    // The Dequeue functions append to the output vector and must only be
+    // called from a single consumer thread.
+    bool DequeueProcessEvents(std::vector<NTProcessEvent>& outProcessEvents)
+    {
+        auto count = outProcessEvents.size();
+        NTProcessEvent event;
+        while (mNTProcessEvents.pop(event)) {
+            outProcessEvents.emplace_back(std::move(event));
+        }
+        return outProcessEvents.size() != count;
     }
 
-    bool DequeuePresents(std::vector<std::shared_ptr<PresentEvent>>& outPresents)
+    bool DequeuePresents(std::vector<CompletedFrame>& outPresents)
     {
-        if (mCompletedPresents.empty()) {
-            return false;
+        auto count = outPresents.size();
+        CompletedFrame p;
+        while (mCompletedPresents.pop(p)) {
+            outPresents.push_back(p);
         }
+        return outPresents.size() != count;
+    }
+
+    uint64_t GetDroppedPresentCount() const { return mDroppedPresents.load(std::memory_order_relaxed); }
+    uint64_t GetDroppedProcessEventCount() const { return mDroppedProcessEvents.load(std::memory_order_relaxed); }
 
-        auto lock = scoped_lock(mMutex);
-        outPresents.swap(mCompletedPresents);
-        return true;
+    // How full the completed present queue is, 0..1 (approximate).
+    double GetQueueBacklog() const { return (double) mCompletedPresents.size() / mCompletedPresents.capacity(); }
+
+    // Replaces outDisplays with the displays seen so far (up to
+    // MAX_DISPLAYS), by VidPnTargetId.  Safe to call from any thread.
+    void GetDisplayRefresh(std::vector<DisplayRefresh>& outDisplays) const
+    {
+        mPublishedDisplays.load(&outDisplays);
+        std::sort(outDisplays.begin(), outDisplays.end(), [](DisplayRefresh const& a, DisplayRefresh const& b) {
+            return a.VidPnTargetId < b.VidPnTargetId;
+        });
     }
 
+    // mDisplays, in the order the displays were first seen, belongs to the
+    // thread handling events; every update is also published to
+    // mPublishedDisplays, so a VSyncDPC never waits on GetDisplayRefresh().
+    enum { MAX_DISPLAYS = 16 };
+    std::vector<DisplayRefresh> mDisplays;
+    SeqlockArray<DisplayRefresh, MAX_DISPLAYS> mPublishedDisplays;
+    void UpdateDisplayRefresh(uint32_t vidPnTargetId, uint32_t frameNumber, uint64_t frameQpc);
+
     void HandleDxgkBlt(DxgkBltEventArgs& args);
     void HandleDxgkFlip(DxgkFlipEventArgs& args);
     void HandleDxgkQueueSubmit(DxgkQueueSubmitEventArgs& args);
@@ -281,7 +452,10 @@ struct PMTraceConsumer
     void RuntimePresentStop(EVENT_HEADER const& hdr, bool AllowPresentBatching);
 };
 
+typedef void (*PMEventHandlerFn)(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
+
 void HandleNTProcessEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
+void HandleKernelProcessEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
 void HandleDXGIEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
 void HandleD3D9Event(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
 void HandleDXGKEvent(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer);
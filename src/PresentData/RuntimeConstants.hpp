@@ -0,0 +1,51 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+// The D3D9 and DXGI Present() flags and results the runtime event handlers
+// look at, from the SDK headers on Windows and defined here elsewhere.
+
+#ifdef _WIN32
+
+#include <d3d9.h>
+#include <dxgi.h>
+
+#else
+
+#define DXGI_PRESENT_TEST                       0x00000001
+#define DXGI_PRESENT_DO_NOT_SEQUENCE            0x00000002
+#define DXGI_PRESENT_RESTART                    0x00000004
+#define DXGI_PRESENT_DO_NOT_WAIT                0x00000008
+
+#define DXGI_STATUS_OCCLUDED                    ((HRESULT) 0x087A0001)
+#define DXGI_STATUS_NO_DESKTOP_ACCESS           ((HRESULT) 0x087A0005)
+#define DXGI_STATUS_MODE_CHANGE_IN_PROGRESS     ((HRESULT) 0x087A0008)
+
+#define D3DPRESENT_DONOTWAIT                    0x00000001
+#define D3DPRESENT_DONOTFLIP                    0x00000004
+#define D3DPRESENT_FLIPRESTART                  0x00000008
+#define D3DPRESENT_FORCEIMMEDIATE               0x00000100
+
+#define S_PRESENT_OCCLUDED                      ((HRESULT) 0x08760878)
+
+#endif
@@ -0,0 +1,176 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include "RuntimeTraceConsumer.hpp"
+#include "RuntimeConstants.hpp"
+
+namespace {
+
+// Present_Start for both runtimes begins with the swapchain pointer followed
+// by a 32-bit Flags field, and Present_Stop with the 32-bit Result.  Reading
+// them straight out of UserData avoids a TDH lookup per present; the
+// pointer size is that of the presenting process.  flags may be null.
+bool ReadPresentStartFields(EVENT_RECORD const* pEventRecord, uint64_t* swapChainAddress, uint32_t* flags)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    auto ptrSize = (hdr.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0 ? 4u : 8u;
+    if (pEventRecord->UserDataLength < ptrSize + (flags == nullptr ? 0 : sizeof(uint32_t))) {
+        return false;
+    }
+
+    auto data = (uint8_t const*) pEventRecord->UserData;
+    if (ptrSize == 4) {
+        uint32_t ptr = 0;
+        memcpy(&ptr, data, sizeof(ptr));
+        *swapChainAddress = ptr;
+    } else {
+        memcpy(swapChainAddress, data, sizeof(uint64_t));
+    }
+    if (flags != nullptr) {
+        memcpy(flags, data + ptrSize, sizeof(uint32_t));
+    }
+    return true;
+}
+
+bool ReadPresentStopResult(EVENT_RECORD const* pEventRecord, uint32_t* result)
+{
+    if (pEventRecord->UserDataLength < sizeof(uint32_t)) {
+        return false;
+    }
+    memcpy(result, pEventRecord->UserData, sizeof(uint32_t));
+    return true;
+}
+
+}
+
+void RuntimeTraceConsumer::PresentStart(EVENT_HEADER const& hdr, uint64_t swapChainAddress)
+{
+    auto& inFlight = mPresentByThreadId[hdr.ThreadId];
+    inFlight.SwapChainAddress = swapChainAddress;
+    inFlight.QpcTime = *(uint64_t*) &hdr.TimeStamp;
+}
+
+void RuntimeTraceConsumer::PresentStop(EVENT_HEADER const& hdr, bool presented)
+{
+    auto eventIter = mPresentByThreadId.find(hdr.ThreadId);
+    if (eventIter == mPresentByThreadId.end()) {
+        return;
+    }
+
+    RuntimePresent present;
+    present.SwapChainAddress = eventIter->second.SwapChainAddress;
+    present.ProcessId = hdr.ProcessId;
+    present.QpcTime = eventIter->second.QpcTime;
+    present.TimeTaken = *(uint64_t*) &hdr.TimeStamp - present.QpcTime;
+    mPresentByThreadId.erase(eventIter);
+
+    if (mTimeoutTicks != 0 && present.QpcTime >= mNextPruneQpc) {
+        Prune(present.QpcTime);
+    }
+    if (!presented) {
+        return;
+    }
+
+    auto& lastQpc = mLastQpcByProcessAndSwapChain[std::make_pair(present.ProcessId, present.SwapChainAddress)];
+    present.PrevQpcTime = lastQpc;
+    lastQpc = present.QpcTime;
+
+    if (!mCompletedPresents.push(present)) {
+        mDroppedPresents.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Forgets swapchains, and presents whose Present_Stop never came, idle for
+// the timeout.  Runs at most once per timeout period.
+void RuntimeTraceConsumer::Prune(uint64_t now)
+{
+    auto cutoff = now > mTimeoutTicks ? now - mTimeoutTicks : 0;
+    for (auto ii = mLastQpcByProcessAndSwapChain.begin(); ii != mLastQpcByProcessAndSwapChain.end(); ) {
+        ii = ii->second < cutoff ? mLastQpcByProcessAndSwapChain.erase(ii) : std::next(ii);
+    }
+    for (auto ii = mPresentByThreadId.begin(); ii != mPresentByThreadId.end(); ) {
+        ii = ii->second.QpcTime < cutoff ? mPresentByThreadId.erase(ii) : std::next(ii);
+    }
+    mNextPruneQpc = now + mTimeoutTicks;
+}
+
+void HandleRuntimeDXGIEvent(EVENT_RECORD* pEventRecord, RuntimeTraceConsumer* rtConsumer)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    if (!rtConsumer->IsTarget(hdr.ProcessId)) {
+        return;
+    }
+
+    switch (hdr.EventDescriptor.Id)
+    {
+    case DXGIPresent_Start:
+    case DXGIPresentMPO_Start:
+    {
+        uint64_t swapChainAddress = 0;
+        uint32_t flags = 0;
+        // Ignore PRESENT_TEST: it's just to check if you're still fullscreen
+        if (ReadPresentStartFields(pEventRecord, &swapChainAddress, &flags) && (flags & DXGI_PRESENT_TEST) == 0) {
+            rtConsumer->PresentStart(hdr, swapChainAddress);
+        }
+        break;
+    }
+    case DXGIPresent_Stop:
+    case DXGIPresentMPO_Stop:
+    {
+        // As in HandleDXGIEvent(), these results mean nothing was presented.
+        uint32_t result = 0;
+        bool presented = ReadPresentStopResult(pEventRecord, &result) &&
+            SUCCEEDED(result) && result != DXGI_STATUS_OCCLUDED && result != DXGI_STATUS_MODE_CHANGE_IN_PROGRESS && result != DXGI_STATUS_NO_DESKTOP_ACCESS;
+        rtConsumer->PresentStop(hdr, presented);
+        break;
+    }
+    }
+}
+
+void HandleRuntimeD3D9Event(EVENT_RECORD* pEventRecord, RuntimeTraceConsumer* rtConsumer)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    if (!rtConsumer->IsTarget(hdr.ProcessId)) {
+        return;
+    }
+
+    switch (hdr.EventDescriptor.Id)
+    {
+    case D3D9PresentStart:
+    {
+        uint64_t swapChainAddress = 0;
+        if (ReadPresentStartFields(pEventRecord, &swapChainAddress, nullptr)) {
+            rtConsumer->PresentStart(hdr, swapChainAddress);
+        }
+        break;
+    }
+    case D3D9PresentStop:
+    {
+        uint32_t result = 0;
+        bool presented = ReadPresentStopResult(pEventRecord, &result) && SUCCEEDED(result) && result != S_PRESENT_OCCLUDED;
+        rtConsumer->PresentStop(hdr, presented);
+        break;
+    }
+    }
+}
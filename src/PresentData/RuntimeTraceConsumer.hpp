@@ -0,0 +1,113 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "PresentMonTraceConsumer.hpp"
+
+// A runtime present as seen by RuntimeTraceConsumer: only the Present() call
+// itself is known, not when (or whether) it reached the screen.
+struct RuntimePresent {
+    uint64_t SwapChainAddress;
+    uint32_t ProcessId;
+    uint64_t QpcTime;          // Present start
+    uint64_t PrevQpcTime;      // Previous present start on the same swapchain, 0 for the first one
+    uint64_t TimeTaken;        // Time spent in the Present() call
+};
+
+// Lightweight alternative to PMTraceConsumer for captures that only need
+// FPS and TimeTaken.  It is fed by the DXGI and D3D9 runtime providers only,
+// so no DxgKrnl/Win32K/DWM events are enabled or decoded.  The only state
+// kept is the in-flight present for each thread and the last present start
+// for each swapchain; swapchains that haven't presented for
+// SWAPCHAIN_TIMEOUT_SECONDS are forgotten.
+//
+// Presents that failed or were occluded (see the Present_Stop Result) are
+// not reported, and don't count as the previous present of the next one.
+struct RuntimeTraceConsumer
+{
+    enum {
+        COMPLETED_PRESENT_QUEUE_SIZE = 1 << 14,
+        SWAPCHAIN_TIMEOUT_SECONDS = 10,
+    };
+
+    explicit RuntimeTraceConsumer(uint32_t targetPid)
+        : mTargetPid(targetPid)
+        , mCompletedPresents(COMPLETED_PRESENT_QUEUE_SIZE)
+        , mDroppedPresents(0)
+    { }
+
+    // Enables the expiry of idle swapchains; call before the first event.
+    void SetQpcFrequency(int64_t qpcFrequency) { mTimeoutTicks = (uint64_t) qpcFrequency * SWAPCHAIN_TIMEOUT_SECONDS; }
+
+    void PresentStart(EVENT_HEADER const& hdr, uint64_t swapChainAddress);
+    void PresentStop(EVENT_HEADER const& hdr, bool presented);
+
+    // Appends to outPresents; single consumer thread only.
+    bool DequeuePresents(std::vector<RuntimePresent>& outPresents)
+    {
+        auto count = outPresents.size();
+        RuntimePresent p;
+        while (mCompletedPresents.pop(p)) {
+            outPresents.push_back(p);
+        }
+        return outPresents.size() != count;
+    }
+
+    uint64_t GetDroppedPresentCount() const { return mDroppedPresents.load(std::memory_order_relaxed); }
+
+    // How full the completed present queue is, 0..1 (approximate).
+    double GetQueueBacklog() const { return (double) mCompletedPresents.size() / mCompletedPresents.capacity(); }
+
+    bool IsTarget(uint32_t processId) const
+    {
+        return mTargetPid == 0 || mTargetPid == processId;
+    }
+
+    size_t GetTrackedSwapChainCount() const { return mLastQpcByProcessAndSwapChain.size(); }
+
+private:
+    struct InFlightPresent {
+        uint64_t SwapChainAddress;
+        uint64_t QpcTime;
+    };
+
+    void Prune(uint64_t now);
+
+    uint32_t mTargetPid;
+    std::map<uint32_t, InFlightPresent> mPresentByThreadId;
+    std::map<std::pair<uint32_t, uint64_t>, uint64_t> mLastQpcByProcessAndSwapChain;
+    uint64_t mTimeoutTicks = 0;  // 0 until SetQpcFrequency()
+    uint64_t mNextPruneQpc = 0;
+
+    SPSCQueue<RuntimePresent> mCompletedPresents;
+    std::atomic<uint64_t> mDroppedPresents;
+};
+
+void HandleRuntimeDXGIEvent(EVENT_RECORD* pEventRecord, RuntimeTraceConsumer* rtConsumer);
+void HandleRuntimeD3D9Event(EVENT_RECORD* pEventRecord, RuntimeTraceConsumer* rtConsumer);
@@ -0,0 +1,606 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define NOMINMAX
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <tuple>
+#include <unordered_map>
+
+#include "ShardedTraceConsumer.hpp"
+#include "DxgkrnlEventStructs.hpp"
+#include "TraceConsumer.hpp"
+
+namespace {
+
+// The correlation keys read on the ETW thread; each enum indexes the list
+// below it.
+enum { QueueSubmit_PacketType, QueueSubmit_SubmitSequence, QueueSubmit_bPresent };
+EventFieldList const QueueSubmitKeyFields = { L"PacketType", L"SubmitSequence", L"bPresent" };
+
+enum { QueueComplete_SubmitSequence };
+EventFieldList const QueueCompleteKeyFields = { L"SubmitSequence" };
+
+enum { MMIOFlip_FlipSubmitSequence };
+EventFieldList const MMIOFlipKeyFields = { L"FlipSubmitSequence" };
+
+enum { HSyncDPC_FlipEntryCount, HSyncDPC_FlipSubmitSequence };
+EventFieldList const HSyncDPCKeyFields = { L"FlipEntryCount", L"FlipSubmitSequence" };
+
+enum { VSyncDPC_FlipFenceId };
+EventFieldList const VSyncDPCKeyFields = { L"FlipFenceId" };
+
+enum { PresentHistory_Token, PresentHistory_TokenData };
+EventFieldList const PresentHistoryKeyFields = { L"Token", L"TokenData" };
+
+enum { PropagatePresentHistory_Token };
+EventFieldList const PropagatePresentHistoryKeyFields = { L"Token" };
+
+enum { TokenCompositionSurfaceObject_CompositionSurfaceLuid, TokenCompositionSurfaceObject_PresentCount, TokenCompositionSurfaceObject_BindId };
+EventFieldList const TokenCompositionSurfaceObjectKeyFields = { L"CompositionSurfaceLuid", L"PresentCount", L"BindId" };
+
+enum { TokenStateChanged_CompositionSurfaceLuid, TokenStateChanged_PresentCount, TokenStateChanged_BindId };
+EventFieldList const TokenStateChangedKeyFields = { L"CompositionSurfaceLuid", L"PresentCount", L"BindId" };
+
+enum { DwmFlipChain_ulFlipChain, DwmFlipChain_ulSerialNumber };
+EventFieldList const DwmFlipChainKeyFields = { L"ulFlipChain", L"ulSerialNumber" };
+
+enum { DwmSurfaceUpdate_luidSurface, DwmSurfaceUpdate_PresentCount, DwmSurfaceUpdate_bindId };
+EventFieldList const DwmSurfaceUpdateKeyFields = { L"luidSurface", L"PresentCount", L"bindId" };
+
+struct Win32KTokenHash {
+    size_t operator()(PMTraceConsumer::Win32KPresentHistoryTokenKey const& key) const
+    {
+        std::hash<uint64_t> h;
+        return h(std::get<0>(key)) ^ (h(std::get<1>(key)) * 31) ^ (h(std::get<2>(key)) * 131);
+    }
+};
+
+// Which shard registered each key.  Keys are forgotten oldest first once
+// capacity is reached, well after any present using them has completed or
+// been dropped by the shard.
+template <typename Key, typename Hash = std::hash<Key>>
+class KeyDirectory {
+public:
+    enum { CAPACITY = 1 << 16 };
+
+    void Set(Key const& key, uint32_t shard)
+    {
+        auto& entry = mShards[key];
+        entry.first = shard;
+        entry.second = ++mSerial;
+        mOrder.emplace_back(key, mSerial);
+        if (mOrder.size() > CAPACITY) {
+            auto ii = mShards.find(mOrder.front().first);
+            if (ii != mShards.end() && ii->second.second == mOrder.front().second) {
+                mShards.erase(ii);
+            }
+            mOrder.pop_front();
+        }
+    }
+
+    // Returns the shard that registered key, or fallback if none did.
+    uint32_t Find(Key const& key, uint32_t fallback) const
+    {
+        auto ii = mShards.find(key);
+        return ii == mShards.end() ? fallback : ii->second.first;
+    }
+
+private:
+    std::unordered_map<Key, std::pair<uint32_t, uint64_t>, Hash> mShards; // shard, serial
+    std::deque<std::pair<Key, uint64_t>> mOrder;
+    uint64_t mSerial = 0;
+};
+
+}
+
+struct ShardedPMTraceConsumer::Directory {
+    KeyDirectory<uint32_t> mSubmitSequences;
+    KeyDirectory<uint64_t> mTokens; // DxgKrnl present history tokens and legacy blit token data
+    KeyDirectory<PMTraceConsumer::Win32KPresentHistoryTokenKey, Win32KTokenHash> mWin32KTokens;
+};
+
+void QueuedEvent::Assign(EVENT_RECORD const& record)
+{
+    Header = record.EventHeader;
+    BufferContext = record.BufferContext;
+    UserDataLength = record.UserDataLength;
+    if (UserDataLength > INLINE_DATA_SIZE) {
+        HeapData.reset(new uint8_t[UserDataLength]);
+    } else {
+        HeapData.reset();
+    }
+    memcpy(UserData(), record.UserData, UserDataLength);
+
+    ExtendedItems.assign(record.ExtendedData, record.ExtendedData + record.ExtendedDataCount);
+    ExtendedData.clear();
+    for (auto const& item : ExtendedItems) {
+        auto data = (uint8_t const*) item.DataPtr;
+        ExtendedData.insert(ExtendedData.end(), data, data + item.DataSize);
+    }
+}
+
+void QueuedEvent::ToRecord(EVENT_RECORD* record)
+{
+    memset(record, 0, sizeof(*record));
+    record->EventHeader = Header;
+    record->BufferContext = BufferContext;
+    record->UserDataLength = UserDataLength;
+    record->UserData = UserData();
+
+    size_t offset = 0;
+    for (auto& item : ExtendedItems) {
+        item.DataPtr = (ULONGLONG) (ExtendedData.data() + offset);
+        offset += item.DataSize;
+    }
+    record->ExtendedDataCount = (USHORT) ExtendedItems.size();
+    record->ExtendedData = ExtendedItems.empty() ? nullptr : ExtendedItems.data();
+}
+
+ShardedPMTraceConsumer::ShardedPMTraceConsumer(uint32_t shardCount, size_t queueCapacity)
+    : mDirectory(new Directory)
+    , mStopWorkers(false)
+{
+    if (shardCount == 0) {
+        shardCount = 1;
+    }
+    for (uint32_t i = 0; i < shardCount; ++i) {
+        mShards.emplace_back(new Shard(queueCapacity));
+    }
+}
+
+ShardedPMTraceConsumer::~ShardedPMTraceConsumer()
+{
+    Stop();
+}
+
+void ShardedPMTraceConsumer::AddHandler(GUID const& providerId, PMEventHandlerFn handlerFn)
+{
+    Handler h;
+    h.ProviderId = providerId;
+    h.Fn = handlerFn;
+    mHandlers.push_back(h);
+}
+
+void ShardedPMTraceConsumer::SetTargetProcessId(uint32_t processId)
+{
+    mTargetProcessId = processId;
+    for (auto& shard : mShards) {
+        shard->mConsumer.mTargetProcessId = processId;
+    }
+}
+
+void ShardedPMTraceConsumer::SetDwmProcessId(uint32_t processId)
+{
+    mDwmProcessId = processId;
+    for (auto& shard : mShards) {
+        shard->mConsumer.mDwmProcessId = processId;
+    }
+}
+
+void ShardedPMTraceConsumer::Start()
+{
+    mStopWorkers = false;
+    for (auto& shard : mShards) {
+        shard->mThread = std::thread(&ShardedPMTraceConsumer::WorkerThread, this, shard.get());
+    }
+}
+
+void ShardedPMTraceConsumer::Flush()
+{
+    for (;;) {
+        DrainSpills();
+        bool idle = mSpilledEvents == 0;
+        for (auto& shard : mShards) {
+            if (shard->mThread.joinable() && shard->mProcessed.load(std::memory_order_acquire) != shard->mQueued) {
+                idle = false;
+                break;
+            }
+        }
+        if (idle || !mShards[0]->mThread.joinable()) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void ShardedPMTraceConsumer::Stop()
+{
+    Flush();
+    mStopWorkers = true;
+    for (auto& shard : mShards) {
+        if (shard->mThread.joinable()) {
+            shard->mThread.join();
+        }
+    }
+}
+
+PMEventHandlerFn ShardedPMTraceConsumer::FindHandler(GUID const& providerId) const
+{
+    for (auto const& h : mHandlers) {
+        if (IsEqualGUID(h.ProviderId, providerId)) {
+            return h.Fn;
+        }
+    }
+    return nullptr;
+}
+
+// Routes an event raised on the presenting thread to the shard owning its
+// process, and registers the correlation keys it introduces to that shard.
+uint32_t ShardedPMTraceConsumer::RoutePresentPath(EVENT_RECORD* pEventRecord)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    auto const& provider = hdr.ProviderId;
+
+    uint32_t shard = 0;
+    if (hdr.ProcessId == mDwmProcessId) {
+        // DWM's presents must be seen by every shard, see above.
+        shard = ALL_SHARDS;
+    } else if (mTargetProcessId != 0 && hdr.ProcessId != mTargetProcessId) {
+        return NO_SHARD;
+    } else {
+        shard = ShardOf(hdr.ProcessId);
+    }
+
+    if (IsEqualGUID(provider, DXGKRNL_PROVIDER_GUID)) {
+        switch (hdr.EventDescriptor.Id) {
+        case DxgKrnl_QueueSubmit: {
+            // Only packets that can carry a present are correlated, see
+            // PMTraceConsumer::HandleDxgkQueueSubmit().
+            EventDataReader data(pEventRecord, QueueSubmitKeyFields);
+            auto packetType = data.Get<DxgKrnl_QueueSubmit_Type>(QueueSubmit_PacketType);
+            if (packetType == DxgKrnl_QueueSubmit_Type::MMIOFlip ||
+                packetType == DxgKrnl_QueueSubmit_Type::Software ||
+                data.Get<BOOL>(QueueSubmit_bPresent) != 0) {
+                mDirectory->mSubmitSequences.Set(data.Get<uint32_t>(QueueSubmit_SubmitSequence), shard);
+            }
+            break;
+        }
+        case DxgKrnl_PresentHistoryDetailed:
+        case DxgKrnl_SubmitPresentHistory: {
+            EventDataReader data(pEventRecord, PresentHistoryKeyFields);
+            mDirectory->mTokens.Set(data.Get<uint64_t>(PresentHistory_Token), shard);
+            auto tokenData = data.Get<uint64_t>(PresentHistory_TokenData);
+            if (tokenData != 0) {
+                mDirectory->mTokens.Set(tokenData, shard);
+            }
+            break;
+        }
+        }
+    } else if (IsEqualGUID(provider, WIN32K_PROVIDER_GUID)) {
+        EventDataReader data(pEventRecord, TokenCompositionSurfaceObjectKeyFields);
+        PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(TokenCompositionSurfaceObject_CompositionSurfaceLuid),
+            data.Get<uint64_t>(TokenCompositionSurfaceObject_PresentCount),
+            data.Get<uint64_t>(TokenCompositionSurfaceObject_BindId));
+        mDirectory->mWin32KTokens.Set(key, shard);
+    } else if (IsEqualGUID(provider, Win7::DXGKQUEUEPACKET_GUID)) {
+        auto pSubmitEvent = reinterpret_cast<DXGKETW_QUEUESUBMITEVENT*>(pEventRecord->UserData);
+        if (pSubmitEvent->PacketType == DXGKETW_MMIOFLIP_COMMAND_BUFFER ||
+            pSubmitEvent->PacketType == DXGKETW_SOFTWARE_COMMAND_BUFFER ||
+            pSubmitEvent->bPresent != 0) {
+            mDirectory->mSubmitSequences.Set(pSubmitEvent->SubmitSequence, shard);
+        }
+    } else if (IsEqualGUID(provider, Win7::DXGKPRESENTHISTORY_GUID)) {
+        mDirectory->mTokens.Set(reinterpret_cast<DXGKETW_PRESENTHISTORYEVENT*>(pEventRecord->UserData)->Token, shard);
+    }
+
+    return shard;
+}
+
+// Routes a completion event to the shard that registered its key; events
+// whose key no shard registered are dropped, as every shard would ignore
+// them.
+uint32_t ShardedPMTraceConsumer::RouteCompletion(EVENT_RECORD* pEventRecord)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    auto const& provider = hdr.ProviderId;
+    auto& directory = *mDirectory;
+
+    if (IsEqualGUID(provider, DXGKRNL_PROVIDER_GUID)) {
+        switch (hdr.EventDescriptor.Id) {
+        case DxgKrnl_QueueComplete:
+            return directory.mSubmitSequences.Find(EventDataReader(pEventRecord, QueueCompleteKeyFields).Get<uint32_t>(QueueComplete_SubmitSequence), NO_SHARD);
+        case DxgKrnl_MMIOFlip:
+            return directory.mSubmitSequences.Find(EventDataReader(pEventRecord, MMIOFlipKeyFields).Get<uint32_t>(MMIOFlip_FlipSubmitSequence), NO_SHARD);
+        case DxgKrnl_MMIOFlipMPO: {
+            auto flipFenceId = EventDataReader(pEventRecord, MMIOFlipKeyFields).Get<uint64_t>(MMIOFlip_FlipSubmitSequence);
+            return directory.mSubmitSequences.Find((uint32_t) (flipFenceId >> 32u), NO_SHARD);
+        }
+        case DxgKrnl_HSyncDPC: {
+            // Every flip in the DPC must reach its shard; they rarely differ.
+            EventDataReader data(pEventRecord, HSyncDPCKeyFields);
+            auto flipCount = data.Get<uint32_t>(HSyncDPC_FlipEntryCount);
+            uint32_t shard = NO_SHARD;
+            for (uint32_t i = 0; i < flipCount; ++i) {
+                auto flipShard = directory.mSubmitSequences.Find((uint32_t) (data.GetArrayElement<uint64_t>(HSyncDPC_FlipSubmitSequence, i) >> 32u), NO_SHARD);
+                if (flipShard != NO_SHARD && flipShard != shard) {
+                    shard = shard == NO_SHARD ? flipShard : ALL_SHARDS;
+                }
+            }
+            return shard;
+        }
+        case DxgKrnl_VSyncDPC: {
+            auto flipFenceId = EventDataReader(pEventRecord, VSyncDPCKeyFields).Get<uint64_t>(VSyncDPC_FlipFenceId);
+            return directory.mSubmitSequences.Find((uint32_t) (flipFenceId >> 32u), NO_SHARD);
+        }
+        case DxgKrnl_PropagatePresentHistory:
+            return directory.mTokens.Find(EventDataReader(pEventRecord, PropagatePresentHistoryKeyFields).Get<uint64_t>(PropagatePresentHistory_Token), NO_SHARD);
+        }
+        return NO_SHARD;
+    }
+
+    if (IsEqualGUID(provider, WIN32K_PROVIDER_GUID)) {
+        EventDataReader data(pEventRecord, TokenStateChangedKeyFields);
+        PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(TokenStateChanged_CompositionSurfaceLuid),
+            data.Get<uint32_t>(TokenStateChanged_PresentCount),
+            data.Get<uint64_t>(TokenStateChanged_BindId));
+        return directory.mWin32KTokens.Find(key, NO_SHARD);
+    }
+
+    if (IsEqualGUID(provider, DWM_PROVIDER_GUID)) {
+        switch (hdr.EventDescriptor.Id) {
+        case DWM_FlipChain_Pending:
+        case DWM_FlipChain_Complete:
+        case DWM_FlipChain_Dirty: {
+            EventDataReader data(pEventRecord, DwmFlipChainKeyFields);
+            auto flipChainId = (uint32_t) data.Get<uint64_t>(DwmFlipChain_ulFlipChain);
+            auto serialNumber = (uint32_t) data.Get<uint64_t>(DwmFlipChain_ulSerialNumber);
+            return directory.mTokens.Find(((uint64_t) flipChainId << 32ull) | serialNumber, NO_SHARD);
+        }
+        case DWM_Schedule_SurfaceUpdate: {
+            EventDataReader data(pEventRecord, DwmSurfaceUpdateKeyFields);
+            PMTraceConsumer::Win32KPresentHistoryTokenKey key(data.Get<uint64_t>(DwmSurfaceUpdate_luidSurface),
+                data.Get<uint64_t>(DwmSurfaceUpdate_PresentCount),
+                data.Get<uint64_t>(DwmSurfaceUpdate_bindId));
+            return directory.mWin32KTokens.Find(key, NO_SHARD);
+        }
+        }
+        return NO_SHARD;
+    }
+
+    if (IsEqualGUID(provider, Win7::DXGKQUEUEPACKET_GUID)) {
+        return directory.mSubmitSequences.Find(reinterpret_cast<DXGKETW_QUEUECOMPLETEEVENT*>(pEventRecord->UserData)->SubmitSequence, NO_SHARD);
+    }
+    if (IsEqualGUID(provider, Win7::DXGKPRESENTHISTORY_GUID)) {
+        return directory.mTokens.Find(reinterpret_cast<DXGKETW_PRESENTHISTORYEVENT*>(pEventRecord->UserData)->Token, NO_SHARD);
+    }
+    if (IsEqualGUID(provider, Win7::DXGKVSYNCDPC_GUID)) {
+        auto pVSyncDPCEvent = reinterpret_cast<DXGKETW_SCHEDULER_VSYNC_DPC*>(pEventRecord->UserData);
+        return directory.mSubmitSequences.Find((uint32_t) (pVSyncDPCEvent->FlipFenceId.QuadPart >> 32u), NO_SHARD);
+    }
+    if (IsEqualGUID(provider, Win7::DXGKMMIOFLIP_GUID)) {
+        auto flipSubmitSequence = (hdr.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER)
+            ? reinterpret_cast<DXGKETW_SCHEDULER_MMIO_FLIP_32*>(pEventRecord->UserData)->FlipSubmitSequence
+            : reinterpret_cast<DXGKETW_SCHEDULER_MMIO_FLIP_64*>(pEventRecord->UserData)->FlipSubmitSequence;
+        return directory.mSubmitSequences.Find(flipSubmitSequence, NO_SHARD);
+    }
+    return NO_SHARD;
+}
+
+// Returns the shard that must handle the event, ALL_SHARDS, or NO_SHARD to
+// drop it.  *vsync is set for VSyncDPCs, which shard 0 also needs.
+uint32_t ShardedPMTraceConsumer::RouteEvent(EVENT_RECORD* pEventRecord, bool* vsync)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    auto const& provider = hdr.ProviderId;
+
+    *vsync = false;
+
+    if (IsEqualGUID(provider, DXGI_PROVIDER_GUID) || IsEqualGUID(provider, D3D9_PROVIDER_GUID) ||
+        IsEqualGUID(provider, Win7::DXGKBLT_GUID) || IsEqualGUID(provider, Win7::DXGKFLIP_GUID)) {
+        return RoutePresentPath(pEventRecord);
+    }
+    if (IsEqualGUID(provider, DXGKRNL_PROVIDER_GUID)) {
+        // Events emitted on the presenting thread; the rest complete presents
+        // from DPC/worker context.
+        switch (hdr.EventDescriptor.Id) {
+        case DxgKrnl_Flip:
+        case DxgKrnl_FlipMPO:
+        case DxgKrnl_QueueSubmit:
+        case DxgKrnl_Present:
+        case DxgKrnl_PresentHistoryDetailed:
+        case DxgKrnl_SubmitPresentHistory:
+        case DxgKrnl_Blit:
+            return RoutePresentPath(pEventRecord);
+        case DxgKrnl_VSyncDPC:
+            *vsync = true;
+            break;
+        }
+        return RouteCompletion(pEventRecord);
+    }
+    if (IsEqualGUID(provider, WIN32K_PROVIDER_GUID)) {
+        switch (hdr.EventDescriptor.Id) {
+        case Win32K_TokenCompositionSurfaceObject: return RoutePresentPath(pEventRecord);
+        case Win32K_TokenStateChanged:             return RouteCompletion(pEventRecord);
+        }
+        return NO_SHARD;
+    }
+    if (IsEqualGUID(provider, DWM_PROVIDER_GUID) || IsEqualGUID(provider, Win7::DWM_PROVIDER_GUID)) {
+        mDwmProcessId = hdr.ProcessId;
+        switch (hdr.EventDescriptor.Id) {
+        case DWM_GetPresentHistory:
+        case DWM_Schedule_Present_Start:
+            return ALL_SHARDS;
+        }
+        // The Win7 flip chain events aren't handled.
+        return IsEqualGUID(provider, DWM_PROVIDER_GUID) ? RouteCompletion(pEventRecord) : NO_SHARD;
+    }
+    if (IsEqualGUID(provider, Win7::DXGKPRESENTHISTORY_GUID) || IsEqualGUID(provider, Win7::DXGKQUEUEPACKET_GUID)) {
+        return hdr.EventDescriptor.Opcode == EVENT_TRACE_TYPE_START ? RoutePresentPath(pEventRecord) : RouteCompletion(pEventRecord);
+    }
+    if (IsEqualGUID(provider, Win7::DXGKVSYNCDPC_GUID) || IsEqualGUID(provider, Win7::DXGKMMIOFLIP_GUID)) {
+        *vsync = IsEqualGUID(provider, Win7::DXGKVSYNCDPC_GUID);
+        return RouteCompletion(pEventRecord);
+    }
+
+    // Process events, and anything else handlers were added for.
+    return 0;
+}
+
+void ShardedPMTraceConsumer::Enqueue(Shard& shard, EVENT_RECORD const& record)
+{
+    QueuedEvent ev;
+    ev.Assign(record);
+
+    // Events can't be dropped without corrupting correlation state, and
+    // waiting here would back up ETW's buffers until it drops events itself,
+    // so a full shard's events wait on its spill list instead.
+    if (shard.mSpill.empty() && shard.mQueue.push(std::move(ev))) {
+        shard.mQueued += 1;
+        return;
+    }
+    shard.mSpill.emplace_back(std::move(ev));
+    mSpillCount += 1;
+    mSpilledEvents += 1;
+}
+
+void ShardedPMTraceConsumer::DrainSpills()
+{
+    if (mSpilledEvents == 0) {
+        return;
+    }
+    for (auto& shard : mShards) {
+        while (!shard->mSpill.empty() && shard->mQueue.push(std::move(shard->mSpill.front()))) {
+            shard->mSpill.pop_front();
+            shard->mQueued += 1;
+            mSpilledEvents -= 1;
+        }
+    }
+}
+
+void ShardedPMTraceConsumer::DispatchEvent(EVENT_RECORD* pEventRecord)
+{
+    DrainSpills();
+
+    bool vsync = false;
+    auto shard = RouteEvent(pEventRecord, &vsync);
+
+    // Shard 0 tracks the display refresh from every VSyncDPC.
+    if (vsync && shard != 0 && shard != ALL_SHARDS) {
+        Enqueue(*mShards[0], *pEventRecord);
+    }
+
+    if (shard == ALL_SHARDS) {
+        for (auto& s : mShards) {
+            Enqueue(*s, *pEventRecord);
+        }
+    } else if (shard != NO_SHARD) {
+        Enqueue(*mShards[shard], *pEventRecord);
+    }
+}
+
+void ShardedPMTraceConsumer::WorkerThread(Shard* shard)
+{
+    uint32_t idleSpins = 0;
+    QueuedEvent ev;
+    for (;;) {
+        if (!shard->mQueue.pop(ev)) {
+            if (mStopWorkers) {
+                break;
+            }
+            if (++idleSpins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            continue;
+        }
+        idleSpins = 0;
+
+        auto handlerFn = FindHandler(ev.Header.ProviderId);
+        if (handlerFn != nullptr) {
+            EVENT_RECORD record;
+            ev.ToRecord(&record);
+            (*handlerFn)(&record, &shard->mConsumer);
+        }
+        shard->mProcessed.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool ShardedPMTraceConsumer::DequeueProcessEvents(std::vector<NTProcessEvent>& outProcessEvents)
+{
+    return mShards[0]->mConsumer.DequeueProcessEvents(outProcessEvents);
+}
+
+bool ShardedPMTraceConsumer::DequeuePresents(std::vector<CompletedFrame>& outPresents)
+{
+    for (uint32_t i = 0, n = (uint32_t) mShards.size(); i < n; ++i) {
+        mDequeueScratch.clear();
+        if (!mShards[i]->mConsumer.DequeuePresents(mDequeueScratch)) {
+            continue;
+        }
+        for (auto const& p : mDequeueScratch) {
+            if (ShardOf(p.ProcessId) == i) {
+                outPresents.push_back(p);
+            }
+        }
+    }
+    mDequeueScratch.clear();
+    return !outPresents.empty();
+}
+
+uint64_t ShardedPMTraceConsumer::GetDroppedPresentCount() const
+{
+    uint64_t count = 0;
+    for (auto const& shard : mShards) {
+        count += shard->mConsumer.GetDroppedPresentCount();
+    }
+    return count;
+}
+
+uint64_t ShardedPMTraceConsumer::GetDroppedProcessEventCount() const
+{
+    return mShards[0]->mConsumer.GetDroppedProcessEventCount();
+}
+
+double ShardedPMTraceConsumer::GetQueueBacklog() const
+{
+    double backlog = 0.0;
+    for (auto const& shard : mShards) {
+        backlog = std::max(backlog, (double) shard->mQueue.size() / shard->mQueue.capacity());
+        backlog = std::max(backlog, shard->mConsumer.GetQueueBacklog());
+    }
+    return backlog;
+}
+
+uint64_t ShardedPMTraceConsumer::GetQueuedEventCount() const
+{
+    uint64_t count = 0;
+    for (auto const& shard : mShards) {
+        count += shard->mQueued + shard->mSpill.size();
+    }
+    return count;
+}
+
+void ShardedPMTraceConsumer::GetDisplayRefresh(std::vector<DisplayRefresh>& outDisplays)
+{
+    // Shard 0 is enough: RouteEvent() sends every VSyncDPC to shard 0 as
+    // well as to the shard owning its flip, so shard 0 has seen every
+    // display.  The other shards' copies are partial and never read.
+    mShards[0]->mConsumer.GetDisplayRefresh(outDisplays);
+}
+
+void HandleShardedEvent(EVENT_RECORD* pEventRecord, ShardedPMTraceConsumer* shardedConsumer)
+{
+    shardedConsumer->DispatchEvent(pEventRecord);
+}
@@ -0,0 +1,177 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "PresentMonTraceConsumer.hpp"
+#include "../Utils/inc/spsc_queue.h"
+
+// A copy of an EVENT_RECORD that can be handed to a shard's worker thread,
+// including its extended data items (TraceLogging events carry their schema
+// in one).
+struct QueuedEvent {
+    enum { INLINE_DATA_SIZE = 128 };
+
+    EVENT_HEADER Header;
+    ETW_BUFFER_CONTEXT BufferContext;
+    USHORT UserDataLength;
+    uint8_t InlineData[INLINE_DATA_SIZE];
+    std::unique_ptr<uint8_t[]> HeapData; // only used when UserDataLength > INLINE_DATA_SIZE
+    std::vector<EVENT_HEADER_EXTENDED_DATA_ITEM> ExtendedItems;
+    std::vector<uint8_t> ExtendedData; // the items' data, back to back
+
+    void Assign(EVENT_RECORD const& record);
+    void* UserData() { return HeapData ? HeapData.get() : InlineData; }
+
+    // Points record at this event; valid until the next Assign().
+    void ToRecord(EVENT_RECORD* record);
+};
+
+// Spreads the PMTraceConsumer state machine over several worker threads.
+//
+// Events raised from an application's own present path (runtime Present
+// start/stop, and the DxgKrnl/Win32K events emitted on the presenting thread)
+// are routed to the shard that owns the event's ProcessId, so every process
+// and therefore every swapchain is handled in order by exactly one shard.
+//
+// Events that complete presents asynchronously (queue completion, MMIO flips,
+// sync DPCs, present history propagation, token state changes, DWM's flip
+// chain and surface updates) carry no application ProcessId.  Instead, the
+// ETW thread reads the correlation key (submit sequence, present history
+// token, or Win32K composition token) out of each present-path event that
+// registers one, remembers which shard it went to, and sends the completion
+// event carrying that key to the same shard only.  VSyncDPCs also go to shard
+// 0, which tracks the display refresh.
+//
+// DWM's own presents are tracked by every shard so that windowed presents
+// waiting on composition can piggyback on them, but only the owning shard
+// reports them.  DWM's present-path events, the completions of the keys they
+// register, and DWM's per-frame GetPresentHistory and Schedule_Present_Start
+// events are therefore broadcast; that's a handful of events per composed
+// frame, however many applications are presenting.
+//
+// A shard whose queue is full doesn't stall the ETW thread: its events wait
+// in order on a per-shard spill list that's moved into the queue as the shard
+// catches up.
+struct ShardedPMTraceConsumer
+{
+    ShardedPMTraceConsumer(uint32_t shardCount, size_t queueCapacity = 1 << 14);
+    ~ShardedPMTraceConsumer();
+
+    // Handlers must be added before Start().
+    void AddHandler(GUID const& providerId, PMEventHandlerFn handlerFn);
+
+    // See PMTraceConsumer::mTargetProcessId; other processes' present-path
+    // events are dropped on the ETW thread before being queued.  Must be
+    // called before Start().
+    void SetTargetProcessId(uint32_t processId);
+
+    // DWM's process id, if known before its first event; it is also learned
+    // from DWM's own events.  Must be called before Start().
+    void SetDwmProcessId(uint32_t processId);
+
+    void Start();
+
+    // Wait until every queued event has been processed.  Must be called on
+    // the ETW thread, or once it has stopped.
+    void Flush();
+
+    // Flush, then stop and join the worker threads.
+    void Stop();
+
+    // Called on the ETW thread for every event.
+    void DispatchEvent(EVENT_RECORD* pEventRecord);
+
+    bool DequeueProcessEvents(std::vector<NTProcessEvent>& outProcessEvents);
+    bool DequeuePresents(std::vector<CompletedFrame>& outPresents);
+
+    uint32_t GetShardCount() const { return (uint32_t) mShards.size(); }
+
+    // Completed presents/process events dropped by the shards' output queues.
+    uint64_t GetDroppedPresentCount() const;
+    uint64_t GetDroppedProcessEventCount() const;
+
+    // Number of events that found their shard's queue full and went through
+    // its spill list.  ETW thread only.
+    uint64_t GetSpillCount() const { return mSpillCount; }
+
+    // Number of events queued to all shards, counting broadcasts once per
+    // shard.  ETW thread only.
+    uint64_t GetQueuedEventCount() const;
+
+    // Fullest shard input or completed present queue, 0..1 (approximate).
+    double GetQueueBacklog() const;
+
+    // VSyncDPCs always reach shard 0, so it sees every display.
+    void GetDisplayRefresh(std::vector<DisplayRefresh>& outDisplays);
+
+private:
+    enum : uint32_t {
+        ALL_SHARDS = UINT32_MAX,
+        NO_SHARD   = UINT32_MAX - 1,
+    };
+
+    struct Handler {
+        GUID ProviderId;
+        PMEventHandlerFn Fn;
+    };
+
+    struct Shard {
+        Shard(size_t queueCapacity) : mConsumer(false), mQueue(queueCapacity), mProcessed(0) {}
+
+        PMTraceConsumer mConsumer;
+        SPSCQueue<QueuedEvent> mQueue;
+        std::deque<QueuedEvent> mSpill; // ETW thread only
+        std::thread mThread;
+        std::atomic<uint64_t> mProcessed;
+        uint64_t mQueued = 0; // ETW thread only
+    };
+
+    struct Directory;
+
+    uint32_t ShardOf(uint32_t processId) const { return (processId >> 2) % (uint32_t) mShards.size(); }
+    uint32_t RouteEvent(EVENT_RECORD* pEventRecord, bool* vsync);
+    uint32_t RoutePresentPath(EVENT_RECORD* pEventRecord);
+    uint32_t RouteCompletion(EVENT_RECORD* pEventRecord);
+    void Enqueue(Shard& shard, EVENT_RECORD const& record);
+    void DrainSpills();
+    void WorkerThread(Shard* shard);
+    PMEventHandlerFn FindHandler(GUID const& providerId) const;
+
+    std::vector<std::unique_ptr<Shard>> mShards;
+    std::vector<Handler> mHandlers;
+    std::unique_ptr<Directory> mDirectory; // ETW thread only
+    std::atomic<bool> mStopWorkers;
+    uint32_t mDwmProcessId = 0; // ETW thread only
+    uint32_t mTargetProcessId = 0;
+    uint64_t mSpillCount = 0;
+    size_t mSpilledEvents = 0; // events currently on spill lists
+    std::vector<CompletedFrame> mDequeueScratch;
+};
+
+void HandleShardedEvent(EVENT_RECORD* pEventRecord, ShardedPMTraceConsumer* shardedConsumer);
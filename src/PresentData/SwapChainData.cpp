@@ -23,36 +23,116 @@ SOFTWARE.
 #include "SwapChainData.hpp"
 
 enum {
-    MAX_HISTORY_TIME = 2000,
     CHAIN_TIMEOUT_THRESHOLD_TICKS = 10000, // 10 sec
-    MAX_PRESENTS_IN_DEQUE = 60 * (MAX_HISTORY_TIME / 1000)
 };
 
-void SwapChainData::PruneDeque(std::deque<PresentEvent> &presentHistory, uint64_t perfFreq, uint32_t msTimeDiff, uint32_t maxHistLen) {
-    while (!presentHistory.empty() &&
-        (presentHistory.size() > maxHistLen ||
-        ((double)(presentHistory.back().QpcTime - presentHistory.front().QpcTime) / perfFreq) * 1000 > msTimeDiff)) {
-        presentHistory.pop_front();
+namespace {
+
+uint64_t Latency(PresentSample const& s) { return s.ScreenTime - s.QpcTime; }
+
+// PushSample() and PruneHistory() call drop(i) for every sample that leaves
+// the history, before it does, so the running statistics over the history
+// (see SwapChainData.hpp) are kept without ever walking it.  The sums are
+// modulo 2^64, which is exact as long as the true sum fits.
+
+template <typename Drop>
+void PushSample(SwapChainData::History& history, PresentSample const& sample, Drop drop)
+{
+    if (history.size() == history.max_size()) {
+        drop(0); // push_back() drops it
     }
+    history.push_back(sample);
 }
 
-void SwapChainData::AddPresentToSwapChain(PresentEvent& p)
+// The ring caps the number of presents to the budget; drop the ones more than
+// maxTicks older than the newest.  Each present leaves the window once, so
+// scanning from the oldest is O(1) amortized and only touches the front of
+// the ring.
+template <typename Drop>
+void PruneHistory(SwapChainData::History& history, uint64_t maxTicks, Drop drop)
 {
+    if (history.empty()) {
+        return;
+    }
+    auto newest = history.back().QpcTime;
+    size_t count = 0;
+    while (count < history.size() && newest - history[count].QpcTime > maxTicks) {
+        drop(count);
+        ++count;
+    }
+    history.pop_front(count);
+}
+
+}
+
+void SwapChainData::DropPresentSample(size_t i)
+{
+    mTimeInPresentSum -= mPresentHistory[i].TimeTaken;
+    if (i + 1 < mPresentHistory.size()) {
+        mWindowFrameTimes.remove(mPresentHistory[i + 1].QpcTime - mPresentHistory[i].QpcTime);
+    }
+}
+
+void SwapChainData::DropDisplayedSample(size_t i)
+{
+    mLatencySum -= Latency(mDisplayedPresentHistory[i]);
+}
+
+size_t SwapChainData::MaxHistorySamples(uint32_t budgetKB)
+{
+    size_t maxSamples = (size_t) budgetKB * 1024 / (2 * sizeof(PresentSample));
+    size_t n = MIN_HISTORY_SAMPLES;
+    while (n * 2 <= maxSamples) {
+        n *= 2;
+    }
+    return n;
+}
+
+void SwapChainData::SetHistoryWindow(uint32_t historyTimeMs, uint32_t budgetKB)
+{
+    assert(mPresentHistory.empty() && mDisplayedPresentHistory.empty());
+    mHistoryTimeMs = historyTimeMs;
+    mPresentHistory.set_max_size(MaxHistorySamples(budgetKB));
+    mDisplayedPresentHistory.set_max_size(MaxHistorySamples(budgetKB));
+}
+
+void SwapChainData::AddPresentToSwapChain(CompletedFrame const& p)
+{
+    PresentSample sample;
+    sample.QpcTime = p.QpcTime;
+    sample.ScreenTime = p.ScreenTime;
+    sample.ReadyTime = p.ReadyTime;
+    sample.TimeTaken = p.TimeTaken;
+    sample.FinalState = p.FinalState;
+
     if (p.FinalState == PresentResult::Presented)
     {
-        mDisplayedPresentHistory.push_back(p);
+        if (!mDisplayedPresentHistory.empty()) {
+            mDisplayIntervals.push(p.ScreenTime - mDisplayedPresentHistory.back().ScreenTime);
+        }
+        mPacing.add(p.ScreenTime, p.SyncInterval, p.SupportsTearing);
+        PushSample(mDisplayedPresentHistory, sample, [this](size_t i) { DropDisplayedSample(i); });
+        mLatencySum += Latency(sample);
     }
     if (!mPresentHistory.empty())
     {
         assert(mPresentHistory.back().QpcTime <= p.QpcTime);
     }
-    mPresentHistory.push_back(p);
+    PushSample(mPresentHistory, sample, [this](size_t i) { DropPresentSample(i); });
+    mTimeInPresentSum += sample.TimeTaken;
+    if (mPresentHistory.size() > 1) {
+        auto frameTime = p.QpcTime - mPresentHistory[mPresentHistory.size() - 2].QpcTime;
+        mFrameTimes.add(frameTime);
+        mWindowFrameTimes.add(frameTime);
+        mPresentIntervals.push(frameTime);
+    }
 }
 
-void SwapChainData::UpdateSwapChainInfo(PresentEvent&p, uint64_t now, uint64_t perfFreq)
+void SwapChainData::UpdateSwapChainInfo(CompletedFrame const& p, uint64_t now, QpcClock const& clock)
 {
-    PruneDeque(mDisplayedPresentHistory, perfFreq, MAX_HISTORY_TIME, MAX_PRESENTS_IN_DEQUE);
-    PruneDeque(mPresentHistory, perfFreq, MAX_HISTORY_TIME, MAX_PRESENTS_IN_DEQUE);
+    auto maxTicks = clock.getFrequency() * mHistoryTimeMs / 1000;
+    PruneHistory(mDisplayedPresentHistory, maxTicks, [this](size_t i) { DropDisplayedSample(i); });
+    PruneHistory(mPresentHistory, maxTicks, [this](size_t i) { DropPresentSample(i); });
 
     mLastUpdateTicks = now;
     mRuntime = p.Runtime;
@@ -67,7 +147,7 @@ void SwapChainData::UpdateSwapChainInfo(PresentEvent&p, uint64_t now, uint64_t p
     mDwmNotified = p.DwmNotified;
 }
 
-double SwapChainData::ComputeDisplayedFps(uint64_t qpcFreq) const
+double SwapChainData::ComputeDisplayedFps(QpcClock const& clock) const
 {
     if (mDisplayedPresentHistory.size() < 2) {
         return 0.0;
@@ -76,11 +156,11 @@ double SwapChainData::ComputeDisplayedFps(uint64_t qpcFreq) const
     auto end = mDisplayedPresentHistory.back().ScreenTime;
     auto count = mDisplayedPresentHistory.size() - 1;
 
-    double deltaT = double(end - start) / qpcFreq;
+    double deltaT = clock.toSeconds(end - start);
     return count / deltaT;
 }
 
-double SwapChainData::ComputeFps(uint64_t qpcFreq) const
+double SwapChainData::ComputeFps(QpcClock const& clock) const
 {
     if (mPresentHistory.size() < 2) {
         return 0.0;
@@ -89,37 +169,47 @@ double SwapChainData::ComputeFps(uint64_t qpcFreq) const
     auto end = mPresentHistory.back().QpcTime;
     auto count = mPresentHistory.size() - 1;
 
-    double deltaT = double(end - start) / qpcFreq;
+    double deltaT = clock.toSeconds(end - start);
     return count / deltaT;
 }
 
-double SwapChainData::ComputeLatency( uint64_t qpcFreq) const
+double SwapChainData::ComputeLatency(QpcClock const& clock) const
 {
     if (mDisplayedPresentHistory.size() < 2) {
         return 0.0;
     }
 
-    uint64_t totalLatency = std::accumulate(mDisplayedPresentHistory.begin(), mDisplayedPresentHistory.end() - 1, 0ull,
-        [](uint64_t current, PresentEvent const& e) { return current + e.ScreenTime - e.QpcTime; });
-    double average = ((double)(totalLatency) / qpcFreq) / (mDisplayedPresentHistory.size() - 1);
+    // The newest present isn't part of the average.
+    uint64_t totalLatency = mLatencySum - Latency(mDisplayedPresentHistory.back());
+    double average = clock.toSeconds(totalLatency) / (mDisplayedPresentHistory.size() - 1);
     return average;
 }
 
-double SwapChainData::ComputeCpuFrameTime(uint64_t qpcFreq) const
+double SwapChainData::ComputeCpuFrameTime(QpcClock const& clock) const
 {
     if (mPresentHistory.size() < 2) {
         return 0.0;
     }
 
-    uint64_t timeInPresent = std::accumulate(mPresentHistory.begin(), mPresentHistory.end() - 1, 0ull,
-        [](uint64_t current, PresentEvent const& e) { return current + e.TimeTaken; });
+    uint64_t timeInPresent = mTimeInPresentSum - mPresentHistory.back().TimeTaken;
     uint64_t totalTime = mPresentHistory.back().QpcTime - mPresentHistory.front().QpcTime;
 
-    double timeNotInPresent = double(totalTime - timeInPresent) / qpcFreq;
+    double timeNotInPresent = clock.toSeconds(totalTime - timeInPresent);
     return timeNotInPresent / (mPresentHistory.size() - 1);
 }
 
+double SwapChainData::ComputeFrameTimePercentile(QpcClock const& clock, double percentile, bool window) const
+{
+    auto const& frameTimes = window ? mWindowFrameTimes : mFrameTimes;
+    return clock.msPerTick() * frameTimes.quantile(percentile / 100.0);
+}
+
 bool SwapChainData::IsStale(uint64_t now) const
 {
     return now - mLastUpdateTicks > CHAIN_TIMEOUT_THRESHOLD_TICKS;
 }
+
+uint64_t SwapChainData::ExpiryTicks() const
+{
+    return mLastUpdateTicks + CHAIN_TIMEOUT_THRESHOLD_TICKS;
+}
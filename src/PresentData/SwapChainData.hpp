@@ -22,31 +22,96 @@ SOFTWARE.
 
 #pragma once
 
-#include <deque>
 #include <stdint.h>
 
 #include "PresentMonTraceConsumer.hpp"
+#include "../Utils/inc/frame_pacing.h"
+#include "../Utils/inc/history_ring.h"
+#include "../Utils/inc/log_histogram.h"
+#include "../Utils/inc/rolling_median.h"
+#include "../Utils/inc/qpc_clock.h"
+
+// The part of a completed present that the swapchain history needs.
+struct PresentSample {
+    uint64_t QpcTime;
+    uint64_t ScreenTime;
+    uint64_t ReadyTime;
+    uint64_t TimeTaken;
+    PresentResult FinalState;
+};
 
 struct SwapChainData {
+    enum {
+        DEFAULT_HISTORY_TIME = 2000,        // ms
+        DEFAULT_HISTORY_BUDGET_KB = 1024,   // per swapchain, both histories
+        MIN_HISTORY_SAMPLES = 8,
+        INTERVAL_MEDIAN_WINDOW = 31,        // presents
+    };
+
+    typedef HistoryRing<PresentSample> History;
+
     Runtime mRuntime = Runtime::Other;
     uint64_t mLastUpdateTicks = 0;
     uint32_t mLastSyncInterval = UINT32_MAX;
     uint32_t mLastFlags = UINT32_MAX;
-    std::deque<PresentEvent> mPresentHistory;
-    std::deque<PresentEvent> mDisplayedPresentHistory;
+    History mPresentHistory;
+    History mDisplayedPresentHistory;
     PresentMode mLastPresentMode = PresentMode::Unknown;
     uint32_t mLastPlane = 0;
     bool mHasBeenBatched = false;
     bool mDwmNotified = false;
-    
-    void PruneDeque(std::deque<PresentEvent> &presentHistory, uint64_t perfFreq, uint32_t msTimeDiff, uint32_t maxHistLen);
-    void AddPresentToSwapChain(PresentEvent& p);
-    void UpdateSwapChainInfo(PresentEvent&p, uint64_t now, uint64_t perfFreq);
-    double ComputeDisplayedFps(uint64_t qpcFreq) const;
-    double ComputeFps(uint64_t qpcFreq) const;
-    double ComputeLatency(uint64_t qpcFreq) const;
-    double ComputeCpuFrameTime(uint64_t qpcFreq) const;
+    uint32_t mHistoryTimeMs = DEFAULT_HISTORY_TIME;
+
+    // Running sums over the histories, see SwapChainData.cpp.
+    uint64_t mLatencySum = 0;       // ScreenTime - QpcTime over mDisplayedPresentHistory
+    uint64_t mTimeInPresentSum = 0; // TimeTaken over mPresentHistory
+
+    // Present-to-present intervals in QPC ticks, since the swapchain was
+    // first seen and over mPresentHistory.
+    LogHistogram mFrameTimes;
+    LogHistogram mWindowFrameTimes;
+
+    // The last INTERVAL_MEDIAN_WINDOW present-to-present (QpcTime) and
+    // display-to-display (ScreenTime) intervals in ticks, for spotting
+    // hitches against the swapchain's recent pace.
+    typedef RollingMedian<uint64_t, INTERVAL_MEDIAN_WINDOW> IntervalMedian;
+    IntervalMedian mPresentIntervals;
+    IntervalMedian mDisplayIntervals;
+
+    // Refresh period, vsyncs per frame and display jitter, from ScreenTime.
+    FramePacing mPacing;
+
+    // The window is historyTimeMs of presents; the histories grow to
+    // whatever that takes at the swapchain's present rate, limited to
+    // budgetKB for both together (the window is cut short by count only
+    // above that rate).  Must be called before the first present is added.
+    void SetHistoryWindow(uint32_t historyTimeMs, uint32_t budgetKB);
+
+    // The histories must only be changed through these two.
+    void AddPresentToSwapChain(CompletedFrame const& p);
+    void UpdateSwapChainInfo(CompletedFrame const& p, uint64_t now, QpcClock const& clock);
+
+    // Averages over the current window (at most mHistoryTimeMs), in
+    // seconds or per second; all O(1).
+    double ComputeDisplayedFps(QpcClock const& clock) const;
+    double ComputeFps(QpcClock const& clock) const;
+    double ComputeLatency(QpcClock const& clock) const;
+    double ComputeCpuFrameTime(QpcClock const& clock) const;
+
+    // Frame time (ms) that percentile (0..100) of the intervals are at or
+    // below, over the session or the window; e.g. 99 gives P99, and 1000 /
+    // P99 is the "1% low" fps.  Within 1% of the exact value.
+    double ComputeFrameTimePercentile(QpcClock const& clock, double percentile, bool window) const;
     bool IsStale(uint64_t now) const;
+    uint64_t ExpiryTicks() const; // IsStale() once now is past this
+
+    SwapChainData() : mPresentHistory(MaxHistorySamples(DEFAULT_HISTORY_BUDGET_KB)),
+        mDisplayedPresentHistory(MaxHistorySamples(DEFAULT_HISTORY_BUDGET_KB)) {}
+
+    // Largest power of two number of samples per history that fits in budgetKB.
+    static size_t MaxHistorySamples(uint32_t budgetKB);
+
 private:
-    double ComputeFps(const std::deque<PresentEvent>& presentHistory, uint64_t qpcFreq) const;
+    void DropPresentSample(size_t i);
+    void DropDisplayedSample(size_t i);
 };
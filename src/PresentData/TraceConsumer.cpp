@@ -23,14 +23,154 @@ SOFTWARE.
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
-#include <windows.h>
-#include <tdh.h> // must include after windows.h
+#include <unordered_map>
 
 #include "TraceConsumer.hpp"
+#include "EventSchema.hpp"
+
+#ifdef _WIN32
+#include <tdh.h> // must include after windows.h
+#endif
 
 namespace {
 
+// Each ETW/consumer thread keeps its own cache so lookups don't need a lock.
+// Handlers usually read several fields of the same event in a row, so
+// remember the last schema as well.
+thread_local std::unordered_map<uint64_t, EventSchema> schemaCache;
+thread_local uint64_t lastSchemaKey;
+thread_local EventSchema const* lastSchema = nullptr;
+
+// What identifies the schema of an event without TraceLogging metadata.  A
+// run of such events with the same identity as the last lookup skips the
+// hash.
+struct EventIdentity {
+    GUID ProviderId;
+    USHORT Id;
+    UCHAR Version;
+    UCHAR Opcode;
+    UCHAR Is32Bit;
+};
+thread_local EventIdentity lastIdentity;
+thread_local bool lastIdentityValid = false;
+
+bool HasTraceLoggingSchema(EVENT_RECORD const* pEventRecord)
+{
+    for (USHORT i = 0; i < pEventRecord->ExtendedDataCount; ++i) {
+        if (pEventRecord->ExtendedData[i].ExtType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Task names installed by SeedEventSchema(), consulted before TDH.
+thread_local std::unordered_map<uint64_t, std::wstring> seededTaskNames;
+
+#ifdef _WIN32
+
+// Size of a property of this type if it doesn't depend on the payload, 0
+// otherwise.
+uint32_t GetFixedTypeSize(USHORT inType, uint32_t pointerSize)
+{
+    switch (inType) {
+    case TDH_INTYPE_INT8:
+    case TDH_INTYPE_UINT8:      return 1;
+    case TDH_INTYPE_INT16:
+    case TDH_INTYPE_UINT16:     return 2;
+    case TDH_INTYPE_INT32:
+    case TDH_INTYPE_UINT32:
+    case TDH_INTYPE_HEXINT32:
+    case TDH_INTYPE_FLOAT:
+    case TDH_INTYPE_BOOLEAN:    return 4;
+    case TDH_INTYPE_INT64:
+    case TDH_INTYPE_UINT64:
+    case TDH_INTYPE_HEXINT64:
+    case TDH_INTYPE_DOUBLE:
+    case TDH_INTYPE_FILETIME:   return 8;
+    case TDH_INTYPE_GUID:
+    case TDH_INTYPE_SYSTEMTIME: return 16;
+    case TDH_INTYPE_POINTER:    return pointerSize;
+    }
+    return 0;
+}
+
+// Append a top-level property to the schema; the layout ends at the first
+// property whose extent EventSchema can't work out.
+void AddEventProperty(EventSchema* schema, wchar_t const* name, EVENT_PROPERTY_INFO const& prop, uint32_t pointerSize)
+{
+    if (prop.Flags & PropertyStruct) {
+        schema->EndLayout();
+        return;
+    }
+
+    auto inType = prop.nonStructType.InType;
+    if (prop.Flags & PropertyParamLength) {
+        // Only byte blobs have their length in bytes.
+        if (inType == TDH_INTYPE_BINARY) {
+            schema->AddField(name, EventSchema::FieldKind::CountedArray, 1, 1, prop.lengthPropertyIndex);
+        } else {
+            schema->EndLayout();
+        }
+        return;
+    }
+
+    auto isArray = (prop.Flags & PropertyParamCount) != 0 || prop.count != 1;
+    auto kind = EventSchema::FieldKind::Scalar;
+    switch (inType) {
+    case TDH_INTYPE_UNICODESTRING:  kind = EventSchema::FieldKind::UnicodeString; break;
+    case TDH_INTYPE_ANSISTRING:     kind = EventSchema::FieldKind::AnsiString; break;
+    case TDH_INTYPE_SID:            kind = EventSchema::FieldKind::Sid; break;
+    case TDH_INTYPE_WBEMSID:        kind = EventSchema::FieldKind::WbemSid; break;
+    }
+    if (kind != EventSchema::FieldKind::Scalar) {
+        // Fixed-length strings and arrays of strings or SIDs aren't handled.
+        if (isArray || prop.length != 0) {
+            schema->EndLayout();
+        } else {
+            schema->AddField(name, kind, 0);
+        }
+        return;
+    }
+
+    auto size = GetFixedTypeSize(inType, pointerSize);
+    if (size == 0) {
+        schema->EndLayout();
+    } else if (prop.Flags & PropertyParamCount) {
+        schema->AddField(name, EventSchema::FieldKind::CountedArray, size, 1, prop.countPropertyIndex);
+    } else {
+        schema->AddProperty(name, size, prop.count);
+    }
+}
+
+void BuildEventSchema(EVENT_RECORD* pEventRecord, EventSchema* schema)
+{
+    ULONG bufferSize = 0;
+    auto status = TdhGetEventInformation(pEventRecord, 0, nullptr, nullptr, &bufferSize);
+    if (status != ERROR_INSUFFICIENT_BUFFER) {
+        schema->EndLayout();
+        return;
+    }
+
+    auto bufferAddr = (uintptr_t) malloc(bufferSize);
+    auto info = (TRACE_EVENT_INFO*) bufferAddr;
+    status = TdhGetEventInformation(pEventRecord, 0, nullptr, info, &bufferSize);
+    if (status == ERROR_SUCCESS) {
+        auto pointerSize = (pEventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0 ? 4u : 8u;
+        schema->mPointerSize = pointerSize;
+        for (ULONG i = 0, N = info->TopLevelPropertyCount; i < N && !schema->IsLayoutEnded(); ++i) {
+            auto const& prop = info->EventPropertyInfoArray[i];
+            AddEventProperty(schema, (wchar_t const*)(bufferAddr + prop.NameOffset), prop, pointerSize);
+        }
+    } else {
+        schema->EndLayout();
+    }
+
+    free((void*) bufferAddr);
+}
+
 void PrintIndent(FILE* fp, uint32_t indent)
 {
     for (uint32_t i = 0; i < indent; ++i) {
@@ -126,10 +266,91 @@ void PrintEventProperty(FILE* fp, uintptr_t bufferAddr, EVENT_PROPERTY_INFO cons
     }
 }
 
+#else
+
+// Without TDH only seeded schemas have a layout.
+void BuildEventSchema(EVENT_RECORD*, EventSchema* schema)
+{
+    schema->EndLayout();
+}
+
+#endif
+
+}
+
+uint64_t GetEventSchemaKey(EVENT_RECORD const* pEventRecord)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    uint64_t key = 14695981039346656037ull; // FNV-1a
+    auto mix = [&key](void const* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            key = (key ^ ((uint8_t const*) data)[i]) * 1099511628211ull;
+        }
+    };
+
+    uint8_t is32Bit = (hdr.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0;
+    mix(&hdr.ProviderId, sizeof(GUID));
+    mix(&hdr.EventDescriptor.Id, sizeof(hdr.EventDescriptor.Id));
+    mix(&hdr.EventDescriptor.Version, sizeof(hdr.EventDescriptor.Version));
+    mix(&hdr.EventDescriptor.Opcode, sizeof(hdr.EventDescriptor.Opcode));
+    mix(&is32Bit, sizeof(is32Bit));
+    for (USHORT i = 0; i < pEventRecord->ExtendedDataCount; ++i) {
+        auto const& item = pEventRecord->ExtendedData[i];
+        if (item.ExtType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL) {
+            mix((void const*)(uintptr_t) item.DataPtr, item.DataSize);
+            break;
+        }
+    }
+    return key;
+}
+
+EventSchema const& GetEventSchema(EVENT_RECORD* pEventRecord)
+{
+    auto const& hdr = pEventRecord->EventHeader;
+    EventIdentity identity;
+    memset(&identity, 0, sizeof(identity)); // compared with memcmp, padding included
+    auto hasIdentity = !HasTraceLoggingSchema(pEventRecord);
+    if (hasIdentity) {
+        identity.ProviderId = hdr.ProviderId;
+        identity.Id = hdr.EventDescriptor.Id;
+        identity.Version = hdr.EventDescriptor.Version;
+        identity.Opcode = hdr.EventDescriptor.Opcode;
+        identity.Is32Bit = (hdr.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0;
+        if (lastSchema != nullptr && lastIdentityValid && memcmp(&identity, &lastIdentity, sizeof(identity)) == 0) {
+            return *lastSchema;
+        }
+    }
+
+    auto key = GetEventSchemaKey(pEventRecord);
+    if (lastSchema != nullptr && key == lastSchemaKey) {
+        lastIdentity = identity;
+        lastIdentityValid = hasIdentity;
+        return *lastSchema;
+    }
+
+    auto ii = schemaCache.find(key);
+    if (ii == schemaCache.end()) {
+        ii = schemaCache.emplace(key, EventSchema()).first;
+        BuildEventSchema(pEventRecord, &ii->second);
+    }
+
+    lastSchemaKey = key;
+    lastSchema = &ii->second;
+    lastIdentity = identity;
+    lastIdentityValid = hasIdentity;
+    return ii->second;
+}
+
+void SeedEventSchema(uint64_t key, EventSchema const& schema, std::wstring const& taskName)
+{
+    schemaCache[key] = schema;
+    seededTaskNames[key] = taskName;
+    lastSchema = nullptr;
 }
 
 void PrintEventInformation(FILE* fp, EVENT_RECORD* pEventRecord)
 {
+#ifdef _WIN32
     ULONG bufferSize = 0;
     auto status = TdhGetEventInformation(pEventRecord, 0, nullptr, nullptr, &bufferSize);
     if (status == ERROR_INSUFFICIENT_BUFFER) {
@@ -152,11 +373,23 @@ void PrintEventInformation(FILE* fp, EVENT_RECORD* pEventRecord)
 
         free((void*) bufferAddr);
     }
+#else
+    auto const& desc = pEventRecord->EventHeader.EventDescriptor;
+    fprintf(fp, "event id %u version %u opcode %u\n", desc.Id, desc.Version, desc.Opcode);
+#endif
 }
 
 std::wstring GetEventTaskName(EVENT_RECORD* pEventRecord)
 {
+    if (!seededTaskNames.empty()) {
+        auto ii = seededTaskNames.find(GetEventSchemaKey(pEventRecord));
+        if (ii != seededTaskNames.end()) {
+            return ii->second;
+        }
+    }
+
     std::wstring taskName = L"";
+#ifdef _WIN32
     ULONG bufferSize = 0;
     auto status = TdhGetEventInformation(pEventRecord, 0, nullptr, nullptr, &bufferSize);
     if (status == ERROR_INSUFFICIENT_BUFFER) {
@@ -170,13 +403,50 @@ std::wstring GetEventTaskName(EVENT_RECORD* pEventRecord)
 
         free((void*)bufferAddr);
     }
+#endif
 
     return taskName;
 }
 
+bool GetTdhEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, void* out, uint32_t outSize, uint32_t arrayIndex, bool bPrintOnError)
+{
+#ifdef _WIN32
+    PROPERTY_DATA_DESCRIPTOR descriptor;
+    descriptor.PropertyName = (ULONGLONG) name;
+    descriptor.ArrayIndex = arrayIndex;
+
+    auto status = TdhGetProperty(pEventRecord, 0, nullptr, 1, &descriptor, outSize, (BYTE*) out);
+    if (status != ERROR_SUCCESS) {
+        if (bPrintOnError) {
+            fprintf(stderr, "error: could not get event %ls property (error=%lu).\n", name, status);
+            PrintEventInformation(stderr, pEventRecord);
+        }
+        return false;
+    }
+
+    return true;
+#else
+    (void) out;
+    (void) outSize;
+    (void) arrayIndex;
+    if (bPrintOnError) {
+        fprintf(stderr, "error: could not get event %ls property (not in the event's schema).\n", name);
+        PrintEventInformation(stderr, pEventRecord);
+    }
+    return false;
+#endif
+}
+
 template <>
 bool GetEventData<std::string>(EVENT_RECORD* pEventRecord, wchar_t const* name, std::string* out, bool bPrintOnError)
 {
+    auto const& schema = GetEventSchema(pEventRecord);
+    auto field = schema.FindField(name);
+    if (field != nullptr && schema.ReadBytes(pEventRecord->UserData, pEventRecord->UserDataLength, int32_t(field - schema.mFields.data()), out)) {
+        return true;
+    }
+
+#ifdef _WIN32
     PROPERTY_DATA_DESCRIPTOR descriptor;
     descriptor.PropertyName = (ULONGLONG) name;
     descriptor.ArrayIndex = ULONG_MAX;
@@ -201,4 +471,20 @@ bool GetEventData<std::string>(EVENT_RECORD* pEventRecord, wchar_t const* name,
     }
 
     return true;
+#else
+    return GetTdhEventData(pEventRecord, name, nullptr, 0, UINT32_MAX, bPrintOnError);
+#endif
+}
+
+bool GetCachedEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, uint32_t arrayIndex, void* out, size_t outSize)
+{
+    auto const& schema = GetEventSchema(pEventRecord);
+    auto field = schema.FindField(name);
+    if (field == nullptr) {
+        return false;
+    }
+    auto index = int32_t(field - schema.mFields.data());
+    return arrayIndex == UINT32_MAX
+        ? schema.ReadField(pEventRecord->UserData, pEventRecord->UserDataLength, index, out, outSize)
+        : schema.ReadElement(pEventRecord->UserData, pEventRecord->UserDataLength, index, arrayIndex, out, outSize);
 }
@@ -22,32 +22,49 @@ SOFTWARE.
 
 #pragma once
 
-#include <windows.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string>
-#include <tdh.h>
+#include <type_traits>
 #include <vector>
 
+#include "EventRecord.hpp"
+#include "EventSchema.hpp"
+
 void PrintEventInformation(FILE* fp, EVENT_RECORD* pEventRecord);
 std::wstring GetEventTaskName(EVENT_RECORD* pEventRecord);
 
+// Identifies the layout of an event's payload: a hash of the provider, event
+// id, version, opcode and pointer size, plus the TraceLogging metadata for
+// TraceLogging events since those all share one descriptor per provider.
+uint64_t GetEventSchemaKey(EVENT_RECORD const* pEventRecord);
+
+// The calling thread's cached layout for the event's schema, built with TDH
+// on first use (off Windows, only seeded schemas have fields).
+EventSchema const& GetEventSchema(EVENT_RECORD* pEventRecord);
+
+// Install a layout and task name for a schema key on the calling thread, so
+// matching events are decoded without TDH (e.g. when replaying a capture on
+// a machine without the provider manifests).
+void SeedEventSchema(uint64_t key, EventSchema const& schema, std::wstring const& taskName);
+
+// Read a top-level property (an array element unless arrayIndex is
+// UINT32_MAX) through the layout in the per-thread schema cache.
+// Returns false if the schema doesn't record the property, in which case the
+// caller should use TDH.
+bool GetCachedEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, uint32_t arrayIndex, void* out, size_t outSize);
+
+// Read a property (an array element unless arrayIndex is UINT32_MAX) with
+// TdhGetProperty.  Always fails off Windows.
+bool GetTdhEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, void* out, uint32_t outSize, uint32_t arrayIndex, bool bPrintOnError);
+
 template <typename T>
 bool GetEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, T* out, uint32_t arrayIndex, bool bPrintOnError = true)
 {
-    PROPERTY_DATA_DESCRIPTOR descriptor;
-    descriptor.PropertyName = (ULONGLONG)name;
-    descriptor.ArrayIndex = arrayIndex;
-
-    auto status = TdhGetProperty(pEventRecord, 0, nullptr, 1, &descriptor, sizeof(T), (BYTE*)out);
-    if (status != ERROR_SUCCESS) {
-        if (bPrintOnError) {
-            fprintf(stderr, "error: could not get event %ls property (error=%lu).\n", name, status);
-            PrintEventInformation(stderr, pEventRecord);
-        }
-        return false;
+    if (GetCachedEventData(pEventRecord, name, arrayIndex, out, sizeof(T))) {
+        return true;
     }
-
-    return true;
+    return GetTdhEventData(pEventRecord, name, out, sizeof(T), arrayIndex, bPrintOnError);
 }
 
 template <typename T>
@@ -62,7 +79,7 @@ T GetEventDataFromArray(EVENT_RECORD* pEventRecord, wchar_t const* name, uint32_
 template <typename T>
 bool GetEventData(EVENT_RECORD* pEventRecord, wchar_t const* name, T* out, bool bPrintOnError = true)
 {
-    return GetEventData<T>(pEventRecord, name, out, ULONG_MAX, bPrintOnError);
+    return GetEventData<T>(pEventRecord, name, out, UINT32_MAX, bPrintOnError);
 }
 
 template <typename T>
@@ -74,4 +91,60 @@ T GetEventData(EVENT_RECORD* pEventRecord, wchar_t const* name)
     return value;
 }
 
+// The property's raw bytes, including a string's terminator.
 template <> bool GetEventData<std::string>(EVENT_RECORD* pEventRecord, wchar_t const* name, std::string* out, bool bPrintOnError);
+
+// Reads the fields of one event named in an EventFieldList.  The schema is
+// looked up once per event and each field is read where the schema resolved
+// it to; fields the schema doesn't record go through TDH by name.  Field
+// indices are the list's enum.
+class EventDataReader {
+public:
+    EventDataReader(EVENT_RECORD* pEventRecord, EventFieldList const& fields)
+        : mEventRecord(pEventRecord)
+        , mFields(fields)
+        , mSchema(GetEventSchema(pEventRecord))
+        , mIndices(mSchema.Resolve(fields))
+    {
+    }
+
+    template <typename T>
+    bool Get(uint32_t field, T* out, bool bPrintOnError = true)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "strings are read with GetEventData<std::string>()");
+        return mSchema.ReadField(mEventRecord->UserData, mEventRecord->UserDataLength, mIndices[field], out, sizeof(T)) ||
+               GetTdhEventData(mEventRecord, mFields.mNames[field], out, sizeof(T), UINT32_MAX, bPrintOnError);
+    }
+
+    template <typename T>
+    T Get(uint32_t field)
+    {
+        T value = {};
+        auto ok = Get(field, &value);
+        (void) ok;
+        return value;
+    }
+
+    template <typename T>
+    T GetArrayElement(uint32_t field, uint32_t index)
+    {
+        T value = {};
+        auto ok = mSchema.ReadElement(mEventRecord->UserData, mEventRecord->UserDataLength, mIndices[field], index, &value, sizeof(T)) ||
+                  GetTdhEventData(mEventRecord, mFields.mNames[field], &value, sizeof(T), index, true);
+        (void) ok;
+        return value;
+    }
+
+    // The field's raw bytes, including a string's terminator.
+    bool GetBytes(uint32_t field, std::string* out)
+    {
+        return mSchema.ReadBytes(mEventRecord->UserData, mEventRecord->UserDataLength, mIndices[field], out) ||
+               GetEventData<std::string>(mEventRecord, mFields.mNames[field], out, true);
+    }
+
+private:
+    EVENT_RECORD* mEventRecord;
+    EventFieldList const& mFields;
+    EventSchema const& mSchema;
+    int32_t const* mIndices;
+};
@@ -0,0 +1,110 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <algorithm>
+
+#include "BufferTuner.hpp"
+
+BufferTuner::BufferTuner(Config const& config, bool enabled)
+    : mInitial(config)
+    , mConfig(config)
+    , mRecommended(config)
+    , mEnabled(enabled)
+{
+}
+
+BufferTuner::Sample BufferTuner::MakeSample(uint64_t tickMs, uint32_t eventsLost, uint32_t buffersLost,
+                                            uint32_t numberOfBuffers, uint32_t freeBuffers, double consumerBacklog)
+{
+    Sample sample;
+    sample.mTickMs = tickMs;
+    sample.mEventsLost = eventsLost;
+    sample.mBuffersLost = buffersLost;
+    sample.mNumberOfBuffers = numberOfBuffers;
+    sample.mBuffersInUse = freeBuffers < numberOfBuffers ? numberOfBuffers - freeBuffers : 0;
+    sample.mConsumerBacklog = consumerBacklog;
+    return sample;
+}
+
+bool BufferTuner::Update(Sample const& sample)
+{
+    // Poll faster while the consumer queues fill up, relax once drained.
+    if (sample.mConsumerBacklog > 0.5) {
+        mPollIntervalMs = FAST_POLL_MS;
+    } else if (sample.mConsumerBacklog < 0.1) {
+        mPollIntervalMs = SLOW_POLL_MS;
+    }
+
+    if (!mEnabled) {
+        return false;
+    }
+
+    auto lost = sample.mEventsLost != 0 || sample.mBuffersLost != 0;
+    auto allocated = std::max(sample.mNumberOfBuffers, 1u);
+    auto occupancy = (double) sample.mBuffersInUse / allocated;
+    auto maximum = std::max(mConfig.mMaximumBuffers, sample.mNumberOfBuffers);
+
+    if (lost || occupancy > 0.75) {
+        mQuietSinceMs = sample.mTickMs;
+        if (mLastGrowMs != 0 && sample.mTickMs - mLastGrowMs < GROW_INTERVAL_MS) {
+            return false;
+        }
+        mLastGrowMs = sample.mTickMs;
+
+        // Lost events also mean the session started too small: recommend
+        // larger buffers and a higher floor for the next one.
+        if (lost) {
+            mRecommended.mBufferSizeKB = std::min<uint32_t>(std::max(mRecommended.mBufferSizeKB, 64u) * 2, MAX_BUFFER_SIZE_KB);
+            mRecommended.mMinimumBuffers = std::max(mRecommended.mMinimumBuffers, sample.mNumberOfBuffers);
+        }
+
+        if (maximum >= MAX_BUFFERS_CEILING && mConfig.mFlushTimerSeconds == 1) {
+            return false;
+        }
+        mConfig.mMaximumBuffers = std::min<uint32_t>(std::max(maximum, 1u) * 2, MAX_BUFFERS_CEILING);
+        mConfig.mFlushTimerSeconds = 1;
+        mRecommended.mMaximumBuffers = std::max(mRecommended.mMaximumBuffers, mConfig.mMaximumBuffers);
+        mRetuneCount += 1;
+        return true;
+    }
+
+    if (occupancy >= 0.25) {
+        mQuietSinceMs = sample.mTickMs;
+        return false;
+    }
+    if (mQuietSinceMs == 0) {
+        mQuietSinceMs = sample.mTickMs;
+        return false;
+    }
+    if (sample.mTickMs - mQuietSinceMs < SHRINK_QUIET_MS || mConfig.mMaximumBuffers <= mInitial.mMaximumBuffers) {
+        return false;
+    }
+
+    mQuietSinceMs = sample.mTickMs;
+    mConfig.mMaximumBuffers = std::max(mConfig.mMaximumBuffers / 2, mInitial.mMaximumBuffers);
+    if (mConfig.mMaximumBuffers == mInitial.mMaximumBuffers) {
+        mConfig.mFlushTimerSeconds = mInitial.mFlushTimerSeconds;
+    }
+    mRetuneCount += 1;
+    return true;
+}
@@ -0,0 +1,93 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+// Decides how a realtime session's buffers should be sized from the loss and
+// occupancy it reports.
+//
+// Loss or buffers running more than 3/4 full grow MaximumBuffers (doubling,
+// at most once a second) and drop FlushTimer to 1s so buffers reach the
+// consumer sooner.  After a minute without loss at under 1/4 occupancy
+// MaximumBuffers is halved again, down to the configured value.  ETW only
+// lets a running session change MaximumBuffers and FlushTimer; BufferSize and
+// MinimumBuffers are reported as a recommendation for the next session.
+//
+// Separately, the consumer's poll interval is shortened while its output
+// queues are filling up, since presents dropped there never reach the
+// scores.
+struct BufferTuner {
+    struct Config {
+        uint32_t mBufferSizeKB;      // 0 for the ETW default
+        uint32_t mMinimumBuffers;
+        uint32_t mMaximumBuffers;    // 0 for the ETW default
+        uint32_t mFlushTimerSeconds; // 0 for the ETW default
+    };
+
+    struct Sample {
+        uint64_t mTickMs;
+        uint32_t mEventsLost;       // since the previous sample
+        uint32_t mBuffersLost;      // since the previous sample
+        uint32_t mBuffersInUse;
+        uint32_t mNumberOfBuffers;  // currently allocated by ETW
+        double mConsumerBacklog;    // fullest consumer queue, 0..1
+    };
+
+    enum {
+        MAX_BUFFERS_CEILING = 2048,
+        MAX_BUFFER_SIZE_KB = 1024,
+        GROW_INTERVAL_MS = 1000,
+        SHRINK_QUIET_MS = 60000,
+        FAST_POLL_MS = 10,
+        SLOW_POLL_MS = 100,
+    };
+
+    BufferTuner(Config const& config, bool enabled);
+
+    // Builds a sample from the counters a session reports; ETW reports free
+    // buffers rather than buffers in use, and the two can be read out of
+    // step.
+    static Sample MakeSample(uint64_t tickMs, uint32_t eventsLost, uint32_t buffersLost,
+                             uint32_t numberOfBuffers, uint32_t freeBuffers, double consumerBacklog);
+
+    // Returns true if MaximumBuffers/FlushTimer should be pushed to the
+    // session.
+    bool Update(Sample const& sample);
+
+    Config const& GetConfig() const { return mConfig; }
+    Config const& GetRecommendedConfig() const { return mRecommended; }
+    uint32_t GetPollIntervalMs() const { return mPollIntervalMs; }
+    uint32_t GetRetuneCount() const { return mRetuneCount; }
+
+private:
+    Config mInitial;
+    Config mConfig;
+    Config mRecommended;
+    bool mEnabled;
+    uint64_t mLastGrowMs = 0;
+    uint64_t mQuietSinceMs = 0;
+    uint32_t mPollIntervalMs = SLOW_POLL_MS;
+    uint32_t mRetuneCount = 0;
+};
@@ -0,0 +1,42 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+
+// Fewer intervals than this and the median is not trusted to judge one.
+#define HITCH_MIN_INTERVALS 8
+
+// Whether an interval is a hitch against median, the rolling median of the
+// medianCount intervals before it: longer than factor * median, or longer
+// than median by more than marginMs.  A factor or margin of 0 disables that
+// test.
+inline bool IsHitch(double intervalMs, double medianMs, size_t medianCount, double factor, double marginMs)
+{
+    if (medianCount < HITCH_MIN_INTERVALS || medianMs <= 0.0) {
+        return false;
+    }
+    return (factor > 0.0 && intervalMs > factor * medianMs) ||
+           (marginMs > 0.0 && intervalMs - medianMs > marginMs);
+}
@@ -22,31 +22,67 @@ SOFTWARE.
 
 #include <algorithm>
 #include <shlwapi.h>
+#include <tlhelp32.h>
 
 #include "TraceSession.hpp"
 #include "PresentMon.hpp"
+#include "..\PresentData\ShardedTraceConsumer.hpp"
+#include "..\PresentData\RuntimeTraceConsumer.hpp"
+#include "..\PresentData\EventReplay.hpp"
+#include "..\PresentData\ParallelAnalysis.hpp"
 #include "Logger.hpp"
 #include "Privilege.hpp"
+#include "BufferTuner.hpp"
+#include "HitchDetector.hpp"
 
 #include "DataBuffer.h"
 #include "timing.h"
+#include "qpc_clock.h"
 
 namespace spd = spdlog;
 
 #define MAX_CAPTURE_SAMPLES (60*86400*7)
+#define MAX_CONSUMER_SHARDS 64
+#define CLOCK_ANCHOR_INTERVAL_MS 60000
+#define MAX_HISTORY_TIME_MS (60*60*1000)
+#define MAX_HISTORY_BUDGET_KB (256*1024)
+#define HITCH_BUFFER_SIZE 4096
+#define PROCESS_REFRESH_TICKS 1000 // ms between polls of a process the process events don't vouch for
 
 extern bool CheckPriviliges();
-void EtwConsumingThread(uint32_t TargetPid);
+void EtwConsumingThread(uint32_t TargetPid, uint32_t shardCount, CaptureProfile profile, std::string captureFile,
+                        TraceSession::BufferConfig bufferConfig, bool autoTuneBuffers, uint32_t historyTimeMs,
+                        uint32_t historyBudgetKB, double hitchFactor, double hitchMarginMs);
 void PresentMon_Init(uint32_t TargetPid, PresentMonData& data);
-void PresentMon_Update(PresentMonData& data, std::vector<std::shared_ptr<PresentEvent>>& presents, std::vector<std::shared_ptr<LateStageReprojectionEvent>>& lsrs, uint64_t perfFreq);
+void PresentMon_Update(PresentMonData& data, std::vector<CompletedFrame>& presents, std::vector<std::shared_ptr<LateStageReprojectionEvent>>& lsrs, uint64_t now, QpcClock const& clock);
 void PresentMon_Shutdown(PresentMonData& data, bool log_corrupted);
 bool EtwThreadsShouldQuit();
 
 std::thread g_EtwConsumingThread;
 bool g_StopEtwThreads = true;
 DataBuffer<EventScores> *g_ScoreBuffer = NULL;
-double g_FirstTimestamp = 0;
-uint64_t g_QpcFirst = 0;
+DataBuffer<HitchEvent> *g_HitchBuffer = NULL;
+uint32_t g_ConsumerShards = 1;
+CaptureProfile g_CaptureProfile = FULL_CAPTURE_PROFILE;
+std::string g_CaptureFile;
+TraceSession::BufferConfig g_BufferConfig = { 0, 200, 0, 0 };
+bool g_AutoTuneBuffers = true;
+uint32_t g_HistoryTimeMs = SwapChainData::DEFAULT_HISTORY_TIME;
+uint32_t g_HistoryBudgetKB = SwapChainData::DEFAULT_HISTORY_BUDGET_KB;
+double g_HitchFactor = 2.0;
+double g_HitchMarginMs = 0.0;
+std::mutex g_LossStatsMutex;
+EventLossStats g_LossStats = {};
+std::mutex g_SwapChainStatsMutex;
+std::vector<SwapChainStats> g_SwapChainStats;
+struct FrameTimeSummary {
+    LogHistogram mSession;
+    LogHistogram mWindow;
+};
+std::vector<FrameTimeSummary> g_FrameTimeSummaries; // by chain slot, kept current with copy_changed_to()
+std::vector<uint32_t> g_SwapChainSlots;             // chain slot of each of g_SwapChainStats
+double g_FrameTimeMsPerTick = 0.0;
+std::vector<DisplayRefreshStats> g_DisplayRefresh; // also under g_SwapChainStatsMutex
 
 extern "C" {
     BOOL WINAPI DllMain (HANDLE hInst, ULONG reason, LPVOID reserved) {
@@ -86,14 +122,20 @@ int StartEventRecording(int TargetPid, int arraySize) {
         delete g_ScoreBuffer;
         g_ScoreBuffer = nullptr;
     }
+    if (g_HitchBuffer) {
+        delete g_HitchBuffer;
+        g_HitchBuffer = nullptr;
+    }
 
     if (!CheckPriviliges())
         return PRIVILIGIES_ERROR;
 
     g_ScoreBuffer = new DataBuffer<EventScores>(arraySize);
+    g_HitchBuffer = new DataBuffer<HitchEvent>(HITCH_BUFFER_SIZE);
 
     g_StopEtwThreads = false;
-    g_EtwConsumingThread = std::thread(EtwConsumingThread, TargetPid);
+    g_EtwConsumingThread = std::thread(EtwConsumingThread, TargetPid, g_ConsumerShards, g_CaptureProfile, g_CaptureFile,
+        g_BufferConfig, g_AutoTuneBuffers, g_HistoryTimeMs, g_HistoryBudgetKB, g_HitchFactor, g_HitchMarginMs);
     return STATUS_OK;
 }
 
@@ -108,6 +150,199 @@ int StopEventRecording() {
     return STATUS_OK;
 }
 
+int SetConsumerShards(int shardCount) {
+    if (shardCount < 1 || shardCount > MAX_CONSUMER_SHARDS) {
+        g_InspectorLogger->error("Incorrect number of consumer shards");
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_ConsumerShards = uint32_t(shardCount);
+    return STATUS_OK;
+}
+
+int SetCaptureProfile(int profile) {
+    if (profile != FULL_CAPTURE_PROFILE && profile != RUNTIME_CAPTURE_PROFILE) {
+        g_InspectorLogger->error("Incorrect capture profile");
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_CaptureProfile = CaptureProfile(profile);
+    return STATUS_OK;
+}
+
+int SetCaptureFile(const char *path) {
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_CaptureFile = path ? path : "";
+    return STATUS_OK;
+}
+
+int AnalyzeCaptureFile(const char *path, int threadCount, int maxCount, CaptureSwapChainStats *statsBuf, int *returnedCount) {
+    if (!path || !statsBuf || !returnedCount || threadCount < 0 || maxCount < 0)
+        return INVALID_ARGUMENTS_ERROR;
+
+    EventCaptureFileHeader header;
+    if (!EventCaptureReader::ReadHeader(path, &header) || header.QpcFrequency <= 0) {
+        g_InspectorLogger->error("Can't read capture {}", path);
+        return GENERAL_ERROR;
+    }
+    QpcClock clock((uint64_t) header.QpcFrequency);
+
+    uint32_t threads = threadCount != 0 ? uint32_t(threadCount) : std::max(1u, std::thread::hardware_concurrency());
+    SwapChainFrames swapChains;
+    if (!AnalyzeCapture(path, threads, &swapChains)) {
+        g_InspectorLogger->error("Capture {} is corrupt", path);
+        return GENERAL_ERROR;
+    }
+
+    int count = 0;
+    for (auto const& ii : swapChains) {
+        if (count == maxCount)
+            break;
+        auto const& frames = ii.second;
+        CaptureSwapChainStats stats = {};
+        stats.processId = ii.first.first;
+        stats.swapChainAddress = (double) ii.first.second;
+        stats.presentCount = (double) frames.size();
+
+        uint64_t firstQpc = UINT64_MAX;
+        uint64_t lastQpc = 0;
+        double latencyMs = 0.0;
+        for (auto const& frame : frames) {
+            firstQpc = std::min(firstQpc, frame.QpcTime);
+            lastQpc = std::max(lastQpc, frame.QpcTime);
+            if (frame.FinalState == PresentResult::Presented && frame.ScreenTime > frame.QpcTime) {
+                stats.displayedCount += 1;
+                latencyMs += clock.toMs(frame.ScreenTime - frame.QpcTime);
+            }
+        }
+        stats.durationMs = clock.toMs(lastQpc - firstQpc);
+        if (frames.size() > 1 && stats.durationMs > 0.0) {
+            stats.fps = 1000.0 * (stats.presentCount - 1) / stats.durationMs;
+            stats.displayedFps = 1000.0 * stats.displayedCount / stats.durationMs;
+        }
+        stats.latencyMs = stats.displayedCount != 0 ? latencyMs / stats.displayedCount : 0.0;
+        statsBuf[count++] = stats;
+    }
+    *returnedCount = count;
+    return STATUS_OK;
+}
+
+int SetSessionBuffers(int bufferSizeKB, int minimumBuffers, int maximumBuffers, int flushTimerSeconds, int autoTune) {
+    if (bufferSizeKB < 0 || bufferSizeKB > BufferTuner::MAX_BUFFER_SIZE_KB || minimumBuffers < 0 ||
+        maximumBuffers < 0 || maximumBuffers > BufferTuner::MAX_BUFFERS_CEILING ||
+        (maximumBuffers != 0 && maximumBuffers < minimumBuffers) || flushTimerSeconds < 0) {
+        g_InspectorLogger->error("Incorrect session buffer configuration");
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_BufferConfig.bufferSizeKB_ = ULONG(bufferSizeKB);
+    g_BufferConfig.minimumBuffers_ = ULONG(minimumBuffers);
+    g_BufferConfig.maximumBuffers_ = ULONG(maximumBuffers);
+    g_BufferConfig.flushTimerSeconds_ = ULONG(flushTimerSeconds);
+    g_AutoTuneBuffers = autoTune != 0;
+    return STATUS_OK;
+}
+
+int SetHistoryWindow(int historyTimeMs, int budgetKB) {
+    if (historyTimeMs <= 0 || historyTimeMs > MAX_HISTORY_TIME_MS || budgetKB <= 0 || budgetKB > MAX_HISTORY_BUDGET_KB) {
+        g_InspectorLogger->error("Incorrect history window {} ms, {} KB", historyTimeMs, budgetKB);
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_HistoryTimeMs = uint32_t(historyTimeMs);
+    g_HistoryBudgetKB = uint32_t(budgetKB);
+    return STATUS_OK;
+}
+
+int SetHitchDetection(double factor, double marginMs) {
+    if (factor < 0.0 || (factor > 0.0 && factor <= 1.0) || marginMs < 0.0) {
+        g_InspectorLogger->error("Incorrect hitch detection factor {} / margin {} ms", factor, marginMs);
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (g_EtwConsumingThread.joinable())
+        return EVENT_RECORDING_ALREADY_RUN_ERROR;
+
+    g_HitchFactor = factor;
+    g_HitchMarginMs = marginMs;
+    return STATUS_OK;
+}
+
+int GetEventLossStats(EventLossStats *stats) {
+    if (!stats)
+        return INVALID_ARGUMENTS_ERROR;
+
+    std::lock_guard<std::mutex> lock(g_LossStatsMutex);
+    *stats = g_LossStats;
+    return STATUS_OK;
+}
+
+int GetSwapChainStats(int maxCount, SwapChainStats *statsBuf, int *returnedCount) {
+    if (!statsBuf || !returnedCount || maxCount < 0)
+        return INVALID_ARGUMENTS_ERROR;
+
+    std::lock_guard<std::mutex> lock(g_SwapChainStatsMutex);
+    size_t count = g_SwapChainStats.size() < (size_t) maxCount ? g_SwapChainStats.size() : (size_t) maxCount;
+    std::copy(g_SwapChainStats.begin(), g_SwapChainStats.begin() + count, statsBuf);
+    *returnedCount = int(count);
+    return STATUS_OK;
+}
+
+int GetFrameTimePercentiles(int processId, uint64_t swapChainAddress, int window, int count, const double *percentiles, double *frameTimesMs) {
+    if (!percentiles || !frameTimesMs || count < 0)
+        return INVALID_ARGUMENTS_ERROR;
+
+    std::lock_guard<std::mutex> lock(g_SwapChainStatsMutex);
+    for (size_t i = 0; i < g_SwapChainStats.size(); ++i) {
+        if (g_SwapChainStats[i].processId != processId || g_SwapChainStats[i].swapChainAddress != (double) swapChainAddress)
+            continue;
+
+        auto const& summary = g_FrameTimeSummaries[g_SwapChainSlots[i]];
+        auto const& frameTimes = window ? summary.mWindow : summary.mSession;
+        for (int j = 0; j < count; ++j) {
+            frameTimesMs[j] = g_FrameTimeMsPerTick * frameTimes.quantile(percentiles[j] / 100.0);
+        }
+        return STATUS_OK;
+    }
+    g_InspectorLogger->error("No swapchain {:x} in process {}", swapChainAddress, processId);
+    return INVALID_ARGUMENTS_ERROR;
+}
+
+int GetDisplayRefresh(int maxCount, DisplayRefreshStats *statsBuf, int *returnedCount) {
+    if (!statsBuf || !returnedCount || maxCount < 0)
+        return INVALID_ARGUMENTS_ERROR;
+
+    std::lock_guard<std::mutex> lock(g_SwapChainStatsMutex);
+    size_t count = g_DisplayRefresh.size() < (size_t) maxCount ? g_DisplayRefresh.size() : (size_t) maxCount;
+    std::copy(g_DisplayRefresh.begin(), g_DisplayRefresh.begin() + count, statsBuf);
+    *returnedCount = int(count);
+    return STATUS_OK;
+}
+
+int GetHitchEvents(int maxCount, double *tsBuf, HitchEvent *hitchBuf, int *returnedCount) {
+    if (!g_HitchBuffer)
+    {
+        g_InspectorLogger->error("buffer is uninitialized.");
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    if (!tsBuf || !hitchBuf || !returnedCount || maxCount < 0)
+    {
+        g_InspectorLogger->error("output array is uninitialized.");
+        return INVALID_ARGUMENTS_ERROR;
+    }
+    *returnedCount = int(g_HitchBuffer->getData(maxCount, tsBuf, hitchBuf));
+    return STATUS_OK;
+}
+
 int GetCurrentData(int numSamples, EventScores *OutputBuf, double *timeOutputBuf, int *returnedSamples) {
     if (g_ScoreBuffer && OutputBuf && timeOutputBuf && returnedSamples) {
         size_t result = g_ScoreBuffer->getCurrentData(numSamples, timeOutputBuf, OutputBuf);
@@ -152,15 +387,6 @@ bool EtwThreadsShouldQuit()
     return g_StopEtwThreads;
 }
 
-template <typename Map, typename F>
-static void map_erase_if(Map& m, F pred)
-{
-    typename Map::iterator i = m.begin();
-    while ((i = std::find_if(i, m.end(), pred)) != m.end()) {
-        m.erase(i++);
-    }
-}
-
 static bool IsTargetProcess(uint32_t targetPid, uint32_t processId)
 {
     // -capture_all
@@ -176,17 +402,19 @@ static bool IsTargetProcess(uint32_t targetPid, uint32_t processId)
     return false;
 }
 
-static void StopProcess(PresentMonData& pm, std::map<uint32_t, ProcessInfo>::iterator it)
-{
-    pm.mProcessMap.erase(it);
-}
-
 static void StopProcess(PresentMonData& pm, uint32_t processId)
 {
-    auto it = pm.mProcessMap.find(processId);
-    if (it != pm.mProcessMap.end()) {
-        StopProcess(pm, it);
+    auto slot = pm.mProcessIndex.find(processId);
+    if (slot == NO_SLOT) {
+        return;
+    }
+
+    auto& proc = pm.mProcesses[slot];
+    for (uint32_t i = 0; i < proc.mChainCount; ++i) {
+        pm.mChains.release(proc.Chain(i).mSlot);
     }
+    pm.mProcessIndex.erase(processId);
+    pm.mProcesses.release(slot);
 }
 
 static ProcessInfo* StartNewProcess(PresentMonData& pm, ProcessInfo* proc, uint32_t processId, std::string const& imageFileName, uint64_t now)
@@ -201,158 +429,479 @@ static ProcessInfo* StartNewProcess(PresentMonData& pm, ProcessInfo* proc, uint3
     return proc;
 }
 
-static ProcessInfo* StartProcess(PresentMonData& pm, uint32_t processId, std::string const& imageFileName, uint64_t now)
+static void QueueProcessPoll(PresentMonData& pm, ProcessInfo& proc, uint64_t now)
 {
-    auto it = pm.mProcessMap.find(processId);
-    if (it != pm.mProcessMap.end()) {
-        StopProcess(pm, it);
+    if (!proc.mPollQueued) {
+        proc.mPollQueued = true;
+        pm.mProcessExpiry.push(now + PROCESS_REFRESH_TICKS, ProcessExpiryKey{ proc.mProcessId, proc.mSerial });
     }
+}
 
-    auto proc = &pm.mProcessMap.emplace(processId, ProcessInfo()).first->second;
-    return StartNewProcess(pm, proc, processId, imageFileName, now);
+static ProcessInfo* AddProcess(PresentMonData& pm, uint32_t processId, uint64_t now)
+{
+    auto slot = pm.mProcesses.acquire();
+    pm.mProcessIndex.insert(processId, slot);
+    auto proc = &pm.mProcesses[slot];
+    proc->mProcessId = processId;
+    proc->mSerial = pm.mNextProcessSerial++;
+
+    // Processes whose start event was seen end with their end event; the
+    // others are polled until a poll finds them gone (or confirms them).
+    if (!pm.mLifetimes.IsConfirmed(processId)) {
+        proc->mPollSinceTicks = now;
+        QueueProcessPoll(pm, *proc, now);
+    }
+    return proc;
+}
+
+// Process ids are reused, so a start for a live id replaces that process.
+static void StartProcess(PresentMonData& pm, uint32_t processId, std::string const& imageFileName, uint64_t timestamp, uint64_t now)
+{
+    if (pm.mLifetimes.Start(processId, timestamp) == ProcessLifetimeTracker::StartResult::Duplicate) {
+        return;
+    }
+    StopProcess(pm, processId);
+    if (IsTargetProcess(pm.mTargetPid, processId)) {
+        pm.mProcessNames->Set(processId, imageFileName, now);
+    }
+
+    auto proc = AddProcess(pm, processId, now);
+    StartNewProcess(pm, proc, processId, imageFileName, now);
+}
+
+// An end older than the tracked instance's start was for an earlier process
+// with the same id.
+static void EndProcess(PresentMonData& pm, uint32_t processId, uint64_t timestamp)
+{
+    if (pm.mLifetimes.Stop(processId, timestamp)) {
+        StopProcess(pm, processId);
+        pm.mProcessNames->Remove(processId);
+    }
 }
 
 static ProcessInfo* StartProcessIfNew(PresentMonData& pm, uint32_t processId, uint64_t now)
 {
-    auto it = pm.mProcessMap.find(processId);
-    if (it != pm.mProcessMap.end()) {
-        auto proc = &it->second;
+    auto slot = pm.mProcessIndex.find(processId);
+    if (slot != NO_SLOT) {
+        auto proc = &pm.mProcesses[slot];
         return proc->mTargetProcess ? proc : nullptr;
     }
 
-    std::string imageFileName("<error>");
-    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
-    if (h) {
-        char path[MAX_PATH] = "<error>";
-        char* name = path;
-        DWORD numChars = sizeof(path);
-        if (QueryFullProcessImageNameA(h, 0, path, &numChars) == TRUE) {
-            name = PathFindFileNameA(path);
-        }
-        imageFileName = name;
-        CloseHandle(h);
+    // Without a start event for it yet the name is resolved in the
+    // background and filled in by UpdateProcessInfo_Realtime().  Only
+    // target processes are looked up, so only they are cached.
+    std::string imageFileName;
+    ProcessNameCache::Info info;
+    if (IsTargetProcess(pm.mTargetPid, processId) &&
+        pm.mProcessNames->Get(processId, now, PROCESS_REFRESH_TICKS, &info)) {
+        imageFileName = info.mFound ? info.mImageFileName : "<error>";
     }
 
-    auto proc = &pm.mProcessMap.emplace(processId, ProcessInfo()).first->second;
+    pm.mLifetimes.Observe(processId);
+    auto proc = AddProcess(pm, processId, now);
     return StartNewProcess(pm, proc, processId, imageFileName, now);
 }
 
-static bool UpdateProcessInfo_Realtime(PresentMonData& pm, ProcessInfo& info, uint64_t now, uint32_t thisPid)
+// Runs on ProcessNameCache's resolver thread.
+static bool QueryProcessFromOS(uint32_t processId, ProcessNameCache::Info* info)
 {
-    // Check periodically if the process has exited
-    if (now - info.mLastRefreshTicks > 1000) {
-        info.mLastRefreshTicks = now;
-
-        auto running = false;
-        HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, thisPid);
-        if (h) {
-            char path[MAX_PATH] = "<error>";
-            char* name = path;
-            DWORD numChars = sizeof(path);
-            if (QueryFullProcessImageNameA(h, 0, path, &numChars) == TRUE) {
-                name = PathFindFileNameA(path);
-            }
-            if (info.mModuleName.compare(name) != 0) {
-                // Image name changed, which means that our process exited and another
-                // one started with the same PID.
-                StartNewProcess(pm, &info, thisPid, name, now);
-            }
+    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (!h) {
+        return false;
+    }
 
-            DWORD dwExitCode = 0;
-            if (GetExitCodeProcess(h, &dwExitCode) == TRUE && dwExitCode == STILL_ACTIVE) {
-                running = true;
-            }
-            CloseHandle(h);
+    char path[MAX_PATH] = "<error>";
+    char* name = path;
+    DWORD numChars = sizeof(path);
+    if (QueryFullProcessImageNameA(h, 0, path, &numChars) == TRUE) {
+        name = PathFindFileNameA(path);
+    }
+    info->mImageFileName = name;
+
+    DWORD dwExitCode = 0;
+    info->mRunning = GetExitCodeProcess(h, &dwExitCode) == TRUE && dwExitCode == STILL_ACTIVE;
+    CloseHandle(h);
+    return true;
+}
+
+// The id of the running dwm.exe, or 0.  The consumers otherwise only learn
+// it from DWM's own events, and route DWM's present-path events by it.
+static uint32_t FindDwmProcessId()
+{
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    uint32_t processId = 0;
+    PROCESSENTRY32W entry = {};
+    entry.dwSize = sizeof(entry);
+    for (auto ok = Process32FirstW(snapshot, &entry); ok; ok = Process32NextW(snapshot, &entry)) {
+        if (_wcsicmp(entry.szExeFile, L"dwm.exe") == 0) {
+            processId = entry.th32ProcessID;
+            break;
         }
+    }
+    CloseHandle(snapshot);
+    return processId;
+}
 
-        if (!running) {
-            return false;
+enum class ProcessPoll {
+    Pending,    // nothing recent enough known yet
+    Running,
+    Exited,
+};
+
+// Called every PROCESS_REFRESH_TICKS for each unconfirmed process to check
+// if it has exited, from what ProcessNameCache has; that queues a fresh
+// query for the next check.  Info requested before the poll began (e.g.
+// before events were lost) doesn't count.
+static ProcessPoll UpdateProcessInfo_Realtime(PresentMonData& pm, ProcessInfo& info, uint64_t now, uint32_t thisPid)
+{
+    info.mLastRefreshTicks = now;
+
+    ProcessNameCache::Info cached;
+    if (!pm.mProcessNames->Get(thisPid, now, PROCESS_REFRESH_TICKS, &cached) ||
+        cached.mUpdatedMs < info.mPollSinceTicks) {
+        return ProcessPoll::Pending;
+    }
+    if (!cached.mFound || !cached.mRunning) {
+        return ProcessPoll::Exited;
+    }
+    if (info.mModuleName.empty()) {
+        info.mModuleName = cached.mImageFileName;
+    } else if (info.mModuleName.compare(cached.mImageFileName) != 0) {
+        // Image name changed, which means that our process exited and another
+        // one started with the same PID.
+        StartNewProcess(pm, &info, thisPid, cached.mImageFileName, now);
+    }
+    return ProcessPoll::Running;
+}
+
+// Process events may have been lost, so no process is known to be alive
+// any more: poll them all until each is confirmed again.
+static void PollAllProcesses(PresentMonData& pm, uint64_t now)
+{
+    pm.mLifetimes.EventsLost();
+    for (uint32_t slot = 0; slot < pm.mProcesses.slot_end(); ++slot) {
+        if (pm.mProcesses.in_use(slot)) {
+            auto& proc = pm.mProcesses[slot];
+            proc.mPollSinceTicks = now;
+            QueueProcessPoll(pm, proc, now);
         }
     }
+}
 
-    // remove chains without recent updates
-    map_erase_if(info.mChainMap, [now](const std::pair<const uint64_t, SwapChainData>& entry) {
-        return entry.second.IsStale(now);
-    });
+static ProcessInfo* FindProcess(PresentMonData& pm, uint32_t processId, uint32_t serial)
+{
+    auto slot = pm.mProcessIndex.find(processId);
+    return slot != NO_SLOT && pm.mProcesses[slot].mSerial == serial ? &pm.mProcesses[slot] : nullptr;
+}
 
-    return true;
+// Runtime-only captures have no display information, so only fps and
+// timeTaken are filled in.
+static void AddRuntimePresents(PresentMonData& pm, std::vector<RuntimePresent> const& presents, QpcClock const& clock)
+{
+    auto& timestamps = pm.mBatchTimestamps;
+    auto& scores = pm.mBatchScores;
+    timestamps.clear();
+    scores.clear();
+    for (auto const& p : presents) {
+        if (p.PrevQpcTime == 0) {
+            continue;
+        }
+
+        EventScores currentScores = {};
+        currentScores.fps = 1000. / clock.toMs(p.QpcTime - p.PrevQpcTime);
+        currentScores.timeTaken = clock.toMs(p.TimeTaken);
+
+        timestamps.push_back(clock.toUnixSeconds(p.QpcTime));
+        scores.push_back(currentScores);
+    }
+    g_ScoreBuffer->addData(scores.size(), timestamps.data(), scores.data());
 }
 
-void AddPresent(PresentMonData& pm, PresentEvent& p, uint64_t now, uint64_t perfFreq)
+// Records a HitchEvent if the newest of intervals is over median, the
+// rolling median of the intervals before it, by the configured factor or
+// margin.
+static void DetectHitch(PresentMonData const& pm, uint32_t processId, uint64_t swapChainAddress, bool display,
+                        SwapChainData::IntervalMedian const& intervals, uint64_t median, size_t medianCount,
+                        uint64_t qpcTime, QpcClock const& clock)
 {
-    const uint32_t appProcessId = p.ProcessId;
-    auto proc = StartProcessIfNew(pm, appProcessId, now);
-    if (proc == nullptr) {
-        return; // process is not a target
-    }
-
-    auto& chain = proc->mChainMap[p.SwapChainAddress];
-    chain.AddPresentToSwapChain(p);
-
-    auto len = chain.mPresentHistory.size();
-    auto displayedLen = chain.mDisplayedPresentHistory.size();
-    if (len > 1) {
-        auto& curr = chain.mPresentHistory[len - 1];
-        auto& prev = chain.mPresentHistory[len - 2];
-        double deltaMilliseconds = 1000 * double(curr.QpcTime - prev.QpcTime) / perfFreq;
-        double deltaReady = curr.ReadyTime == 0 ? 0.0 : (1000 * double(curr.ReadyTime - curr.QpcTime) / perfFreq);
-        double deltaDisplayed = curr.FinalState == PresentResult::Presented ? (1000 * double(curr.ScreenTime - curr.QpcTime) / perfFreq) : 0.0;
-        double timeTakenMilliseconds = 1000 * double(curr.TimeTaken) / perfFreq;
-
-        double timeSincePreviousDisplayed = 0.0;
-        if (curr.FinalState == PresentResult::Presented && displayedLen > 1) {
-            if (chain.mDisplayedPresentHistory[displayedLen - 1].QpcTime != curr.QpcTime){
-                g_InspectorLogger->error("Incorrect QpcTime");
+    auto intervalMs = clock.toMs(intervals.recent(0));
+    auto medianMs = clock.toMs(median);
+    if (!IsHitch(intervalMs, medianMs, medianCount, pm.mHitchFactor, pm.mHitchMarginMs)) {
+        return;
+    }
+
+    HitchEvent hitch = {};
+    hitch.processId = processId;
+    hitch.swapChainAddress = (double) swapChainAddress;
+    hitch.displayInterval = display ? 1.0 : 0.0;
+    hitch.intervalMs = intervalMs;
+    hitch.medianMs = medianMs;
+    for (size_t i = 0; i < HITCH_CONTEXT_INTERVALS && i + 1 < intervals.size(); ++i) {
+        hitch.precedingMs[i] = clock.toMs(intervals.recent(i + 1));
+    }
+    g_HitchBuffer->addData(clock.toUnixSeconds(qpcTime), hitch);
+}
+
+// The batch is walked one swapchain at a time, so the process and swapchain
+// lookups happen once per swapchain rather than once per present.  The tick
+// deltas gathered on the way are turned into scores by ComputeScores(), and
+// the scores are appended to the buffer under one lock in the order the
+// presents completed.
+static void AddPresents(PresentMonData& pm, std::vector<CompletedFrame> const& presents, uint64_t now, QpcClock const& clock)
+{
+    auto const count = presents.size();
+    if (count == 0) {
+        return;
+    }
+
+    auto& batch = pm.mScoreBatch;
+    auto& order = pm.mBatchOrder;
+    batch.Reset(count);
+    order.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&presents](uint32_t a, uint32_t b) {
+        auto const& pa = presents[a];
+        auto const& pb = presents[b];
+        return pa.ProcessId != pb.ProcessId ? pa.ProcessId < pb.ProcessId : pa.SwapChainAddress < pb.SwapChainAddress;
+    });
+
+    for (size_t begin = 0, end = 0; begin < count; begin = end) {
+        auto const& first = presents[order[begin]];
+        for (end = begin + 1; end < count; ++end) {
+            auto const& p = presents[order[end]];
+            if (p.ProcessId != first.ProcessId || p.SwapChainAddress != first.SwapChainAddress) {
+                break;
             }
-            auto& prevDisplayed = chain.mDisplayedPresentHistory[displayedLen - 2];
-            timeSincePreviousDisplayed = 1000 * double(curr.ScreenTime - prevDisplayed.ScreenTime) / perfFreq;
         }
 
-        EventScores currentScores;
-        currentScores.fps = 1000. / deltaMilliseconds;
-        currentScores.flip = 1000. / timeSincePreviousDisplayed;
-        currentScores.deltaReady = deltaReady;
-        currentScores.deltaDisplayed = deltaDisplayed;
-        currentScores.timeTaken = timeTakenMilliseconds;
-        currentScores.screenTime = (double)curr.ScreenTime;
-
-        if (!g_FirstTimestamp) {
-            g_FirstTimestamp = getCurrentTime();
-            g_QpcFirst = curr.QpcTime;
-            g_ScoreBuffer->addData(g_FirstTimestamp, currentScores);
+        auto proc = StartProcessIfNew(pm, first.ProcessId, now);
+        if (proc == nullptr) {
+            continue; // process is not a target
+        }
+
+        auto chainSlot = proc->FindChain(first.SwapChainAddress);
+        auto newChain = chainSlot == NO_SLOT;
+        if (newChain) {
+            chainSlot = pm.mChains.acquire();
+            proc->AddChain(first.SwapChainAddress, chainSlot);
+            pm.mChains[chainSlot].SetHistoryWindow(pm.mHistoryTimeMs, pm.mHistoryBudgetKB);
         }
-        else {
-            double timeSinceFirst = g_FirstTimestamp + double(curr.QpcTime - g_QpcFirst) / perfFreq;
-            g_ScoreBuffer->addData(timeSinceFirst, currentScores);
+        auto& chain = pm.mChains[chainSlot];
+        for (auto i = begin; i < end; ++i) {
+            auto const row = order[i];
+            auto const& p = presents[row];
+
+            // Hitches are judged against the intervals before this present.
+            auto presentMedian = chain.mPresentIntervals.median();
+            auto presentMedianCount = chain.mPresentIntervals.size();
+            auto displayMedian = chain.mDisplayIntervals.median();
+            auto displayMedianCount = chain.mDisplayIntervals.size();
+
+            chain.AddPresentToSwapChain(p);
+
+            auto len = chain.mPresentHistory.size();
+            auto displayedLen = chain.mDisplayedPresentHistory.size();
+            if (len > 1) {
+                auto& curr = chain.mPresentHistory[len - 1];
+                auto& prev = chain.mPresentHistory[len - 2];
+                auto presented = curr.FinalState == PresentResult::Presented;
+
+                uint64_t flipTicks = 0;
+                if (presented && displayedLen > 1) {
+                    if (chain.mDisplayedPresentHistory[displayedLen - 1].QpcTime != curr.QpcTime){
+                        g_InspectorLogger->error("Incorrect QpcTime");
+                    }
+                    flipTicks = curr.ScreenTime - chain.mDisplayedPresentHistory[displayedLen - 2].ScreenTime;
+                    DetectHitch(pm, p.ProcessId, p.SwapChainAddress, true, chain.mDisplayIntervals,
+                                displayMedian, displayMedianCount, curr.ScreenTime, clock);
+                }
+                DetectHitch(pm, p.ProcessId, p.SwapChainAddress, false, chain.mPresentIntervals,
+                            presentMedian, presentMedianCount, curr.QpcTime, clock);
+
+                batch.Set(row,
+                    curr.QpcTime - prev.QpcTime,
+                    flipTicks,
+                    curr.ReadyTime == 0 ? 0 : curr.ReadyTime - curr.QpcTime,
+                    presented ? curr.ScreenTime - curr.QpcTime : 0,
+                    curr.TimeTaken);
+            }
+
+            chain.UpdateSwapChainInfo(p, now, clock);
+        }
+        if (newChain) {
+            pm.mChainExpiry.push(chain.ExpiryTicks(), ChainExpiryKey{ first.SwapChainAddress, first.ProcessId, proc->mSerial });
         }
     }
 
-    chain.UpdateSwapChainInfo(p, now, perfFreq);
+    ComputeScores(batch, clock.msPerTick());
+
+    auto& timestamps = pm.mBatchTimestamps;
+    auto& scores = pm.mBatchScores;
+    timestamps.clear();
+    scores.clear();
+    for (uint32_t row = 0; row < count; ++row) {
+        if (!batch.mValid[row]) {
+            continue;
+        }
+
+        EventScores currentScores;
+        currentScores.fps = batch.mFps[row];
+        currentScores.flip = batch.mFlip[row];
+        currentScores.deltaReady = batch.mDeltaReady[row];
+        currentScores.deltaDisplayed = batch.mDeltaDisplayed[row];
+        currentScores.timeTaken = batch.mTimeTaken[row];
+        currentScores.screenTime = (double)presents[row].ScreenTime;
+
+        timestamps.push_back(clock.toUnixSeconds(presents[row].QpcTime));
+        scores.push_back(currentScores);
+    }
+    g_ScoreBuffer->addData(scores.size(), timestamps.data(), scores.data());
 }
 
 void PresentMon_Init(uint32_t TargetPid, PresentMonData& pm)
 {
     pm.mTargetPid = TargetPid;
     QueryPerformanceCounter((PLARGE_INTEGER)&pm.mStartupQpcTime);
+    pm.mProcessNames.reset(new ProcessNameCache(&QueryProcessFromOS));
 }
 
-void PresentMon_Update(PresentMonData& pm, std::vector<std::shared_ptr<PresentEvent>>& presents, std::vector<std::shared_ptr<LateStageReprojectionEvent>>& lsrs, uint64_t now, uint64_t perfFreq)
+void PresentMon_Update(PresentMonData& pm, std::vector<CompletedFrame>& presents, std::vector<std::shared_ptr<LateStageReprojectionEvent>>& lsrs, uint64_t now, QpcClock const& clock)
 {
     // store the new presents into processes
-    for (auto& p : presents)
-    {
-        AddPresent(pm, *p, now, perfFreq);
+    AddPresents(pm, presents, now, clock);
+
+    // Only the processes and swapchains that are due are visited.  Keys of
+    // processes that were stopped (or restarted with the same id) since they
+    // were queued don't match anything and are dropped.
+    //
+    // Processes are only polled until the process events vouch for them;
+    // without process events (runtime-only profile) they're polled for as
+    // long as they run.
+    ProcessExpiryKey processKey;
+    while (pm.mProcessExpiry.pop_due(now, &processKey)) {
+        auto proc = FindProcess(pm, processKey.mProcessId, processKey.mSerial);
+        if (proc == nullptr) {
+            continue;
+        }
+        proc->mPollQueued = false;
+        // Non-target processes are only tracked to know to ignore them, so
+        // they aren't queried (which would cache them too).
+        if (!proc->mTargetProcess || pm.mLifetimes.IsConfirmed(processKey.mProcessId)) {
+            continue;
+        }
+        switch (UpdateProcessInfo_Realtime(pm, *proc, now, processKey.mProcessId)) {
+        case ProcessPoll::Exited:
+            pm.mLifetimes.Remove(processKey.mProcessId);
+            StopProcess(pm, processKey.mProcessId);
+            pm.mProcessNames->Remove(processKey.mProcessId);
+            break;
+        case ProcessPoll::Running:
+            if (pm.mProcessEvents) {
+                pm.mLifetimes.Confirm(processKey.mProcessId);
+                break;
+            }
+            QueueProcessPoll(pm, *proc, now);
+            break;
+        case ProcessPoll::Pending:
+            QueueProcessPoll(pm, *proc, now);
+            break;
+        }
+    }
+
+    // Remove chains without recent updates; the others are queued again for
+    // when they would time out as of their latest update.
+    ChainExpiryKey chainKey;
+    while (pm.mChainExpiry.pop_due(now, &chainKey)) {
+        auto proc = FindProcess(pm, chainKey.mProcessId, chainKey.mSerial);
+        if (proc == nullptr) {
+            continue;
+        }
+        auto chainSlot = proc->FindChain(chainKey.mSwapChainAddress);
+        if (chainSlot == NO_SLOT) {
+            continue;
+        }
+        if (pm.mChains[chainSlot].IsStale(now)) {
+            proc->RemoveChain(chainKey.mSwapChainAddress);
+            pm.mChains.release(chainSlot);
+        } else {
+            pm.mChainExpiry.push(pm.mChains[chainSlot].ExpiryTicks(), chainKey);
+        }
     }
+}
 
-    // Update realtime process info
-    std::vector<std::map<uint32_t, ProcessInfo>::iterator> remove;
-    for (auto ii = pm.mProcessMap.begin(), ie = pm.mProcessMap.end(); ii != ie; ++ii) {
-        if (!UpdateProcessInfo_Realtime(pm, ii->second, now, ii->first)) {
-            remove.emplace_back(ii);
+// Publishes every tracked swapchain's current averages and frame time
+// histograms for GetSwapChainStats() and GetFrameTimePercentiles(), and the
+// displays' refresh cadence for GetDisplayRefresh().  The published vectors
+// are reused, so this doesn't allocate once the set of swapchains is stable.
+//
+// A chain's published histograms stay at its slot and only the buckets that
+// changed since the last poll are copied, usually a few dozen bytes rather
+// than two 7 KB histograms.  A chain that takes over a released slot starts
+// out with every bucket changed, so its first poll copies them all.
+static void PublishSwapChainStats(PresentMonData& pm, std::vector<DisplayRefresh> const& displays, QpcClock const& clock)
+{
+    std::lock_guard<std::mutex> lock(g_SwapChainStatsMutex);
+    size_t count = pm.mChains.size();
+    g_SwapChainStats.resize(count);
+    g_SwapChainSlots.resize(count);
+    if (g_FrameTimeSummaries.size() < pm.mChains.slot_end()) {
+        g_FrameTimeSummaries.resize(pm.mChains.slot_end());
+    }
+    g_FrameTimeMsPerTick = clock.msPerTick();
+
+    // Slots are reused in whatever order swapchains come and go, so list
+    // them in (process id, address) order as the maps they replaced did.
+    auto& order = pm.mPublishOrder;
+    order.clear();
+    for (uint32_t slot = 0; slot < pm.mProcesses.slot_end(); ++slot) {
+        if (!pm.mProcesses.in_use(slot)) {
+            continue;
+        }
+        auto const& proc = pm.mProcesses[slot];
+        for (uint32_t j = 0; j < proc.mChainCount; ++j) {
+            PublishedChain published = { proc.Chain(j).mSwapChainAddress, proc.mProcessId, proc.Chain(j).mSlot };
+            order.push_back(published);
         }
     }
-    for (auto ii : remove) {
-        StopProcess(pm, ii);
+    std::sort(order.begin(), order.end(), [](PublishedChain const& a, PublishedChain const& b) {
+        return a.mProcessId != b.mProcessId ? a.mProcessId < b.mProcessId : a.mSwapChainAddress < b.mSwapChainAddress;
+    });
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto chainSlot = order[i].mSlot;
+        auto& chain = pm.mChains[chainSlot];
+        auto& s = g_SwapChainStats[i];
+        s.processId = order[i].mProcessId;
+        s.swapChainAddress = (double) order[i].mSwapChainAddress;
+        s.fps = chain.ComputeFps(clock);
+        s.displayedFps = chain.ComputeDisplayedFps(clock);
+        s.latencyMs = 1000 * chain.ComputeLatency(clock);
+        s.cpuFrameTimeMs = 1000 * chain.ComputeCpuFrameTime(clock);
+        s.presentCount = (double) chain.mPresentHistory.size();
+        s.displayedCount = (double) chain.mDisplayedPresentHistory.size();
+        s.refreshPeriodMs = chain.mPacing.refreshPeriod() * g_FrameTimeMsPerTick;
+        s.vsyncIntervals = chain.mPacing.lastVsyncIntervals();
+        s.meanVsyncIntervals = chain.mPacing.meanVsyncIntervals();
+        s.missedVsyncCount = (double) chain.mPacing.missedVsyncCount();
+        s.displayJitterMs = chain.mPacing.displayJitter() * g_FrameTimeMsPerTick;
+        g_SwapChainSlots[i] = chainSlot;
+        chain.mFrameTimes.copy_changed_to(&g_FrameTimeSummaries[chainSlot].mSession);
+        chain.mWindowFrameTimes.copy_changed_to(&g_FrameTimeSummaries[chainSlot].mWindow);
+    }
+
+    g_DisplayRefresh.resize(displays.size());
+    for (size_t j = 0; j < displays.size(); ++j) {
+        auto& d = g_DisplayRefresh[j];
+        d.vidPnTargetId = displays[j].VidPnTargetId;
+        d.refreshPeriodMs = displays[j].PeriodTicks * g_FrameTimeMsPerTick;
+        d.refreshRateHz = d.refreshPeriodMs > 0.0 ? 1000.0 / d.refreshPeriodMs : 0.0;
+        d.vsyncCount = (double) displays[j].VsyncCount;
     }
 }
 
@@ -360,11 +909,18 @@ void PresentMon_Shutdown(PresentMonData& pm)
 {
     pm.mTargetPid = 0;
 
-    pm.mProcessMap.clear();
+    pm.mProcesses.clear();
+    pm.mProcessIndex.clear();
+    pm.mChains.clear();
+    pm.mProcessExpiry.clear();
+    pm.mChainExpiry.clear();
+    pm.mProcessNames.reset();
+    pm.mLifetimes.Clear();
+    pm.mProcessEvents = false;
 }
 
 static bool g_EtwProcessingThreadProcessing = false;
-static void EtwProcessingThread(TraceSession *session)
+static void EtwProcessingThread(TraceSession *session, ShardedPMTraceConsumer *shardedConsumer)
 {
     if (!g_EtwProcessingThreadProcessing)
     {
@@ -376,11 +932,19 @@ static void EtwProcessingThread(TraceSession *session)
     auto status = ProcessTrace(&session->traceHandle_, 1, NULL, NULL);
     (void) status; // check: _status == ERROR_SUCCESS;
 
+    // Make sure the shards have handled everything ProcessTrace() delivered
+    // before EtwConsumingThread does its final dequeue.
+    if (shardedConsumer) {
+        shardedConsumer->Flush();
+    }
+
     // Notify EtwConsumingThread that processing is complete
     g_EtwProcessingThreadProcessing = false;
 }
 
-void EtwConsumingThread(uint32_t targetPid)
+void EtwConsumingThread(uint32_t targetPid, uint32_t shardCount, CaptureProfile profile, std::string captureFile,
+                        TraceSession::BufferConfig bufferConfig, bool autoTuneBuffers, uint32_t historyTimeMs,
+                        uint32_t historyBudgetKB, double hitchFactor, double hitchMarginMs)
 {
     if (EtwThreadsShouldQuit()) {
         return;
@@ -390,44 +954,171 @@ void EtwConsumingThread(uint32_t targetPid)
     PMTraceConsumer pmConsumer(false);
     MRTraceConsumer mrConsumer(false);
 
-    TraceSession session;
+    std::unique_ptr<RuntimeTraceConsumer> rtConsumer;
+    std::unique_ptr<ShardedPMTraceConsumer> shardedConsumer;
+    if (profile == RUNTIME_CAPTURE_PROFILE) {
+        rtConsumer.reset(new RuntimeTraceConsumer(targetPid));
+    } else if (shardCount > 1) {
+        shardedConsumer.reset(new ShardedPMTraceConsumer(shardCount));
+    }
 
-    session.AddProviderAndHandler(DXGI_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 0, 0, (EventHandlerFn) &HandleDXGIEvent, &pmConsumer);
-    session.AddProviderAndHandler(D3D9_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 0, 0, (EventHandlerFn) &HandleD3D9Event, &pmConsumer);
-    session.AddProviderAndHandler(DXGKRNL_PROVIDER_GUID,   TRACE_LEVEL_INFORMATION, 1,      0, (EventHandlerFn) &HandleDXGKEvent,   &pmConsumer);
-    session.AddProviderAndHandler(WIN32K_PROVIDER_GUID,    TRACE_LEVEL_INFORMATION, 0x1000, 0, (EventHandlerFn) &HandleWin32kEvent, &pmConsumer);
-    session.AddProviderAndHandler(DWM_PROVIDER_GUID,       TRACE_LEVEL_VERBOSE,     0,      0, (EventHandlerFn) &HandleDWMEvent,    &pmConsumer);
-    session.AddProviderAndHandler(Win7::DWM_PROVIDER_GUID, TRACE_LEVEL_VERBOSE, 0, 0, (EventHandlerFn) &HandleDWMEvent, &pmConsumer);
-    session.AddProvider(Win7::DXGKRNL_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 1, 0);
-    session.AddHandler(NT_PROCESS_EVENT_GUID,         (EventHandlerFn) &HandleNTProcessEvent,           &pmConsumer);
-    session.AddHandler(Win7::DXGKBLT_GUID,            (EventHandlerFn) &Win7::HandleDxgkBlt,            &pmConsumer);
-    session.AddHandler(Win7::DXGKFLIP_GUID,           (EventHandlerFn) &Win7::HandleDxgkFlip,           &pmConsumer);
-    session.AddHandler(Win7::DXGKPRESENTHISTORY_GUID, (EventHandlerFn) &Win7::HandleDxgkPresentHistory, &pmConsumer);
-    session.AddHandler(Win7::DXGKQUEUEPACKET_GUID,    (EventHandlerFn) &Win7::HandleDxgkQueuePacket,    &pmConsumer);
-    session.AddHandler(Win7::DXGKVSYNCDPC_GUID,       (EventHandlerFn) &Win7::HandleDxgkVSyncDPC,       &pmConsumer);
-    session.AddHandler(Win7::DXGKMMIOFLIP_GUID,       (EventHandlerFn) &Win7::HandleDxgkMMIOFlip,       &pmConsumer);
+    TraceSession session;
+    session.bufferConfig_ = bufferConfig;
+
+    // With a single shard the handlers run directly on the ETW thread against
+    // pmConsumer; otherwise every provider goes through the sharded consumer.
+    auto addHandler = [&](GUID const& providerId, PMEventHandlerFn handlerFn) {
+        if (shardedConsumer) {
+            shardedConsumer->AddHandler(providerId, handlerFn);
+            return session.AddHandler(providerId, (EventHandlerFn) &HandleShardedEvent, shardedConsumer.get());
+        }
+        return session.AddHandler(providerId, (EventHandlerFn) handlerFn, &pmConsumer);
+    };
+
+    if (rtConsumer) {
+        // Runtime-only profile: only the DXGI/D3D9 Present start/stop events.
+        session.AddProviderAndHandler(DXGI_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 0, 0, (EventHandlerFn) &HandleRuntimeDXGIEvent, rtConsumer.get());
+        session.AddProviderAndHandler(D3D9_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 0, 0, (EventHandlerFn) &HandleRuntimeD3D9Event, rtConsumer.get());
+    } else {
+        session.AddProvider(DXGI_PROVIDER_GUID,       TRACE_LEVEL_INFORMATION, 0,      0);
+        session.AddProvider(D3D9_PROVIDER_GUID,       TRACE_LEVEL_INFORMATION, 0,      0);
+        session.AddProvider(DXGKRNL_PROVIDER_GUID,    TRACE_LEVEL_INFORMATION, 1,      0);
+        session.AddProvider(WIN32K_PROVIDER_GUID,     TRACE_LEVEL_INFORMATION, 0x1000, 0);
+        session.AddProvider(DWM_PROVIDER_GUID,        TRACE_LEVEL_VERBOSE,     0,      0);
+        session.AddProvider(Win7::DWM_PROVIDER_GUID,  TRACE_LEVEL_VERBOSE,     0,      0);
+        session.AddProvider(Win7::DXGKRNL_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, 1,   0);
+        session.AddProvider(KERNEL_PROCESS_PROVIDER_GUID, TRACE_LEVEL_INFORMATION, KERNEL_PROCESS_KEYWORD_PROCESS, 0);
+        addHandler(DXGI_PROVIDER_GUID,           &HandleDXGIEvent);
+        addHandler(D3D9_PROVIDER_GUID,           &HandleD3D9Event);
+        addHandler(DXGKRNL_PROVIDER_GUID,        &HandleDXGKEvent);
+        addHandler(WIN32K_PROVIDER_GUID,         &HandleWin32kEvent);
+        addHandler(DWM_PROVIDER_GUID,            &HandleDWMEvent);
+        addHandler(Win7::DWM_PROVIDER_GUID,      &HandleDWMEvent);
+        addHandler(NT_PROCESS_EVENT_GUID,        &HandleNTProcessEvent);
+        addHandler(KERNEL_PROCESS_PROVIDER_GUID, &HandleKernelProcessEvent);
+        addHandler(Win7::DXGKBLT_GUID,           &Win7::HandleDxgkBlt);
+        addHandler(Win7::DXGKFLIP_GUID,          &Win7::HandleDxgkFlip);
+        addHandler(Win7::DXGKPRESENTHISTORY_GUID, &Win7::HandleDxgkPresentHistory);
+        addHandler(Win7::DXGKQUEUEPACKET_GUID,   &Win7::HandleDxgkQueuePacket);
+        addHandler(Win7::DXGKVSYNCDPC_GUID,      &Win7::HandleDxgkVSyncDPC);
+        addHandler(Win7::DXGKMMIOFLIP_GUID,      &Win7::HandleDxgkMMIOFlip);
+
+        session.SetEventIdFilter(DXGKRNL_PROVIDER_GUID, {
+            DxgKrnl_Flip, DxgKrnl_FlipMPO, DxgKrnl_QueueSubmit, DxgKrnl_QueueComplete,
+            DxgKrnl_MMIOFlip, DxgKrnl_MMIOFlipMPO, DxgKrnl_HSyncDPC, DxgKrnl_VSyncDPC,
+            DxgKrnl_Present, DxgKrnl_PresentHistoryDetailed, DxgKrnl_SubmitPresentHistory,
+            DxgKrnl_PropagatePresentHistory, DxgKrnl_Blit });
+        session.SetEventIdFilter(WIN32K_PROVIDER_GUID, { Win32K_TokenCompositionSurfaceObject, Win32K_TokenStateChanged });
+        for (auto const& dwmProviderId : { DWM_PROVIDER_GUID, Win7::DWM_PROVIDER_GUID }) {
+            session.SetEventIdFilter(dwmProviderId, {
+                DWM_GetPresentHistory, DWM_Schedule_Present_Start, DWM_FlipChain_Pending,
+                DWM_FlipChain_Complete, DWM_FlipChain_Dirty, DWM_Schedule_SurfaceUpdate });
+        }
+        session.SetEventIdFilter(KERNEL_PROCESS_PROVIDER_GUID, { KernelProcess_ProcessStart, KernelProcess_ProcessStop });
+    }
 
+    // Both profiles only handle Present start/stop from the runtimes; the
+    // classic (MOF) providers above dispatch on opcode and aren't filtered.
+    session.SetEventIdFilter(DXGI_PROVIDER_GUID, { DXGIPresent_Start, DXGIPresent_Stop, DXGIPresentMPO_Start, DXGIPresentMPO_Stop });
+    session.SetEventIdFilter(D3D9_PROVIDER_GUID, { D3D9PresentStart, D3D9PresentStop });
+
+    // When capturing a single process, other processes' runtime events are
+    // dropped in the session callback, and the consumer ignores their
+    // present-path kernel events; only completion events and DWM's are still
+    // decoded for everyone.
+    if (targetPid != 0) {
+        session.SetProcessFilter(DXGI_PROVIDER_GUID, targetPid);
+        session.SetProcessFilter(D3D9_PROVIDER_GUID, targetPid);
+        if (shardedConsumer) {
+            shardedConsumer->SetTargetProcessId(targetPid);
+        } else {
+            pmConsumer.mTargetProcessId = targetPid;
+            pmConsumer.mDwmProcessId = FindDwmProcessId();
+        }
+    }
 
     session.InitializeRealtime("PresentMon", &EtwThreadsShouldQuit);
+    if (rtConsumer) {
+        rtConsumer->SetQpcFrequency((int64_t) session.frequency_);
+    }
+
+    // All QPC -> ms and QPC -> wall clock conversions go through this clock;
+    // it is re-anchored periodically below to follow system time.
+    QpcClock clock(session.frequency_);
+    uint64_t anchorQpc = 0;
+    int64_t anchorUnixNs = 0;
+    sampleClocks(&anchorQpc, &anchorUnixNs);
+    clock.anchor(anchorQpc, anchorUnixNs);
+    auto nextAnchorTicks = GetTickCount64() + CLOCK_ANCHOR_INTERVAL_MS;
+
+    // Start tuning from the buffer configuration ETW actually chose.
+    BufferTuner::Config tunerConfig;
+    tunerConfig.mBufferSizeKB = session.properties_.BufferSize;
+    tunerConfig.mMinimumBuffers = session.properties_.MinimumBuffers;
+    tunerConfig.mMaximumBuffers = session.properties_.MaximumBuffers;
+    tunerConfig.mFlushTimerSeconds = session.properties_.FlushTimer;
+    BufferTuner tuner(tunerConfig, autoTuneBuffers);
+    {
+        std::lock_guard<std::mutex> lock(g_LossStatsMutex);
+        g_LossStats = EventLossStats();
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_SwapChainStatsMutex);
+        g_SwapChainStats.clear();
+        g_SwapChainSlots.clear();
+        g_FrameTimeSummaries.clear();
+        g_DisplayRefresh.clear();
+    }
+
+    // Record the raw events next to the consumers so the session can be
+    // replayed later (see EventReplayer).
+    EventCaptureWriter captureWriter;
+    if (!captureFile.empty()) {
+        if (captureWriter.Open(captureFile.c_str(), (int64_t) session.frequency_)) {
+            std::vector<GUID> providerIds;
+            for (auto const& pair : session.eventHandler_) {
+                providerIds.push_back(pair.first);
+            }
+            for (auto const& providerId : providerIds) {
+                session.AddHandler(providerId, (EventHandlerFn) &HandleCaptureEvent, &captureWriter);
+            }
+        } else {
+            g_InspectorLogger->error("failed to open capture file {}", captureFile);
+        }
+    }
+
+    if (shardedConsumer) {
+        shardedConsumer->SetDwmProcessId(FindDwmProcessId());
+        shardedConsumer->Start();
+    }
 
     {
         // Launch the ETW producer thread
         g_EtwProcessingThreadProcessing = true;
-        std::thread etwProcessingThread(EtwProcessingThread, &session);
+        std::thread etwProcessingThread(EtwProcessingThread, &session, shardedConsumer.get());
 
         // Consume / Update based on the ETW output
         {
 
             PresentMon_Init(targetPid, data);
+            data.mHistoryTimeMs = historyTimeMs;
+            data.mHistoryBudgetKB = historyBudgetKB;
+            data.mHitchFactor = hitchFactor;
+            data.mHitchMarginMs = hitchMarginMs;
+            data.mProcessEvents = !rtConsumer;
             auto timerRunning = false;
             auto timerEnd = GetTickCount64();
 
-            std::vector<std::shared_ptr<PresentEvent>> presents;
+            std::vector<CompletedFrame> presents;
             std::vector<std::shared_ptr<LateStageReprojectionEvent>> lsrs;
             std::vector<NTProcessEvent> ntProcessEvents;
+            std::vector<RuntimePresent> runtimePresents;
+            std::vector<DisplayRefresh> displays;
 
-            uint32_t totalEventsLost = 0;
-            uint32_t totalBuffersLost = 0;
+            uint64_t totalEventsLost = 0;
+            uint64_t totalBuffersLost = 0;
+            uint64_t totalPresentsDropped = 0;
+            uint64_t totalProcessEventsDropped = 0;
             for (;;) {
                 presents.clear();
                 lsrs.clear();
@@ -435,36 +1126,111 @@ void EtwConsumingThread(uint32_t targetPid)
 
                 uint64_t now = GetTickCount64();
 
+                if (now >= nextAnchorTicks) {
+                    sampleClocks(&anchorQpc, &anchorUnixNs);
+                    clock.anchor(anchorQpc, anchorUnixNs);
+                    nextAnchorTicks = now + CLOCK_ANCHOR_INTERVAL_MS;
+                }
+
                 // Dequeue any captured NTProcess events; if ImageFileName is
                 // empty then the process stopped, otherwise it started.
-                pmConsumer.DequeueProcessEvents(ntProcessEvents);
+                if (shardedConsumer) {
+                    shardedConsumer->DequeueProcessEvents(ntProcessEvents);
+                } else {
+                    pmConsumer.DequeueProcessEvents(ntProcessEvents);
+                }
                 for (auto ntProcessEvent : ntProcessEvents) {
                     if (!ntProcessEvent.ImageFileName.empty()) {
-                        StartProcess(data, ntProcessEvent.ProcessId, ntProcessEvent.ImageFileName, now);
+                        StartProcess(data, ntProcessEvent.ProcessId, ntProcessEvent.ImageFileName, ntProcessEvent.Timestamp, now);
                     }
                 }
 
-                pmConsumer.DequeuePresents(presents);
+                if (rtConsumer) {
+                    runtimePresents.clear();
+                    rtConsumer->DequeuePresents(runtimePresents);
+                    AddRuntimePresents(data, runtimePresents, clock);
+                } else if (shardedConsumer) {
+                    shardedConsumer->DequeuePresents(presents);
+                } else {
+                    pmConsumer.DequeuePresents(presents);
+                }
                 mrConsumer.DequeueLSRs(lsrs);
 
                 auto doneProcessingEvents = g_EtwProcessingThreadProcessing ? false : true;
-                PresentMon_Update(data, presents, lsrs, now, session.frequency_);
+                PresentMon_Update(data, presents, lsrs, now, clock);
+                if (shardedConsumer) {
+                    shardedConsumer->GetDisplayRefresh(displays);
+                } else {
+                    pmConsumer.GetDisplayRefresh(displays);
+                }
+                // A swapchain's refresh period comes from its own ScreenTimes
+                // (FramePacing), not from its display's VSyncDPCs: presents
+                // don't say which VidPn target they landed on.  A chain that
+                // never flips on consecutive vsyncs therefore reports a
+                // multiple of the true period; the displays' own cadence is
+                // published next to it.
+                PublishSwapChainStats(data, displays, clock);
 
                 for (auto ntProcessEvent : ntProcessEvents) {
                     if (ntProcessEvent.ImageFileName.empty()) {
-                        StopProcess(data, ntProcessEvent.ProcessId);
+                        EndProcess(data, ntProcessEvent.ProcessId, ntProcessEvent.Timestamp);
                     }
                 }
 
                 uint32_t eventsLost = 0;
                 uint32_t buffersLost = 0;
                 if (session.CheckLostReports(&eventsLost, &buffersLost)) {
-                    printf("Lost %u events, %u buffers.", eventsLost, buffersLost);
+                    g_InspectorLogger->warn("Lost {} events, {} buffers.", eventsLost, buffersLost);
 
                     totalEventsLost += eventsLost;
                     totalBuffersLost += buffersLost;
                 }
 
+                // The consumers drop completed records rather than block the
+                // ETW thread when this loop falls behind.
+                uint64_t presentsDropped =
+                    rtConsumer ? rtConsumer->GetDroppedPresentCount() :
+                    shardedConsumer ? shardedConsumer->GetDroppedPresentCount() :
+                    pmConsumer.GetDroppedPresentCount();
+                uint64_t processEventsDropped = shardedConsumer ?
+                    shardedConsumer->GetDroppedProcessEventCount() :
+                    pmConsumer.GetDroppedProcessEventCount();
+                if (data.mProcessEvents && (eventsLost + buffersLost != 0 || processEventsDropped != totalProcessEventsDropped)) {
+                    PollAllProcesses(data, now);
+                }
+                if (presentsDropped != totalPresentsDropped || processEventsDropped != totalProcessEventsDropped) {
+                    g_InspectorLogger->warn("Dropped {} completed presents, {} process events.",
+                        presentsDropped - totalPresentsDropped, processEventsDropped - totalProcessEventsDropped);
+                    totalPresentsDropped = presentsDropped;
+                    totalProcessEventsDropped = processEventsDropped;
+                }
+
+                auto consumerBacklog =
+                    rtConsumer ? rtConsumer->GetQueueBacklog() :
+                    shardedConsumer ? shardedConsumer->GetQueueBacklog() :
+                    pmConsumer.GetQueueBacklog();
+                if (tuner.Update(BufferTuner::MakeSample(now, eventsLost, buffersLost,
+                        session.numberOfBuffers_, session.freeBuffers_, consumerBacklog))) {
+                    auto const& config = tuner.GetConfig();
+                    if (session.UpdateBuffers(config.mMaximumBuffers, config.mFlushTimerSeconds)) {
+                        g_InspectorLogger->info("Trace buffers retuned: maximum {}, flush timer {}s.",
+                            config.mMaximumBuffers, config.mFlushTimerSeconds);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(g_LossStatsMutex);
+                    g_LossStats.eventsLost = totalEventsLost;
+                    g_LossStats.buffersLost = totalBuffersLost;
+                    g_LossStats.presentsDropped = totalPresentsDropped;
+                    g_LossStats.processEventsDropped = totalProcessEventsDropped;
+                    g_LossStats.bufferSizeKB = session.properties_.BufferSize;
+                    g_LossStats.minimumBuffers = session.properties_.MinimumBuffers;
+                    g_LossStats.maximumBuffers = session.properties_.MaximumBuffers;
+                    g_LossStats.flushTimerSeconds = session.properties_.FlushTimer;
+                    g_LossStats.bufferRetunes = tuner.GetRetuneCount();
+                }
+
                 if (timerRunning) {
                     if (GetTickCount64() >= timerEnd) {
                         timerRunning = false;
@@ -477,7 +1243,13 @@ void EtwConsumingThread(uint32_t targetPid)
                     break;
                 }
 
-                Sleep(100);
+                Sleep(tuner.GetPollIntervalMs());
+            }
+
+            if (totalEventsLost + totalBuffersLost != 0) {
+                auto const& recommended = tuner.GetRecommendedConfig();
+                g_InspectorLogger->warn("Events were lost; consider SetSessionBuffers({}, {}, {}, 1, 1) for the next session.",
+                    recommended.mBufferSizeKB, recommended.mMinimumBuffers, recommended.mMaximumBuffers);
             }
 
             PresentMon_Shutdown(data);
@@ -493,5 +1265,16 @@ void EtwConsumingThread(uint32_t targetPid)
         etwProcessingThread.join();
     }
 
+    if (shardedConsumer) {
+        shardedConsumer->Stop();
+    }
+
     session.Finalize();
+
+    if (captureWriter.IsOpen()) {
+        captureWriter.Close();
+        if (captureWriter.GetFailedWriteCount() != 0) {
+            g_InspectorLogger->error("{} writes to the capture file failed", captureWriter.GetFailedWriteCount());
+        }
+    }
 }
@@ -23,6 +23,7 @@ SOFTWARE.
 #pragma once
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdint.h>
 #include <stdio.h>
@@ -32,19 +33,92 @@ SOFTWARE.
 #include "..\PresentData\SwapChainData.hpp"
 #include "..\PresentData\LateStageReprojectionData.hpp"
 #include "..\PresentData\MixedRealityTraceConsumer.hpp"
+#include "..\Utils\inc\expiry_queue.h"
+#include "..\Utils\inc\flat_table.h"
+#include "ProcessLifetimeTracker.hpp"
+#include "ProcessNameCache.hpp"
+#include "ScoreKernel.hpp"
+
+// A swapchain of a process, by its slot in PresentMonData::mChains.
+struct ChainRef {
+    uint64_t mSwapChainAddress;
+    uint32_t mSlot;
+};
+
+// A swapchain as listed by GetSwapChainStats(), which keeps them in
+// (process id, swapchain address) order whatever slots they occupy.
+struct PublishedChain {
+    uint64_t mSwapChainAddress;
+    uint32_t mProcessId;
+    uint32_t mSlot;
+};
 
 struct ProcessInfo {
-    std::string mModuleName;
-    std::map<uint64_t, SwapChainData> mChainMap;
+    enum {
+        INLINE_CHAINS = 4,      // processes rarely present through more
+    };
+
+    std::string mModuleName;    // empty until ProcessNameCache resolves it
+    ChainRef mChains[INLINE_CHAINS];
+    std::vector<ChainRef> mMoreChains;
+    uint32_t mChainCount;
+    uint32_t mProcessId;
     uint64_t mLastRefreshTicks; // GetTickCount64
+    uint32_t mSerial;           // tells a restarted process id apart in the expiry queues
+    uint64_t mPollSinceTicks;   // polls only trust process info requested after this
+    bool mPollQueued;
     bool mTargetProcess;
+
+    ChainRef& Chain(uint32_t i) { return i < INLINE_CHAINS ? mChains[i] : mMoreChains[i - INLINE_CHAINS]; }
+    ChainRef const& Chain(uint32_t i) const { return i < INLINE_CHAINS ? mChains[i] : mMoreChains[i - INLINE_CHAINS]; }
+
+    // NO_SLOT if the process has no such swapchain
+    uint32_t FindChain(uint64_t swapChainAddress) const
+    {
+        for (uint32_t i = 0; i < mChainCount; ++i) {
+            if (Chain(i).mSwapChainAddress == swapChainAddress) {
+                return Chain(i).mSlot;
+            }
+        }
+        return NO_SLOT;
+    }
+
+    void AddChain(uint64_t swapChainAddress, uint32_t slot)
+    {
+        ChainRef ref = { swapChainAddress, slot };
+        if (mChainCount < INLINE_CHAINS) {
+            mChains[mChainCount] = ref;
+        } else {
+            mMoreChains.push_back(ref);
+        }
+        mChainCount += 1;
+    }
+
+    // Order isn't kept: the last swapchain takes the removed one's place.
+    void RemoveChain(uint64_t swapChainAddress)
+    {
+        for (uint32_t i = 0; i < mChainCount; ++i) {
+            if (Chain(i).mSwapChainAddress == swapChainAddress) {
+                Chain(i) = Chain(mChainCount - 1);
+                if (mChainCount > INLINE_CHAINS) {
+                    mMoreChains.pop_back();
+                }
+                mChainCount -= 1;
+                return;
+            }
+        }
+    }
 };
 
-struct PresentMonData {
-    char mCaptureTimeStr[18] = "";
-    uint64_t mStartupQpcTime = 0;
-    uint32_t mTargetPid = 0;
-    std::map<uint32_t, ProcessInfo> mProcessMap;
+struct ProcessExpiryKey {
+    uint32_t mProcessId;
+    uint32_t mSerial;
+};
+
+struct ChainExpiryKey {
+    uint64_t mSwapChainAddress;
+    uint32_t mProcessId;
+    uint32_t mSerial;
 };
 
 #pragma pack (push, 1)
@@ -56,8 +130,111 @@ typedef struct EventScores {
     double timeTaken;
     double screenTime;
 } EventScores;
+
+// Totals for the current (or last) recording session.  Events/buffers lost
+// by ETW and presents dropped by the consumers are missing from the scores.
+typedef struct EventLossStats {
+    uint64_t eventsLost;
+    uint64_t buffersLost;
+    uint64_t presentsDropped;
+    uint64_t processEventsDropped;
+    uint64_t bufferSizeKB;          // session buffer configuration currently in effect
+    uint64_t minimumBuffers;
+    uint64_t maximumBuffers;
+    uint64_t flushTimerSeconds;
+    uint64_t bufferRetunes;         // times auto-tuning changed the configuration
+} EventLossStats;
+
+// Current averages for one swapchain, over its history window (see
+// SetHistoryWindow() and SwapChainData).  All fields are doubles so the array can be
+// read as a plain float64 matrix; process ids and user-mode swapchain
+// addresses are exact in a double.
+typedef struct SwapChainStats {
+    double processId;
+    double swapChainAddress;
+    double fps;
+    double displayedFps;
+    double latencyMs;
+    double cpuFrameTimeMs;
+    double presentCount;        // presents in the window
+    double displayedCount;      // displayed presents in the window
+    // Frame pacing since the swapchain was first seen (see FramePacing);
+    // 0 until it has displayed two vsync'd frames.
+    double refreshPeriodMs;
+    double vsyncIntervals;      // refresh periods before the last displayed frame
+    double meanVsyncIntervals;
+    double missedVsyncCount;    // vsyncs beyond each frame's SyncInterval, summed
+    double displayJitterMs;     // smoothed change between display intervals
+} SwapChainStats;
+
+// Refresh cadence of one display, from its VSyncDPC events (full capture
+// profile only).
+typedef struct DisplayRefreshStats {
+    double vidPnTargetId;
+    double refreshPeriodMs;
+    double refreshRateHz;
+    double vsyncCount;          // since the display was first seen
+} DisplayRefreshStats;
+
+#define HITCH_CONTEXT_INTERVALS 8
+
+// A present-to-present or display-to-display interval that exceeded the
+// swapchain's rolling median (over SwapChainData::INTERVAL_MEDIAN_WINDOW
+// intervals) by the factor or margin given to SetHitchDetection().
+typedef struct HitchEvent {
+    double processId;
+    double swapChainAddress;
+    double displayInterval;     // 0: present-to-present, 1: display-to-display
+    double intervalMs;
+    double medianMs;
+    double precedingMs[HITCH_CONTEXT_INTERVALS]; // intervals before it, most recent first; 0 if unknown
+} HitchEvent;
+
+// Summary of one swapchain of a recorded capture (see SetCaptureFile()),
+// from AnalyzeCaptureFile().
+typedef struct CaptureSwapChainStats {
+    double processId;
+    double swapChainAddress;
+    double presentCount;
+    double displayedCount;
+    double durationMs;          // first to last present
+    double fps;
+    double displayedFps;
+    double latencyMs;           // mean present to screen of displayed presents
+} CaptureSwapChainStats;
 #pragma pack (pop)
 
+struct PresentMonData {
+    char mCaptureTimeStr[18] = "";
+    uint64_t mStartupQpcTime = 0;
+    uint32_t mTargetPid = 0;
+    // Processes by slot, found by process id through mProcessIndex; their
+    // swapchains by the slots in ProcessInfo::mChains.
+    SlotPool<ProcessInfo> mProcesses;
+    FlatIndex mProcessIndex;
+    SlotPool<SwapChainData> mChains;
+    uint32_t mNextProcessSerial = 0;
+    std::unique_ptr<ProcessNameCache> mProcessNames;
+    ProcessLifetimeTracker mLifetimes;
+    bool mProcessEvents = false;    // process start/end events are traced
+
+    // When each process is next checked for exit and each swapchain for
+    // staleness, so an update only visits those that are due.
+    ExpiryQueue<ProcessExpiryKey> mProcessExpiry;
+    ExpiryQueue<ChainExpiryKey> mChainExpiry;
+    uint32_t mHistoryTimeMs = SwapChainData::DEFAULT_HISTORY_TIME;
+    uint32_t mHistoryBudgetKB = SwapChainData::DEFAULT_HISTORY_BUDGET_KB;
+    double mHitchFactor = 0.0;      // 0 disables the check
+    double mHitchMarginMs = 0.0;    // 0 disables the check
+
+    // Scratch for scoring a dequeued batch of presents, reused across updates.
+    ScoreBatch mScoreBatch;
+    std::vector<uint32_t> mBatchOrder;
+    std::vector<double> mBatchTimestamps;
+    std::vector<EventScores> mBatchScores;
+    std::vector<PublishedChain> mPublishOrder;
+};
+
 typedef enum
 {
     STATUS_OK = 0,
@@ -71,10 +248,37 @@ typedef enum
     PRIVILIGIES_ERROR
 }EventTracerExitCodes;
 
+// FULL_CAPTURE_PROFILE tracks every present to the screen; RUNTIME_CAPTURE_PROFILE
+// only enables the DXGI/D3D9 runtime providers and reports fps and timeTaken.
+typedef enum
+{
+    FULL_CAPTURE_PROFILE = 0,
+    RUNTIME_CAPTURE_PROFILE = 1
+}CaptureProfile;
+
 extern "C" {
     __declspec(dllexport) int StartEventRecording(int TargetPid, int arraySize);
     __declspec(dllexport) int StopEventRecording();
     __declspec(dllexport) int SetLogLevel(int level);
+    __declspec(dllexport) int SetConsumerShards(int shardCount);
+    __declspec(dllexport) int SetCaptureProfile(int profile);
+    __declspec(dllexport) int SetCaptureFile(const char *path);
+    // Replay a capture written by a session with SetCaptureFile() on
+    // threadCount threads (0: one per core); swapchains in (processId,
+    // swapChainAddress) order.
+    __declspec(dllexport) int AnalyzeCaptureFile(const char *path, int threadCount, int maxCount, CaptureSwapChainStats *statsBuf, int *returnedCount);
+    __declspec(dllexport) int SetSessionBuffers(int bufferSizeKB, int minimumBuffers, int maximumBuffers, int flushTimerSeconds, int autoTune);
+    __declspec(dllexport) int SetHistoryWindow(int historyTimeMs, int budgetKB);
+    __declspec(dllexport) int SetHitchDetection(double factor, double marginMs);
+    __declspec(dllexport) int GetEventLossStats(EventLossStats *stats);
+    // Swapchains in (processId, swapChainAddress) order.
+    __declspec(dllexport) int GetSwapChainStats(int maxCount, SwapChainStats *statsBuf, int *returnedCount);
+    // Frame time (ms) at each of count percentiles (0..100) for one swapchain
+    // from GetSwapChainStats(), since it was first seen or (window != 0) over
+    // its history window.
+    __declspec(dllexport) int GetFrameTimePercentiles(int processId, uint64_t swapChainAddress, int window, int count, const double *percentiles, double *frameTimesMs);
+    __declspec(dllexport) int GetDisplayRefresh(int maxCount, DisplayRefreshStats *statsBuf, int *returnedCount);
+    __declspec(dllexport) int GetHitchEvents(int maxCount, double *tsBuf, HitchEvent *hitchBuf, int *returnedCount);
     __declspec(dllexport) int GetCurrentData(int numSamples, EventScores *scoresOutputBuf, double *timeOutputBuf, int *returnedSamples);
     __declspec(dllexport) int GetDataCount(int *result);
     __declspec(dllexport) int GetData(int dataCount, double *tsBuf, EventScores *scoresBuf);
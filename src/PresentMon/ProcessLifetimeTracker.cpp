@@ -0,0 +1,91 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "ProcessLifetimeTracker.hpp"
+
+ProcessLifetimeTracker::StartResult ProcessLifetimeTracker::Start(uint32_t processId, uint64_t timestamp)
+{
+    auto inserted = mLifetimes.emplace(processId, Lifetime());
+    auto& lifetime = inserted.first->second;
+    if (!inserted.second && lifetime.mStartTime == timestamp) {
+        return StartResult::Duplicate;
+    }
+
+    lifetime.mStartTime = timestamp;
+    lifetime.mConfirmed = true;
+    return inserted.second ? StartResult::New : StartResult::Reused;
+}
+
+bool ProcessLifetimeTracker::Stop(uint32_t processId, uint64_t timestamp)
+{
+    auto it = mLifetimes.find(processId);
+    if (it == mLifetimes.end()) {
+        return true; // never tracked; nothing to keep alive
+    }
+    if (timestamp < it->second.mStartTime) {
+        return false;
+    }
+    mLifetimes.erase(it);
+    return true;
+}
+
+void ProcessLifetimeTracker::Observe(uint32_t processId)
+{
+    auto inserted = mLifetimes.emplace(processId, Lifetime());
+    if (inserted.second) {
+        inserted.first->second.mStartTime = 0;
+        inserted.first->second.mConfirmed = false;
+    }
+}
+
+void ProcessLifetimeTracker::Confirm(uint32_t processId)
+{
+    auto it = mLifetimes.find(processId);
+    if (it != mLifetimes.end()) {
+        it->second.mConfirmed = true;
+    }
+}
+
+void ProcessLifetimeTracker::Remove(uint32_t processId)
+{
+    mLifetimes.erase(processId);
+}
+
+void ProcessLifetimeTracker::EventsLost()
+{
+    for (auto& pair : mLifetimes) {
+        pair.second.mConfirmed = false;
+    }
+}
+
+bool ProcessLifetimeTracker::IsConfirmed(uint32_t processId) const
+{
+    auto lifetime = Find(processId);
+    return lifetime != nullptr && lifetime->mConfirmed;
+}
+
+ProcessLifetimeTracker::Lifetime const* ProcessLifetimeTracker::Find(uint32_t processId) const
+{
+    auto it = mLifetimes.find(processId);
+    return it != mLifetimes.end() ? &it->second : nullptr;
+}
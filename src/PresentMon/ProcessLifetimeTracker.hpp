@@ -0,0 +1,78 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+
+// Process lifetimes from the process start/end events, so exits and process
+// id reuse are known without asking the OS.
+//
+// A start for an id that is already alive means the id was reused and its
+// end event was lost.  An end older than the tracked instance's start
+// belongs to an earlier instance and is ignored, so the order in which a
+// batch's starts and ends are applied doesn't matter.
+//
+// Processes first seen some other way (by their presents, having started
+// before the trace) and every process once events may have been lost are
+// unconfirmed: the owner polls those, and confirms them once a poll after
+// the loss finds them running.
+class ProcessLifetimeTracker {
+public:
+    struct Lifetime {
+        uint64_t mStartTime;    // of the start event; 0 if it wasn't seen
+        bool mConfirmed;
+    };
+
+    enum class StartResult {
+        New,
+        Reused,                 // replaced a live instance of the same id
+        Duplicate,              // the tracked instance's own start, again
+    };
+
+    StartResult Start(uint32_t processId, uint64_t timestamp);
+
+    // Returns false if the end is for an earlier instance than the tracked
+    // one.
+    bool Stop(uint32_t processId, uint64_t timestamp);
+
+    // Tracks processId unconfirmed if it isn't tracked yet.
+    void Observe(uint32_t processId);
+    void Confirm(uint32_t processId);
+
+    // A poll found the process gone.
+    void Remove(uint32_t processId);
+
+    // Events may have been lost: nothing is confirmed any more.
+    void EventsLost();
+
+    bool IsConfirmed(uint32_t processId) const;
+    Lifetime const* Find(uint32_t processId) const;
+    size_t Size() const { return mLifetimes.size(); }
+    void Clear() { mLifetimes.clear(); }
+
+private:
+    std::map<uint32_t, Lifetime> mLifetimes;
+};
@@ -0,0 +1,118 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "ProcessNameCache.hpp"
+
+ProcessNameCache::ProcessNameCache(QueryFn queryFn)
+    : mQueryFn(queryFn)
+{
+}
+
+ProcessNameCache::~ProcessNameCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void ProcessNameCache::Set(uint32_t processId, std::string const& imageFileName, uint64_t now)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& entry = mEntries[processId];
+    entry.mInfo.mImageFileName = imageFileName;
+    entry.mInfo.mFound = true;
+    entry.mInfo.mRunning = true;
+    entry.mUpdatedMs = now;
+    entry.mKnown = true;
+    entry.mQueued = false;  // a query still in flight is older; drop its result
+}
+
+void ProcessNameCache::Remove(uint32_t processId)
+{
+    // A query still in flight finds no entry and is discarded.
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.erase(processId);
+}
+
+bool ProcessNameCache::Get(uint32_t processId, uint64_t now, uint64_t maxAgeMs, Info* info)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto inserted = mEntries.emplace(processId, Entry());
+    auto& entry = inserted.first->second;
+    if (inserted.second) {
+        entry.mKnown = false;
+        entry.mQueued = false;
+    }
+
+    if (entry.mKnown && !entry.mInfo.mFound && maxAgeMs < NEGATIVE_TTL_MS) {
+        maxAgeMs = NEGATIVE_TTL_MS;
+    }
+    if ((!entry.mKnown || now - entry.mUpdatedMs > maxAgeMs) && !entry.mQueued) {
+        entry.mQueued = true;
+        entry.mRequestedMs = now;
+        mQueue.push_back(processId);
+        if (!mThread.joinable()) {
+            mThread = std::thread(&ProcessNameCache::ResolverThread, this);
+        }
+        mWake.notify_one();
+    }
+
+    if (!entry.mKnown) {
+        return false;
+    }
+    *info = entry.mInfo;
+    info->mUpdatedMs = entry.mUpdatedMs;
+    return true;
+}
+
+void ProcessNameCache::ResolverThread()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;) {
+        mWake.wait(lock, [this] { return mStop || !mQueue.empty(); });
+        if (mStop) {
+            break;
+        }
+        auto processId = mQueue.front();
+        mQueue.pop_front();
+
+        lock.unlock();
+        Info info = {};
+        info.mFound = mQueryFn(processId, &info);
+        lock.lock();
+
+        auto it = mEntries.find(processId);
+        if (it == mEntries.end() || !it->second.mQueued) {
+            continue;
+        }
+        it->second.mInfo = info;
+        it->second.mUpdatedMs = it->second.mRequestedMs;
+        it->second.mKnown = true;
+        it->second.mQueued = false;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// Image names and liveness of processes by id, so the consumer thread never
+// waits on an OS process query.
+//
+// Names come primarily from the NT process start/DC_START events (Set()).
+// Processes seen without one (the event was dropped, or the process is
+// looked up before its event is dequeued) and periodic liveness checks are
+// resolved by a background thread through a QueryFn; Get() returns what is
+// cached meanwhile.  Failed queries are cached for NEGATIVE_TTL_MS so a
+// process that can't be opened isn't queried again on every lookup.
+class ProcessNameCache {
+public:
+    struct Info {
+        std::string mImageFileName;
+        bool mFound;                // false if the process couldn't be queried
+        bool mRunning;
+        uint64_t mUpdatedMs;        // when the query was requested; set by Get()
+    };
+
+    // Fills in info; returns false if the process couldn't be queried.
+    typedef bool (*QueryFn)(uint32_t processId, Info* info);
+
+    enum {
+        NEGATIVE_TTL_MS = 5000,
+    };
+
+    explicit ProcessNameCache(QueryFn queryFn);
+    ~ProcessNameCache();
+
+    // From the NT process events.
+    void Set(uint32_t processId, std::string const& imageFileName, uint64_t now);
+    void Remove(uint32_t processId);
+
+    // Cached info for processId, returning false if there is none yet.  If
+    // the info is older than maxAgeMs (NEGATIVE_TTL_MS for a failed query)
+    // it is still returned and a refresh is queued.
+    bool Get(uint32_t processId, uint64_t now, uint64_t maxAgeMs, Info* info);
+
+private:
+    struct Entry {
+        Info mInfo;
+        uint64_t mUpdatedMs;        // as of the caller's clock when requested
+        uint64_t mRequestedMs;
+        bool mKnown;
+        bool mQueued;
+    };
+
+    void ResolverThread();
+
+    QueryFn mQueryFn;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::map<uint32_t, Entry> mEntries;
+    std::deque<uint32_t> mQueue;
+    std::thread mThread;            // started by the first query
+    bool mStop = false;
+};
@@ -0,0 +1,165 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "ScoreKernel.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SCORE_KERNEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// MSVC accepts AVX2 intrinsics without /arch:AVX2, so the AVX2 path is built
+// unconditionally there and selected at runtime.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SCORE_KERNEL_AVX2 1
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+void ScoreBatch::Reset(size_t rowCount)
+{
+    mFrameTicks.resize(rowCount);
+    mFlipTicks.resize(rowCount);
+    mReadyTicks.resize(rowCount);
+    mDisplayedTicks.resize(rowCount);
+    mTimeTakenTicks.resize(rowCount);
+    mValid.assign(rowCount, 0);
+
+    mFps.resize(rowCount);
+    mFlip.resize(rowCount);
+    mDeltaReady.resize(rowCount);
+    mDeltaDisplayed.resize(rowCount);
+    mTimeTaken.resize(rowCount);
+}
+
+void ScoreBatch::Set(size_t row, uint64_t frameTicks, uint64_t flipTicks, uint64_t readyTicks,
+                     uint64_t displayedTicks, uint64_t timeTakenTicks)
+{
+    mFrameTicks[row] = frameTicks < MAX_TICKS ? frameTicks : MAX_TICKS;
+    mFlipTicks[row] = flipTicks < MAX_TICKS ? flipTicks : MAX_TICKS;
+    mReadyTicks[row] = readyTicks < MAX_TICKS ? readyTicks : MAX_TICKS;
+    mDisplayedTicks[row] = displayedTicks < MAX_TICKS ? displayedTicks : MAX_TICKS;
+    mTimeTakenTicks[row] = timeTakenTicks < MAX_TICKS ? timeTakenTicks : MAX_TICKS;
+    mValid[row] = 1;
+}
+
+namespace {
+
+// 2^52: OR-ing a value below 2^52 into this double's mantissa and subtracting
+// it again converts uint64 -> double without the AVX-512 conversion.
+const double TWO_POW_52 = 4503599627370496.0;
+
+void ComputeScoresScalar(ScoreBatch& b, size_t begin, size_t end, double msPerTick)
+{
+    for (size_t i = begin; i < end; ++i) {
+        b.mFps[i] = 1000. / ((double) b.mFrameTicks[i] * msPerTick);
+        b.mFlip[i] = 1000. / ((double) b.mFlipTicks[i] * msPerTick);
+        b.mDeltaReady[i] = (double) b.mReadyTicks[i] * msPerTick;
+        b.mDeltaDisplayed[i] = (double) b.mDisplayedTicks[i] * msPerTick;
+        b.mTimeTaken[i] = (double) b.mTimeTakenTicks[i] * msPerTick;
+    }
+}
+
+#if SCORE_KERNEL_SSE2
+inline __m128d TicksToMs(uint64_t const* ticks, __m128d scale)
+{
+    __m128i bits = _mm_or_si128(_mm_loadu_si128((__m128i const*) ticks), _mm_castpd_si128(_mm_set1_pd(TWO_POW_52)));
+    return _mm_mul_pd(_mm_sub_pd(_mm_castsi128_pd(bits), _mm_set1_pd(TWO_POW_52)), scale);
+}
+
+size_t ComputeScoresSSE2(ScoreBatch& b, size_t count, double msPerTick)
+{
+    __m128d scale = _mm_set1_pd(msPerTick);
+    __m128d thousand = _mm_set1_pd(1000.);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(&b.mFps[i], _mm_div_pd(thousand, TicksToMs(&b.mFrameTicks[i], scale)));
+        _mm_storeu_pd(&b.mFlip[i], _mm_div_pd(thousand, TicksToMs(&b.mFlipTicks[i], scale)));
+        _mm_storeu_pd(&b.mDeltaReady[i], TicksToMs(&b.mReadyTicks[i], scale));
+        _mm_storeu_pd(&b.mDeltaDisplayed[i], TicksToMs(&b.mDisplayedTicks[i], scale));
+        _mm_storeu_pd(&b.mTimeTaken[i], TicksToMs(&b.mTimeTakenTicks[i], scale));
+    }
+    return i;
+}
+#endif
+
+#if SCORE_KERNEL_AVX2
+inline __m256d TicksToMs256(uint64_t const* ticks, __m256d scale)
+{
+    __m256i bits = _mm256_or_si256(_mm256_loadu_si256((__m256i const*) ticks), _mm256_castpd_si256(_mm256_set1_pd(TWO_POW_52)));
+    return _mm256_mul_pd(_mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(TWO_POW_52)), scale);
+}
+
+size_t ComputeScoresAVX2(ScoreBatch& b, size_t count, double msPerTick)
+{
+    __m256d scale = _mm256_set1_pd(msPerTick);
+    __m256d thousand = _mm256_set1_pd(1000.);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(&b.mFps[i], _mm256_div_pd(thousand, TicksToMs256(&b.mFrameTicks[i], scale)));
+        _mm256_storeu_pd(&b.mFlip[i], _mm256_div_pd(thousand, TicksToMs256(&b.mFlipTicks[i], scale)));
+        _mm256_storeu_pd(&b.mDeltaReady[i], TicksToMs256(&b.mReadyTicks[i], scale));
+        _mm256_storeu_pd(&b.mDeltaDisplayed[i], TicksToMs256(&b.mDisplayedTicks[i], scale));
+        _mm256_storeu_pd(&b.mTimeTaken[i], TicksToMs256(&b.mTimeTakenTicks[i], scale));
+    }
+    _mm256_zeroupper();
+    return i;
+}
+
+bool CpuHasAVX2()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) { // OS saves XMM and YMM state
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+#endif
+
+}
+
+void ComputeScores(ScoreBatch& batch, double msPerTick)
+{
+    size_t count = batch.Size();
+    size_t done = 0;
+#if SCORE_KERNEL_AVX2
+    static const bool hasAVX2 = CpuHasAVX2();
+    if (hasAVX2) {
+        done = ComputeScoresAVX2(batch, count, msPerTick);
+    }
+#endif
+#if SCORE_KERNEL_SSE2
+    if (done == 0) {
+        done = ComputeScoresSSE2(batch, count, msPerTick);
+    }
+#endif
+    ComputeScoresScalar(batch, done, count, msPerTick);
+}
@@ -0,0 +1,68 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Columnar inputs and outputs for ComputeScores(), one row per completed
+// present in a dequeued batch.  Inputs are QPC tick deltas; a zero delta
+// means "not available" and produces the same 0 (or, for the rates, inf)
+// that the per-present computation did.  Rows that produce no score (the
+// first present of a swapchain, presents from non-target processes) are
+// left invalid and skipped when the scores are emitted.
+struct ScoreBatch {
+    // Deltas are clamped to this so they convert to double exactly.
+    static const uint64_t MAX_TICKS = (1ull << 52) - 1;
+
+    // inputs
+    std::vector<uint64_t> mFrameTicks;      // QpcTime - previous present's QpcTime
+    std::vector<uint64_t> mFlipTicks;       // ScreenTime - previous displayed present's ScreenTime
+    std::vector<uint64_t> mReadyTicks;      // ReadyTime - QpcTime
+    std::vector<uint64_t> mDisplayedTicks;  // ScreenTime - QpcTime
+    std::vector<uint64_t> mTimeTakenTicks;
+    std::vector<uint8_t> mValid;
+
+    // outputs
+    std::vector<double> mFps;
+    std::vector<double> mFlip;
+    std::vector<double> mDeltaReady;
+    std::vector<double> mDeltaDisplayed;
+    std::vector<double> mTimeTaken;
+
+    // Sizes every column to rowCount and invalidates all rows.  The inputs
+    // of a row are only meaningful once Set(); invalid rows still get
+    // (ignored) outputs.
+    void Reset(size_t rowCount);
+    size_t Size() const { return mValid.size(); }
+
+    void Set(size_t row, uint64_t frameTicks, uint64_t flipTicks, uint64_t readyTicks,
+             uint64_t displayedTicks, uint64_t timeTakenTicks);
+};
+
+// Fills the output columns of every row (valid or not) from the input
+// columns.  Uses AVX2 when the CPU supports it, otherwise SSE2 where the
+// build targets it, otherwise plain C++; all three produce identical results.
+void ComputeScores(ScoreBatch& batch, double msPerTick);
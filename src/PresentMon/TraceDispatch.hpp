@@ -0,0 +1,93 @@
+/*
+Copyright 2017-2018 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "../PresentData/EventRecord.hpp"
+
+typedef void (*EventHandlerFn)(EVENT_RECORD* pEventRecord, void* pContext);
+
+// Flat provider table scanned by TraceSession's event callback.  There are
+// only a handful of providers, so a linear 128-bit compare (starting from the
+// last hit) beats hashing.  It only depends on EVENT_RECORD, so the dispatch
+// path builds and can be benchmarked off Windows too.
+struct TraceDispatchTable {
+    enum { MAX_HANDLERS_PER_PROVIDER = 4 };
+    enum { MAX_FILTERED_EVENT_ID = 1023 };
+    struct Handler {
+        EventHandlerFn fn_;
+        void* ctxt_;
+    };
+    struct Entry {
+        uint64_t id_[2];
+        uint32_t processId_;
+        uint32_t handlerCount_;
+        Handler handlers_[MAX_HANDLERS_PER_PROVIDER];
+        bool hasIdFilter_;
+        uint64_t idFilter_[(MAX_FILTERED_EVENT_ID + 64) / 64];
+    };
+    std::vector<Entry> entries_;
+
+    // Pass the event to its provider's handlers unless the entry's process
+    // or id filter drops it.  *last is the index of the last entry hit,
+    // owned by the dispatching thread.
+    void Dispatch(EVENT_RECORD* pEventRecord, size_t* last) const
+    {
+        auto const& hdr = pEventRecord->EventHeader;
+
+        uint64_t id[2];
+        memcpy(id, &hdr.ProviderId, sizeof(id));
+
+        auto n = entries_.size();
+        auto i = *last;
+        if (i >= n || entries_[i].id_[0] != id[0] || entries_[i].id_[1] != id[1]) {
+            for (i = 0; i < n; ++i) {
+                if (entries_[i].id_[0] == id[0] && entries_[i].id_[1] == id[1]) {
+                    break;
+                }
+            }
+            if (i == n) {
+                return;
+            }
+            *last = i;
+        }
+
+        auto const& e = entries_[i];
+        if (e.processId_ != 0 && e.processId_ != hdr.ProcessId) {
+            return;
+        }
+        if (e.hasIdFilter_) {
+            auto eventId = hdr.EventDescriptor.Id;
+            if (eventId > MAX_FILTERED_EVENT_ID || (e.idFilter_[eventId >> 6] & (1ull << (eventId & 63))) == 0) {
+                return;
+            }
+        }
+
+        for (uint32_t h = 0; h < e.handlerCount_; ++h) {
+            (*e.handlers_[h].fn_)(pEventRecord, e.handlers_[h].ctxt_);
+        }
+    }
+};
@@ -20,6 +20,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <algorithm>
+#include <thread>
+
 #include "TraceSession.hpp"
 #include "Logger.hpp"
 
@@ -28,17 +31,22 @@ namespace {
 VOID WINAPI EventRecordCallback(EVENT_RECORD* pEventRecord)
 {
     auto session = (TraceSession*) pEventRecord->UserContext;
-    auto const& hdr = pEventRecord->EventHeader;
 
     if (session->startTime_ == 0) {
-        session->startTime_ = hdr.TimeStamp.QuadPart;
+        session->startTime_ = pEventRecord->EventHeader.TimeStamp.QuadPart;
     }
 
-    auto iter = session->eventHandler_.find(hdr.ProviderId);
-    if (iter != session->eventHandler_.end()) {
-        auto const& h = iter->second;
-        (*h.fn_)(pEventRecord, h.ctxt_);
+    // Mark the dispatch as in flight before loading the table, so that once
+    // WaitForDispatch() sees an even sequence after a handler change, every
+    // later event is guaranteed to use the new table.  Only this thread
+    // writes dispatchSequence_.
+    auto seq = session->dispatchSequence_.load(std::memory_order_relaxed);
+    session->dispatchSequence_.store(seq + 1);
+    auto table = session->dispatch_.load();
+    if (table != nullptr) {
+        table->Dispatch(pEventRecord, &session->dispatchLast_);
     }
+    session->dispatchSequence_.store(seq + 2, std::memory_order_release);
 }
 
 ULONG WINAPI BufferCallback(EVENT_TRACE_LOGFILEA* pLogFile)
@@ -140,14 +148,28 @@ bool TraceSession::AddProvider(GUID providerId, UCHAR level,
 
 bool TraceSession::AddHandler(GUID providerId, EventHandlerFn handlerFn, void* handlerContext)
 {
-    auto p = eventHandler_.emplace(std::make_pair(providerId, Handler()));
-    if (!p.second) {
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+
+    auto p = eventHandler_.emplace(std::make_pair(providerId, HandlerChain()));
+    auto chain = &p.first->second;
+    if (p.second) {
+        chain->processId_ = 0;
+    }
+
+    for (auto const& h : chain->handlers_) {
+        if (h.fn_ == handlerFn && h.ctxt_ == handlerContext) {
+            return false;
+        }
+    }
+    if (chain->handlers_.size() == MAX_HANDLERS_PER_PROVIDER) {
         return false;
     }
 
-    auto h = &p.first->second;
-    h->fn_ = handlerFn;
-    h->ctxt_ = handlerContext;
+    Handler h;
+    h.fn_ = handlerFn;
+    h.ctxt_ = handlerContext;
+    chain->handlers_.push_back(h);
+    UpdateDispatchTable();
     return true;
 }
 
@@ -176,7 +198,130 @@ bool TraceSession::RemoveProvider(GUID providerId)
 
 bool TraceSession::RemoveHandler(GUID providerId)
 {
-    return eventHandler_.erase(providerId) != 0;
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+
+    if (eventHandler_.erase(providerId) == 0) {
+        return false;
+    }
+    UpdateDispatchTable();
+    return true;
+}
+
+bool TraceSession::RemoveHandler(GUID providerId, EventHandlerFn handlerFn, void* handlerContext)
+{
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+
+    auto iter = eventHandler_.find(providerId);
+    if (iter == eventHandler_.end()) {
+        return false;
+    }
+
+    auto& handlers = iter->second.handlers_;
+    for (auto ii = handlers.begin(), ie = handlers.end(); ii != ie; ++ii) {
+        if (ii->fn_ == handlerFn && ii->ctxt_ == handlerContext) {
+            handlers.erase(ii);
+            if (handlers.empty()) {
+                eventHandler_.erase(iter);
+            }
+            UpdateDispatchTable();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TraceSession::WaitForDispatch()
+{
+    auto seq = dispatchSequence_.load();
+    if ((seq & 1) == 0) {
+        return;
+    }
+    while (dispatchSequence_.load(std::memory_order_acquire) == seq) {
+        std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+    FreeRetiredTables();
+}
+
+bool TraceSession::SetEventIdFilter(GUID providerId, std::initializer_list<USHORT> eventIds)
+{
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+
+    auto iter = eventHandler_.find(providerId);
+    if (iter == eventHandler_.end()) {
+        return false;
+    }
+
+    std::vector<uint64_t> filter((MAX_FILTERED_EVENT_ID + 64) / 64, 0);
+    for (auto eventId : eventIds) {
+        if (eventId > MAX_FILTERED_EVENT_ID) {
+            return false;
+        }
+        filter[eventId >> 6] |= 1ull << (eventId & 63);
+    }
+
+    iter->second.idFilter_.swap(filter);
+    UpdateDispatchTable();
+    return true;
+}
+
+bool TraceSession::SetProcessFilter(GUID providerId, uint32_t processId)
+{
+    std::lock_guard<std::mutex> lock(handlerMutex_);
+
+    auto iter = eventHandler_.find(providerId);
+    if (iter == eventHandler_.end()) {
+        return false;
+    }
+
+    iter->second.processId_ = processId;
+    UpdateDispatchTable();
+    return true;
+}
+
+void TraceSession::UpdateDispatchTable()
+{
+    std::unique_ptr<DispatchTable> table(new DispatchTable);
+    table->entries_.reserve(eventHandler_.size());
+    for (auto const& pair : eventHandler_) {
+        auto const& chain = pair.second;
+
+        DispatchEntry e = {};
+        memcpy(e.id_, &pair.first, sizeof(e.id_));
+        e.processId_ = chain.processId_;
+        e.handlerCount_ = (uint32_t) chain.handlers_.size();
+        std::copy(chain.handlers_.begin(), chain.handlers_.end(), e.handlers_);
+        e.hasIdFilter_ = !chain.idFilter_.empty();
+        if (e.hasIdFilter_) {
+            memcpy(e.idFilter_, chain.idFilter_.data(), sizeof(e.idFilter_));
+        }
+        table->entries_.push_back(e);
+    }
+
+    // The swap and the sequence load pair with the callback's sequence store
+    // and table load: if the sequence is even here, no dispatch in flight or
+    // to come can use the old table.
+    dispatch_.store(table.get());
+    if (dispatchTable_ != nullptr) {
+        RetiredTable retired;
+        retired.sequence_ = dispatchSequence_.load();
+        retired.table_ = std::move(dispatchTable_);
+        retiredTables_.push_back(std::move(retired));
+    }
+    dispatchTable_ = std::move(table);
+
+    FreeRetiredTables();
+}
+
+void TraceSession::FreeRetiredTables()
+{
+    // A table retired during a dispatch (odd sequence) is free once that
+    // dispatch has finished, i.e. the sequence has moved on.
+    auto seq = dispatchSequence_.load(std::memory_order_acquire);
+    retiredTables_.erase(std::remove_if(retiredTables_.begin(), retiredTables_.end(), [seq](RetiredTable const& r) {
+        return (r.sequence_ & 1) == 0 || r.sequence_ != seq;
+    }), retiredTables_.end());
 }
 
 bool TraceSession::RemoveProviderAndHandler(GUID providerId)
@@ -209,12 +354,12 @@ bool TraceSession::InitializeRealtime(char const* traceSessionName, ShouldStopPr
     properties_.Wnode.ClientContext = 1;   // Clock resolution to use when logging the timestamp for each event
                                            // 1 == query performance counter
     properties_.Wnode.Flags = 0;
-    //properties_.BufferSize = 0;
-    properties_.MinimumBuffers = 200;
-    //properties_.MaximumBuffers = 0;
+    properties_.BufferSize = bufferConfig_.bufferSizeKB_;
+    properties_.MinimumBuffers = bufferConfig_.minimumBuffers_;
+    properties_.MaximumBuffers = bufferConfig_.maximumBuffers_;
     //properties_.MaximumFileSize = 0;
     properties_.LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
-    //properties_.FlushTimer = 0;
+    properties_.FlushTimer = bufferConfig_.flushTimerSeconds_;
     //properties_.EnableFlags = 0;
     properties_.LogFileNameOffset = 0;
     properties_.LoggerNameOffset = offsetof(TraceSession, loggerName_);
@@ -277,8 +422,13 @@ void TraceSession::Finalize()
     while (!eventProvider_.empty()) {
         RemoveProvider(eventProvider_.begin()->first);
     }
-    while (!eventHandler_.empty()) {
-        RemoveHandler(eventHandler_.begin()->first);
+    {
+        std::lock_guard<std::mutex> lock(handlerMutex_);
+        eventHandler_.clear();
+        dispatch_.store(nullptr, std::memory_order_release);
+        dispatchTable_.reset();
+        retiredTables_.clear();
+        dispatchLast_ = 0;
     }
 
     sessionHandle_ = 0;
@@ -304,6 +454,8 @@ bool TraceSession::CheckLostReports(uint32_t* eventsLost, uint32_t* buffersLost)
         auto status = ControlTraceW(sessionHandle_, nullptr, &properties_, EVENT_TRACE_CONTROL_QUERY);
         switch (status) {
         case ERROR_SUCCESS:
+            numberOfBuffers_ = properties_.NumberOfBuffers;
+            freeBuffers_ = properties_.FreeBuffers;
             *eventsLost = properties_.EventsLost - eventsLostCount_;
             *buffersLost = properties_.RealTimeBuffersLost - buffersLostCount_;
             eventsLostCount_ = properties_.EventsLost;
@@ -334,3 +486,18 @@ bool TraceSession::CheckLostReports(uint32_t* eventsLost, uint32_t* buffersLost)
     return ret;
 }
 
+bool TraceSession::UpdateBuffers(ULONG maximumBuffers, ULONG flushTimerSeconds)
+{
+    if (sessionHandle_ == 0) {
+        return false;
+    }
+
+    properties_.MaximumBuffers = maximumBuffers;
+    properties_.FlushTimer = flushTimerSeconds;
+    auto status = ControlTraceW(sessionHandle_, nullptr, &properties_, EVENT_TRACE_CONTROL_UPDATE);
+    if (status != ERROR_SUCCESS) {
+        g_InspectorLogger->warn("failed to update trace buffers (error={})", status);
+        return false;
+    }
+    return true;
+}
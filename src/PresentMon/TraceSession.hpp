@@ -24,10 +24,16 @@ SOFTWARE.
 
 #include <windows.h>
 #include <evntcons.h> // must be after windows.h
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
+
+#include "TraceDispatch.hpp"
 
-typedef void (*EventHandlerFn)(EVENT_RECORD* pEventRecord, void* pContext);
 typedef bool (*ShouldStopProcessingEventsFn)();
 
 struct TraceSession {
@@ -44,6 +50,20 @@ struct TraceSession {
     uint32_t eventsLostCount_;
     uint32_t buffersLostCount_;
 
+    // Buffer configuration used by InitializeRealtime(); 0 leaves a value to
+    // ETW.  After the session starts, properties_ holds the values ETW chose.
+    struct BufferConfig {
+        ULONG bufferSizeKB_;
+        ULONG minimumBuffers_;
+        ULONG maximumBuffers_;
+        ULONG flushTimerSeconds_;
+    };
+    BufferConfig bufferConfig_;
+
+    // Buffer usage as of the last CheckLostReports().
+    uint32_t numberOfBuffers_;
+    uint32_t freeBuffers_;
+
     // Structure to hold the mapping from provider ID to event handler function
     struct GUIDHash { size_t operator()(GUID const& g) const; };
     struct GUIDEqual { bool operator()(GUID const& lhs, GUID const& rhs) const; };
@@ -52,12 +72,36 @@ struct TraceSession {
         ULONGLONG matchAll_;
         UCHAR level_;
     };
-    struct Handler {
-        EventHandlerFn fn_;
-        void* ctxt_;
+    enum { MAX_HANDLERS_PER_PROVIDER = TraceDispatchTable::MAX_HANDLERS_PER_PROVIDER };
+    typedef TraceDispatchTable::Handler Handler;
+    struct HandlerChain {
+        std::vector<Handler> handlers_;  // invoked in the order they were added
+        std::vector<uint64_t> idFilter_; // bitset over event ids, empty if all ids are handled
+        uint32_t processId_;             // only events from this process are handled, 0 for any
     };
     std::unordered_map<GUID, Provider, GUIDHash, GUIDEqual> eventProvider_;
-    std::unordered_map<GUID, Handler, GUIDHash, GUIDEqual> eventHandler_;
+    std::unordered_map<GUID, HandlerChain, GUIDHash, GUIDEqual> eventHandler_;
+
+    // Flat copy of eventHandler_ scanned by the event callback.
+    //
+    // Tables are immutable once published: a handler change builds a new
+    // table under handlerMutex_ and swaps the pointer, so the callback never
+    // locks.  A replaced table is retired with the dispatch sequence seen
+    // after the swap and freed by the next handler change or
+    // WaitForDispatch() once no dispatch can still be reading it.
+    enum { MAX_FILTERED_EVENT_ID = TraceDispatchTable::MAX_FILTERED_EVENT_ID };
+    typedef TraceDispatchTable DispatchTable;
+    typedef TraceDispatchTable::Entry DispatchEntry;
+    struct RetiredTable {
+        uint64_t sequence_;
+        std::unique_ptr<DispatchTable> table_;
+    };
+    std::atomic<DispatchTable const*> dispatch_;
+    std::unique_ptr<DispatchTable> dispatchTable_; // owns dispatch_
+    std::vector<RetiredTable> retiredTables_;
+    std::mutex handlerMutex_;
+    size_t dispatchLast_;                    // callback thread only
+    std::atomic<uint64_t> dispatchSequence_; // odd while an event is being dispatched
 
     TraceSession()
         : sessionHandle_(0)
@@ -65,6 +109,12 @@ struct TraceSession {
         , startTime_(0)
         , frequency_(0)
         , shouldStopProcessingEventsFn_(nullptr)
+        , bufferConfig_{0, 200, 0, 0}
+        , numberOfBuffers_(0)
+        , freeBuffers_(0)
+        , dispatch_(nullptr)
+        , dispatchLast_(0)
+        , dispatchSequence_(0)
     {
     }
 
@@ -86,16 +136,44 @@ struct TraceSession {
     //
     // 4) Finalize() to clean up.
 
-    // AddProvider/Handler() returns false if the providerId already has a handler.
-    // RemoveProvider/Handler() returns false if the providerId don't have a handler.
+    // AddProvider() returns false if the providerId was already added.
+    // RemoveProvider() returns false if the providerId wasn't added.
+    //
+    // Several handlers can be attached to one provider; each event is passed
+    // to all of them in the order they were added.  AddHandler() returns
+    // false if this handler/context pair is already attached or the provider
+    // already has MAX_HANDLERS_PER_PROVIDER handlers.  RemoveHandler(id)
+    // detaches every handler of the provider, RemoveHandler(id, fn, ctxt)
+    // only that one; both return false if nothing was attached.
+    //
+    // Handlers can be added and removed from any thread while events are
+    // being processed.  A removed handler may still be running for the event
+    // in flight, so call WaitForDispatch() before destroying its context.
     bool AddProvider(GUID providerId, UCHAR level, ULONGLONG matchAnyKeyword, ULONGLONG matchAllKeyword);
     bool AddHandler(GUID handlerId, EventHandlerFn handlerFn, void* handlerContext);
     bool AddProviderAndHandler(GUID providerId, UCHAR level, ULONGLONG matchAnyKeyword, ULONGLONG matchAllKeyword,
                                EventHandlerFn handlerFn, void* handlerContext);
     bool RemoveProvider(GUID providerId);
     bool RemoveHandler(GUID handlerId);
+    bool RemoveHandler(GUID handlerId, EventHandlerFn handlerFn, void* handlerContext);
     bool RemoveProviderAndHandler(GUID providerId);
 
+    // Wait until the event being dispatched (if any) has been handled.  Must
+    // not be called from a handler.
+    void WaitForDispatch();
+
+    // Only pass events with one of these ids to the provider's handlers; the
+    // rest are dropped in the callback before any handler runs.  Returns
+    // false if the provider has no handler or an id exceeds
+    // MAX_FILTERED_EVENT_ID.
+    bool SetEventIdFilter(GUID providerId, std::initializer_list<USHORT> eventIds);
+
+    // Only pass events raised by processId to the provider's handlers, or all
+    // events if processId is 0.  Only meaningful for user-mode providers,
+    // whose events are raised in the context of the emitting process.
+    // Returns false if the provider has no handler.
+    bool SetProcessFilter(GUID providerId, uint32_t processId);
+
     // InitializeRealtime() and InitializeEtlFile() return false if the session
     // could not be created.
     bool InitializeEtlFile(char const* etlPath, ShouldStopProcessingEventsFn shouldStopProcessingEventsFn);
@@ -106,6 +184,15 @@ struct TraceSession {
     // how many events and buffers have been lost while tracing.
     bool CheckLostReports(uint32_t* eventsLost, uint32_t* buffersLost);
 
+    // Change the running session's MaximumBuffers and FlushTimer, the only
+    // buffer settings ETW can update on a live session.  Returns false if the
+    // session isn't running or rejected the update.
+    bool UpdateBuffers(ULONG maximumBuffers, ULONG flushTimerSeconds);
+
     void Stop();
+
+private:
+    void UpdateDispatchTable();
+    void FreeRetiredTables();
 };
 
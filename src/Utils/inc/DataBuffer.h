@@ -26,6 +26,7 @@ class DataBuffer {
 		~DataBuffer();
 
 		void addData(double timestamp, T data);
+		void addData(size_t n, double const *tsBuf, T const *dataBuf);
 		size_t getData(size_t maxCount, double *tsBuf, T *dataBuf);
 		size_t getCurrentData(size_t maxCount, double *tsBuf, T *dataBuf);
 		size_t getDataCount();
@@ -68,6 +69,22 @@ void DataBuffer<T>::addData(double timestamp, T data) {
 	LeaveCriticalSection(&lock);
 }
 
+template <class T>
+void DataBuffer<T>::addData(size_t n, double const *tsBuf, T const *dataBuf) {
+	EnterCriticalSection(&lock);
+	for (size_t i = 0; i < n; i++) {
+		this->timestamps[firstFree] = tsBuf[i];
+		this->data[firstFree] = dataBuf[i];
+		firstFree = next(firstFree);
+		count++;
+		if (firstFree == firstUsed) {
+			firstUsed = next(firstUsed);
+			count--;
+		}
+	}
+	LeaveCriticalSection(&lock);
+}
+
 template <class T>
 void DataBuffer<T>::getChunk(size_t start, size_t size, double *tsBuf, T *dataBuf) {
 	if (start + size < bufferSize) {
@@ -0,0 +1,64 @@
+#ifndef EXPIRY_QUEUE
+#define EXPIRY_QUEUE
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+// Min-heap of keys by due time, so a periodic sweep only visits the entries
+// that are actually due instead of scanning everything it tracks.
+//
+// Entries aren't updated or removed in place: the owner checks a popped key
+// against its current state, drops it if the object is gone and pushes it
+// again with a new due time if the object was touched since.  Each live
+// object then has one entry, and push/pop are O(log n).
+template <class Key>
+class ExpiryQueue
+{
+
+    struct Entry
+    {
+        uint64_t due;
+        Key key;
+
+        bool operator< (Entry const& other) const
+        {
+            return due > other.due; // std heaps are max-heaps
+        }
+    };
+
+    std::vector<Entry> heap;
+
+    public:
+
+        void push (uint64_t due, Key const& key)
+        {
+            Entry entry = { due, key };
+            heap.push_back (entry);
+            std::push_heap (heap.begin (), heap.end ());
+        }
+
+        // Pops the earliest key if it was due before now.
+        bool pop_due (uint64_t now, Key *key)
+        {
+            if (heap.empty () || heap.front ().due >= now)
+                return false;
+            *key = heap.front ().key;
+            std::pop_heap (heap.begin (), heap.end ());
+            heap.pop_back ();
+            return true;
+        }
+
+        size_t size () const
+        {
+            return heap.size ();
+        }
+
+        void clear ()
+        {
+            heap.clear ();
+        }
+
+};
+
+#endif
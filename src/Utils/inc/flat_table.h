@@ -0,0 +1,210 @@
+#ifndef FLAT_TABLE
+#define FLAT_TABLE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum { NO_SLOT = 0xffffffffu };
+
+// Values in one contiguous array, addressed by slot.  A slot stays valid
+// until it is released and released slots are reused before the array
+// grows, so slots can be kept where pointers couldn't (references into the
+// pool are invalidated when it grows).
+template <class T>
+class SlotPool
+{
+
+    std::vector<T> values;
+    std::vector<uint8_t> used;
+    std::vector<uint32_t> freeSlots;
+    size_t count;
+
+    public:
+
+        SlotPool () : count (0) {}
+
+        uint32_t acquire ()
+        {
+            uint32_t slot;
+            if (!freeSlots.empty ())
+            {
+                slot = freeSlots.back ();
+                freeSlots.pop_back ();
+            }
+            else
+            {
+                slot = (uint32_t) values.size ();
+                values.emplace_back ();
+                used.push_back (0);
+            }
+            used[slot] = 1;
+            ++count;
+            return slot;
+        }
+
+        // Resets the value, so whatever it owns is freed now.
+        void release (uint32_t slot)
+        {
+            values[slot] = T ();
+            used[slot] = 0;
+            freeSlots.push_back (slot);
+            --count;
+        }
+
+        bool in_use (uint32_t slot) const
+        {
+            return slot < used.size () && used[slot] != 0;
+        }
+
+        T& operator[] (uint32_t slot)
+        {
+            return values[slot];
+        }
+
+        T const& operator[] (uint32_t slot) const
+        {
+            return values[slot];
+        }
+
+        size_t size () const
+        {
+            return count;
+        }
+
+        // One past the highest slot handed out; iterate with in_use ().
+        uint32_t slot_end () const
+        {
+            return (uint32_t) values.size ();
+        }
+
+        void clear ()
+        {
+            values.clear ();
+            used.clear ();
+            freeSlots.clear ();
+            count = 0;
+        }
+
+};
+
+// Hash index from a 64-bit key to a slot: open addressing with linear
+// probing over a power-of-two bucket array kept at most half full, so a
+// lookup is a hash and a scan of a few adjacent buckets.  Erase shifts the
+// following run back instead of leaving tombstones.
+class FlatIndex
+{
+
+    enum { INITIAL_BUCKETS = 16 };
+
+    struct Bucket
+    {
+        uint64_t key;
+        uint32_t slot;
+    };
+
+    std::vector<Bucket> buckets;
+    size_t count;
+
+    static uint64_t hash (uint64_t k)
+    {
+        // 64-bit finalizer of MurmurHash3; process ids and aligned
+        // addresses are far from uniform in the low bits.
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    size_t mask () const
+    {
+        return buckets.size () - 1;
+    }
+
+    void place (Bucket const& b)
+    {
+        size_t i = hash (b.key) & mask ();
+        while (buckets[i].slot != NO_SLOT)
+            i = (i + 1) & mask ();
+        buckets[i] = b;
+    }
+
+    void rehash (size_t bucketCount)
+    {
+        std::vector<Bucket> old (bucketCount);
+        old.swap (buckets);
+        for (size_t i = 0; i < buckets.size (); ++i)
+            buckets[i].slot = NO_SLOT;
+        for (size_t i = 0; i < old.size (); ++i)
+            if (old[i].slot != NO_SLOT)
+                place (old[i]);
+    }
+
+    size_t bucketOf (uint64_t key) const
+    {
+        if (count == 0)
+            return buckets.size ();
+        for (size_t i = hash (key) & mask (); buckets[i].slot != NO_SLOT; i = (i + 1) & mask ())
+            if (buckets[i].key == key)
+                return i;
+        return buckets.size ();
+    }
+
+    public:
+
+        FlatIndex () : count (0) {}
+
+        // NO_SLOT if key isn't in the index
+        uint32_t find (uint64_t key) const
+        {
+            size_t i = bucketOf (key);
+            return i < buckets.size () ? buckets[i].slot : (uint32_t) NO_SLOT;
+        }
+
+        // key must not be in the index yet
+        void insert (uint64_t key, uint32_t slot)
+        {
+            if ((count + 1) * 2 > buckets.size ())
+                rehash (buckets.empty () ? (size_t) INITIAL_BUCKETS : buckets.size () * 2);
+            Bucket b = { key, slot };
+            place (b);
+            ++count;
+        }
+
+        void erase (uint64_t key)
+        {
+            size_t hole = bucketOf (key);
+            if (hole == buckets.size ())
+                return;
+
+            // Move back every following entry whose home bucket isn't
+            // between the hole and where it sits now.
+            for (size_t j = (hole + 1) & mask (); buckets[j].slot != NO_SLOT; j = (j + 1) & mask ())
+            {
+                size_t home = hash (buckets[j].key) & mask ();
+                if (((j - home) & mask ()) >= ((j - hole) & mask ()))
+                {
+                    buckets[hole] = buckets[j];
+                    hole = j;
+                }
+            }
+            buckets[hole].slot = NO_SLOT;
+            --count;
+        }
+
+        size_t size () const
+        {
+            return count;
+        }
+
+        void clear ()
+        {
+            buckets.clear ();
+            count = 0;
+        }
+
+};
+
+#endif
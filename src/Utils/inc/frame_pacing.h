@@ -0,0 +1,119 @@
+#ifndef FRAME_PACING
+#define FRAME_PACING
+
+#include <math.h>
+#include <stdint.h>
+
+// Incremental pacing of one swapchain's displayed frames, O(1) per frame.
+//
+// Vsync'd flips land on vsync boundaries, so every display interval is a
+// whole number of refresh periods.  The refresh period is estimated from the
+// intervals themselves: an interval under 3/4 of the estimate replaces it
+// (the refresh rate went up, or the first frames were already late), and
+// intervals that are a clean multiple of it refine it with an exponential
+// average.  A swapchain that never displays two frames on consecutive vsyncs
+// therefore reads as a multiple of the true period; the display's own
+// cadence is tracked from its VSyncDPC events for that case.
+//
+// Tearing (immediate) flips aren't quantized; they count towards jitter but
+// leave the period and vsync counts alone.
+class FramePacing
+{
+
+    enum
+    {
+        WEIGHT_SHIFT = 4 // exponential averages move 1/16 of the way
+    };
+
+    uint64_t lastScreenTime;
+    uint64_t lastInterval;
+    double periodTicks;
+    double jitterTicks;
+    uint32_t lastVsyncs;
+    uint64_t vsyncCount;
+    uint64_t quantizedFrames;
+    uint64_t missedVsyncs;
+
+    public:
+
+        FramePacing () : lastScreenTime (0), lastInterval (0), periodTicks (0.0), jitterTicks (0.0), lastVsyncs (0),
+            vsyncCount (0), quantizedFrames (0), missedVsyncs (0) {}
+
+        // syncInterval is the present's requested interval; the frame missed
+        // the vsyncs it took beyond that (at least one).
+        void add (uint64_t screenTime, int32_t syncInterval, bool tearing)
+        {
+            if (lastScreenTime == 0 || screenTime <= lastScreenTime)
+            {
+                lastScreenTime = screenTime;
+                return;
+            }
+
+            uint64_t interval = screenTime - lastScreenTime;
+            lastScreenTime = screenTime;
+            if (lastInterval != 0)
+            {
+                double change = interval > lastInterval ? (double) (interval - lastInterval) : (double) (lastInterval - interval);
+                jitterTicks += ldexp (change - jitterTicks, -WEIGHT_SHIFT);
+            }
+            lastInterval = interval;
+
+            if (tearing)
+            {
+                lastVsyncs = 0;
+                return;
+            }
+
+            if (periodTicks == 0.0 || (double) interval < 0.75 * periodTicks)
+                periodTicks = (double) interval;
+            uint32_t vsyncs = (uint32_t) ((double) interval / periodTicks + 0.5);
+            if (vsyncs < 1)
+                vsyncs = 1;
+            double perVsync = (double) interval / vsyncs;
+            if (fabs (perVsync - periodTicks) < 0.1 * periodTicks)
+                periodTicks += ldexp (perVsync - periodTicks, -WEIGHT_SHIFT);
+
+            uint32_t expected = syncInterval > 1 ? (uint32_t) syncInterval : 1;
+            lastVsyncs = vsyncs;
+            vsyncCount += vsyncs;
+            quantizedFrames += 1;
+            if (vsyncs > expected)
+                missedVsyncs += vsyncs - expected;
+        }
+
+        void clear ()
+        {
+            *this = FramePacing ();
+        }
+
+        // 0 until two vsync'd frames have been displayed
+        double refreshPeriod () const
+        {
+            return periodTicks;
+        }
+
+        // refresh periods the last frame stayed on screen before it; 0 if it tore
+        uint32_t lastVsyncIntervals () const
+        {
+            return lastVsyncs;
+        }
+
+        double meanVsyncIntervals () const
+        {
+            return quantizedFrames == 0 ? 0.0 : (double) vsyncCount / quantizedFrames;
+        }
+
+        uint64_t missedVsyncCount () const
+        {
+            return missedVsyncs;
+        }
+
+        // smoothed |change| between successive display intervals
+        double displayJitter () const
+        {
+            return jitterTicks;
+        }
+
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef HISTORY_RING
+#define HISTORY_RING
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Sliding window of the most recent samples, oldest first.
+//
+// Storage starts small and doubles as the window fills, up to max_size (), so
+// a low-rate source never pays for the worst case; once a source's window has
+// reached its steady size, push_back() and pop_front() are index arithmetic
+// only.  Pushing into a full ring drops the oldest sample.  Storage is a
+// power of two, so a power-of-two max_size () wastes nothing.
+template <class T>
+class HistoryRing
+{
+
+    enum { INITIAL_CAPACITY = 8 };
+
+    std::vector<T> slots;
+    size_t head;
+    size_t count;
+    size_t maxSize;
+
+    void grow ()
+    {
+        size_t capacity = slots.empty () ? INITIAL_CAPACITY : slots.size () * 2;
+        std::vector<T> bigger (capacity);
+        for (size_t i = 0; i < count; ++i)
+            bigger[i] = (*this)[i];
+        slots.swap (bigger);
+        head = 0;
+    }
+
+    public:
+
+        explicit HistoryRing (size_t maxSize = 128) : head (0), count (0), maxSize (maxSize > 0 ? maxSize : 1) {}
+
+        size_t max_size () const
+        {
+            return maxSize;
+        }
+
+        // Drops the oldest samples if the ring holds more than n.
+        void set_max_size (size_t n)
+        {
+            maxSize = n > 0 ? n : 1;
+            if (count > maxSize)
+                pop_front (count - maxSize);
+        }
+
+        size_t size () const
+        {
+            return count;
+        }
+
+        bool empty () const
+        {
+            return count == 0;
+        }
+
+        // i = 0 is the oldest sample
+        T const& operator[] (size_t i) const
+        {
+            return slots[(head + i) & (slots.size () - 1)];
+        }
+
+        T const& front () const
+        {
+            return (*this)[0];
+        }
+
+        T const& back () const
+        {
+            return (*this)[count - 1];
+        }
+
+        void push_back (T const& item)
+        {
+            if (count >= maxSize)
+                pop_front (1);
+            else if (count == slots.size ())
+                grow ();
+            slots[(head + count) & (slots.size () - 1)] = item;
+            ++count;
+        }
+
+        void pop_front (size_t n)
+        {
+            if (n > count)
+                n = count;
+            head = (head + n) & (slots.size () - 1);
+            count -= n;
+        }
+
+        void clear ()
+        {
+            head = 0;
+            count = 0;
+        }
+
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef LOG_HISTOGRAM
+#define LOG_HISTOGRAM
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// Fixed-size log-linear histogram of unsigned integer values (HDR-histogram
+// layout): values below 128 get a bucket each, above that every power of two
+// is split into 64 linear buckets, so a bucket is never wider than 1/64 of
+// the values in it and quantiles are within 0.8% of the true value.  Values
+// of 2^32 and above share the last bucket.
+//
+// add() and remove() are O(1); quantile() walks the ~1.7k buckets.  The
+// whole histogram is a 7 KB array, so it can be copied as a summary, and
+// copy_changed_to() keeps such a copy current by copying only the buckets
+// touched since the last call.
+class LogHistogram
+{
+
+    enum
+    {
+        SUB_BUCKET_BITS = 7,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,     // buckets for [0, 128)
+        HALF_SUB_BUCKETS = SUB_BUCKETS / 2,     // buckets per octave above that
+        MAX_VALUE_BITS = 32,
+        BUCKET_COUNT = HALF_SUB_BUCKETS * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2)
+    };
+
+    uint32_t counts[BUCKET_COUNT];
+    uint64_t total;
+
+    // Buckets [dirtyLow, dirtyHigh] may have changed since the last
+    // copy_changed_to (); all of them before the first.
+    uint32_t dirtyLow;
+    uint32_t dirtyHigh;
+
+    void touch (uint32_t index)
+    {
+        if (index < dirtyLow)
+            dirtyLow = index;
+        if (index > dirtyHigh)
+            dirtyHigh = index;
+    }
+
+    static uint32_t bitWidth (uint64_t v)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        return _BitScanReverse64 (&index, v) ? index + 1 : 0;
+#elif defined(__GNUC__)
+        return v == 0 ? 0 : 64 - __builtin_clzll (v);
+#else
+        uint32_t n = 0;
+        while (v != 0)
+        {
+            v >>= 1;
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    static uint32_t bucketOf (uint64_t v)
+    {
+        if (v < SUB_BUCKETS)
+            return (uint32_t) v;
+        uint32_t shift = bitWidth (v) - SUB_BUCKET_BITS;
+        uint32_t index = HALF_SUB_BUCKETS * (shift + 1) + (uint32_t) (v >> shift) - HALF_SUB_BUCKETS;
+        return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+    }
+
+    // [low, high) of the values in a bucket
+    static void bucketRange (uint32_t index, uint64_t *low, uint64_t *high)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            *low = index;
+            *high = index + 1;
+            return;
+        }
+        uint32_t shift = index / HALF_SUB_BUCKETS - 1;
+        uint64_t mantissa = index % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+        *low = mantissa << shift;
+        *high = (mantissa + 1) << shift;
+    }
+
+    public:
+
+        LogHistogram ()
+        {
+            clear ();
+        }
+
+        void clear ()
+        {
+            memset (counts, 0, sizeof (counts));
+            total = 0;
+            dirtyLow = 0;
+            dirtyHigh = BUCKET_COUNT - 1;
+        }
+
+        void add (uint64_t v)
+        {
+            uint32_t index = bucketOf (v);
+            counts[index] += 1;
+            total += 1;
+            touch (index);
+        }
+
+        // v must have been add()ed before
+        void remove (uint64_t v)
+        {
+            uint32_t index = bucketOf (v);
+            counts[index] -= 1;
+            total -= 1;
+            touch (index);
+        }
+
+        // Makes *copy equal to this histogram, given that it was equal as of
+        // the last call (any *copy will do for the first call after clear ()).
+        void copy_changed_to (LogHistogram *copy)
+        {
+            if (dirtyLow <= dirtyHigh)
+                memcpy (&copy->counts[dirtyLow], &counts[dirtyLow], (dirtyHigh - dirtyLow + 1) * sizeof (counts[0]));
+            copy->total = total;
+            dirtyLow = BUCKET_COUNT;
+            dirtyHigh = 0;
+        }
+
+        uint64_t count () const
+        {
+            return total;
+        }
+
+        // Smallest value v such that at least q (0..1) of the values are <= v,
+        // as the middle of its bucket.  0 if the histogram is empty.
+        double quantile (double q) const
+        {
+            if (total == 0)
+                return 0.0;
+            if (q < 0.0)
+                q = 0.0;
+            if (q > 1.0)
+                q = 1.0;
+
+            uint64_t rank = (uint64_t) ceil (q * (double) total);
+            if (rank < 1)
+                rank = 1;
+            if (rank > total)
+                rank = total;
+
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+            {
+                seen += counts[i];
+                if (seen >= rank)
+                {
+                    uint64_t low, high;
+                    bucketRange (i, &low, &high);
+                    return high - low == 1 ? (double) low : 0.5 * (double) (low + high - 1);
+                }
+            }
+            return 0.0;
+        }
+
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef QPC_CLOCK
+#define QPC_CLOCK
+
+#include <math.h>
+#include <stdint.h>
+#if defined(QPC_CLOCK_PORTABLE_MULSHIFT)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define QPC_CLOCK_UMUL128
+#include <intrin.h>
+#elif defined(__SIZEOF_INT128__)
+#define QPC_CLOCK_INT128
+#endif
+
+// Converts QueryPerformanceCounter ticks to time.
+//
+// Durations are a single 64x64->128 multiply and shift by a fixed-point
+// multiplier precomputed from the counter frequency, instead of a double
+// division per conversion.
+//
+// Absolute (wall clock) times are measured from an anchor pairing a QPC value
+// with the system time sampled at the same moment.  QPC and the system clock
+// drift apart over long runs (the system clock is NTP-disciplined, QPC is
+// not), so the owner is expected to re-anchor() periodically; each sample is
+// then only ever extrapolated over one anchor interval.
+//
+// Define QPC_CLOCK_PORTABLE_MULSHIFT to use the 32-bit multiply on every
+// target (the tests build it both ways).
+class QpcClock
+{
+
+    uint64_t frequency;
+    uint64_t mult;
+    uint32_t shift;
+
+    uint64_t anchorQpc;
+    int64_t anchorUnixNs;
+    bool anchored;
+
+    static uint32_t bitWidth (uint64_t v)
+    {
+        uint32_t n = 0;
+        while (v != 0)
+        {
+            v >>= 1;
+            ++n;
+        }
+        return n;
+    }
+
+    static uint64_t mulShift (uint64_t a, uint64_t b, uint32_t s)
+    {
+#if defined(QPC_CLOCK_UMUL128)
+        uint64_t hi;
+        uint64_t lo = _umul128 (a, b, &hi);
+        return s == 0 ? lo : (lo >> s) | (hi << (64 - s));
+#elif defined(QPC_CLOCK_INT128)
+        return (uint64_t) (((unsigned __int128) a * b) >> s);
+#else
+        // 32-bit builds: schoolbook multiply on 32-bit halves.
+        uint64_t aLo = a & 0xffffffffu, aHi = a >> 32;
+        uint64_t bLo = b & 0xffffffffu, bHi = b >> 32;
+        uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+        uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+        uint64_t lo = (mid << 32) | (ll & 0xffffffffu);
+        uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+        return s == 0 ? lo : (lo >> s) | (hi << (64 - s));
+#endif
+    }
+
+    public:
+
+        QpcClock () : frequency (0), mult (0), shift (0), anchorQpc (0), anchorUnixNs (0), anchored (false) {}
+
+        explicit QpcClock (uint64_t freq) : QpcClock ()
+        {
+            setFrequency (freq);
+        }
+
+        // mult / 2^shift approximates 1e9 / freq with as many fractional bits
+        // as fit in 63 bits, a relative error below 2^-62.
+        void setFrequency (uint64_t freq)
+        {
+            frequency = freq;
+            mult = 0;
+            shift = 0;
+            if (freq == 0)
+                return;
+
+            const uint64_t nsPerSecond = 1000000000ull;
+            uint64_t q = nsPerSecond / freq;
+            uint64_t r = nsPerSecond % freq;
+            uint32_t intBits = bitWidth (q);
+            uint32_t maxShift = intBits >= 63 ? 0 : 63 - intBits;
+
+            // long division, one fractional bit at a time
+            for (shift = 0; shift < maxShift; ++shift)
+            {
+                r <<= 1;
+                q = (q << 1) | (r >= freq ? 1 : 0);
+                if (r >= freq)
+                    r -= freq;
+            }
+            // round to nearest
+            if (r * 2 >= freq)
+                q += 1;
+            mult = q;
+        }
+
+        uint64_t getFrequency () const
+        {
+            return frequency;
+        }
+
+        uint64_t toNs (uint64_t ticks) const
+        {
+            return mulShift (ticks, mult, shift);
+        }
+
+        double toMs (uint64_t ticks) const
+        {
+            return (double) toNs (ticks) * 1e-6;
+        }
+
+        double toSeconds (uint64_t ticks) const
+        {
+            return (double) toNs (ticks) * 1e-9;
+        }
+
+        // The same scale as a double, for converting many values at once
+        // (ms = ticks * msPerTick ()).
+        double msPerTick () const
+        {
+            return ldexp ((double) mult, -(int) shift) * 1e-6;
+        }
+
+        // Signed difference b - a, for timestamps that aren't known to be ordered.
+        double deltaMs (uint64_t a, uint64_t b) const
+        {
+            return b >= a ? toMs (b - a) : -toMs (a - b);
+        }
+
+        // Re-anchoring never moves the clock back.  If the system clock has
+        // fallen behind the current extrapolation (a backward step, or QPC
+        // running fast) the new anchor is held at the extrapolation, so
+        // timestamps stay ordered across the change; forward corrections are
+        // taken as they come.
+        void anchor (uint64_t qpc, int64_t unixNs)
+        {
+            if (anchored && qpc >= anchorQpc)
+            {
+                int64_t extrapolated = toUnixNs (qpc);
+                if (unixNs < extrapolated)
+                    unixNs = extrapolated;
+            }
+            anchorQpc = qpc;
+            anchorUnixNs = unixNs;
+            anchored = true;
+        }
+
+        bool isAnchored () const
+        {
+            return anchored;
+        }
+
+        int64_t toUnixNs (uint64_t qpc) const
+        {
+            return qpc >= anchorQpc
+                ? anchorUnixNs + (int64_t) toNs (qpc - anchorQpc)
+                : anchorUnixNs - (int64_t) toNs (anchorQpc - qpc);
+        }
+
+        // Same epoch and unit as getCurrentTime().
+        double toUnixSeconds (uint64_t qpc) const
+        {
+            return (double) toUnixNs (qpc) * 1e-9;
+        }
+
+};
+
+#endif
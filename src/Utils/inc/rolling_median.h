@@ -0,0 +1,71 @@
+#ifndef ROLLING_MEDIAN
+#define ROLLING_MEDIAN
+
+#include <algorithm>
+#include <stddef.h>
+
+// Median of the last N values pushed.  The window is kept both in arrival
+// order and sorted; push() replaces the oldest value in the sorted copy with
+// a binary search and one shift, so its cost is bounded by N regardless of
+// how long the stream is.  Meant for small N (tens of values).
+template <class T, size_t N>
+class RollingMedian
+{
+
+    T recentValues[N]; // arrival order, ring
+    T sortedValues[N];
+    size_t head;
+    size_t count;
+
+    public:
+
+        RollingMedian () : head (0), count (0) {}
+
+        void clear ()
+        {
+            head = 0;
+            count = 0;
+        }
+
+        size_t size () const
+        {
+            return count;
+        }
+
+        void push (T v)
+        {
+            if (count == N)
+            {
+                T oldest = recentValues[head];
+                T *pos = std::lower_bound (sortedValues, sortedValues + count, oldest);
+                std::copy (pos + 1, sortedValues + count, pos);
+                recentValues[head] = v;
+                head = (head + 1) % N;
+                --count;
+            }
+            else
+            {
+                recentValues[(head + count) % N] = v;
+            }
+
+            T *pos = std::upper_bound (sortedValues, sortedValues + count, v);
+            std::copy_backward (pos, sortedValues + count, sortedValues + count + 1);
+            *pos = v;
+            ++count;
+        }
+
+        // upper median; T () when empty
+        T median () const
+        {
+            return count == 0 ? T () : sortedValues[count / 2];
+        }
+
+        // i = 0 is the most recent value; i < size ()
+        T recent (size_t i) const
+        {
+            return recentValues[(head + count - 1 - i) % N];
+        }
+
+};
+
+#endif
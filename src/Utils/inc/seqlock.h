@@ -0,0 +1,105 @@
+#ifndef SEQLOCK
+#define SEQLOCK
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+// Up to N trivially copyable values written by exactly one thread and read by
+// any number of others.  The writer never waits: it bumps a sequence number
+// around each change, and a reader whose copy overlapped a change retries.
+// Values are kept as atomic words so the overlapping reads are well-defined;
+// release stores and acquire loads of those words stand in for fences (which
+// -fsanitize=thread does not model) and are plain moves on x86.
+template <class T, size_t N>
+class SeqlockArray
+{
+
+    static_assert (std::is_trivially_copyable<T>::value, "SeqlockArray values must be trivially copyable");
+
+    enum { WORDS = (sizeof (T) + sizeof (uint64_t) - 1) / sizeof (uint64_t) };
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> words[N][WORDS];
+
+    void beginWrite (uint32_t *seq)
+    {
+        *seq = sequence.load (std::memory_order_relaxed);
+        sequence.store (*seq + 1, std::memory_order_relaxed);
+    }
+
+    void endWrite (uint32_t seq)
+    {
+        sequence.store (seq + 2, std::memory_order_release);
+    }
+
+    public:
+
+        SeqlockArray () : sequence (0), count (0)
+        {
+            for (size_t i = 0; i < N; ++i)
+                for (size_t w = 0; w < WORDS; ++w)
+                    words[i][w].store (0, std::memory_order_relaxed);
+        }
+
+        SeqlockArray (const SeqlockArray &) = delete;
+        SeqlockArray &operator= (const SeqlockArray &) = delete;
+
+        size_t capacity () const
+        {
+            return N;
+        }
+
+        // writer side; i <= size (), and i == size () appends
+        void store (size_t i, T const& value)
+        {
+            uint64_t buf[WORDS] = {};
+            memcpy (buf, &value, sizeof (T));
+
+            uint32_t seq;
+            beginWrite (&seq);
+            for (size_t w = 0; w < WORDS; ++w)
+                words[i][w].store (buf[w], std::memory_order_release);
+            if (i >= count.load (std::memory_order_relaxed))
+                count.store ((uint32_t) (i + 1), std::memory_order_release);
+            endWrite (seq);
+        }
+
+        void clear ()
+        {
+            uint32_t seq;
+            beginWrite (&seq);
+            count.store (0, std::memory_order_release);
+            endWrite (seq);
+        }
+
+        // reader side: replaces *out with a consistent copy of every value
+        void load (std::vector<T> *out) const
+        {
+            uint64_t buf[N][WORDS];
+            for (;;)
+            {
+                uint32_t seq = sequence.load (std::memory_order_acquire);
+                if (seq & 1)
+                    continue;
+                size_t n = count.load (std::memory_order_acquire);
+                for (size_t i = 0; i < n; ++i)
+                    for (size_t w = 0; w < WORDS; ++w)
+                        buf[i][w] = words[i][w].load (std::memory_order_acquire);
+                if (sequence.load (std::memory_order_relaxed) != seq)
+                    continue;
+
+                out->resize (n);
+                for (size_t i = 0; i < n; ++i)
+                    memcpy (&(*out)[i], buf[i], sizeof (T));
+                return;
+            }
+        }
+
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free ring for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two. push() fails instead of blocking when full.
+template <class T>
+class SPSCQueue
+{
+
+    std::vector<T> slots;
+    size_t mask;
+
+    // head is written only by the consumer, tail only by the producer; keep them
+    // on separate cache lines so the two threads don't false-share.
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    char pad2[64];
+
+    public:
+
+        explicit SPSCQueue (size_t capacity) : head (0), tail (0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+                size <<= 1;
+            slots.resize (size);
+            mask = size - 1;
+        }
+
+        SPSCQueue (const SPSCQueue &) = delete;
+        SPSCQueue &operator= (const SPSCQueue &) = delete;
+
+        // producer side
+        bool push (T &&item)
+        {
+            size_t t = tail.load (std::memory_order_relaxed);
+            if (t - head.load (std::memory_order_acquire) > mask)
+                return false;
+            slots[t & mask] = std::move (item);
+            tail.store (t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool push (const T &item)
+        {
+            T copy (item);
+            return push (std::move (copy));
+        }
+
+        // consumer side
+        bool pop (T &item)
+        {
+            size_t h = head.load (std::memory_order_relaxed);
+            if (h == tail.load (std::memory_order_acquire))
+                return false;
+            item = std::move (slots[h & mask]);
+            head.store (h + 1, std::memory_order_release);
+            return true;
+        }
+
+        // approximate when called from a thread that isn't the producer or consumer
+        size_t size () const
+        {
+            return tail.load (std::memory_order_acquire) - head.load (std::memory_order_acquire);
+        }
+
+        bool empty () const
+        {
+            return size () == 0;
+        }
+
+        size_t capacity () const
+        {
+            return mask + 1;
+        }
+
+};
+
+#endif
@@ -1,3 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
 double getCurrentTime();
+
+// Reads QueryPerformanceCounter and the precise system time (unix epoch, ns)
+// as close together as possible, for anchoring a QpcClock.
+void sampleClocks(uint64_t* qpc, int64_t* unixNs);
@@ -4,9 +4,33 @@
 
 #define FILETIME_TO_UNIX 116444736000000000i64
 
+static int64_t fileTimeToInt(FILETIME const& ft) {
+    return ((int64_t) ft.dwHighDateTime << 32L) | (int64_t) ft.dwLowDateTime;
+}
+
 double getCurrentTime() {
     FILETIME ft;
     GetSystemTimePreciseAsFileTime(&ft);
-    int64_t t = ((int64_t) ft.dwHighDateTime << 32L) | (int64_t) ft.dwLowDateTime;
+    int64_t t = fileTimeToInt(ft);
     return (t - FILETIME_TO_UNIX) / (10.0 * 1000.0 * 1000.0);
 }
+
+void sampleClocks(uint64_t* qpc, int64_t* unixNs) {
+    // Bracket the system time read with two QPC reads and keep the tightest
+    // of a few tries, so a preemption between the reads doesn't skew the pair.
+    uint64_t bestWindow = UINT64_MAX;
+    for (int i = 0; i < 3; ++i) {
+        LARGE_INTEGER before, after;
+        FILETIME ft;
+        QueryPerformanceCounter(&before);
+        GetSystemTimePreciseAsFileTime(&ft);
+        QueryPerformanceCounter(&after);
+
+        uint64_t window = (uint64_t) (after.QuadPart - before.QuadPart);
+        if (window < bestWindow) {
+            bestWindow = window;
+            *qpc = (uint64_t) before.QuadPart + window / 2;
+            *unixNs = (fileTimeToInt(ft) - FILETIME_TO_UNIX) * 100;
+        }
+    }
+}
@@ -0,0 +1,212 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// BufferTuner must grow MaximumBuffers on loss or high occupancy (at most once
+// per GROW_INTERVAL_MS, up to MAX_BUFFERS_CEILING), recommend larger buffers
+// only when events were actually lost, and back off by halves after
+// SHRINK_QUIET_MS of idle samples without going below the configured value.
+
+#include <stdio.h>
+
+#include "../src/PresentMon/BufferTuner.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+BufferTuner::Config MakeConfig(uint32_t bufferSizeKB, uint32_t minimumBuffers, uint32_t maximumBuffers, uint32_t flushTimerSeconds)
+{
+    BufferTuner::Config config;
+    config.mBufferSizeKB = bufferSizeKB;
+    config.mMinimumBuffers = minimumBuffers;
+    config.mMaximumBuffers = maximumBuffers;
+    config.mFlushTimerSeconds = flushTimerSeconds;
+    return config;
+}
+
+BufferTuner::Sample Lost(uint64_t tickMs, uint32_t numberOfBuffers)
+{
+    return BufferTuner::MakeSample(tickMs, 10, 1, numberOfBuffers, numberOfBuffers, 0.0);
+}
+
+BufferTuner::Sample Idle(uint64_t tickMs, uint32_t numberOfBuffers)
+{
+    return BufferTuner::MakeSample(tickMs, 0, 0, numberOfBuffers, numberOfBuffers, 0.0);
+}
+
+void TestMakeSample()
+{
+    auto sample = BufferTuner::MakeSample(5, 1, 2, 32, 8, 0.25);
+    CHECK(sample.mTickMs == 5);
+    CHECK(sample.mEventsLost == 1);
+    CHECK(sample.mBuffersLost == 2);
+    CHECK(sample.mNumberOfBuffers == 32);
+    CHECK(sample.mBuffersInUse == 24);
+    CHECK(sample.mConsumerBacklog == 0.25);
+
+    // Free and allocated counts read out of step must not wrap.
+    CHECK(BufferTuner::MakeSample(5, 0, 0, 32, 40, 0.0).mBuffersInUse == 0);
+}
+
+void TestGrowOnLoss()
+{
+    BufferTuner tuner(MakeConfig(64, 20, 64, 0), true);
+
+    CHECK(tuner.Update(Lost(1000, 64)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 128);
+    CHECK(tuner.GetConfig().mFlushTimerSeconds == 1);
+    CHECK(tuner.GetRetuneCount() == 1);
+    CHECK(tuner.GetRecommendedConfig().mBufferSizeKB == 128);
+    CHECK(tuner.GetRecommendedConfig().mMinimumBuffers == 64);
+    CHECK(tuner.GetRecommendedConfig().mMaximumBuffers == 128);
+
+    // At most one grow per GROW_INTERVAL_MS.
+    CHECK(!tuner.Update(Lost(1000 + BufferTuner::GROW_INTERVAL_MS - 1, 128)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 128);
+    CHECK(tuner.GetRetuneCount() == 1);
+
+    CHECK(tuner.Update(Lost(1000 + BufferTuner::GROW_INTERVAL_MS, 128)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 256);
+    CHECK(tuner.GetRecommendedConfig().mBufferSizeKB == 256);
+    CHECK(tuner.GetRecommendedConfig().mMinimumBuffers == 128);
+    CHECK(tuner.GetRetuneCount() == 2);
+}
+
+void TestGrowOnOccupancy()
+{
+    BufferTuner tuner(MakeConfig(64, 20, 64, 0), true);
+
+    // 3/4 full is not enough; more than that grows without touching the
+    // recommendation, which only follows actual loss.
+    CHECK(!tuner.Update(BufferTuner::MakeSample(1000, 0, 0, 64, 16, 0.0)));
+    CHECK(tuner.Update(BufferTuner::MakeSample(2000, 0, 0, 64, 15, 0.0)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 128);
+    CHECK(tuner.GetConfig().mFlushTimerSeconds == 1);
+    CHECK(tuner.GetRecommendedConfig().mBufferSizeKB == 64);
+    CHECK(tuner.GetRecommendedConfig().mMinimumBuffers == 20);
+}
+
+void TestClamps()
+{
+    // An ETW-default (0) maximum grows from what ETW allocated.
+    BufferTuner tuner(MakeConfig(0, 0, 0, 0), true);
+    uint64_t tick = 1000;
+    CHECK(tuner.Update(Lost(tick, 40)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 80);
+    CHECK(tuner.GetRecommendedConfig().mBufferSizeKB == 128);
+
+    // Growth stops at MAX_BUFFERS_CEILING and the recommended buffer size at
+    // MAX_BUFFER_SIZE_KB.
+    for (int i = 0; i < 20; ++i) {
+        tick += BufferTuner::GROW_INTERVAL_MS;
+        tuner.Update(Lost(tick, tuner.GetConfig().mMaximumBuffers));
+        CHECK(tuner.GetConfig().mMaximumBuffers <= BufferTuner::MAX_BUFFERS_CEILING);
+        CHECK(tuner.GetRecommendedConfig().mBufferSizeKB <= BufferTuner::MAX_BUFFER_SIZE_KB);
+    }
+    CHECK(tuner.GetConfig().mMaximumBuffers == BufferTuner::MAX_BUFFERS_CEILING);
+    CHECK(tuner.GetRecommendedConfig().mBufferSizeKB == BufferTuner::MAX_BUFFER_SIZE_KB);
+    CHECK(tuner.GetRecommendedConfig().mMaximumBuffers == BufferTuner::MAX_BUFFERS_CEILING);
+
+    // Nothing left to push once at the ceiling.
+    auto retunes = tuner.GetRetuneCount();
+    tick += BufferTuner::GROW_INTERVAL_MS;
+    CHECK(!tuner.Update(Lost(tick, BufferTuner::MAX_BUFFERS_CEILING)));
+    CHECK(tuner.GetRetuneCount() == retunes);
+}
+
+void TestBackOffWhenIdle()
+{
+    BufferTuner tuner(MakeConfig(64, 20, 64, 5), true);
+    CHECK(tuner.Update(Lost(1000, 64)));
+    CHECK(tuner.Update(Lost(2000, 128)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 256);
+
+    // Idle samples shrink only after SHRINK_QUIET_MS since the last busy one.
+    CHECK(!tuner.Update(Idle(3000, 256)));
+    CHECK(!tuner.Update(Idle(2000 + BufferTuner::SHRINK_QUIET_MS - 1, 256)));
+    CHECK(tuner.Update(Idle(2000 + BufferTuner::SHRINK_QUIET_MS, 256)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 128);
+    CHECK(tuner.GetConfig().mFlushTimerSeconds == 1);
+
+    // A moderately busy sample restarts the quiet period.
+    uint64_t tick = 2000 + BufferTuner::SHRINK_QUIET_MS;
+    CHECK(!tuner.Update(BufferTuner::MakeSample(tick + 1000, 0, 0, 128, 64, 0.0)));
+    CHECK(!tuner.Update(Idle(tick + BufferTuner::SHRINK_QUIET_MS, 128)));
+    tick += 1000 + BufferTuner::SHRINK_QUIET_MS;
+    CHECK(tuner.Update(Idle(tick, 128)));
+
+    // Back at the configured maximum, the configured flush timer returns and
+    // there is no further shrinking.
+    CHECK(tuner.GetConfig().mMaximumBuffers == 64);
+    CHECK(tuner.GetConfig().mFlushTimerSeconds == 5);
+    tick += BufferTuner::SHRINK_QUIET_MS;
+    CHECK(!tuner.Update(Idle(tick, 64)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 64);
+    CHECK(tuner.GetRetuneCount() == 4);
+}
+
+void TestDisabled()
+{
+    BufferTuner tuner(MakeConfig(64, 20, 64, 0), false);
+    CHECK(!tuner.Update(Lost(1000, 64)));
+    CHECK(tuner.GetConfig().mMaximumBuffers == 64);
+    CHECK(tuner.GetRetuneCount() == 0);
+}
+
+void TestPollInterval()
+{
+    // The poll interval follows the consumer backlog whether or not buffer
+    // tuning is enabled, with hysteresis between the two thresholds.
+    BufferTuner tuner(MakeConfig(64, 20, 64, 0), false);
+    CHECK(tuner.GetPollIntervalMs() == BufferTuner::SLOW_POLL_MS);
+    tuner.Update(BufferTuner::MakeSample(1000, 0, 0, 64, 64, 0.6));
+    CHECK(tuner.GetPollIntervalMs() == BufferTuner::FAST_POLL_MS);
+    tuner.Update(BufferTuner::MakeSample(1100, 0, 0, 64, 64, 0.3));
+    CHECK(tuner.GetPollIntervalMs() == BufferTuner::FAST_POLL_MS);
+    tuner.Update(BufferTuner::MakeSample(1200, 0, 0, 64, 64, 0.05));
+    CHECK(tuner.GetPollIntervalMs() == BufferTuner::SLOW_POLL_MS);
+    tuner.Update(BufferTuner::MakeSample(1300, 0, 0, 64, 64, 0.3));
+    CHECK(tuner.GetPollIntervalMs() == BufferTuner::SLOW_POLL_MS);
+}
+
+}
+
+int main()
+{
+    TestMakeSample();
+    TestGrowOnLoss();
+    TestGrowOnOccupancy();
+    TestClamps();
+    TestBackOffWhenIdle();
+    TestDisabled();
+    TestPollInterval();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
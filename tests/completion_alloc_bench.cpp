@@ -0,0 +1,318 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Counts heap allocations per completed frame along the whole completion
+// path, on 16 processes flipping fullscreen and 8 composed through DWM for
+// 10 s:
+//
+//   handlers     PMTraceConsumer's state machine, up to and including
+//                CompletePresent() queuing the CompletedFrame (ETW thread)
+//   dequeue      DequeuePresents() into a reused vector
+//   add          what AddPresents() does with the batch: group it by
+//                swapchain, find the process and swapchain slots, update the
+//                swapchain's histories, medians and pacing, score the batch
+//
+// PresentMon.cpp only builds on Windows, so "add" repeats AddPresents()'s
+// steps here with the same types (FlatIndex, SlotPool, SwapChainData,
+// ScoreBatch); the score ring it appends to is preallocated and not
+// included.  The first second is a warm-up that isn't counted: it is when
+// the swapchains, histories and scratch vectors are first sized.
+//
+// For comparison, "legacy" is the handoff user-029 replaced: every
+// dequeued present copied by value, DependentPresents deque included, into
+// a present and (if displayed) a displayed-present std::deque history
+// pruned to 2 s.  Only those history copies are counted.
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SwapChainData.hpp"
+#include "../src/PresentMon/ScoreKernel.hpp"
+#include "../src/Utils/inc/flat_table.h"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+std::atomic<uint64_t> g_Allocations(0);
+
+}
+
+void* operator new(size_t size)
+{
+    ++g_Allocations;
+    if (auto p = malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// std::stable_sort()'s scratch buffer comes from the nothrow form.
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+    ++g_Allocations;
+    return malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+enum {
+    FLIP_PROCESS_COUNT = 16,
+    COMPOSED_PROCESS_COUNT = 8,
+    SECONDS = 10,
+    WARM_UP_TICKS = synthetic::QPC_FREQUENCY,
+    DEQUEUE_EVERY = 2048,           // events between dequeues
+    HISTORY_TIME_MS = 2000,
+};
+
+// What AddPresents() keeps per process.
+struct Process {
+    std::vector<std::pair<uint64_t, uint32_t>> mChains; // swapchain address, slot
+};
+
+struct Consumer {
+    SlotPool<Process> mProcesses;
+    FlatIndex mProcessIndex;
+    SlotPool<SwapChainData> mChains;
+    ScoreBatch mBatch;
+    std::vector<uint32_t> mOrder;
+    std::vector<double> mTimestamps;
+    std::vector<double> mScores;
+    double mChecksum = 0.0;
+};
+
+void AddPresents(Consumer& c, std::vector<CompletedFrame> const& presents, uint64_t now, QpcClock const& clock)
+{
+    auto const count = presents.size();
+    if (count == 0) {
+        return;
+    }
+
+    c.mBatch.Reset(count);
+    c.mOrder.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        c.mOrder[i] = i;
+    }
+    std::stable_sort(c.mOrder.begin(), c.mOrder.end(), [&presents](uint32_t a, uint32_t b) {
+        auto const& pa = presents[a];
+        auto const& pb = presents[b];
+        return pa.ProcessId != pb.ProcessId ? pa.ProcessId < pb.ProcessId : pa.SwapChainAddress < pb.SwapChainAddress;
+    });
+
+    for (size_t begin = 0, end = 0; begin < count; begin = end) {
+        auto const& first = presents[c.mOrder[begin]];
+        for (end = begin + 1; end < count; ++end) {
+            auto const& p = presents[c.mOrder[end]];
+            if (p.ProcessId != first.ProcessId || p.SwapChainAddress != first.SwapChainAddress) {
+                break;
+            }
+        }
+
+        auto procSlot = c.mProcessIndex.find(first.ProcessId);
+        if (procSlot == NO_SLOT) {
+            procSlot = c.mProcesses.acquire();
+            c.mProcessIndex.insert(first.ProcessId, procSlot);
+        }
+        auto& proc = c.mProcesses[procSlot];
+        auto chainSlot = (uint32_t) NO_SLOT;
+        for (auto const& chain : proc.mChains) {
+            if (chain.first == first.SwapChainAddress) {
+                chainSlot = chain.second;
+            }
+        }
+        if (chainSlot == NO_SLOT) {
+            chainSlot = c.mChains.acquire();
+            proc.mChains.emplace_back(first.SwapChainAddress, chainSlot);
+            c.mChains[chainSlot].SetHistoryWindow(HISTORY_TIME_MS, SwapChainData::DEFAULT_HISTORY_BUDGET_KB);
+        }
+
+        auto& chain = c.mChains[chainSlot];
+        for (auto i = begin; i < end; ++i) {
+            auto const row = c.mOrder[i];
+            auto const& p = presents[row];
+            c.mChecksum += (double) chain.mPresentIntervals.median() + (double) chain.mDisplayIntervals.median();
+            chain.AddPresentToSwapChain(p);
+
+            auto len = chain.mPresentHistory.size();
+            auto displayedLen = chain.mDisplayedPresentHistory.size();
+            if (len > 1) {
+                auto& curr = chain.mPresentHistory[len - 1];
+                auto& prev = chain.mPresentHistory[len - 2];
+                auto presented = curr.FinalState == PresentResult::Presented;
+                uint64_t flipTicks = 0;
+                if (presented && displayedLen > 1) {
+                    flipTicks = curr.ScreenTime - chain.mDisplayedPresentHistory[displayedLen - 2].ScreenTime;
+                }
+                c.mBatch.Set(row, curr.QpcTime - prev.QpcTime, flipTicks,
+                    curr.ReadyTime == 0 ? 0 : curr.ReadyTime - curr.QpcTime,
+                    presented ? curr.ScreenTime - curr.QpcTime : 0,
+                    curr.TimeTaken);
+            }
+            chain.UpdateSwapChainInfo(p, now, clock);
+        }
+    }
+
+    ComputeScores(c.mBatch, clock.msPerTick());
+
+    c.mTimestamps.clear();
+    c.mScores.clear();
+    for (uint32_t row = 0; row < count; ++row) {
+        if (c.mBatch.mValid[row]) {
+            c.mTimestamps.push_back(clock.toUnixSeconds(presents[row].QpcTime));
+            c.mScores.push_back(c.mBatch.mFps[row]);
+        }
+    }
+}
+
+// The pre-user-029 history entry: a full PresentEvent copy, whose
+// DependentPresents deque allocates even when empty.
+struct LegacyFrame {
+    CompletedFrame mFrame;
+    uint64_t mHwnd;
+    uint64_t mTokenPtr;
+    std::deque<std::shared_ptr<LegacyFrame>> mDependentPresents;
+};
+
+void AddLegacy(std::deque<LegacyFrame>& history, LegacyFrame const& frame, uint64_t maxTicks)
+{
+    history.push_back(frame);
+    while (frame.mFrame.QpcTime - history.front().mFrame.QpcTime > maxTicks) {
+        history.pop_front();
+    }
+}
+
+struct Counts {
+    uint64_t mHandlers = 0;
+    uint64_t mDequeue = 0;
+    uint64_t mAdd = 0;
+    uint64_t mLegacy = 0;
+    uint64_t mFrames = 0;
+};
+
+}
+
+int main()
+{
+    synthetic::SeedSchemas();
+    auto events = synthetic::Generate(FLIP_PROCESS_COUNT, SECONDS);
+    auto composed = synthetic::GenerateComposed(COMPOSED_PROCESS_COUNT, SECONDS);
+    events.insert(events.end(), composed.begin(), composed.end());
+    std::stable_sort(events.begin(), events.end(), [](synthetic::Event const& a, synthetic::Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    std::vector<EVENT_RECORD> records;
+    for (auto& e : events) {
+        records.push_back(synthetic::MakeRecord(e));
+    }
+
+    QpcClock clock(synthetic::QPC_FREQUENCY);
+    auto const maxTicks = (uint64_t) HISTORY_TIME_MS * synthetic::QPC_FREQUENCY / 1000;
+    PMTraceConsumer pmConsumer(false);
+    Consumer consumer;
+    std::vector<CompletedFrame> presents;
+    std::vector<LegacyFrame> legacyFrames;
+    std::map<std::pair<uint32_t, uint64_t>, std::pair<std::deque<LegacyFrame>, std::deque<LegacyFrame>>> legacyHistories;
+    Counts counts;
+
+    auto drain = [&](bool counted) {
+        auto before = g_Allocations.load();
+        presents.clear();
+        pmConsumer.DequeuePresents(presents);
+        auto dequeued = g_Allocations.load();
+        AddPresents(consumer, presents, 0, clock);
+        auto added = g_Allocations.load();
+
+        // The legacy entries are built outside the count: before user-029
+        // they were already on the heap behind the queued shared_ptr.
+        legacyFrames.clear();
+        for (auto const& p : presents) {
+            legacyFrames.push_back(LegacyFrame{ p, 0, 0, {} });
+        }
+        for (auto const& p : presents) {
+            legacyHistories[std::make_pair(p.ProcessId, p.SwapChainAddress)];
+        }
+        auto legacyBefore = g_Allocations.load();
+        for (auto const& f : legacyFrames) {
+            auto& histories = legacyHistories[std::make_pair(f.mFrame.ProcessId, f.mFrame.SwapChainAddress)];
+            AddLegacy(histories.first, f, maxTicks);
+            if (f.mFrame.FinalState == PresentResult::Presented) {
+                AddLegacy(histories.second, f, maxTicks);
+            }
+        }
+        auto legacyAfter = g_Allocations.load();
+
+        if (counted) {
+            counts.mDequeue += dequeued - before;
+            counts.mAdd += added - dequeued;
+            counts.mLegacy += legacyAfter - legacyBefore;
+            counts.mFrames += presents.size();
+        }
+    };
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        auto& record = records[i];
+        auto counted = record.EventHeader.TimeStamp.QuadPart >= WARM_UP_TICKS;
+        auto const& provider = record.EventHeader.ProviderId;
+        auto before = g_Allocations.load();
+        if (IsEqualGUID(provider, DXGI_PROVIDER_GUID)) {
+            HandleDXGIEvent(&record, &pmConsumer);
+        } else if (IsEqualGUID(provider, DXGKRNL_PROVIDER_GUID)) {
+            HandleDXGKEvent(&record, &pmConsumer);
+        } else {
+            HandleWin32kEvent(&record, &pmConsumer);
+        }
+        if (counted) {
+            counts.mHandlers += g_Allocations.load() - before;
+        }
+        if ((i + 1) % DEQUEUE_EVERY == 0) {
+            drain(counted);
+        }
+    }
+    drain(true);
+
+    auto perFrame = [&counts](uint64_t n) { return (double) n / counts.mFrames; };
+    printf("%zu events, %llu frames counted (%u + %u processes, %u s, first second not counted)\n",
+           records.size(), (unsigned long long) counts.mFrames, FLIP_PROCESS_COUNT, COMPOSED_PROCESS_COUNT, SECONDS);
+    printf("  allocations/frame  handlers %.3f  dequeue %.3f  add %.3f  total %.3f\n",
+           perFrame(counts.mHandlers), perFrame(counts.mDequeue), perFrame(counts.mAdd),
+           perFrame(counts.mHandlers + counts.mDequeue + counts.mAdd));
+    printf("  legacy history copies %.3f allocations/frame\n", perFrame(counts.mLegacy));
+    printf("  (checksum %.0f, %zu swapchains)\n", consumer.mChecksum, consumer.mChains.size());
+    return 0;
+}
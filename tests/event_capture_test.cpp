@@ -0,0 +1,447 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Round-trips synthetic process events through EventCaptureWriter and
+// EventReplayer into the PMTraceConsumer handlers, decoding their strings
+// from the captured schemas only (no TDH, on any platform), does the same
+// for mixed-reality events, which MRTraceConsumer tells apart by their
+// captured task names, and reads a version 1 capture.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EventCapture.hpp"
+#include "EventReplay.hpp"
+#include "MixedRealityTraceConsumer.hpp"
+#include "PresentMonTraceConsumer.hpp"
+#include "TraceConsumer.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+char const* const CAPTURE_PATH = "event_capture_test.pmcap";
+
+struct SyntheticEvent {
+    EVENT_RECORD Record;
+    std::vector<uint8_t> UserData;
+
+    SyntheticEvent(GUID const& providerId, uint16_t id, uint8_t opcode, int64_t timeStamp)
+    {
+        memset(&Record, 0, sizeof(Record));
+        Record.EventHeader.ProviderId = providerId;
+        Record.EventHeader.EventDescriptor.Id = id;
+        Record.EventHeader.EventDescriptor.Opcode = opcode;
+        Record.EventHeader.TimeStamp.QuadPart = timeStamp;
+    }
+
+    template <typename T>
+    void Put(T value)
+    {
+        auto p = (uint8_t const*) &value;
+        UserData.insert(UserData.end(), p, p + sizeof(value));
+    }
+
+    void PutUtf16(char16_t const* s)
+    {
+        do {
+            Put<uint16_t>(*s);
+        } while (*s++ != 0);
+    }
+
+    void PutAnsi(char const* s)
+    {
+        UserData.insert(UserData.end(), s, s + strlen(s) + 1);
+    }
+
+    EVENT_RECORD* Get()
+    {
+        Record.UserData = UserData.data();
+        Record.UserDataLength = (USHORT) UserData.size();
+        return &Record;
+    }
+};
+
+// Microsoft-Windows-Kernel-Process ProcessStart (trimmed).
+SyntheticEvent KernelProcessStart(uint32_t processId, char16_t const* imageName, int64_t timeStamp)
+{
+    SyntheticEvent e(KERNEL_PROCESS_PROVIDER_GUID, KernelProcess_ProcessStart, EVENT_TRACE_TYPE_INFO, timeStamp);
+    e.Put<uint32_t>(processId);
+    e.Put<uint64_t>(0);     // CreateTime
+    e.Put<uint8_t>(1);      // UserSID, one sub-authority
+    e.Put<uint8_t>(1);
+    e.UserData.resize(e.UserData.size() + 10);
+    e.PutUtf16(imageName);
+    e.Put<uint32_t>(0);     // Flags
+    return e;
+}
+
+EventSchema KernelProcessStartSchema()
+{
+    EventSchema schema;
+    schema.AddField(L"ProcessID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"CreateTime", EventSchema::FieldKind::Scalar, 8);
+    schema.AddField(L"UserSID", EventSchema::FieldKind::Sid, 0);
+    schema.AddField(L"ImageName", EventSchema::FieldKind::UnicodeString, 0);
+    schema.AddField(L"Flags", EventSchema::FieldKind::Scalar, 4);
+    return schema;
+}
+
+// NT Kernel Logger Process/DCStart (trimmed).  The rundown rather than a
+// live start, which the consumer would drop in favor of Kernel-Process's.
+SyntheticEvent NTProcessStart(uint32_t processId, char const* imageFileName, int64_t timeStamp)
+{
+    SyntheticEvent e(NT_PROCESS_EVENT_GUID, 0, EVENT_TRACE_TYPE_DC_START, timeStamp);
+    e.Put<uint64_t>(0);     // UniqueProcessKey
+    e.Put<uint32_t>(processId);
+    e.Put<uint8_t>(1);      // UserSID, no sub-authorities
+    e.Put<uint8_t>(0);
+    e.UserData.resize(e.UserData.size() + 6);
+    e.PutAnsi(imageFileName);
+    return e;
+}
+
+EventSchema NTProcessStartSchema()
+{
+    EventSchema schema;
+    schema.AddField(L"UniqueProcessKey", EventSchema::FieldKind::Scalar, 8);
+    schema.AddField(L"ProcessId", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"UserSID", EventSchema::FieldKind::Sid, 0);
+    schema.AddField(L"ImageFileName", EventSchema::FieldKind::AnsiString, 0);
+    return schema;
+}
+
+std::vector<NTProcessEvent> ReplayProcessEvents(char const* path, bool* ok)
+{
+    // Replay on a fresh thread, so nothing is in the schema cache but what
+    // the capture holds.
+    std::vector<NTProcessEvent> processEvents;
+    std::thread([&]() {
+        PMTraceConsumer pmConsumer(false);
+        EventReplayer replayer;
+        replayer.AddHandler(KERNEL_PROCESS_PROVIDER_GUID, (ReplayHandlerFn) &HandleKernelProcessEvent, &pmConsumer);
+        replayer.AddHandler(NT_PROCESS_EVENT_GUID, (ReplayHandlerFn) &HandleNTProcessEvent, &pmConsumer);
+        *ok = replayer.Replay(path);
+        pmConsumer.DequeueProcessEvents(processEvents);
+    }).join();
+    return processEvents;
+}
+
+void TestRoundTrip()
+{
+    auto kernelStart = KernelProcessStart(100, u"\\Device\\HarddiskVolume2\\Games\\g\u00e4me.exe", 1000);
+    auto ntStart = NTProcessStart(200, "other.exe", 2000);
+    auto kernelStart2 = KernelProcessStart(300, u"\\??\\C:\\x\U0001F600.exe", 3000);
+
+    // Capture on another thread, with the schemas seeded as TDH would have
+    // built them.
+    std::thread([&]() {
+        SeedEventSchema(GetEventSchemaKey(kernelStart.Get()), KernelProcessStartSchema(), L"ProcessStart");
+        SeedEventSchema(GetEventSchemaKey(ntStart.Get()), NTProcessStartSchema(), L"Process");
+
+        EventCaptureWriter writer;
+        CHECK(writer.Open(CAPTURE_PATH, 10000000));
+        HandleCaptureEvent(kernelStart.Get(), &writer);
+        HandleCaptureEvent(ntStart.Get(), &writer);
+        HandleCaptureEvent(kernelStart2.Get(), &writer);
+        CHECK(writer.GetEventCount() == 3);
+        writer.Close();
+    }).join();
+
+    bool ok = false;
+    auto processEvents = ReplayProcessEvents(CAPTURE_PATH, &ok);
+    CHECK(ok);
+    CHECK(processEvents.size() == 3);
+    if (processEvents.size() == 3) {
+        CHECK(processEvents[0].ProcessId == 100);
+        CHECK(processEvents[0].ImageFileName == "g\xc3\xa4me.exe");
+        CHECK(processEvents[0].Timestamp == 1000);
+        CHECK(processEvents[1].ProcessId == 200);
+        CHECK(processEvents[1].ImageFileName == std::string("other.exe", 10)); // as TDH returns it
+        CHECK(processEvents[2].ProcessId == 300);
+        CHECK(processEvents[2].ImageFileName == "x\xf0\x9f\x98\x80.exe");
+    }
+
+    // The schemas come back with the same layout.
+    EventCaptureReader reader;
+    CHECK(reader.Open(CAPTURE_PATH));
+    EventCaptureEvent const* event = nullptr;
+    void const* userData = nullptr;
+    CHECK(reader.Next(&event, &userData));
+    auto captured = reader.FindSchema(event->SchemaKey);
+    CHECK(captured != nullptr);
+    if (captured != nullptr) {
+        auto expected = KernelProcessStartSchema();
+        CHECK(captured->TaskName == L"ProcessStart");
+        CHECK(captured->Schema.mFields.size() == expected.mFields.size());
+        CHECK(captured->Schema.mFixedSize == expected.mFixedSize);
+        CHECK(captured->Schema.mFields[3].Kind == EventSchema::FieldKind::UnicodeString);
+        CHECK(captured->Schema.mFields[4].Offset == EventSchema::VARIABLE_OFFSET);
+    }
+}
+
+// TraceLogging events all have id 0 and differ in their metadata, which is
+// part of the schema key; distinct ids stand in for that here.
+enum {
+    BEGIN_LSR_ID = 1,
+    PRESENTATION_TIMING_ID,
+    HOLOGRAPHIC_FRAME_ID,
+};
+
+// DHD LsrThread_BeginLsrProcessing (trimmed).
+SyntheticEvent BeginLsrProcessing(uint64_t sourcePtr, int64_t timeStamp)
+{
+    SyntheticEvent e(DHD_PROVIDER_GUID, BEGIN_LSR_ID, EVENT_TRACE_TYPE_INFO, timeStamp);
+    e.Put<uint64_t>(sourcePtr);
+    e.Put<uint8_t>(1);      // NewSourceLatched
+    e.Put<float>(4.0f);     // TimeUntilVblankMs
+    e.Put<float>(12.0f);    // TimeUntilPhotonsMiddleMs
+    e.Put<float>(20.0f);    // PredictionSampleTimeToPhotonsVisibleMs
+    e.Put<float>(0.5f);     // MispredictionMs
+    return e;
+}
+
+EventSchema BeginLsrProcessingSchema()
+{
+    EventSchema schema;
+    schema.AddField(L"SourcePtr", EventSchema::FieldKind::Scalar, 8);
+    schema.AddField(L"NewSourceLatched", EventSchema::FieldKind::Scalar, 1);
+    schema.AddField(L"TimeUntilVblankMs", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"TimeUntilPhotonsMiddleMs", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"PredictionSampleTimeToPhotonsVisibleMs", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"MispredictionMs", EventSchema::FieldKind::Scalar, 4);
+    return schema;
+}
+
+wchar_t const* const PRESENTATION_TIMING_FLOATS[] = {
+    L"startLatchToCpuRenderFrameStartInMs",
+    L"cpuRenderFrameStartToHeadPoseCallbackStartInMs",
+    L"headPoseCallbackDurationInMs",
+    L"headPoseCallbackEndToInputLatchInMs",
+    L"inputLatchToGpuSubmissionInMs",
+    L"gpuSubmissionToGpuStartInMs",
+    L"gpuStartToGpuStopInMs",
+    L"gpuStopToCopyStartInMs",
+    L"copyStartToCopyStopInMs",
+    L"copyStopToVsyncInMs",
+    L"totalWakeupErrorMs",
+};
+
+// DHD OnTimePresentationTiming; field i is i + 1 ms.
+SyntheticEvent OnTimePresentationTiming(int64_t timeStamp)
+{
+    SyntheticEvent e(DHD_PROVIDER_GUID, PRESENTATION_TIMING_ID, EVENT_TRACE_TYPE_INFO, timeStamp);
+    for (size_t i = 0; i < sizeof(PRESENTATION_TIMING_FLOATS) / sizeof(PRESENTATION_TIMING_FLOATS[0]); ++i) {
+        e.Put<float>((float) (i + 1));
+    }
+    e.Put<uint8_t>(1);      // frameSubmittedOnSchedule
+    return e;
+}
+
+EventSchema OnTimePresentationTimingSchema()
+{
+    EventSchema schema;
+    for (auto name : PRESENTATION_TIMING_FLOATS) {
+        schema.AddField(name, EventSchema::FieldKind::Scalar, 4);
+    }
+    schema.AddField(L"frameSubmittedOnSchedule", EventSchema::FieldKind::Scalar, 1);
+    return schema;
+}
+
+// SpectrumContinuous HolographicFrame start (trimmed).
+SyntheticEvent HolographicFrameStart(uint32_t frameId, int64_t timeStamp)
+{
+    SyntheticEvent e(SPECTRUMCONTINUOUS_PROVIDER_GUID, HOLOGRAPHIC_FRAME_ID, EVENT_TRACE_TYPE_START, timeStamp);
+    e.Put<uint8_t>(0);      // isRehydration
+    e.Put<uint32_t>(frameId);
+    return e;
+}
+
+EventSchema HolographicFrameStartSchema()
+{
+    EventSchema schema;
+    schema.AddField(L"isRehydration", EventSchema::FieldKind::Scalar, 1);
+    schema.AddField(L"holographicFrameID", EventSchema::FieldKind::Scalar, 4);
+    return schema;
+}
+
+void TestMixedReality()
+{
+    auto frameStart = HolographicFrameStart(77, 500);
+    auto lsr1 = BeginLsrProcessing(0x1234, 1000);
+    auto timing = OnTimePresentationTiming(1500);
+    auto lsr2 = BeginLsrProcessing(0x1234, 2000);
+
+    std::thread([&]() {
+        SeedEventSchema(GetEventSchemaKey(frameStart.Get()), HolographicFrameStartSchema(), L"HolographicFrame");
+        SeedEventSchema(GetEventSchemaKey(lsr1.Get()), BeginLsrProcessingSchema(), L"LsrThread_BeginLsrProcessing");
+        SeedEventSchema(GetEventSchemaKey(timing.Get()), OnTimePresentationTimingSchema(), L"OnTimePresentationTiming");
+
+        EventCaptureWriter writer;
+        CHECK(writer.Open(CAPTURE_PATH, 10000000));
+        for (auto e : { &frameStart, &lsr1, &timing, &lsr2 }) {
+            HandleCaptureEvent(e->Get(), &writer);
+        }
+        CHECK(writer.GetEventCount() == 4);
+        writer.Close();
+    }).join();
+
+    // Replay on a fresh thread: the task names come from the capture.
+    std::thread([&]() {
+        MRTraceConsumer mrConsumer(false);
+        EventReplayer replayer;
+        replayer.AddHandler(DHD_PROVIDER_GUID, (ReplayHandlerFn) &HandleDHDEvent, &mrConsumer);
+        replayer.AddHandler(SPECTRUMCONTINUOUS_PROVIDER_GUID, (ReplayHandlerFn) &HandleSpectrumContinuousEvent, &mrConsumer);
+        CHECK(replayer.Replay(CAPTURE_PATH));
+
+        // The Spectrum start began tracking the frame...
+        CHECK(mrConsumer.mHolographicFramesByFrameId.count(77) == 1);
+
+        // ...and the second BeginLsrProcessing completed the first LSR with
+        // the timing read in between.
+        std::vector<std::shared_ptr<LateStageReprojectionEvent>> lsrs;
+        CHECK(mrConsumer.DequeueLSRs(lsrs));
+        CHECK(lsrs.size() == 1);
+        if (lsrs.size() == 1) {
+            auto const& lsr = *lsrs[0];
+            CHECK(lsr.QpcTime == 1000);
+            CHECK(lsr.Source.Ptr == 0x1234);
+            CHECK(lsr.NewSourceLatched);
+            CHECK(lsr.TimeUntilVsyncMs == 4.0f);
+            CHECK(lsr.AppMispredictionMs == 0.5f);
+            CHECK(lsr.ThreadWakeupStartLatchToCpuRenderFrameStartInMs == 1.0f);
+            CHECK(lsr.CopyStopToVsyncInMs == 10.0f);
+            CHECK(lsr.TotalWakeupErrorMs == 11.0f);
+            CHECK(lsr.FinalState == LateStageReprojectionResult::Presented);
+        }
+        CHECK(mrConsumer.mActiveLSR != nullptr && mrConsumer.mActiveLSR->QpcTime == 2000);
+
+        // One task lookup per kind of event, cached by schema key.
+        CHECK(mrConsumer.mEventTaskByKey.size() == 3);
+    }).join();
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>* out, T const& value, size_t size = sizeof(T))
+{
+    auto p = (uint8_t const*) &value;
+    out->insert(out->end(), p, p + size);
+}
+
+void TestVersion1()
+{
+    // Version 1 records stop before the members version 2 added, and only
+    // hold fixed-offset scalars.
+    std::vector<uint8_t> file;
+    EventCaptureFileHeader header = {};
+    memcpy(header.Magic, "PMEVCAP", 8);
+    header.Version = 1;
+    header.QpcFrequency = 10000000;
+    Append(&file, header);
+
+    auto ntStop = SyntheticEvent(NT_PROCESS_EVENT_GUID, 0, EVENT_TRACE_TYPE_END, 5000);
+    ntStop.Put<uint64_t>(0);
+    ntStop.Put<uint32_t>(42);
+    auto schemaKey = GetEventSchemaKey(ntStop.Get());
+
+    Append(&file, EventCaptureRecordType::Schema);
+    EventCaptureSchema schema = {};
+    schema.SchemaKey = schemaKey;
+    schema.FixedSize = 12;
+    schema.FieldCount = 1;
+    Append(&file, schema, offsetof(EventCaptureSchema, PointerSize));
+    EventCaptureField field = {};
+    field.Offset = 8;
+    field.Size = 4;
+    field.NameLength = 9;
+    Append(&file, field, offsetof(EventCaptureField, Kind));
+    for (auto c : u"ProcessId") {
+        if (c != 0) {
+            Append(&file, (uint16_t) c);
+        }
+    }
+
+    Append(&file, EventCaptureRecordType::Event);
+    EventCaptureEvent event = {};
+    memcpy(event.ProviderId, &NT_PROCESS_EVENT_GUID, sizeof(event.ProviderId));
+    event.TimeStamp = 5000;
+    event.SchemaKey = schemaKey;
+    event.Opcode = EVENT_TRACE_TYPE_END;
+    event.UserDataLength = (uint16_t) ntStop.UserData.size();
+    Append(&file, event);
+    file.insert(file.end(), ntStop.UserData.begin(), ntStop.UserData.end());
+
+    auto fp = fopen(CAPTURE_PATH, "wb");
+    CHECK(fp != nullptr);
+    if (fp == nullptr) {
+        return;
+    }
+    fwrite(file.data(), 1, file.size(), fp);
+    fclose(fp);
+
+    bool ok = false;
+    auto processEvents = ReplayProcessEvents(CAPTURE_PATH, &ok);
+    CHECK(ok);
+    CHECK(processEvents.size() == 1);
+    if (processEvents.size() == 1) {
+        CHECK(processEvents[0].ProcessId == 42);
+        CHECK(processEvents[0].ImageFileName.empty());
+    }
+
+    // Unknown versions are refused.
+    header.Version = EVENT_CAPTURE_VERSION + 1;
+    memcpy(file.data(), &header, sizeof(header));
+    fp = fopen(CAPTURE_PATH, "wb");
+    fwrite(file.data(), 1, file.size(), fp);
+    fclose(fp);
+    EventCaptureReader reader;
+    CHECK(!reader.Open(CAPTURE_PATH));
+}
+
+}
+
+int main()
+{
+    TestRoundTrip();
+    TestMixedReality();
+    TestVersion1();
+    remove(CAPTURE_PATH);
+
+    if (failures != 0) {
+        printf("FAIL: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
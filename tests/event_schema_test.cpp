@@ -0,0 +1,295 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Decodes synthetic payloads through EventSchema: fixed offsets, field list
+// resolution, zero-extension, bounds, and the variable-length fields
+// (strings, SIDs, arrays) replay decodes without TDH.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "EventSchema.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+template <typename T>
+void Put(uint8_t* payload, uint32_t offset, T value)
+{
+    memcpy(payload + offset, &value, sizeof(value));
+}
+
+// Layout of DxgKrnl VSyncDPC on a 64-bit system.
+EventSchema VSyncDPCSchema()
+{
+    EventSchema schema;
+    schema.AddProperty(L"pDxgAdapter", 8, 1);               // 0
+    schema.AddProperty(L"VidPnTargetId", 4, 1);             // 8
+    schema.AddProperty(L"ScannedPhysicalAddress", 8, 1);    // 12
+    schema.AddProperty(L"VidPnSourceId", 4, 1);             // 20
+    schema.AddProperty(L"FrameNumber", 4, 1);               // 24
+    schema.AddProperty(L"FrameQPCTime", 8, 1);              // 28
+    schema.AddProperty(L"hFlipDevice", 8, 1);               // 36
+    schema.AddProperty(L"FlipType", 4, 1);                  // 44
+    schema.AddProperty(L"FlipFenceId", 8, 1);               // 48
+    return schema;
+}
+
+void TestFixedLayout()
+{
+    auto schema = VSyncDPCSchema();
+    CHECK(!schema.mVariable);
+    CHECK(schema.mFixedSize == 56);
+
+    uint8_t payload[56] = {};
+    Put<uint32_t>(payload, 8, 3);
+    Put<uint32_t>(payload, 24, 1234);
+    Put<uint64_t>(payload, 28, 0x1122334455667788ull);
+    Put<uint64_t>(payload, 48, 0xabcdef0100000000ull);
+
+    enum { FlipFenceId, VidPnTargetId, FrameNumber, FrameQPCTime, Missing };
+    EventFieldList const fields = { L"FlipFenceId", L"VidPnTargetId", L"FrameNumber", L"FrameQPCTime", L"Missing" };
+    auto indices = schema.Resolve(fields);
+    CHECK(indices == schema.Resolve(fields)); // resolved once
+    CHECK(indices[Missing] == EventSchema::NO_FIELD);
+
+    uint64_t u64 = 0;
+    uint32_t u32 = 0;
+    CHECK(schema.ReadField(payload, sizeof(payload), indices[FlipFenceId], &u64, sizeof(u64)) && u64 == 0xabcdef0100000000ull);
+    CHECK(schema.ReadField(payload, sizeof(payload), indices[VidPnTargetId], &u32, sizeof(u32)) && u32 == 3);
+    CHECK(schema.ReadField(payload, sizeof(payload), indices[FrameNumber], &u32, sizeof(u32)) && u32 == 1234);
+    CHECK(schema.ReadField(payload, sizeof(payload), indices[FrameQPCTime], &u64, sizeof(u64)) && u64 == 0x1122334455667788ull);
+    CHECK(!schema.ReadField(payload, sizeof(payload), indices[Missing], &u64, sizeof(u64)));
+
+    // Narrow fields are zero-extended; wide ones don't fit a narrow output.
+    u64 = ~0ull;
+    CHECK(schema.ReadField(payload, sizeof(payload), indices[FrameNumber], &u64, sizeof(u64)) && u64 == 1234);
+    CHECK(!schema.ReadField(payload, sizeof(payload), indices[FrameQPCTime], &u32, sizeof(u32)));
+
+    // Truncated payloads fail rather than read past the end.
+    CHECK(!schema.ReadField(payload, 52, indices[FlipFenceId], &u64, sizeof(u64)));
+
+    // Reads by name agree.
+    CHECK(schema.Read(payload, sizeof(payload), L"FrameNumber", &u32, sizeof(u32)) && u32 == 1234);
+    CHECK(!schema.Read(payload, sizeof(payload), L"Missing", &u32, sizeof(u32)));
+}
+
+void TestVariableTail()
+{
+    // A field of unknown extent ends the layout.
+    EventSchema schema;
+    schema.AddProperty(L"ProcessId", 4, 1);
+    schema.AddProperty(L"Flags", 4, 2);
+    schema.AddProperty(L"Unknown", 0, 1);
+    schema.AddProperty(L"SessionId", 4, 1);
+    CHECK(schema.mVariable);
+    CHECK(schema.IsLayoutEnded());
+    CHECK(schema.mFixedSize == 12);
+
+    enum { ProcessId, Flags, Unknown, SessionId };
+    EventFieldList const fields = { L"ProcessId", L"Flags", L"Unknown", L"SessionId" };
+    auto indices = schema.Resolve(fields);
+    CHECK(indices[ProcessId] != EventSchema::NO_FIELD);
+    CHECK(indices[Flags] != EventSchema::NO_FIELD);
+    CHECK(indices[Unknown] == EventSchema::NO_FIELD);
+    CHECK(indices[SessionId] == EventSchema::NO_FIELD);
+
+    // Arrays are read an element at a time, not as a scalar.
+    uint8_t payload[12] = {};
+    Put<uint32_t>(payload, 8, 5);
+    uint32_t value = 0;
+    CHECK(!schema.ReadField(payload, sizeof(payload), indices[Flags], &value, sizeof(value)));
+    CHECK(schema.ReadElement(payload, sizeof(payload), indices[Flags], 1, &value, sizeof(value)) && value == 5);
+    CHECK(!schema.ReadElement(payload, sizeof(payload), indices[Flags], 2, &value, sizeof(value)));
+}
+
+// Layout of Microsoft-Windows-Kernel-Process ProcessStart: strings and a SID
+// between fixed fields.
+EventSchema ProcessStartSchema()
+{
+    EventSchema schema;
+    schema.AddField(L"ProcessID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"CreateTime", EventSchema::FieldKind::Scalar, 8);
+    schema.AddField(L"ParentProcessID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"SessionID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"UserSID", EventSchema::FieldKind::Sid, 0);
+    schema.AddField(L"ImageName", EventSchema::FieldKind::UnicodeString, 0);
+    schema.AddField(L"Flags", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"PackageFullName", EventSchema::FieldKind::AnsiString, 0);
+    schema.AddField(L"ExitCode", EventSchema::FieldKind::Scalar, 4);
+    return schema;
+}
+
+void TestStrings()
+{
+    auto schema = ProcessStartSchema();
+    CHECK(schema.mVariable);
+    CHECK(!schema.IsLayoutEnded());
+    CHECK(schema.mFixedSize == 20);
+
+    // SID with 2 sub-authorities (16 bytes), L"a\\b.exe", 7, "pkg", 9.
+    std::vector<uint8_t> payload(20);
+    Put<uint32_t>(payload.data(), 0, 1234);
+    uint8_t sid[16] = { 1, 2 };
+    payload.insert(payload.end(), sid, sid + sizeof(sid));
+    for (auto c : { u'a', u'\\', u'b', u'.', u'e', u'x', u'e', u'\0' }) {
+        payload.push_back((uint8_t) c);
+        payload.push_back((uint8_t) (c >> 8));
+    }
+    size_t flagsOffset = payload.size();
+    payload.resize(payload.size() + 4);
+    Put<uint32_t>(payload.data(), (uint32_t) flagsOffset, 7);
+    for (auto c : "pkg") {
+        payload.push_back((uint8_t) c);
+    }
+    size_t exitOffset = payload.size();
+    payload.resize(payload.size() + 4);
+    Put<uint32_t>(payload.data(), (uint32_t) exitOffset, 9);
+    auto length = (uint32_t) payload.size();
+
+    enum { ProcessID, UserSID, ImageName, Flags, PackageFullName, ExitCode };
+    EventFieldList const fields = { L"ProcessID", L"UserSID", L"ImageName", L"Flags", L"PackageFullName", L"ExitCode" };
+    auto indices = schema.Resolve(fields);
+
+    uint32_t value = 0;
+    CHECK(schema.ReadField(payload.data(), length, indices[ProcessID], &value, sizeof(value)) && value == 1234);
+    CHECK(schema.ReadField(payload.data(), length, indices[Flags], &value, sizeof(value)) && value == 7);
+    CHECK(schema.ReadField(payload.data(), length, indices[ExitCode], &value, sizeof(value)) && value == 9);
+
+    // Bytes as TDH returns them, terminator included.
+    std::string bytes;
+    CHECK(schema.ReadBytes(payload.data(), length, indices[UserSID], &bytes) && bytes.size() == 16);
+    CHECK(schema.ReadBytes(payload.data(), length, indices[ImageName], &bytes) && bytes.size() == 16 && bytes[2] == '\\');
+    CHECK(schema.ReadBytes(payload.data(), length, indices[PackageFullName], &bytes) && bytes == std::string("pkg", 4));
+    CHECK(!schema.ReadField(payload.data(), length, indices[ImageName], &value, sizeof(value)));
+
+    // A payload cut inside the SID can't locate anything after it.
+    CHECK(!schema.ReadField(payload.data(), 30, indices[Flags], &value, sizeof(value)));
+    CHECK(schema.ReadField(payload.data(), 30, indices[ProcessID], &value, sizeof(value)) && value == 1234);
+
+    // An unterminated string runs to the end of the payload.
+    EventSchema tail;
+    tail.AddField(L"Name", EventSchema::FieldKind::AnsiString, 0);
+    uint8_t name[3] = { 'a', 'b', 'c' };
+    CHECK(tail.ReadBytes(name, sizeof(name), 0, &bytes) && bytes == "abc");
+}
+
+void TestWbemSid()
+{
+    // A null TOKEN_USER is just 4 bytes; otherwise two pointers and a SID.
+    EventSchema schema;
+    schema.mPointerSize = 4;
+    schema.AddField(L"User", EventSchema::FieldKind::WbemSid, 0);
+    schema.AddField(L"Value", EventSchema::FieldKind::Scalar, 4);
+
+    uint8_t empty[8] = {};
+    Put<uint32_t>(empty, 4, 3);
+    uint32_t value = 0;
+    CHECK(schema.ReadField(empty, sizeof(empty), 1, &value, sizeof(value)) && value == 3);
+
+    uint8_t user[8 + 12 + 4] = {};
+    Put<uint32_t>(user, 0, 0x1000);
+    user[8 + 1] = 1; // one sub-authority
+    Put<uint32_t>(user, 20, 4);
+    CHECK(schema.ReadField(user, sizeof(user), 1, &value, sizeof(value)) && value == 4);
+}
+
+void TestCountedArray()
+{
+    // DxgKrnl HSyncDPC: FlipEntryCount then that many submit sequences.
+    EventSchema schema;
+    schema.AddField(L"pDxgAdapter", EventSchema::FieldKind::Scalar, 8);
+    schema.AddField(L"FlipEntryCount", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"FlipSubmitSequence", EventSchema::FieldKind::CountedArray, 4, 1, 1);
+    schema.AddField(L"After", EventSchema::FieldKind::Scalar, 2);
+    CHECK(!schema.IsLayoutEnded());
+
+    uint8_t payload[8 + 4 + 3 * 4 + 2] = {};
+    Put<uint32_t>(payload, 8, 3);
+    Put<uint32_t>(payload, 12, 10);
+    Put<uint32_t>(payload, 16, 11);
+    Put<uint32_t>(payload, 20, 12);
+    Put<uint16_t>(payload, 24, 0xbeef);
+
+    uint32_t value = 0;
+    CHECK(schema.ReadElement(payload, sizeof(payload), 2, 0, &value, sizeof(value)) && value == 10);
+    CHECK(schema.ReadElement(payload, sizeof(payload), 2, 2, &value, sizeof(value)) && value == 12);
+    CHECK(!schema.ReadElement(payload, sizeof(payload), 2, 3, &value, sizeof(value)));
+    CHECK(schema.ReadField(payload, sizeof(payload), 3, &value, sizeof(value)) && value == 0xbeef);
+
+    // A count larger than the payload fails rather than reading past it.
+    Put<uint32_t>(payload, 8, 1000);
+    CHECK(!schema.ReadField(payload, sizeof(payload), 3, &value, sizeof(value)));
+
+    // The count must be an earlier scalar.
+    EventSchema bad;
+    bad.AddField(L"Array", EventSchema::FieldKind::CountedArray, 4, 1, 0);
+    CHECK(bad.IsLayoutEnded() && bad.mFields.empty());
+}
+
+void TestListsPerSchema()
+{
+    // The same list resolves independently in each schema.
+    EventFieldList const fields = { L"B" };
+    EventSchema first;
+    first.AddProperty(L"A", 4, 1);
+    first.AddProperty(L"B", 4, 1);
+    EventSchema second;
+    second.AddProperty(L"B", 2, 1);
+
+    uint8_t payload[8] = {};
+    Put<uint32_t>(payload, 0, 7);
+    Put<uint32_t>(payload, 4, 9);
+    uint32_t value = 0;
+    CHECK(first.ReadField(payload, sizeof(payload), first.Resolve(fields)[0], &value, sizeof(value)) && value == 9);
+    CHECK(second.ReadField(payload, sizeof(payload), second.Resolve(fields)[0], &value, sizeof(value)) && value == 7);
+}
+
+}
+
+int main()
+{
+    TestFixedLayout();
+    TestVariableTail();
+    TestStrings();
+    TestWbemSid();
+    TestCountedArray();
+    TestListsPerSchema();
+
+    if (failures != 0) {
+        printf("FAIL: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times the stale-swapchain sweep PresentMon_Update runs on every pass with
+// 1000 live swapchains: scanning every chain for IsStale(), as before, and
+// popping only the due ones from an ExpiryQueue.  Passes run every 10 ms for
+// 120 s; every live chain presents on each pass, and each goes idle after a
+// random 5-60 s and is replaced by a new one, so chains keep timing out.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <unordered_map>
+
+#include "../src/Utils/inc/expiry_queue.h"
+
+namespace {
+
+enum : uint64_t {
+    LIVE_CHAIN_COUNT = 1000,
+    PASS_MS = 10,
+    SECONDS = 120,
+    TIMEOUT_MS = 10000, // CHAIN_TIMEOUT_THRESHOLD_TICKS
+};
+
+struct Chain {
+    uint64_t lastUpdate;
+    uint64_t idleAt;
+};
+
+struct Result {
+    double nsPerPass;
+    uint64_t removed;
+};
+
+struct Scenario {
+    uint32_t x = 12345;
+    uint64_t nextAddress = 0x10000;
+
+    uint64_t Lifetime()
+    {
+        x = x * 1664525 + 1013904223;
+        return 5000 + (x >> 8) % 55000;
+    }
+};
+
+// The live chains present, and the ones that went idle are replaced.
+// Returns the new chains' addresses in *added.
+void Present(std::unordered_map<uint64_t, Chain>& chains, std::vector<uint64_t>& live, Scenario& s, uint64_t now,
+             std::vector<uint64_t>* added)
+{
+    added->clear();
+    for (auto& address : live) {
+        auto& chain = chains[address];
+        if (now < chain.idleAt) {
+            chain.lastUpdate = now;
+            continue;
+        }
+        address = s.nextAddress++;
+        Chain c = { now, now + s.Lifetime() };
+        chains[address] = c;
+        added->push_back(address);
+    }
+}
+
+template <typename Sweep>
+Result Run(Sweep sweep, bool queueNewChains, ExpiryQueue<uint64_t>* queue)
+{
+    Scenario s;
+    std::unordered_map<uint64_t, Chain> chains;
+    std::vector<uint64_t> live;
+    std::vector<uint64_t> added;
+    for (uint64_t i = 0; i < LIVE_CHAIN_COUNT; ++i) {
+        auto address = s.nextAddress++;
+        Chain c = { 0, s.Lifetime() };
+        chains[address] = c;
+        live.push_back(address);
+        if (queueNewChains) {
+            queue->push(c.lastUpdate + TIMEOUT_MS, address);
+        }
+    }
+
+    Result result = {};
+    double sweepNs = 0.0;
+    uint64_t passCount = SECONDS * 1000 / PASS_MS;
+    for (uint64_t pass = 1; pass <= passCount; ++pass) {
+        auto now = pass * PASS_MS;
+        Present(chains, live, s, now, &added);
+        if (queueNewChains) {
+            for (auto address : added) {
+                queue->push(now + TIMEOUT_MS, address);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        result.removed += sweep(chains, now);
+        sweepNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    result.nsPerPass = sweepNs / passCount;
+    return result;
+}
+
+}
+
+int main()
+{
+    ExpiryQueue<uint64_t> queue;
+
+    auto scan = Run([](std::unordered_map<uint64_t, Chain>& chains, uint64_t now) {
+        uint64_t removed = 0;
+        for (auto iter = chains.begin(); iter != chains.end(); ) {
+            if (now - iter->second.lastUpdate > TIMEOUT_MS) {
+                iter = chains.erase(iter);
+                ++removed;
+            } else {
+                ++iter;
+            }
+        }
+        return removed;
+    }, false, nullptr);
+
+    auto heap = Run([&queue](std::unordered_map<uint64_t, Chain>& chains, uint64_t now) {
+        uint64_t removed = 0;
+        uint64_t address = 0;
+        while (queue.pop_due(now, &address)) {
+            auto iter = chains.find(address);
+            if (iter == chains.end()) {
+                continue;
+            }
+            if (now - iter->second.lastUpdate > TIMEOUT_MS) {
+                chains.erase(iter);
+                ++removed;
+            } else {
+                queue.push(iter->second.lastUpdate + TIMEOUT_MS, address);
+            }
+        }
+        return removed;
+    }, true, &queue);
+
+    printf("%llu live swapchains, a pass every %llu ms for %llu s\n", (unsigned long long) LIVE_CHAIN_COUNT,
+           (unsigned long long) PASS_MS, (unsigned long long) SECONDS);
+    printf("scan every chain: %9.1f ns/pass  (%llu removed)\n", scan.nsPerPass, (unsigned long long) scan.removed);
+    printf("expiry queue:     %9.1f ns/pass  (%llu removed)  %.1fx\n", heap.nsPerPass, (unsigned long long) heap.removed,
+           scan.nsPerPass / heap.nsPerPass);
+
+    if (scan.removed != heap.removed) {
+        printf("FAIL: the sweeps removed different numbers of chains\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,280 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times FlatIndex lookups against std::map and std::unordered_map, with
+// process-id-like keys (multiples of 4) and aligned swapchain-address-like
+// keys, at table sizes from a few processes to a thousand.
+//
+// Then what the lookups cost AddPresents() per present.  A dequeued batch is
+// stable-sorted by (process id, swapchain address) and walked one swapchain
+// at a time, so the process index and the process's swapchain list are
+// searched once per swapchain in the batch rather than once per present.
+// The batch is timed three ways: grouped with those lookups (as
+// AddPresents() does), grouped with the swapchain slot already known (as if
+// the consumer cached it in CompletedFrame), and ungrouped with a lookup per
+// present.  Batches are 100 ms (the slow poll) and 10 ms (the fast poll) of
+// 8 processes with 2 swapchains each presenting at 60-240 fps.
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/Utils/inc/flat_table.h"
+
+namespace {
+
+enum {
+    LOOKUPS = 1 << 22,
+    RUNS = 5,
+    PROCESS_COUNT = 8,
+    CHAINS_PER_PROCESS = 2,
+    BATCHES = 20000,
+};
+
+double NsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Find>
+double TimeLookups(std::vector<uint64_t> const& probes, Find find, uint64_t* checksum)
+{
+    double best = 1e300;
+    for (int run = 0; run < RUNS; ++run) {
+        uint64_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto key : probes) {
+            sum += find(key);
+        }
+        best = std::min(best, NsSince(start) / probes.size());
+        *checksum += sum;
+    }
+    return best;
+}
+
+void BenchLookups(char const* name, size_t count, uint64_t stride, uint64_t base)
+{
+    std::mt19937_64 rng(count);
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back(base + stride * (rng() % (count * 16)));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    FlatIndex flat;
+    std::map<uint64_t, uint32_t> tree;
+    std::unordered_map<uint64_t, uint32_t> hashed;
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        flat.insert(keys[i], i);
+        tree[keys[i]] = i;
+        hashed[keys[i]] = i;
+    }
+
+    std::vector<uint64_t> probes(LOOKUPS);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    for (auto& p : probes) {
+        p = keys[pick(rng)];
+    }
+
+    uint64_t checksums[3] = {};
+    auto flatNs = TimeLookups(probes, [&flat](uint64_t k) { return flat.find(k); }, &checksums[0]);
+    auto treeNs = TimeLookups(probes, [&tree](uint64_t k) { return tree.find(k)->second; }, &checksums[1]);
+    auto hashedNs = TimeLookups(probes, [&hashed](uint64_t k) { return hashed.find(k)->second; }, &checksums[2]);
+    printf("%-9s %5zu keys: FlatIndex %5.1f ns  std::map %5.1f ns  std::unordered_map %5.1f ns%s\n",
+           name, keys.size(), flatNs, treeNs, hashedNs,
+           checksums[0] == checksums[1] && checksums[1] == checksums[2] ? "" : "  (MISMATCH)");
+}
+
+// What AddPresents() needs of a CompletedFrame and a process.
+struct Frame {
+    uint64_t mSwapChainAddress;
+    uint32_t mProcessId;
+    uint32_t mChainSlot;    // only for the cached-slot variant
+};
+
+struct Process {
+    std::pair<uint64_t, uint32_t> mChains[CHAINS_PER_PROCESS]; // address, slot
+
+    uint32_t FindChain(uint64_t address) const
+    {
+        for (auto const& c : mChains) {
+            if (c.first == address) {
+                return c.second;
+            }
+        }
+        return NO_SLOT;
+    }
+};
+
+struct Tables {
+    SlotPool<Process> mProcesses;
+    FlatIndex mProcessIndex;
+    std::vector<uint64_t> mChainPresents; // stands in for the per-chain work, by chain slot
+};
+
+// Batches of presents in completion order.
+std::vector<std::vector<Frame>> MakeBatches(Tables* tables, double batchMs)
+{
+    std::mt19937 rng(7);
+    struct Chain { Frame frame; double periodMs; double nextMs; };
+    std::vector<Chain> chains;
+    uint32_t chainSlot = 0;
+    for (uint32_t p = 0; p < PROCESS_COUNT; ++p) {
+        auto processId = 4 * (1000 + 373 * p);
+        auto slot = tables->mProcesses.acquire();
+        tables->mProcessIndex.insert(processId, slot);
+        for (uint32_t c = 0; c < CHAINS_PER_PROCESS; ++c) {
+            Chain chain;
+            chain.frame.mSwapChainAddress = 0x1f0000000ull + ((uint64_t) rng() << 12);
+            chain.frame.mProcessId = processId;
+            chain.frame.mChainSlot = chainSlot;
+            chain.periodMs = 1000.0 / (60 + rng() % 181);
+            chain.nextMs = chain.periodMs * (rng() % 100) / 100.0;
+            tables->mProcesses[slot].mChains[c] = std::make_pair(chain.frame.mSwapChainAddress, chainSlot);
+            chains.push_back(chain);
+            ++chainSlot;
+        }
+    }
+    tables->mChainPresents.assign(chainSlot, 0);
+
+    std::vector<std::vector<Frame>> batches(BATCHES);
+    for (uint32_t b = 0; b < BATCHES; ++b) {
+        auto endMs = (b + 1) * batchMs;
+        std::vector<std::pair<double, Frame>> due;
+        for (auto& chain : chains) {
+            for (; chain.nextMs < endMs; chain.nextMs += chain.periodMs) {
+                due.push_back(std::make_pair(chain.nextMs, chain.frame));
+            }
+        }
+        std::sort(due.begin(), due.end(), [](std::pair<double, Frame> const& a, std::pair<double, Frame> const& b) {
+            return a.first < b.first;
+        });
+        for (auto const& d : due) {
+            batches[b].push_back(d.second);
+        }
+    }
+    return batches;
+}
+
+enum class Lookup { PerSwapChain, Cached, PerPresent };
+
+uint32_t FindSlot(Tables const& tables, Frame const& f)
+{
+    auto processSlot = tables.mProcessIndex.find(f.mProcessId);
+    return tables.mProcesses[processSlot].FindChain(f.mSwapChainAddress);
+}
+
+// The grouping and lookups of AddPresents(); returns groups walked.
+uint64_t AddBatch(Tables& tables, std::vector<Frame> const& presents, std::vector<uint32_t>& order, Lookup lookup)
+{
+    auto count = (uint32_t) presents.size();
+    if (lookup == Lookup::PerPresent) {
+        for (auto const& p : presents) {
+            tables.mChainPresents[FindSlot(tables, p)] += 1;
+        }
+        return count;
+    }
+
+    order.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&presents](uint32_t a, uint32_t b) {
+        auto const& pa = presents[a];
+        auto const& pb = presents[b];
+        return pa.mProcessId != pb.mProcessId ? pa.mProcessId < pb.mProcessId : pa.mSwapChainAddress < pb.mSwapChainAddress;
+    });
+
+    uint64_t groups = 0;
+    for (uint32_t begin = 0, end = 0; begin < count; begin = end) {
+        auto const& first = presents[order[begin]];
+        for (end = begin + 1; end < count; ++end) {
+            auto const& p = presents[order[end]];
+            if (p.mProcessId != first.mProcessId || p.mSwapChainAddress != first.mSwapChainAddress) {
+                break;
+            }
+        }
+        auto chainSlot = lookup == Lookup::Cached ? first.mChainSlot : FindSlot(tables, first);
+        tables.mChainPresents[chainSlot] += end - begin;
+        ++groups;
+    }
+    return groups;
+}
+
+void BenchBatches(double batchMs)
+{
+    Tables tables;
+    auto batches = MakeBatches(&tables, batchMs);
+    uint64_t presentCount = 0;
+    for (auto const& b : batches) {
+        presentCount += b.size();
+    }
+
+    // The variants take turns so that they see the same machine noise.
+    std::vector<uint32_t> order;
+    double ns[3] = { 1e300, 1e300, 1e300 };
+    uint64_t groups = 0;
+    Lookup const lookups[] = { Lookup::PerSwapChain, Lookup::Cached, Lookup::PerPresent };
+    for (int run = 0; run < 3 * RUNS; ++run) {
+        for (int l = 0; l < 3; ++l) {
+            uint64_t g = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (auto const& b : batches) {
+                g += AddBatch(tables, b, order, lookups[l]);
+            }
+            ns[l] = std::min(ns[l], NsSince(start) / presentCount);
+            if (l == 0) {
+                groups = g;
+            }
+        }
+    }
+
+    printf("%5.0f ms batches, %5.1f presents/batch, %4.1f presents per swapchain lookup:\n",
+           batchMs, (double) presentCount / BATCHES, (double) presentCount / groups);
+    printf("    grouped, lookup per swapchain  %5.2f ns/present\n", ns[0]);
+    printf("    grouped, slot cached           %5.2f ns/present  (lookups %.2f ns/present)\n", ns[1], ns[0] - ns[1]);
+    printf("    ungrouped, lookup per present  %5.2f ns/present\n", ns[2]);
+}
+
+}
+
+int main()
+{
+    uint64_t const sizes[] = { 8, 64, 1024 };
+    for (auto size : sizes) {
+        BenchLookups("pids", size, 4, 1000);
+    }
+    for (auto size : sizes) {
+        BenchLookups("addresses", size, 0x1000, 0x1f0000000ull);
+    }
+    printf("\n");
+
+    BenchBatches(100.0);
+    BenchBatches(10.0);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// FlatIndex and SlotPool against std::unordered_map under random inserts,
+// erases and finds.  Keys are drawn from a small pool so most operations hit
+// existing or recently erased keys, and half the pool is chosen to share
+// home buckets at the end of the bucket array, so probe runs collide and
+// wrap to the start and erase has to shift entries back across the wrap.
+// Slots must be reused, most recently released first, with their values
+// reset.
+
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/Utils/inc/flat_table.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// FlatIndex's hash (the MurmurHash3 finalizer), to pick colliding keys.
+uint64_t Hash(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+// Keys whose home bucket is one of the last two or the first of any bucket
+// array up to 4096 long, so they pile up across the wrap at every size the
+// tests reach.
+std::vector<uint64_t> WrappingKeys(size_t count)
+{
+    std::vector<uint64_t> keys;
+    for (uint64_t k = 1; keys.size() < count; ++k) {
+        auto home = Hash(k) & 4095;
+        if (home >= 4094 || home == 0) {
+            keys.push_back(k);
+        }
+    }
+    return keys;
+}
+
+struct Value {
+    uint64_t key;
+    std::vector<uint32_t> owned; // must be freed on release
+};
+
+void TestSmallWrap()
+{
+    // Up to 8 keys stay in the initial 16 buckets, where these all have
+    // home bucket 14, 15 or 0: one run that wraps from the last bucket to
+    // the first.
+    auto keys = WrappingKeys(8);
+    FlatIndex index;
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+        index.insert(keys[i], i);
+    }
+    CHECK(index.size() == keys.size());
+
+    // Erase from the front of the run, the middle and the wrapped tail, and
+    // every remaining key must still be found.
+    uint32_t const eraseOrder[] = { 0, 5, 7, 2, 1, 6, 3, 4 };
+    std::vector<bool> erased(keys.size());
+    for (auto e : eraseOrder) {
+        index.erase(keys[e]);
+        erased[e] = true;
+        for (uint32_t i = 0; i < keys.size(); ++i) {
+            CHECK(index.find(keys[i]) == (erased[i] ? (uint32_t) NO_SLOT : i));
+        }
+        index.erase(keys[e]); // erasing a missing key is a no-op
+    }
+    CHECK(index.size() == 0);
+    CHECK(index.find(keys[0]) == NO_SLOT);
+}
+
+void TestRandomized(size_t poolSize, uint32_t seed)
+{
+    std::vector<uint64_t> keys = WrappingKeys(poolSize / 2);
+    std::mt19937_64 rng(seed);
+    while (keys.size() < poolSize) {
+        // Process-id- and address-like keys: small, and aligned.
+        keys.push_back(keys.size() % 2 ? (rng() & 0xfffc) : (rng() & ~0xfffull));
+    }
+
+    FlatIndex index;
+    SlotPool<Value> pool;
+    std::unordered_map<uint64_t, uint32_t> reference;
+    std::vector<uint32_t> released; // free slots, most recent last
+    uint32_t maxLive = 0;
+
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::uniform_int_distribution<int> op(0, 9);
+    for (int step = 0; step < 200000; ++step) {
+        auto key = keys[pick(rng)];
+        auto iter = reference.find(key);
+        auto r = op(rng);
+        if (r < 4) {
+            if (iter != reference.end()) {
+                continue;
+            }
+            auto slot = pool.acquire();
+            if (!released.empty()) {
+                CHECK(slot == released.back());
+                released.pop_back();
+            } else {
+                CHECK(slot == pool.slot_end() - 1);
+            }
+            CHECK(pool[slot].key == 0 && pool[slot].owned.empty());
+            pool[slot].key = key;
+            pool[slot].owned.assign(3, slot);
+            index.insert(key, slot);
+            reference[key] = slot;
+        } else if (r < 7) {
+            index.erase(key);
+            if (iter != reference.end()) {
+                pool.release(iter->second);
+                CHECK(!pool.in_use(iter->second));
+                CHECK(pool[iter->second].owned.empty());
+                released.push_back(iter->second);
+                reference.erase(iter);
+            }
+        } else {
+            auto slot = index.find(key);
+            if (iter == reference.end()) {
+                CHECK(slot == NO_SLOT);
+            } else {
+                CHECK(slot == iter->second);
+                CHECK(pool.in_use(slot) && pool[slot].key == key);
+            }
+        }
+
+        CHECK(index.size() == reference.size());
+        CHECK(pool.size() == reference.size());
+        maxLive = std::max(maxLive, (uint32_t) reference.size());
+
+        if (step % 10000 == 0) {
+            for (auto k : keys) {
+                auto i = reference.find(k);
+                CHECK(index.find(k) == (i == reference.end() ? (uint32_t) NO_SLOT : i->second));
+            }
+        }
+    }
+
+    // Slots are reused before the pool grows.
+    CHECK(pool.slot_end() == maxLive);
+    uint32_t inUse = 0;
+    for (uint32_t slot = 0; slot < pool.slot_end(); ++slot) {
+        inUse += pool.in_use(slot) ? 1 : 0;
+    }
+    CHECK(inUse == reference.size());
+
+    index.clear();
+    pool.clear();
+    CHECK(index.size() == 0 && pool.size() == 0 && pool.slot_end() == 0);
+    for (auto k : keys) {
+        CHECK(index.find(k) == NO_SLOT);
+    }
+    index.insert(keys[0], pool.acquire());
+    CHECK(index.find(keys[0]) == 0);
+}
+
+}
+
+int main()
+{
+    TestSmallWrap();
+    TestRandomized(16, 1);
+    TestRandomized(200, 2);
+    TestRandomized(3000, 3);
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
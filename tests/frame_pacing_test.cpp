@@ -0,0 +1,252 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// FramePacing against synthetic ScreenTimes on 60 Hz and 144 Hz vsync grids
+// with DPC jitter and missed vsyncs: the refresh period it infers, the vsync
+// counts, and the jitter.  Then the per-display refresh a PMTraceConsumer
+// keeps from VSyncDPC events: the 1/16 exponential average, vsyncs skipped
+// between DPCs, and the MAX_DISPLAYS bound.
+
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "PresentMonTraceConsumer.hpp"
+#include "TraceConsumer.hpp"
+#include "synthetic_capture.hpp"
+#include "../src/Utils/inc/frame_pacing.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+double const FREQUENCY = (double) synthetic::QPC_FREQUENCY;
+
+bool Near(double value, double expected, double relative)
+{
+    return fabs(value - expected) <= relative * expected;
+}
+
+// Displays frames on a refreshHz grid, each staying up for one vsync except
+// every missEvery-th, which stays up for two; ScreenTimes are off the grid
+// by up to jitterTicks either way.
+void TestVsyncGrid(double refreshHz, int64_t jitterTicks, uint32_t seed)
+{
+    auto period = FREQUENCY / refreshHz;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int64_t> jitter(-jitterTicks, jitterTicks);
+
+    FramePacing pacing;
+    CHECK(pacing.refreshPeriod() == 0.0);
+
+    int const FRAMES = 2000;
+    int const missEvery = 10;
+    uint64_t vsync = 1000;
+    uint64_t missed = 0;
+    for (int i = 0; i < FRAMES; ++i) {
+        uint32_t vsyncs = i % missEvery == missEvery - 1 ? 2 : 1;
+        vsync += vsyncs;
+        pacing.add((uint64_t) ((double) vsync * period) + jitter(rng), 1, false);
+        if (i > 0) {
+            CHECK(pacing.lastVsyncIntervals() == vsyncs);
+            missed += vsyncs - 1;
+        }
+    }
+
+    CHECK(Near(pacing.refreshPeriod(), period, 0.002));
+    CHECK(pacing.missedVsyncCount() == missed);
+    CHECK(Near(pacing.meanVsyncIntervals(), 1.0 + 1.0 / missEvery, 0.01));
+
+    // Interval changes alternate between ~0 and one period around the
+    // missed vsyncs; the average sits well inside that and above the DPC
+    // jitter alone.
+    CHECK(pacing.displayJitter() > (double) jitterTicks);
+    CHECK(pacing.displayJitter() < period);
+
+    pacing.clear();
+    CHECK(pacing.refreshPeriod() == 0.0);
+    CHECK(pacing.missedVsyncCount() == 0);
+    CHECK(pacing.meanVsyncIntervals() == 0.0);
+}
+
+void TestSyncIntervalAndTearing()
+{
+    auto period = FREQUENCY / 144.0;
+    FramePacing pacing;
+    uint64_t screenTime = 10000;
+
+    // Establish the period on single-vsync frames.
+    for (int i = 0; i < 50; ++i) {
+        screenTime += (uint64_t) period;
+        pacing.add(screenTime, 1, false);
+    }
+    auto missed = pacing.missedVsyncCount();
+
+    // SyncInterval 2 asks for two vsyncs per frame; only a third one misses.
+    screenTime += (uint64_t) (2 * period);
+    pacing.add(screenTime, 2, false);
+    CHECK(pacing.lastVsyncIntervals() == 2);
+    CHECK(pacing.missedVsyncCount() == missed);
+    screenTime += (uint64_t) (3 * period);
+    pacing.add(screenTime, 2, false);
+    CHECK(pacing.lastVsyncIntervals() == 3);
+    CHECK(pacing.missedVsyncCount() == missed + 1);
+
+    // Tearing flips aren't on the grid and leave the period alone.
+    auto estimate = pacing.refreshPeriod();
+    screenTime += (uint64_t) (0.37 * period);
+    pacing.add(screenTime, 0, true);
+    CHECK(pacing.lastVsyncIntervals() == 0);
+    CHECK(pacing.refreshPeriod() == estimate);
+    CHECK(pacing.missedVsyncCount() == missed + 1);
+
+    // A ScreenTime that doesn't advance is ignored.
+    pacing.add(screenTime, 1, false);
+    CHECK(pacing.refreshPeriod() == estimate);
+}
+
+void TestRefreshChange()
+{
+    // Every frame on every other vsync of a 60 Hz display reads as 30 Hz:
+    // nothing in the ScreenTimes tells the two apart.
+    auto period60 = FREQUENCY / 60.0;
+    FramePacing pacing;
+    uint64_t screenTime = 10000;
+    for (int i = 0; i < 100; ++i) {
+        screenTime += (uint64_t) (2 * period60);
+        pacing.add(screenTime, 1, false);
+    }
+    CHECK(Near(pacing.refreshPeriod(), 2 * period60, 0.001));
+    CHECK(pacing.lastVsyncIntervals() == 1);
+
+    // The first frame on consecutive vsyncs corrects it at once.
+    screenTime += (uint64_t) period60;
+    pacing.add(screenTime, 1, false);
+    CHECK(Near(pacing.refreshPeriod(), period60, 0.001));
+
+    // So does a switch to a faster display mode.
+    auto period144 = FREQUENCY / 144.0;
+    for (int i = 0; i < 100; ++i) {
+        screenTime += (uint64_t) period144;
+        pacing.add(screenTime, 1, false);
+    }
+    CHECK(Near(pacing.refreshPeriod(), period144, 0.001));
+    CHECK(pacing.lastVsyncIntervals() == 1);
+}
+
+// VSyncDPC as the synthetic capture lays it out, not tied to any flip.
+void VSyncDPC(PMTraceConsumer& consumer, uint32_t vidPnTargetId, uint32_t frameNumber, uint64_t frameQpc)
+{
+    synthetic::Event e = { DXGKRNL_PROVIDER_GUID, DxgKrnl_VSyncDPC, 0, 0, (int64_t) frameQpc };
+    e.Put<uint64_t>(0).Put<uint32_t>(vidPnTargetId).Put<uint64_t>(0).Put<uint32_t>(0).Put<uint32_t>(frameNumber)
+     .Put<uint64_t>(frameQpc).Put<uint64_t>(0).Put<uint32_t>(0).Put<uint64_t>(0);
+    auto record = synthetic::MakeRecord(e);
+    HandleDXGKEvent(&record, &consumer);
+}
+
+void TestDisplayRefresh()
+{
+    PMTraceConsumer consumer(false);
+    std::vector<DisplayRefresh> displays;
+
+    // The first DPC only sets a baseline, the second sets the period.
+    VSyncDPC(consumer, 3, 100, 1000000);
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays.size() == 1);
+    CHECK(displays[0].VidPnTargetId == 3 && displays[0].PeriodTicks == 0.0 && displays[0].VsyncCount == 0);
+
+    VSyncDPC(consumer, 3, 101, 1160000);
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays[0].PeriodTicks == 160000.0);
+    CHECK(displays[0].VsyncCount == 1);
+
+    // Later periods move the average 1/16 of the way...
+    VSyncDPC(consumer, 3, 102, 1160000 + 176000);
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays[0].PeriodTicks == 161000.0);
+
+    // ...with vsyncs between DPCs counted from FrameNumber.
+    VSyncDPC(consumer, 3, 106, 1336000 + 4 * 161000);
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays[0].PeriodTicks == 161000.0);
+    CHECK(displays[0].VsyncCount == 6);
+
+    // A FrameNumber that goes back (the counter reset) rebases without
+    // touching the period.
+    VSyncDPC(consumer, 3, 5, 3000000);
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays[0].PeriodTicks == 161000.0);
+    CHECK(displays[0].VsyncCount == 6);
+    CHECK(displays[0].LastFrameNumber == 5);
+
+    // A jittered 60 Hz stream converges on the true period.
+    auto period = FREQUENCY / 60.0;
+    std::mt19937 rng(60);
+    std::uniform_int_distribution<int64_t> jitter(-500, 500);
+    for (uint32_t frame = 6; frame < 1000; ++frame) {
+        VSyncDPC(consumer, 3, frame, 3000000 + (uint64_t) ((frame - 5) * period) + jitter(rng));
+    }
+    consumer.GetDisplayRefresh(displays);
+    CHECK(Near(displays[0].PeriodTicks, period, 0.001));
+
+    // Only the first MAX_DISPLAYS targets are tracked, reported by
+    // VidPnTargetId whatever order they were first seen in.
+    uint32_t const targets = PMTraceConsumer::MAX_DISPLAYS + 4;
+    for (uint32_t i = 0; i < targets; ++i) {
+        auto target = 100 + (i * 7) % targets;
+        VSyncDPC(consumer, target, 1, 5000000);
+        VSyncDPC(consumer, target, 2, 5000000 + 100000 + target);
+    }
+    consumer.GetDisplayRefresh(displays);
+    CHECK(displays.size() == PMTraceConsumer::MAX_DISPLAYS);
+    CHECK(consumer.mDisplays.size() == PMTraceConsumer::MAX_DISPLAYS);
+    for (size_t i = 1; i < displays.size(); ++i) {
+        CHECK(displays[i - 1].VidPnTargetId < displays[i].VidPnTargetId);
+    }
+    for (auto const& d : displays) {
+        CHECK(d.VidPnTargetId == 3 || d.PeriodTicks == 100000.0 + d.VidPnTargetId);
+    }
+}
+
+}
+
+int main()
+{
+    synthetic::SeedSchemas();
+
+    TestVsyncGrid(60.0, 200, 60);
+    TestVsyncGrid(144.0, 200, 144);
+    TestSyncIntervalAndTearing();
+    TestRefreshChange();
+    TestDisplayRefresh();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
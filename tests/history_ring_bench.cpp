@@ -0,0 +1,179 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times a swapchain's 2 s present history kept in a HistoryRing of
+// PresentSamples, pruned as SwapChainData prunes it, against the std::deque
+// of full frames it replaced.  64 swapchains
+// present round robin at 60, 144 and 1000 fps for 30 s; both histories hold
+// the same presents.  Heap allocations are counted through operator new.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SwapChainData.hpp"
+
+namespace {
+
+std::atomic<uint64_t> g_Allocations(0);
+
+}
+
+void* operator new(size_t size)
+{
+    ++g_Allocations;
+    if (auto p = malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+enum {
+    SWAPCHAIN_COUNT = 64,
+    SECONDS = 30,
+    HISTORY_TIME_MS = 2000,
+    RUNS = 3,
+};
+
+uint64_t const QPC_FREQUENCY = 10000000;
+
+struct Result {
+    double nsPerPresent;
+    double allocationsPerPresent;
+    size_t checksum;
+};
+
+// The pre-ring history: full frames, trimmed from the front one at a time
+// with a tick -> ms conversion per step.
+struct DequeHistory {
+    std::deque<CompletedFrame> history;
+
+    void Add(CompletedFrame const& p)
+    {
+        history.push_back(p);
+        while (!history.empty() &&
+               ((double) (history.back().QpcTime - history.front().QpcTime) / QPC_FREQUENCY) * 1000 > HISTORY_TIME_MS) {
+            history.pop_front();
+        }
+    }
+
+    size_t size() const { return history.size(); }
+};
+
+// The ring history as SwapChainData keeps it.
+struct RingHistory {
+    SwapChainData::History history;
+
+    RingHistory() : history(SwapChainData::MaxHistorySamples(SwapChainData::DEFAULT_HISTORY_BUDGET_KB)) {}
+
+    void Add(CompletedFrame const& p)
+    {
+        PresentSample sample;
+        sample.QpcTime = p.QpcTime;
+        sample.ScreenTime = p.ScreenTime;
+        sample.ReadyTime = p.ReadyTime;
+        sample.TimeTaken = p.TimeTaken;
+        sample.FinalState = p.FinalState;
+        history.push_back(sample);
+
+        auto maxTicks = QPC_FREQUENCY * HISTORY_TIME_MS / 1000;
+        auto newest = history.back().QpcTime;
+        size_t count = 0;
+        while (count < history.size() && newest - history[count].QpcTime > maxTicks) {
+            ++count;
+        }
+        history.pop_front(count);
+    }
+
+    size_t size() const { return history.size(); }
+};
+
+template <typename History>
+Result Time(uint32_t fps)
+{
+    uint64_t period = QPC_FREQUENCY / fps;
+    uint64_t presentCount = (uint64_t) fps * SECONDS * SWAPCHAIN_COUNT;
+
+    Result result = {};
+    for (int run = 0; run < RUNS; ++run) {
+        auto allocations = g_Allocations.load();
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<History> chains(SWAPCHAIN_COUNT);
+        CompletedFrame p = {};
+        p.FinalState = PresentResult::Presented;
+        size_t checksum = 0;
+        for (uint64_t i = 0; i < presentCount; ++i) {
+            auto chain = i % SWAPCHAIN_COUNT;
+            p.QpcTime = (i / SWAPCHAIN_COUNT) * period + chain * 7;
+            p.ScreenTime = p.QpcTime + period / 2;
+            p.TimeTaken = period / 10;
+            chains[chain].Add(p);
+            checksum += chains[chain].size();
+        }
+
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto nsPerPresent = ns / presentCount;
+        if (run == 0 || nsPerPresent < result.nsPerPresent) {
+            result.nsPerPresent = nsPerPresent;
+        }
+        result.allocationsPerPresent = (double) (g_Allocations.load() - allocations) / presentCount;
+        result.checksum = checksum;
+    }
+    return result;
+}
+
+}
+
+int main()
+{
+    printf("%u swapchains, %u s, %u ms window\n", SWAPCHAIN_COUNT, SECONDS, HISTORY_TIME_MS);
+    int failures = 0;
+    for (uint32_t fps : { 60, 144, 1000 }) {
+        auto deque = Time<DequeHistory>(fps);
+        auto ring = Time<RingHistory>(fps);
+        printf("%4u fps  deque: %6.2f ns/present %.4f allocs/present  ring: %6.2f ns/present %.4f allocs/present  %.2fx\n",
+               fps, deque.nsPerPresent, deque.allocationsPerPresent, ring.nsPerPresent, ring.allocationsPerPresent,
+               deque.nsPerPresent / ring.nsPerPresent);
+        if (deque.checksum != ring.checksum) {
+            printf("FAIL: at %u fps the histories held different presents\n", fps);
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
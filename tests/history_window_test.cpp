@@ -0,0 +1,183 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// The swapchain and late-stage reprojection windows must cover exactly their
+// history time at 30, 144 and 1000 FPS, and the averages kept over them
+// (SwapChainData's running sums, LateStageReprojectionData's runtime stats)
+// must match a walk of the window.
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include "LateStageReprojectionData.hpp"
+#include "SwapChainData.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+enum : uint32_t {
+    HISTORY_TIME_MS = 2000,
+    SECONDS = 10,
+};
+
+uint64_t const QPC_FREQUENCY = 10000000;
+
+bool Near(double a, double b)
+{
+    return fabs(a - b) <= 1e-9 * fabs(b);
+}
+
+// Deterministic jitter in [0, range).
+struct Jitter {
+    uint32_t x = 12345;
+
+    uint64_t Next(uint64_t range)
+    {
+        x = x * 1664525 + 1013904223;
+        return (x >> 8) % range;
+    }
+};
+
+uint64_t PresentTime(uint64_t i, uint32_t fps)
+{
+    return 1000000 + i * QPC_FREQUENCY / fps;
+}
+
+void CheckSwapChain(uint32_t fps)
+{
+    QpcClock clock(QPC_FREQUENCY);
+    SwapChainData chain;
+    chain.SetHistoryWindow(HISTORY_TIME_MS, SwapChainData::DEFAULT_HISTORY_BUDGET_KB);
+
+    Jitter jitter;
+    uint64_t period = QPC_FREQUENCY / fps;
+    uint64_t presentCount = (uint64_t) fps * SECONDS;
+    for (uint64_t i = 0; i < presentCount; ++i) {
+        CompletedFrame p = {};
+        p.QpcTime = PresentTime(i, fps);
+        p.ScreenTime = p.QpcTime + period + jitter.Next(period);
+        p.TimeTaken = period / 10 + jitter.Next(period / 10);
+        p.FinalState = PresentResult::Presented;
+        chain.AddPresentToSwapChain(p);
+        chain.UpdateSwapChainInfo(p, 0, clock);
+    }
+
+    // Both windows hold exactly HISTORY_TIME_MS of presents.
+    auto const& presents = chain.mPresentHistory;
+    auto const& displayed = chain.mDisplayedPresentHistory;
+    size_t expectedCount = (size_t) fps * HISTORY_TIME_MS / 1000 + 1;
+    CHECK(presents.size() == expectedCount);
+    CHECK(displayed.size() == expectedCount);
+    CHECK(presents.back().QpcTime - presents.front().QpcTime == QPC_FREQUENCY * HISTORY_TIME_MS / 1000);
+
+    // Averages against a walk of the window, which excludes the newest present.
+    uint64_t latency = 0;
+    for (size_t i = 0; i + 1 < displayed.size(); ++i) {
+        latency += displayed[i].ScreenTime - displayed[i].QpcTime;
+    }
+    uint64_t timeInPresent = 0;
+    for (size_t i = 0; i + 1 < presents.size(); ++i) {
+        timeInPresent += presents[i].TimeTaken;
+    }
+    auto n = (double) (presents.size() - 1);
+    auto windowSeconds = HISTORY_TIME_MS / 1000.0;
+    auto screenSeconds = clock.toSeconds(displayed.back().ScreenTime - displayed.front().ScreenTime);
+
+    CHECK(Near(chain.ComputeFps(clock), fps));
+    CHECK(Near(chain.ComputeDisplayedFps(clock), n / screenSeconds));
+    CHECK(Near(chain.ComputeLatency(clock), clock.toSeconds(latency) / n));
+    CHECK(Near(chain.ComputeCpuFrameTime(clock), (windowSeconds - clock.toSeconds(timeInPresent)) / n));
+
+    printf("swapchain %4u fps: %zu presents over %.3f s, %.3f fps, latency %.3f ms, cpu frame time %.3f ms\n",
+           fps, presents.size(), clock.toSeconds(presents.back().QpcTime - presents.front().QpcTime),
+           chain.ComputeFps(clock), chain.ComputeLatency(clock) * 1000.0, chain.ComputeCpuFrameTime(clock) * 1000.0);
+}
+
+void CheckLateStageReprojection(uint32_t fps)
+{
+    QpcClock clock(QPC_FREQUENCY);
+    LateStageReprojectionData lsr;
+    lsr.SetHistoryWindow(HISTORY_TIME_MS, 8192);
+
+    Jitter jitter;
+    uint64_t presentCount = (uint64_t) fps * SECONDS;
+    for (uint64_t i = 0; i < presentCount; ++i) {
+        EVENT_HEADER hdr = {};
+        hdr.TimeStamp.QuadPart = (LONGLONG) PresentTime(i, fps);
+        LateStageReprojectionEvent p(hdr);
+        p.NewSourceLatched = true;
+        p.FinalState = LateStageReprojectionResult::Presented;
+        p.GpuStartToGpuStopInMs = 1.0f + (float) jitter.Next(1000) / 1000.0f;
+        p.CopyStopToVsyncInMs = 0.5f + (float) jitter.Next(1000) / 2000.0f;
+        p.Completed = true;
+        lsr.AddLateStageReprojection(p);
+        lsr.UpdateLateStageReprojectionInfo(0, clock);
+    }
+
+    size_t expectedCount = (size_t) fps * HISTORY_TIME_MS / 1000 + 1;
+    CHECK(lsr.ComputeHistorySize() == expectedCount);
+    CHECK(lsr.mDisplayedLSRHistory.size() == expectedCount);
+    CHECK(lsr.mSourceHistory.size() == expectedCount);
+    CHECK(lsr.ComputeHistoryTime(clock) == HISTORY_TIME_MS / 1000.0);
+    CHECK(Near(lsr.ComputeFps(clock), fps));
+    CHECK(Near(lsr.ComputeDisplayedFps(clock), fps));
+    CHECK(Near(lsr.ComputeSourceFps(clock), fps));
+
+    double gpuExecution = 0.0;
+    double gpuExecutionMax = 0.0;
+    double gpuEndToVsync = 0.0;
+    for (auto const& e : lsr.mLSRHistory) {
+        gpuExecution += e.GpuStartToGpuStopInMs;
+        gpuExecutionMax = std::max<double>(gpuExecutionMax, e.GpuStartToGpuStopInMs);
+        gpuEndToVsync += e.CopyStopToVsyncInMs;
+    }
+    auto stats = lsr.ComputeRuntimeStats(clock);
+    CHECK(Near(stats.mGpuExecutionInMs.GetAverage(), gpuExecution / lsr.mLSRHistory.size()));
+    CHECK(stats.mGpuExecutionInMs.GetMax() == gpuExecutionMax);
+    CHECK(Near(stats.mGpuEndToVsyncInMs, gpuEndToVsync / lsr.mLSRHistory.size()));
+
+    printf("lsr       %4u fps: %zu LSRs over %.3f s, %.3f fps, gpu execution %.3f ms\n",
+           fps, lsr.ComputeHistorySize(), lsr.ComputeHistoryTime(clock), lsr.ComputeFps(clock),
+           stats.mGpuExecutionInMs.GetAverage());
+}
+
+}
+
+int main()
+{
+    for (uint32_t fps : { 30, 144, 1000 }) {
+        CheckSwapChain(fps);
+        CheckLateStageReprojection(fps);
+    }
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// LogHistogram quantiles must be within 0.8% of an exact sort, after adds
+// and after removes, and copy_changed_to() must keep a copy equal to the
+// histogram it is copied from.
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "../src/Utils/inc/log_histogram.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+double const PERCENTILES[] = { 0.0, 1.0, 5.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.9, 100.0 };
+double const MAX_ERROR = 0.008;
+
+// Smallest value such that at least q of the values are <= it.
+uint64_t ExactQuantile(std::vector<uint64_t> sorted, double q)
+{
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = (size_t) ceil(q * (double) sorted.size());
+    return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+double CheckQuantiles(LogHistogram const& histogram, std::vector<uint64_t> const& values)
+{
+    CHECK(histogram.count() == values.size());
+    double worst = 0.0;
+    for (auto percentile : PERCENTILES) {
+        auto exact = (double) ExactQuantile(values, percentile / 100.0);
+        auto error = fabs(histogram.quantile(percentile / 100.0) - exact) / exact;
+        CHECK(error <= MAX_ERROR);
+        worst = std::max(worst, error);
+    }
+    return worst;
+}
+
+// Frame times in QPC ticks (10 MHz), log-normal around 60 fps.
+void TestAgainstSort()
+{
+    std::mt19937_64 rng(1);
+    std::lognormal_distribution<double> frameTime(log(166666.0), 0.35);
+    std::vector<uint64_t> values(150000);
+    LogHistogram histogram;
+    for (auto& v : values) {
+        v = (uint64_t) frameTime(rng);
+        histogram.add(v);
+    }
+    auto worst = CheckQuantiles(histogram, values);
+
+    // Remove every other value, as samples leaving a window are.
+    std::vector<uint64_t> kept;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i % 2 == 0) {
+            histogram.remove(values[i]);
+        } else {
+            kept.push_back(values[i]);
+        }
+    }
+    worst = std::max(worst, CheckQuantiles(histogram, kept));
+    printf("%zu log-normal samples: worst quantile error %.3f%%\n", values.size(), 100.0 * worst);
+}
+
+void TestSmallValuesExact()
+{
+    LogHistogram histogram;
+    for (uint64_t v = 0; v < 128; ++v) {
+        histogram.add(v);
+    }
+    CHECK(histogram.quantile(0.0) == 0.0);
+    CHECK(histogram.quantile(0.5) == 63.0);
+    CHECK(histogram.quantile(1.0) == 127.0);
+}
+
+bool Same(LogHistogram const& a, LogHistogram const& b)
+{
+    if (a.count() != b.count()) {
+        return false;
+    }
+    for (int i = 0; i <= 1000; ++i) {
+        if (a.quantile(i / 1000.0) != b.quantile(i / 1000.0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TestCopyChanged()
+{
+    std::mt19937_64 rng(2);
+    std::uniform_int_distribution<uint64_t> value(0, 1000000);
+
+    // The copy starts out holding another histogram, like a published slot
+    // left over from a released chain.
+    LogHistogram copy;
+    for (int i = 0; i < 1000; ++i) {
+        copy.add(value(rng));
+    }
+
+    LogHistogram histogram;
+    std::vector<uint64_t> live;
+    for (int round = 0; round < 200; ++round) {
+        // A window sliding over a narrow band, with an outlier now and then.
+        auto base = 100000 + 500 * (uint64_t) round;
+        for (int i = 0; i < 20; ++i) {
+            auto v = (i == 0 && round % 10 == 0) ? value(rng) : base + value(rng) % 2000;
+            histogram.add(v);
+            live.push_back(v);
+        }
+        while (live.size() > 300) {
+            histogram.remove(live.front());
+            live.erase(live.begin());
+        }
+        histogram.copy_changed_to(&copy);
+        CHECK(Same(histogram, copy));
+    }
+
+    // Nothing changed: the copy stays equal.
+    histogram.copy_changed_to(&copy);
+    CHECK(Same(histogram, copy));
+}
+
+}
+
+int main()
+{
+    TestAgainstSort();
+    TestSmallValuesExact();
+    TestCopyChanged();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
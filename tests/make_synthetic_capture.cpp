@@ -0,0 +1,47 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Writes a synthetic capture (see synthetic_capture.hpp); used to produce
+// tests/data/synthetic_flips.pmcap:
+//
+//   make_synthetic_capture synthetic_flips.pmcap 3 1.0
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "synthetic_capture.hpp"
+
+int main(int argc, char** argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s path process_count seconds\n", argv[0]);
+        return 1;
+    }
+
+    auto count = synthetic::WriteCapture(argv[1], (uint32_t) atoi(argv[2]), atof(argv[3]));
+    if (count == 0) {
+        fprintf(stderr, "error: could not write %s\n", argv[1]);
+        return 1;
+    }
+    printf("%llu events\n", (unsigned long long) count);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times AnalyzeCapture() on 1, 4 and 16 threads over a synthetic capture of
+// 64 processes presenting for 30 seconds.
+
+#include <chrono>
+#include <stdio.h>
+
+#include "ParallelAnalysis.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+char const* const CAPTURE_PATH = "parallel_analysis_bench.pmcap";
+
+enum {
+    PROCESS_COUNT = 64,
+    SECONDS = 30,
+};
+
+}
+
+int main()
+{
+    auto eventCount = synthetic::WriteCapture(CAPTURE_PATH, PROCESS_COUNT, SECONDS);
+    if (eventCount == 0) {
+        fprintf(stderr, "error: could not write %s\n", CAPTURE_PATH);
+        return 1;
+    }
+    printf("%llu events, %u processes, %u s\n", (unsigned long long) eventCount, PROCESS_COUNT, SECONDS);
+
+    double serialMs = 0.0;
+    for (uint32_t threads : { 1u, 4u, 16u }) {
+        SwapChainFrames frames;
+        auto start = std::chrono::steady_clock::now();
+        auto ok = AnalyzeCapture(CAPTURE_PATH, threads, &frames);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!ok) {
+            fprintf(stderr, "error: could not analyze %s\n", CAPTURE_PATH);
+            return 1;
+        }
+        if (threads == 1) {
+            serialMs = ms;
+        }
+        printf("%2u threads: %8.1f ms  %.2fx  (%zu swapchains)\n", threads, ms, serialMs / ms, frames.size());
+    }
+
+    remove(CAPTURE_PATH);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// AnalyzeCapture() must give the serial result whatever the thread and
+// chunk counts, on the committed synthetic capture.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ParallelAnalysis.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+bool SameFrame(CompletedFrame const& a, CompletedFrame const& b)
+{
+    return a.QpcTime == b.QpcTime &&
+           a.SwapChainAddress == b.SwapChainAddress &&
+           a.TimeTaken == b.TimeTaken &&
+           a.ReadyTime == b.ReadyTime &&
+           a.ScreenTime == b.ScreenTime &&
+           a.ProcessId == b.ProcessId &&
+           a.SyncInterval == b.SyncInterval &&
+           a.PresentFlags == b.PresentFlags &&
+           a.PresentMode == b.PresentMode &&
+           a.FinalState == b.FinalState &&
+           a.Runtime == b.Runtime;
+}
+
+bool SameFrames(SwapChainFrames const& a, SwapChainFrames const& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (auto ii = a.begin(), jj = b.begin(); ii != a.end(); ++ii, ++jj) {
+        if (ii->first != jj->first || ii->second.size() != jj->second.size()) {
+            return false;
+        }
+        for (size_t k = 0; k < ii->second.size(); ++k) {
+            if (!SameFrame(ii->second[k], jj->second[k])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void TestSerial(char const* path, SwapChainFrames* serial)
+{
+    CHECK(AnalyzeCapture(path, 1, serial));
+
+    // 3 processes at 30, 47 and 64 presents per second for a second, one
+    // in seven occluded.
+    CHECK(serial->size() == 3);
+    size_t displayed = 0;
+    size_t discarded = 0;
+    for (auto const& ii : *serial) {
+        for (auto const& frame : ii.second) {
+            CHECK(frame.ProcessId == ii.first.first && frame.SwapChainAddress == ii.first.second);
+            if (frame.FinalState == PresentResult::Presented) {
+                CHECK(frame.PresentMode == PresentMode::Hardware_Legacy_Flip);
+                CHECK(frame.ScreenTime > frame.ReadyTime && frame.ReadyTime > frame.QpcTime);
+                displayed += 1;
+            } else {
+                CHECK(frame.FinalState == PresentResult::Discarded);
+                discarded += 1;
+            }
+        }
+    }
+    CHECK(displayed + discarded == 30 + 47 + 64);
+    CHECK(discarded == 4 + 6 + 9);
+}
+
+void TestParallel(char const* path, SwapChainFrames const& serial)
+{
+    for (uint32_t threads : { 2u, 4u, 16u }) {
+        SwapChainFrames parallel;
+        CHECK(AnalyzeCapture(path, threads, &parallel));
+        CHECK(SameFrames(serial, parallel));
+    }
+
+    // Short overlaps and many chunks cut through presents in flight; every
+    // present still completes within the overlap.
+    SwapChainFrames parallel;
+    CHECK(AnalyzeCapture(path, 4, &parallel, 0.01, 64));
+    CHECK(SameFrames(serial, parallel));
+
+    // With the Mixed Reality consumers added too (the capture has no MR
+    // events).
+    SwapChainFrames withMR;
+    LateStageReprojections lsrs;
+    CHECK(AnalyzeCapture(path, 4, &withMR, 2.0, 0, &lsrs));
+    CHECK(SameFrames(serial, withMR));
+    CHECK(lsrs.empty());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        printf("usage: %s capture\n", argv[0]);
+        return 1;
+    }
+
+    SwapChainFrames serial;
+    TestSerial(argv[1], &serial);
+    TestParallel(argv[1], serial);
+
+    SwapChainFrames missing;
+    CHECK(!AnalyzeCapture("no such capture", 4, &missing));
+
+    if (failures != 0) {
+        printf("FAIL: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times PMTraceConsumer's present state machine on replayed synthetic
+// captures (the format make_synthetic_capture writes): 64 processes flipping
+// fullscreen, whose presents never touch PresentEventCold, and the same with
+// 32 more composed through DWM, whose presents carry an Hwnd and token in it.
+// Each capture is loaded once and replayed RUNS times from memory through
+// EventReplayer into a fresh consumer, draining completed presents as
+// PresentMon does; ns/event is the best run.  Where Linux perf counters are
+// available, last-level cache misses per event are reported too.
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "synthetic_capture.hpp"
+
+namespace {
+
+enum {
+    FLIP_PROCESS_COUNT = 64,
+    COMPOSED_PROCESS_COUNT = 32,
+    SECONDS = 10,
+    RUNS = 5,
+    DRAIN_INTERVAL = 4096,          // events between DequeuePresents()
+};
+
+char const* const CAPTURE_PATH = "present_state_bench.pmcap";
+
+// Hardware cache-miss counter for this thread; Read() returns UINT64_MAX
+// where it can't be opened (not Linux, no PMU, perf_event_paranoid).
+class CacheMissCounter {
+public:
+    CacheMissCounter()
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        mFd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (mFd >= 0) {
+            close(mFd);
+        }
+#endif
+    }
+
+    void Start()
+    {
+#ifdef __linux__
+        if (mFd >= 0) {
+            ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t Read()
+    {
+#ifdef __linux__
+        uint64_t count = 0;
+        if (mFd >= 0 && ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(mFd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+#endif
+        return UINT64_MAX;
+    }
+
+private:
+    int mFd = -1;
+};
+
+struct IndexedEvent {
+    EventCaptureEvent Event;
+    void const* UserData;
+};
+
+struct Result {
+    double nsPerEvent;
+    double missesPerEvent;          // < 0 if not available
+    size_t presentCount;
+};
+
+Result Replay(EventCaptureReader const& reader, std::vector<IndexedEvent> const& events)
+{
+    Result best = { 0.0, -1.0, 0 };
+    std::vector<CompletedFrame> presents;
+    CacheMissCounter counter;
+    for (int run = 0; run < RUNS; ++run) {
+        PMTraceConsumer pmConsumer(false);
+        EventReplayer replayer;
+        replayer.AddHandler(DXGI_PROVIDER_GUID, (ReplayHandlerFn) &HandleDXGIEvent, &pmConsumer);
+        replayer.AddHandler(DXGKRNL_PROVIDER_GUID, (ReplayHandlerFn) &HandleDXGKEvent, &pmConsumer);
+        replayer.AddHandler(WIN32K_PROVIDER_GUID, (ReplayHandlerFn) &HandleWin32kEvent, &pmConsumer);
+
+        size_t presentCount = 0;
+        counter.Start();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < events.size(); ++i) {
+            replayer.ReplayEvent(reader, events[i].Event, events[i].UserData);
+            if (i % DRAIN_INTERVAL == DRAIN_INTERVAL - 1) {
+                presents.clear();
+                pmConsumer.DequeuePresents(presents);
+                presentCount += presents.size();
+            }
+        }
+        presents.clear();
+        pmConsumer.DequeuePresents(presents);
+        presentCount += presents.size();
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        auto misses = counter.Read();
+
+        auto nsPerEvent = ns / events.size();
+        if (run == 0 || nsPerEvent < best.nsPerEvent) {
+            best.nsPerEvent = nsPerEvent;
+            best.missesPerEvent = misses == UINT64_MAX ? -1.0 : (double) misses / events.size();
+        }
+        best.presentCount = presentCount;
+    }
+    return best;
+}
+
+bool Run(char const* name, uint32_t composedProcessCount)
+{
+    if (synthetic::WriteCapture(CAPTURE_PATH, FLIP_PROCESS_COUNT, SECONDS, composedProcessCount) == 0) {
+        fprintf(stderr, "error: could not write %s\n", CAPTURE_PATH);
+        return false;
+    }
+
+    EventCaptureReader reader;
+    if (!reader.Open(CAPTURE_PATH)) {
+        fprintf(stderr, "error: could not read %s\n", CAPTURE_PATH);
+        return false;
+    }
+    std::vector<IndexedEvent> events;
+    EventCaptureEvent const* event;
+    void const* userData;
+    while (reader.Next(&event, &userData)) {
+        events.push_back({ *event, userData });
+    }
+    remove(CAPTURE_PATH);
+
+    auto result = Replay(reader, events);
+    printf("%-9s %7zu events  %6zu presents  %6.1f ns/event", name, events.size(), result.presentCount, result.nsPerEvent);
+    if (result.missesPerEvent >= 0.0) {
+        printf("  %5.2f cache misses/event\n", result.missesPerEvent);
+    } else {
+        printf("  (cache miss counter not available)\n");
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    printf("sizeof(PresentEvent) %zu, sizeof(PresentEventCold) %zu\n", sizeof(PresentEvent), sizeof(PresentEventCold));
+    auto ok = Run("flip", 0);
+    ok = Run("composed", COMPOSED_PROCESS_COUNT) && ok;
+    return ok ? 0 : 1;
+}
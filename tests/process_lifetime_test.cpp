@@ -0,0 +1,247 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// ProcessLifetimeTracker against synthetic starts and ends: id reuse, ends
+// for earlier instances, and batches applied out of order.  Then the process
+// events a PMTraceConsumer queues when both the NT process events and
+// Kernel-Process report the same processes, which must start each process
+// once rather than make it look reused.
+
+#include <stdio.h>
+#include <vector>
+
+#include "PresentMonTraceConsumer.hpp"
+#include "TraceConsumer.hpp"
+#include "synthetic_capture.hpp"
+#include "../src/PresentMon/ProcessLifetimeTracker.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+typedef ProcessLifetimeTracker::StartResult StartResult;
+
+void TestStartStop()
+{
+    ProcessLifetimeTracker lifetimes;
+
+    CHECK(lifetimes.Start(10, 100) == StartResult::New);
+    CHECK(lifetimes.Start(10, 100) == StartResult::Duplicate);
+    CHECK(lifetimes.IsConfirmed(10));
+    CHECK(lifetimes.Find(10)->mStartTime == 100);
+
+    // A start for a live id: the end of the first instance was lost.
+    CHECK(lifetimes.Start(10, 200) == StartResult::Reused);
+    CHECK(lifetimes.Find(10)->mStartTime == 200);
+
+    // The late end of the first instance leaves the second alone...
+    CHECK(!lifetimes.Stop(10, 150));
+    CHECK(lifetimes.Find(10) != nullptr);
+    // ...and the second's own end removes it.
+    CHECK(lifetimes.Stop(10, 250));
+    CHECK(lifetimes.Find(10) == nullptr);
+
+    // Nothing tracked: nothing to keep alive.
+    CHECK(lifetimes.Stop(11, 300));
+    CHECK(lifetimes.Size() == 0);
+}
+
+void TestBatchOrder()
+{
+    // Instance A of id 20 runs 100..200 and instance B starts at 300; the
+    // same batch gives the same result whether its ends or starts go first.
+    ProcessLifetimeTracker startsFirst;
+    CHECK(startsFirst.Start(20, 100) == StartResult::New);
+    CHECK(startsFirst.Start(20, 300) == StartResult::Reused);
+    CHECK(!startsFirst.Stop(20, 200));
+
+    ProcessLifetimeTracker endsFirst;
+    CHECK(endsFirst.Start(20, 100) == StartResult::New);
+    CHECK(endsFirst.Stop(20, 200));
+    CHECK(endsFirst.Start(20, 300) == StartResult::New);
+
+    CHECK(startsFirst.Find(20) != nullptr && startsFirst.Find(20)->mStartTime == 300);
+    CHECK(endsFirst.Find(20) != nullptr && endsFirst.Find(20)->mStartTime == 300);
+}
+
+void TestObserveAndConfirm()
+{
+    ProcessLifetimeTracker lifetimes;
+
+    // Seen by its presents first: tracked, but unconfirmed until polled.
+    lifetimes.Observe(30);
+    CHECK(lifetimes.Find(30) != nullptr && lifetimes.Find(30)->mStartTime == 0);
+    CHECK(!lifetimes.IsConfirmed(30));
+    lifetimes.Confirm(30);
+    CHECK(lifetimes.IsConfirmed(30));
+
+    // Observe() doesn't downgrade a process with a start event.
+    CHECK(lifetimes.Start(31, 500) == StartResult::New);
+    lifetimes.Observe(31);
+    CHECK(lifetimes.IsConfirmed(31) && lifetimes.Find(31)->mStartTime == 500);
+
+    // Once events are lost nothing is confirmed, but the starts are kept.
+    lifetimes.EventsLost();
+    CHECK(!lifetimes.IsConfirmed(30));
+    CHECK(!lifetimes.IsConfirmed(31));
+    CHECK(lifetimes.Start(31, 500) == StartResult::Duplicate);
+
+    lifetimes.Remove(30);
+    CHECK(lifetimes.Find(30) == nullptr);
+    CHECK(lifetimes.Size() == 1);
+}
+
+// A classic NT process event (MOF, so told apart by opcode) with the fields
+// read.
+EVENT_RECORD NTProcessRecord(synthetic::Event& e, uint8_t opcode, uint32_t processId, char const* imageFileName)
+{
+    e = synthetic::Event{ NT_PROCESS_EVENT_GUID, 0, 4, 8, 0 };
+    e.Put<uint32_t>(processId);
+    do {
+        e.Put<char>(*imageFileName);
+    } while (*imageFileName++ != 0);
+
+    auto record = synthetic::MakeRecord(e);
+    record.EventHeader.EventDescriptor.Opcode = opcode;
+
+    EventSchema schema;
+    schema.AddField(L"ProcessId", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"ImageFileName", EventSchema::FieldKind::AnsiString, 0);
+    SeedEventSchema(GetEventSchemaKey(&record), schema, L"Process");
+    return record;
+}
+
+// Microsoft-Windows-Kernel-Process ProcessStart/ProcessStop, trimmed to the
+// fields read.
+EVENT_RECORD KernelProcessRecord(synthetic::Event& e, uint16_t id, uint32_t processId, char const* imageName)
+{
+    e = synthetic::Event{ KERNEL_PROCESS_PROVIDER_GUID, id, 4, 8, 0 };
+    e.Put<uint32_t>(processId);
+    do {
+        e.Put<uint16_t>((uint16_t) *imageName);
+    } while (*imageName++ != 0);
+
+    EventSchema schema;
+    schema.AddField(L"ProcessID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"ImageName", EventSchema::FieldKind::UnicodeString, 0);
+    auto record = synthetic::MakeRecord(e);
+    SeedEventSchema(GetEventSchemaKey(&record), schema, id == KernelProcess_ProcessStart ? L"ProcessStart" : L"ProcessStop");
+    return record;
+}
+
+// Applies the consumer's queued process events to lifetimes the way
+// PresentMon does, counting starts by result.
+void ApplyProcessEvents(PMTraceConsumer& consumer, ProcessLifetimeTracker& lifetimes, int* newCount, int* reusedCount, int* stopCount)
+{
+    std::vector<NTProcessEvent> events;
+    consumer.DequeueProcessEvents(events);
+    for (auto const& e : events) {
+        if (e.ImageFileName.empty()) {
+            *stopCount += lifetimes.Stop(e.ProcessId, e.Timestamp) ? 1 : 0;
+            continue;
+        }
+        switch (lifetimes.Start(e.ProcessId, e.Timestamp)) {
+        case StartResult::New:       *newCount += 1; break;
+        case StartResult::Reused:    *reusedCount += 1; break;
+        case StartResult::Duplicate: break;
+        }
+    }
+}
+
+void TestBothProviders(bool ntFirst)
+{
+    PMTraceConsumer consumer(false);
+    ProcessLifetimeTracker lifetimes;
+    synthetic::Event storage;
+
+    // Processes 40..42 start and then end; each is reported by both
+    // providers, a little apart, in either order.
+    for (uint32_t pid = 40; pid < 43; ++pid) {
+        for (int i = 0; i < 2; ++i) {
+            auto nt = (i == 0) == ntFirst;
+            auto record = nt
+                ? NTProcessRecord(storage, EVENT_TRACE_TYPE_START, pid, "game.exe")
+                : KernelProcessRecord(storage, KernelProcess_ProcessStart, pid, "\\Device\\HarddiskVolume1\\game.exe");
+            record.EventHeader.TimeStamp.QuadPart = pid * 1000 + i;
+            if (nt) {
+                HandleNTProcessEvent(&record, &consumer);
+            } else {
+                HandleKernelProcessEvent(&record, &consumer);
+            }
+        }
+    }
+
+    int newCount = 0, reusedCount = 0, stopCount = 0;
+    ApplyProcessEvents(consumer, lifetimes, &newCount, &reusedCount, &stopCount);
+    CHECK(newCount == 3);
+    CHECK(reusedCount == 0);
+
+    for (uint32_t pid = 40; pid < 43; ++pid) {
+        for (int i = 0; i < 2; ++i) {
+            auto nt = (i == 0) != ntFirst;
+            auto record = nt
+                ? NTProcessRecord(storage, EVENT_TRACE_TYPE_END, pid, "")
+                : KernelProcessRecord(storage, KernelProcess_ProcessStop, pid, "");
+            record.EventHeader.TimeStamp.QuadPart = pid * 1000 + 500 + i;
+            if (nt) {
+                HandleNTProcessEvent(&record, &consumer);
+            } else {
+                HandleKernelProcessEvent(&record, &consumer);
+            }
+        }
+    }
+
+    // Each end is applied once, and the process is gone.
+    ApplyProcessEvents(consumer, lifetimes, &newCount, &reusedCount, &stopCount);
+    CHECK(stopCount == 3);
+    CHECK(lifetimes.Size() == 0);
+
+    // The NT rundown is used whichever provider reports the live events.
+    auto record = NTProcessRecord(storage, EVENT_TRACE_TYPE_DC_START, 50, "dwm.exe");
+    record.EventHeader.TimeStamp.QuadPart = 60000;
+    HandleNTProcessEvent(&record, &consumer);
+    ApplyProcessEvents(consumer, lifetimes, &newCount, &reusedCount, &stopCount);
+    CHECK(newCount == 4);
+    CHECK(lifetimes.Find(50) != nullptr);
+    CHECK(consumer.mDwmProcessId == 50);
+}
+
+}
+
+int main()
+{
+    TestStartStop();
+    TestBatchOrder();
+    TestObserveAndConfirm();
+    TestBothProviders(true);
+    TestBothProviders(false);
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// ProcessNameCache against a mock QueryFn: lookups queue background queries
+// and return what is cached meanwhile, failed queries are retried only after
+// NEGATIVE_TTL_MS, and names from the process events win over queries that
+// were still in flight.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#include "../src/PresentMon/ProcessNameCache.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// The mock knows pids below 100 as running "pid<N>.exe" and fails the rest.
+// While gQueryGate is held, queries block, so a test can act while one is
+// in flight.
+std::atomic<int> gQueryCount(0);
+std::mutex gQueryGate;
+
+bool MockQuery(uint32_t processId, ProcessNameCache::Info* info)
+{
+    std::lock_guard<std::mutex> gate(gQueryGate);
+    gQueryCount.fetch_add(1);
+    if (processId >= 100) {
+        return false;
+    }
+    info->mImageFileName = "pid" + std::to_string(processId) + ".exe";
+    info->mRunning = true;
+    return true;
+}
+
+// Calls Get() until it returns info updated at or after sinceMs.
+bool WaitForInfo(ProcessNameCache& cache, uint32_t processId, uint64_t now, uint64_t sinceMs, ProcessNameCache::Info* info)
+{
+    for (int i = 0; i < 5000; ++i) {
+        if (cache.Get(processId, now, 1000000, info) && info->mUpdatedMs >= sinceMs) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+void TestQuery()
+{
+    gQueryCount = 0;
+    ProcessNameCache cache(&MockQuery);
+    ProcessNameCache::Info info;
+
+    // The first lookup only queues a query.
+    CHECK(!cache.Get(7, 10, 1000, &info));
+    CHECK(WaitForInfo(cache, 7, 10, 10, &info));
+    CHECK(info.mFound && info.mRunning);
+    CHECK(info.mImageFileName == "pid7.exe");
+    CHECK(info.mUpdatedMs == 10);
+    CHECK(gQueryCount == 1);
+
+    // Fresh info is returned without another query; stale info is still
+    // returned while a refresh is queued.
+    CHECK(cache.Get(7, 500, 1000, &info) && info.mUpdatedMs == 10);
+    CHECK(gQueryCount == 1);
+    CHECK(cache.Get(7, 2000, 1000, &info) && info.mUpdatedMs == 10);
+    CHECK(WaitForInfo(cache, 7, 2000, 2000, &info));
+    CHECK(gQueryCount == 2);
+}
+
+void TestNegativeTtl()
+{
+    gQueryCount = 0;
+    ProcessNameCache cache(&MockQuery);
+    ProcessNameCache::Info info;
+
+    CHECK(!cache.Get(200, 0, 10, &info));
+    CHECK(WaitForInfo(cache, 200, 0, 0, &info));
+    CHECK(!info.mFound);
+    CHECK(gQueryCount == 1);
+
+    // A failed query isn't repeated before NEGATIVE_TTL_MS even if the
+    // caller asks for fresher info...
+    CHECK(cache.Get(200, ProcessNameCache::NEGATIVE_TTL_MS, 10, &info) && !info.mFound);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(gQueryCount == 1);
+
+    // ...but is after.
+    uint64_t later = ProcessNameCache::NEGATIVE_TTL_MS + 1;
+    CHECK(cache.Get(200, later, 10, &info));
+    CHECK(WaitForInfo(cache, 200, later, later, &info));
+    CHECK(gQueryCount == 2);
+}
+
+void TestSetAndRemove()
+{
+    gQueryCount = 0;
+    ProcessNameCache cache(&MockQuery);
+    ProcessNameCache::Info info;
+
+    // A name from a start event needs no query.
+    cache.Set(8, "started.exe", 100);
+    CHECK(cache.Get(8, 200, 1000, &info));
+    CHECK(info.mFound && info.mRunning && info.mImageFileName == "started.exe");
+    CHECK(info.mUpdatedMs == 100);
+
+    // A start event arriving while a query is in flight wins, and a later
+    // stale lookup queues a new query rather than waiting on the dropped one.
+    {
+        std::lock_guard<std::mutex> gate(gQueryGate);
+        CHECK(!cache.Get(9, 300, 1000, &info));
+        cache.Set(9, "started9.exe", 310);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(cache.Get(9, 320, 1000, &info) && info.mImageFileName == "started9.exe");
+    auto queries = gQueryCount.load();
+    CHECK(cache.Get(9, 5000, 1000, &info) && info.mImageFileName == "started9.exe");
+    CHECK(WaitForInfo(cache, 9, 5000, 5000, &info));
+    CHECK(info.mImageFileName == "pid9.exe");
+    CHECK(gQueryCount == queries + 1);
+
+    // Removed processes are forgotten, and a query in flight for one is
+    // discarded.
+    cache.Remove(8);
+    {
+        std::lock_guard<std::mutex> gate(gQueryGate);
+        CHECK(!cache.Get(8, 6000, 1000, &info));
+        cache.Remove(8);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!cache.Get(8, 6000, 1000, &info));
+    CHECK(WaitForInfo(cache, 8, 6000, 6000, &info));
+}
+
+}
+
+int main()
+{
+    TestQuery();
+    TestNegativeTtl();
+    TestSetAndRemove();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
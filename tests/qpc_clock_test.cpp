@@ -0,0 +1,201 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// QpcClock::toNs must match an exact integer reference to within a
+// nanosecond for common counter frequencies over a week of ticks (and to
+// within rounding over the whole 64-bit nanosecond range), toUnixNs must be
+// symmetric about the anchor, and re-anchoring must never make a later QPC
+// value convert to an earlier time.
+//
+// Built twice: once with the native 64x64->128 multiply and once with
+// QPC_CLOCK_PORTABLE_MULSHIFT to cover the 32-bit fallback.
+
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../src/Utils/inc/qpc_clock.h"
+
+#if defined(QPC_CLOCK_PORTABLE_MULSHIFT) && (defined(QPC_CLOCK_UMUL128) || defined(QPC_CLOCK_INT128))
+#error QPC_CLOCK_PORTABLE_MULSHIFT did not select the portable multiply
+#endif
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+uint64_t const NS_PER_SECOND = 1000000000ull;
+uint64_t const SECONDS_PER_WEEK = 7ull * 24 * 60 * 60;
+
+// 10 MHz is the usual QPC rate on current Windows, 3.579545 MHz the ACPI PM
+// timer, 2.4 GHz a raw TSC, and 1 Hz the extreme of a coarse counter.
+uint64_t const FREQUENCIES[] = { 10000000ull, 3579545ull, 2400000000ull, 1ull };
+
+// floor(ticks * 1e9 / frequency) without 128-bit arithmetic: the remainder
+// term is below frequency * 1e9, which fits in 64 bits for every frequency
+// above.  Valid while the result itself fits in 64 bits.
+uint64_t ExactNs(uint64_t ticks, uint64_t frequency)
+{
+    return (ticks / frequency) * NS_PER_SECOND + (ticks % frequency) * NS_PER_SECOND / frequency;
+}
+
+uint64_t AbsDiff(uint64_t a, uint64_t b)
+{
+    return a >= b ? a - b : b - a;
+}
+
+void TestToNs()
+{
+    std::mt19937_64 rng(39);
+    for (auto frequency : FREQUENCIES) {
+        QpcClock clock(frequency);
+        CHECK(clock.getFrequency() == frequency);
+
+        uint64_t week = SECONDS_PER_WEEK * frequency;
+        uint64_t edges[] = {
+            0, 1, 2, frequency - 1, frequency, frequency + 1,
+            60 * frequency + 1, 3600 * frequency - 1, week - 1, week,
+        };
+        uint64_t worst = 0;
+        for (auto ticks : edges) {
+            worst = std::max(worst, AbsDiff(clock.toNs(ticks), ExactNs(ticks, frequency)));
+        }
+        std::uniform_int_distribution<uint64_t> inWeek(0, week);
+        for (int i = 0; i < 100000; ++i) {
+            auto ticks = inWeek(rng);
+            worst = std::max(worst, AbsDiff(clock.toNs(ticks), ExactNs(ticks, frequency)));
+        }
+        CHECK(worst <= 1);
+
+        // Frequencies dividing 1e9 have an exact multiplier.
+        if (NS_PER_SECOND % frequency == 0) {
+            for (int i = 0; i < 1000; ++i) {
+                auto ticks = inWeek(rng);
+                CHECK(clock.toNs(ticks) == ExactNs(ticks, frequency));
+            }
+        }
+
+        // Across the whole range where the result fits in 64 bits, which
+        // exercises the high words of the multiply.
+        uint64_t maxTicks = frequency >= NS_PER_SECOND
+            ? UINT64_MAX / 2
+            : (UINT64_MAX / 2) / (NS_PER_SECOND / frequency + 1);
+        std::uniform_int_distribution<uint64_t> inRange(0, maxTicks);
+        for (int i = 0; i < 100000; ++i) {
+            auto ticks = inRange(rng);
+            CHECK(AbsDiff(clock.toNs(ticks), ExactNs(ticks, frequency)) <= 2);
+        }
+
+        // The double scale agrees with the integer conversion.
+        auto ms = (double) week * clock.msPerTick();
+        CHECK(fabs(ms - clock.toMs(week)) <= 1e-9 * ms);
+    }
+}
+
+void TestToUnixNs()
+{
+    QpcClock clock(3579545);
+    CHECK(!clock.isAnchored());
+
+    uint64_t const anchorQpc = 10000000000000ull;
+    int64_t const anchorUnixNs = 1700000000000000000ll;
+    clock.anchor(anchorQpc, anchorUnixNs);
+    CHECK(clock.isAnchored());
+    CHECK(clock.toUnixNs(anchorQpc) == anchorUnixNs);
+    CHECK(clock.toUnixNs(anchorQpc + 3579545) == anchorUnixNs + (int64_t) NS_PER_SECOND);
+    CHECK(clock.toUnixNs(anchorQpc - 3579545) == anchorUnixNs - (int64_t) NS_PER_SECOND);
+    CHECK(clock.toUnixSeconds(anchorQpc + 3579545) == (double) (anchorUnixNs + (int64_t) NS_PER_SECOND) * 1e-9);
+
+    // Both sides are the same distance from the anchor, and ordered.
+    std::mt19937_64 rng(3579545);
+    std::uniform_int_distribution<uint64_t> delta(0, SECONDS_PER_WEEK * 3579545);
+    for (int i = 0; i < 10000; ++i) {
+        auto d = delta(rng);
+        auto after = clock.toUnixNs(anchorQpc + d);
+        auto before = clock.toUnixNs(anchorQpc - d);
+        CHECK(after - anchorUnixNs == (int64_t) clock.toNs(d));
+        CHECK(anchorUnixNs - before == (int64_t) clock.toNs(d));
+        CHECK(before <= anchorUnixNs && anchorUnixNs <= after);
+    }
+}
+
+void TestReanchor()
+{
+    uint64_t const frequency = 10000000;
+    QpcClock clock(frequency);
+    clock.anchor(5000000, 1700000000000000000ll);
+
+    // Forward corrections are taken.
+    auto ahead = clock.toUnixNs(15000000) + 3000000;
+    clock.anchor(15000000, ahead);
+    CHECK(clock.toUnixNs(15000000) == ahead);
+
+    // A backward step is held at the extrapolation...
+    auto extrapolated = clock.toUnixNs(25000000);
+    clock.anchor(25000000, extrapolated - 5000000);
+    CHECK(clock.toUnixNs(25000000) == extrapolated);
+
+    // ...and so is a system clock running slow against QPC: convert a steady
+    // stream of timestamps, some arriving after the anchor that follows them,
+    // and re-anchor every second to a system time that loses 100us a second
+    // with occasional 1ms backward steps.
+    std::mt19937_64 rng(10);
+    std::uniform_int_distribution<uint64_t> late(0, frequency / 100);
+    uint64_t qpc = 30000000;
+    int64_t systemNs = clock.toUnixNs(qpc);
+    int64_t lastNs = systemNs;
+    uint64_t nextAnchor = qpc + frequency;
+    for (int i = 0; i < 200000; ++i) {
+        qpc += frequency / 1000 + late(rng) / 100;
+        if (qpc >= nextAnchor) {
+            systemNs += (int64_t) NS_PER_SECOND - 100000 - (nextAnchor % 7 == 0 ? 1000000 : 0);
+            clock.anchor(nextAnchor, systemNs);
+            nextAnchor += frequency;
+        }
+        auto ns = clock.toUnixNs(qpc);
+        CHECK(ns >= lastNs);
+        lastNs = ns;
+
+        // A timestamp from before the latest anchor, converted after it.
+        auto earlier = qpc - late(rng);
+        CHECK(clock.toUnixNs(earlier) <= ns);
+    }
+}
+
+}
+
+int main()
+{
+    TestToNs();
+    TestToUnixNs();
+    TestReanchor();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
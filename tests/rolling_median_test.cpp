@@ -0,0 +1,175 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// RollingMedian must agree with sorting the last N values pushed, including
+// after the window wraps and with duplicate values (where push() has to find
+// and remove exactly one copy of the oldest), and recent(i) must return the
+// values newest first.  IsHitch() must hold back until HITCH_MIN_INTERVALS
+// intervals have been seen and apply the factor and margin independently.
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "../src/Utils/inc/rolling_median.h"
+#include "../src/PresentMon/HitchDetector.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// Upper median, as RollingMedian defines it.
+uint64_t ReferenceMedian(std::deque<uint64_t> const& window)
+{
+    std::vector<uint64_t> sorted(window.begin(), window.end());
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[sorted.size() / 2];
+}
+
+template <size_t N>
+void CheckAgainstReference(uint64_t maxValue, uint32_t seed)
+{
+    RollingMedian<uint64_t, N> median;
+    std::deque<uint64_t> window;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint64_t> value(0, maxValue);
+
+    CHECK(median.size() == 0);
+    CHECK(median.median() == 0);
+
+    for (size_t i = 0; i < 20 * N; ++i) {
+        auto v = value(rng);
+        median.push(v);
+        window.push_back(v);
+        if (window.size() > N) {
+            window.pop_front();
+        }
+
+        CHECK(median.size() == window.size());
+        CHECK(median.median() == ReferenceMedian(window));
+        for (size_t j = 0; j < window.size(); ++j) {
+            CHECK(median.recent(j) == window[window.size() - 1 - j]);
+        }
+    }
+
+    median.clear();
+    CHECK(median.size() == 0);
+    median.push(maxValue + 1);
+    CHECK(median.size() == 1);
+    CHECK(median.median() == maxValue + 1);
+    CHECK(median.recent(0) == maxValue + 1);
+}
+
+void TestRollingMedian()
+{
+    // Wide values, then a handful of distinct values so most pushes evict
+    // one of several equal entries.
+    CheckAgainstReference<31>(1000000, 1);
+    CheckAgainstReference<31>(3, 2);
+    CheckAgainstReference<8>(1, 3);
+    CheckAgainstReference<1>(5, 4);
+
+    // All equal, then a change that must take over once half the window has
+    // seen it.
+    RollingMedian<uint64_t, 5> median;
+    for (int i = 0; i < 12; ++i) {
+        median.push(7);
+    }
+    CHECK(median.median() == 7);
+    median.push(9);
+    median.push(9);
+    CHECK(median.median() == 7);
+    median.push(9);
+    CHECK(median.median() == 9);
+    CHECK(median.recent(0) == 9 && median.recent(2) == 9 && median.recent(3) == 7);
+}
+
+void TestHitchGating()
+{
+    // Not judged until HITCH_MIN_INTERVALS intervals, or against a zero median.
+    CHECK(!IsHitch(100.0, 16.7, HITCH_MIN_INTERVALS - 1, 2.0, 0.0));
+    CHECK(IsHitch(100.0, 16.7, HITCH_MIN_INTERVALS, 2.0, 0.0));
+    CHECK(!IsHitch(100.0, 0.0, HITCH_MIN_INTERVALS, 2.0, 10.0));
+
+    // Factor alone: strictly greater than factor * median.
+    CHECK(!IsHitch(33.0, 16.5, 31, 2.0, 0.0));
+    CHECK(IsHitch(33.1, 16.5, 31, 2.0, 0.0));
+
+    // Margin alone: strictly more than margin over the median.
+    CHECK(!IsHitch(26.5, 16.5, 31, 0.0, 10.0));
+    CHECK(IsHitch(26.6, 16.5, 31, 0.0, 10.0));
+
+    // Either test triggers independently when both are set.
+    CHECK(IsHitch(30.0, 16.5, 31, 1.5, 100.0));
+    CHECK(IsHitch(10.0, 4.0, 31, 10.0, 5.0));
+    CHECK(!IsHitch(20.0, 16.5, 31, 1.5, 5.0));
+
+    // Both disabled: nothing is a hitch.
+    CHECK(!IsHitch(1000.0, 16.5, 31, 0.0, 0.0));
+}
+
+// A 60 Hz stream judged the way AddPresents() does: each interval against the
+// median of the ones before it, then pushed.
+void TestHitchStream()
+{
+    RollingMedian<uint64_t, 31> intervals;
+    std::mt19937 rng(60);
+    std::uniform_int_distribution<int> jitter(-300, 300);
+
+    std::vector<size_t> hitches;
+    for (size_t i = 0; i < 200; ++i) {
+        uint64_t us = 16667 + jitter(rng);
+        if (i == 5 || i == 100 || i == 150) {
+            us = 50000;
+        }
+        if (IsHitch(us * 1e-3, intervals.median() * 1e-3, intervals.size(), 2.0, 0.0)) {
+            hitches.push_back(i);
+        }
+        intervals.push(us);
+    }
+
+    // The one at 5 comes before there is a trusted median.
+    CHECK(hitches.size() == 2);
+    CHECK(hitches.size() == 2 && hitches[0] == 100 && hitches[1] == 150);
+}
+
+}
+
+int main()
+{
+    TestRollingMedian();
+    TestHitchGating();
+    TestHitchStream();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
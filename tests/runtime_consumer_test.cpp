@@ -0,0 +1,127 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// RuntimeTraceConsumer must report only presents whose Present_Stop Result
+// says they were presented, and forget swapchains idle for
+// SWAPCHAIN_TIMEOUT_SECONDS.
+
+#include <stdio.h>
+#include <vector>
+
+#include "RuntimeTraceConsumer.hpp"
+#include "RuntimeConstants.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+enum : uint32_t { PROCESS_ID = 1000, THREAD_ID = 5000 };
+
+int64_t const QPC_FREQUENCY = synthetic::QPC_FREQUENCY;
+
+void Present(RuntimeTraceConsumer* consumer, bool d3d9, uint64_t swapChain, int64_t t, uint32_t result)
+{
+    synthetic::Event start = { d3d9 ? D3D9_PROVIDER_GUID : DXGI_PROVIDER_GUID, d3d9 ? (uint16_t) D3D9PresentStart : (uint16_t) DXGIPresent_Start,
+                               PROCESS_ID, THREAD_ID, t };
+    start.Put<uint64_t>(swapChain).Put<uint32_t>(0).Put<int32_t>(1);
+    synthetic::Event stop = { start.ProviderId, d3d9 ? (uint16_t) D3D9PresentStop : (uint16_t) DXGIPresent_Stop, PROCESS_ID, THREAD_ID, t + 100 };
+    stop.Put<uint32_t>(result);
+
+    auto startRecord = synthetic::MakeRecord(start);
+    auto stopRecord = synthetic::MakeRecord(stop);
+    if (d3d9) {
+        HandleRuntimeD3D9Event(&startRecord, consumer);
+        HandleRuntimeD3D9Event(&stopRecord, consumer);
+    } else {
+        HandleRuntimeDXGIEvent(&startRecord, consumer);
+        HandleRuntimeDXGIEvent(&stopRecord, consumer);
+    }
+}
+
+void TestResults()
+{
+    RuntimeTraceConsumer consumer(0);
+    consumer.SetQpcFrequency(QPC_FREQUENCY);
+
+    Present(&consumer, false, 0x10, 1000, 0);
+    Present(&consumer, false, 0x10, 2000, DXGI_STATUS_OCCLUDED);
+    Present(&consumer, false, 0x10, 3000, 0x887a0005 /* DXGI_ERROR_DEVICE_REMOVED */);
+    Present(&consumer, false, 0x10, 4000, DXGI_STATUS_MODE_CHANGE_IN_PROGRESS);
+    Present(&consumer, false, 0x10, 5000, 0);
+    Present(&consumer, true,  0x20, 6000, 0);
+    Present(&consumer, true,  0x20, 7000, S_PRESENT_OCCLUDED);
+    Present(&consumer, true,  0x20, 8000, 0);
+
+    std::vector<RuntimePresent> presents;
+    consumer.DequeuePresents(presents);
+    CHECK(presents.size() == 4);
+    if (presents.size() == 4) {
+        CHECK(presents[0].QpcTime == 1000 && presents[0].PrevQpcTime == 0 && presents[0].TimeTaken == 100);
+        CHECK(presents[1].QpcTime == 5000 && presents[1].PrevQpcTime == 1000);
+        CHECK(presents[2].QpcTime == 6000 && presents[2].PrevQpcTime == 0 && presents[2].SwapChainAddress == 0x20);
+        CHECK(presents[3].QpcTime == 8000 && presents[3].PrevQpcTime == 6000);
+    }
+}
+
+void TestExpiry()
+{
+    RuntimeTraceConsumer consumer(0);
+    consumer.SetQpcFrequency(QPC_FREQUENCY);
+
+    // 100 swapchains present once, then one keeps presenting for longer
+    // than the timeout.
+    for (uint64_t i = 0; i < 100; ++i) {
+        Present(&consumer, false, 0x1000 + i, 1000 + (int64_t) i * 1000, 0);
+    }
+    CHECK(consumer.GetTrackedSwapChainCount() == 100);
+
+    auto end = (RuntimeTraceConsumer::SWAPCHAIN_TIMEOUT_SECONDS * 2 + 1) * QPC_FREQUENCY;
+    for (int64_t t = QPC_FREQUENCY; t < end; t += QPC_FREQUENCY / 60) {
+        Present(&consumer, false, 0x10, t, 0);
+    }
+    CHECK(consumer.GetTrackedSwapChainCount() == 1);
+
+    // An expired swapchain starts over.
+    Present(&consumer, false, 0x1000, end, 0);
+    std::vector<RuntimePresent> presents;
+    consumer.DequeuePresents(presents);
+    CHECK(!presents.empty() && presents.back().SwapChainAddress == 0x1000 && presents.back().PrevQpcTime == 0);
+}
+
+}
+
+int main()
+{
+    TestResults();
+    TestExpiry();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times ComputeScores() over dequeued batches of different sizes against
+// scoring each present on its own, as PresentMon_Update did before presents
+// were scored in batches.  Scores are appended to a locked ring like the
+// score DataBuffer: once per present before, once per batch now.  The batch
+// timings include filling the columns.  Every batch's scores are checked
+// against the per-present ones.
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/PresentMon/ScoreKernel.hpp"
+
+namespace {
+
+enum {
+    PRESENT_COUNT = 1 << 20,
+    RUNS = 5,
+};
+
+double const MS_PER_TICK = 1000.0 / 10000000.0;
+
+struct Deltas {
+    uint64_t frame;
+    uint64_t flip;
+    uint64_t ready;
+    uint64_t displayed;
+    uint64_t timeTaken;
+};
+
+struct Scores {
+    double fps;
+    double flip;
+    double deltaReady;
+    double deltaDisplayed;
+    double timeTaken;
+};
+
+// ~60 fps with jitter; every fourth present isn't displayed.
+std::vector<Deltas> MakeDeltas()
+{
+    std::vector<Deltas> deltas(PRESENT_COUNT);
+    uint32_t x = 12345;
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        x = x * 1664525 + 1013904223;
+        auto jitter = (uint64_t) (x >> 16) % 20000;
+        auto displayed = (i & 3) != 3;
+        deltas[i].frame = 156666 + jitter;
+        deltas[i].flip = displayed ? 166666 : 0;
+        deltas[i].ready = 20000 + jitter / 2;
+        deltas[i].displayed = displayed ? 40000 + jitter : 0;
+        deltas[i].timeTaken = 10000 + jitter / 4;
+    }
+    return deltas;
+}
+
+// Stands in for DataBuffer<EventScores>: a ring appended to under a lock.
+struct ScoreRing {
+    std::mutex lock;
+    std::vector<Scores> data;
+    size_t next;
+
+    ScoreRing() : data(1 << 16), next(0) {}
+
+    void Add(Scores const& s)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        data[next] = s;
+        next = (next + 1) % data.size();
+    }
+
+    void Add(size_t n, Scores const* s)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < n; ++i) {
+            data[next] = s[i];
+            next = (next + 1) % data.size();
+        }
+    }
+};
+
+void ScorePresent(Deltas const& d, Scores* s)
+{
+    s->fps = 1000. / ((double) d.frame * MS_PER_TICK);
+    s->flip = 1000. / ((double) d.flip * MS_PER_TICK);
+    s->deltaReady = (double) d.ready * MS_PER_TICK;
+    s->deltaDisplayed = (double) d.displayed * MS_PER_TICK;
+    s->timeTaken = (double) d.timeTaken * MS_PER_TICK;
+}
+
+template <typename Fn>
+double BestNsPerPresent(Fn fn)
+{
+    double best = 0.0;
+    for (int run = 0; run < RUNS; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = run == 0 ? ns : std::min(best, ns);
+    }
+    return best / PRESENT_COUNT;
+}
+
+bool Same(double a, double b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+}
+
+int main()
+{
+    auto deltas = MakeDeltas();
+    std::vector<Scores> expected(PRESENT_COUNT);
+
+    auto scoreOnlyNs = BestNsPerPresent([&]() {
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            ScorePresent(deltas[i], &expected[i]);
+        }
+    });
+    ScoreRing ring;
+    auto perPresentNs = BestNsPerPresent([&]() {
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            ScorePresent(deltas[i], &expected[i]);
+            ring.Add(expected[i]);
+        }
+    });
+    printf("%u presents\n", PRESENT_COUNT);
+    printf("per present, no append: %6.2f ns/present\n", scoreOnlyNs);
+    printf("per present:            %6.2f ns/present\n", perPresentNs);
+
+    int mismatches = 0;
+    for (size_t batchSize : { 1, 4, 16, 64, 256, 1024, 4096 }) {
+        ScoreBatch batch;
+        std::vector<Scores> scores(PRESENT_COUNT);
+        auto batchNs = BestNsPerPresent([&]() {
+            for (size_t begin = 0; begin < deltas.size(); begin += batchSize) {
+                auto n = std::min(batchSize, deltas.size() - begin);
+                batch.Reset(n);
+                for (size_t row = 0; row < n; ++row) {
+                    auto const& d = deltas[begin + row];
+                    batch.Set(row, d.frame, d.flip, d.ready, d.displayed, d.timeTaken);
+                }
+                ComputeScores(batch, MS_PER_TICK);
+                for (size_t row = 0; row < n; ++row) {
+                    auto& s = scores[begin + row];
+                    s.fps = batch.mFps[row];
+                    s.flip = batch.mFlip[row];
+                    s.deltaReady = batch.mDeltaReady[row];
+                    s.deltaDisplayed = batch.mDeltaDisplayed[row];
+                    s.timeTaken = batch.mTimeTaken[row];
+                }
+                ring.Add(n, &scores[begin]);
+            }
+        });
+
+        for (size_t i = 0; i < scores.size(); ++i) {
+            auto const& a = scores[i];
+            auto const& b = expected[i];
+            if (!Same(a.fps, b.fps) || !Same(a.flip, b.flip) || !Same(a.deltaReady, b.deltaReady) ||
+                !Same(a.deltaDisplayed, b.deltaDisplayed) || !Same(a.timeTaken, b.timeTaken)) {
+                ++mismatches;
+            }
+        }
+        printf("batches of %4zu:        %6.2f ns/present  %.2fx\n", batchSize, batchNs, perPresentNs / batchNs);
+    }
+
+    if (mismatches != 0) {
+        printf("FAIL: %d batched scores differ from the per-present ones\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
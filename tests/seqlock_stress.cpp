@@ -0,0 +1,114 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// One writer keeps rewriting a few SeqlockArray slots, and appends to it now
+// and then, while readers take snapshots.  Every value keeps its fields in a
+// fixed relation, so a snapshot torn by a concurrent write shows up as a
+// broken relation (and as a data race under -fsanitize=thread).
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "seqlock.h"
+
+namespace {
+
+struct Value {
+    uint64_t mA;
+    uint64_t mB;        // always mA * 3
+    double mC;          // always mA / 2.0
+    uint32_t mSlot;
+};
+
+enum {
+    WRITE_COUNT = 500000,
+    SLOT_COUNT = 8,
+    READER_COUNT = 2,
+};
+
+}
+
+int main()
+{
+    SeqlockArray<Value, SLOT_COUNT> values;
+    std::atomic<bool> writerDone(false);
+    std::atomic<uint64_t> badSnapshots(0);
+    std::atomic<uint64_t> snapshotCount(0);
+
+    std::thread writer([&] {
+        for (uint64_t i = 0; i < WRITE_COUNT; ++i) {
+            auto slot = (uint32_t) (i % SLOT_COUNT);
+            Value v;
+            v.mA = i;
+            v.mB = i * 3;
+            v.mC = i / 2.0;
+            v.mSlot = slot;
+            if (i == WRITE_COUNT / 2) {
+                values.clear(); // slot == 0 here, so the stores below append again
+            }
+            values.store(slot, v);
+        }
+        writerDone.store(true, std::memory_order_release);
+    });
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READER_COUNT; ++r) {
+        readers.emplace_back([&] {
+            std::vector<Value> snapshot;
+            while (!writerDone.load(std::memory_order_acquire)) {
+                values.load(&snapshot);
+                snapshotCount.fetch_add(1, std::memory_order_relaxed);
+                if (snapshot.size() > SLOT_COUNT) {
+                    badSnapshots.fetch_add(1, std::memory_order_relaxed);
+                }
+                for (size_t i = 0; i < snapshot.size(); ++i) {
+                    auto const& v = snapshot[i];
+                    if (v.mB != v.mA * 3 || v.mC != v.mA / 2.0 || v.mSlot != i || v.mA % SLOT_COUNT != i) {
+                        badSnapshots.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    // Once the writer is done, a snapshot must hold the last value of every slot.
+    std::vector<Value> final;
+    values.load(&final);
+    auto ok = badSnapshots.load() == 0 && final.size() == SLOT_COUNT;
+    for (size_t i = 0; ok && i < final.size(); ++i) {
+        ok = final[i].mA == WRITE_COUNT - SLOT_COUNT + i;
+    }
+
+    printf("%llu snapshots, %llu torn\n",
+        (unsigned long long) snapshotCount.load(), (unsigned long long) badSnapshots.load());
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
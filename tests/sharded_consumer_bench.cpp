@@ -0,0 +1,125 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times ShardedPMTraceConsumer on 1, 2, 4 and 8 shards against a single
+// PMTraceConsumer, over 64 processes flipping fullscreen and 32 composed
+// through DWM for 10 seconds, and reports how many events the shards were
+// sent per event dispatched.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#include "ShardedTraceConsumer.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+enum {
+    FLIP_PROCESS_COUNT = 64,
+    COMPOSED_PROCESS_COUNT = 32,
+    SECONDS = 10,
+};
+
+template <PMEventHandlerFn HandlerFn>
+void SeededHandler(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
+{
+    thread_local bool seeded = false;
+    if (!seeded) {
+        synthetic::SeedSchemas();
+        seeded = true;
+    }
+    HandlerFn(pEventRecord, pmConsumer);
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main()
+{
+    synthetic::SeedSchemas();
+    auto events = synthetic::Generate(FLIP_PROCESS_COUNT, SECONDS);
+    auto composed = synthetic::GenerateComposed(COMPOSED_PROCESS_COUNT, SECONDS);
+    events.insert(events.end(), composed.begin(), composed.end());
+    std::stable_sort(events.begin(), events.end(), [](synthetic::Event const& a, synthetic::Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    std::vector<EVENT_RECORD> records;
+    for (auto& e : events) {
+        records.push_back(synthetic::MakeRecord(e));
+    }
+    printf("%zu events, %u + %u processes, %u s\n", records.size(), FLIP_PROCESS_COUNT, COMPOSED_PROCESS_COUNT, SECONDS);
+
+    std::vector<CompletedFrame> presents;
+    double serialMs = 0.0;
+    {
+        PMTraceConsumer consumer(false);
+        auto start = std::chrono::steady_clock::now();
+        for (auto& record : records) {
+            auto const& provider = record.EventHeader.ProviderId;
+            if (IsEqualGUID(provider, DXGI_PROVIDER_GUID)) {
+                HandleDXGIEvent(&record, &consumer);
+            } else if (IsEqualGUID(provider, DXGKRNL_PROVIDER_GUID)) {
+                HandleDXGKEvent(&record, &consumer);
+            } else {
+                HandleWin32kEvent(&record, &consumer);
+            }
+            if (consumer.GetQueueBacklog() > 0.5) {
+                consumer.DequeuePresents(presents);
+                presents.clear();
+            }
+        }
+        serialMs = ElapsedMs(start);
+        printf("  serial: %8.1f ms\n", serialMs);
+    }
+
+    for (uint32_t shardCount : { 1u, 2u, 4u, 8u }) {
+        ShardedPMTraceConsumer sharded(shardCount);
+        sharded.AddHandler(DXGI_PROVIDER_GUID, &SeededHandler<HandleDXGIEvent>);
+        sharded.AddHandler(DXGKRNL_PROVIDER_GUID, &SeededHandler<HandleDXGKEvent>);
+        sharded.AddHandler(WIN32K_PROVIDER_GUID, &SeededHandler<HandleWin32kEvent>);
+        sharded.Start();
+
+        size_t presentCount = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < records.size(); ++i) {
+            sharded.DispatchEvent(&records[i]);
+            if ((i & 1023) == 0 && sharded.GetQueueBacklog() > 0.5) {
+                sharded.DequeuePresents(presents);
+                presentCount += presents.size();
+                presents.clear();
+            }
+        }
+        sharded.Flush();
+        auto ms = ElapsedMs(start);
+        sharded.DequeuePresents(presents);
+        presentCount += presents.size();
+        presents.clear();
+
+        printf("%u shards: %8.1f ms  %.2fx  %.3f queued/event  %llu spilled  (%zu presents)\n", shardCount, ms, serialMs / ms,
+               (double) sharded.GetQueuedEventCount() / records.size(), (unsigned long long) sharded.GetSpillCount(), presentCount);
+        sharded.Stop();
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// ShardedPMTraceConsumer must complete the same presents as a single
+// PMTraceConsumer, sending each completion event to the one shard that
+// registered its key, including when shard queues overflow onto their spill
+// lists.
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <tuple>
+
+#include "ShardedTraceConsumer.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// The shards decode on their own threads, whose schema caches must be
+// seeded like the test thread's.
+template <PMEventHandlerFn HandlerFn>
+void SeededHandler(EVENT_RECORD* pEventRecord, PMTraceConsumer* pmConsumer)
+{
+    thread_local bool seeded = false;
+    if (!seeded) {
+        synthetic::SeedSchemas();
+        seeded = true;
+    }
+    HandlerFn(pEventRecord, pmConsumer);
+}
+
+std::vector<synthetic::Event> GenerateEvents()
+{
+    auto events = synthetic::Generate(6, 1.0);
+    auto composed = synthetic::GenerateComposed(5, 1.0);
+    events.insert(events.end(), composed.begin(), composed.end());
+    std::stable_sort(events.begin(), events.end(), [](synthetic::Event const& a, synthetic::Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    return events;
+}
+
+bool FrameLess(CompletedFrame const& a, CompletedFrame const& b)
+{
+    return std::tie(a.ProcessId, a.SwapChainAddress, a.QpcTime) < std::tie(b.ProcessId, b.SwapChainAddress, b.QpcTime);
+}
+
+bool SameFrames(std::vector<CompletedFrame> a, std::vector<CompletedFrame> b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    std::sort(a.begin(), a.end(), FrameLess);
+    std::sort(b.begin(), b.end(), FrameLess);
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].QpcTime != b[i].QpcTime ||
+            a[i].SwapChainAddress != b[i].SwapChainAddress ||
+            a[i].ProcessId != b[i].ProcessId ||
+            a[i].ReadyTime != b[i].ReadyTime ||
+            a[i].ScreenTime != b[i].ScreenTime ||
+            a[i].PresentMode != b[i].PresentMode ||
+            a[i].FinalState != b[i].FinalState) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<CompletedFrame> RunSerial(std::vector<synthetic::Event>& events)
+{
+    PMTraceConsumer consumer(false);
+    for (auto& e : events) {
+        auto record = synthetic::MakeRecord(e);
+        if (IsEqualGUID(e.ProviderId, DXGI_PROVIDER_GUID)) {
+            HandleDXGIEvent(&record, &consumer);
+        } else if (IsEqualGUID(e.ProviderId, DXGKRNL_PROVIDER_GUID)) {
+            HandleDXGKEvent(&record, &consumer);
+        } else {
+            HandleWin32kEvent(&record, &consumer);
+        }
+    }
+    std::vector<CompletedFrame> presents;
+    consumer.DequeuePresents(presents);
+    return presents;
+}
+
+void AddHandlers(ShardedPMTraceConsumer* sharded)
+{
+    sharded->AddHandler(DXGI_PROVIDER_GUID, &SeededHandler<HandleDXGIEvent>);
+    sharded->AddHandler(DXGKRNL_PROVIDER_GUID, &SeededHandler<HandleDXGKEvent>);
+    sharded->AddHandler(WIN32K_PROVIDER_GUID, &SeededHandler<HandleWin32kEvent>);
+}
+
+void TestShards(std::vector<synthetic::Event>& events, std::vector<CompletedFrame> const& serial, uint32_t shardCount)
+{
+    ShardedPMTraceConsumer sharded(shardCount);
+    AddHandlers(&sharded);
+    sharded.Start();
+
+    uint64_t vsyncCount = 0;
+    for (auto& e : events) {
+        auto record = synthetic::MakeRecord(e);
+        sharded.DispatchEvent(&record);
+        vsyncCount += IsEqualGUID(e.ProviderId, DXGKRNL_PROVIDER_GUID) && e.Id == DxgKrnl_VSyncDPC;
+    }
+    sharded.Flush();
+
+    // Nothing is broadcast; only VSyncDPCs of flips owned by another shard
+    // are also sent to shard 0.
+    CHECK(sharded.GetQueuedEventCount() <= events.size() + vsyncCount);
+    if (shardCount == 1) {
+        CHECK(sharded.GetQueuedEventCount() == events.size());
+    }
+
+    std::vector<CompletedFrame> presents;
+    sharded.DequeuePresents(presents);
+    sharded.Stop();
+    CHECK(SameFrames(presents, serial));
+
+    std::vector<DisplayRefresh> displays;
+    sharded.GetDisplayRefresh(displays);
+    CHECK(displays.size() == 1);
+}
+
+void TestSpill(std::vector<synthetic::Event>& events, std::vector<CompletedFrame> const& serial)
+{
+    // Dispatch everything before the workers start, through queues much
+    // smaller than the event count.
+    ShardedPMTraceConsumer sharded(3, 64);
+    AddHandlers(&sharded);
+    for (auto& e : events) {
+        auto record = synthetic::MakeRecord(e);
+        sharded.DispatchEvent(&record);
+    }
+    CHECK(sharded.GetSpillCount() > 0);
+
+    sharded.Start();
+    sharded.Flush();
+    std::vector<CompletedFrame> presents;
+    sharded.DequeuePresents(presents);
+    sharded.Stop();
+    CHECK(SameFrames(presents, serial));
+}
+
+void TestExtendedData()
+{
+    uint8_t userData[200] = {};
+    for (size_t i = 0; i < sizeof(userData); ++i) {
+        userData[i] = (uint8_t) i;
+    }
+    uint8_t schemaData[] = { 11, 0, 'F', 'o', 'o', 0 };
+    uint64_t relatedActivity[2] = { 0x1234, 0x5678 };
+
+    EVENT_HEADER_EXTENDED_DATA_ITEM items[2] = {};
+    items[0].ExtType = 1;
+    items[0].DataSize = sizeof(relatedActivity);
+    items[0].DataPtr = (ULONGLONG) relatedActivity;
+    items[1].ExtType = EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL;
+    items[1].DataSize = sizeof(schemaData);
+    items[1].DataPtr = (ULONGLONG) schemaData;
+
+    EVENT_RECORD record = {};
+    record.EventHeader.ProcessId = 42;
+    record.EventHeader.Flags = EVENT_HEADER_FLAG_EXTENDED_INFO;
+    record.UserData = userData;
+    record.UserDataLength = sizeof(userData);
+    record.ExtendedDataCount = 2;
+    record.ExtendedData = items;
+
+    QueuedEvent queued;
+    queued.Assign(record);
+    memset(userData, 0xff, sizeof(userData));
+    memset(schemaData, 0xff, sizeof(schemaData));
+    memset(relatedActivity, 0xff, sizeof(relatedActivity));
+
+    QueuedEvent moved(std::move(queued));
+    EVENT_RECORD copy;
+    moved.ToRecord(&copy);
+    CHECK(copy.EventHeader.ProcessId == 42);
+    CHECK(copy.UserDataLength == 200);
+    CHECK(((uint8_t const*) copy.UserData)[199] == 199);
+    CHECK(copy.ExtendedDataCount == 2);
+    CHECK(copy.ExtendedData[0].ExtType == 1);
+    CHECK(copy.ExtendedData[0].DataSize == 16);
+    CHECK(((uint64_t const*) copy.ExtendedData[0].DataPtr)[1] == 0x5678);
+    CHECK(copy.ExtendedData[1].ExtType == EVENT_HEADER_EXT_TYPE_EVENT_SCHEMA_TL);
+    CHECK(memcmp((void const*) copy.ExtendedData[1].DataPtr, "\x0b\0Foo", 6) == 0);
+}
+
+}
+
+int main()
+{
+    synthetic::SeedSchemas();
+    auto events = GenerateEvents();
+    auto serial = RunSerial(events);
+
+    // The flips and the composed presents both complete.
+    size_t flips = 0;
+    size_t composed = 0;
+    for (auto const& p : serial) {
+        if (p.FinalState == PresentResult::Presented) {
+            flips += p.PresentMode == PresentMode::Hardware_Legacy_Flip;
+            composed += p.PresentMode == PresentMode::Composed_Flip;
+        }
+    }
+    CHECK(flips > 100);
+    CHECK(composed > 100);
+
+    for (uint32_t shardCount : { 1u, 2u, 4u, 7u }) {
+        TestShards(events, serial, shardCount);
+    }
+    TestSpill(events, serial);
+    TestExtendedData();
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// One producer and one consumer hammer a small SPSCQueue so it is full and
+// empty often.  Items own heap memory, so a slot handed over before the
+// producer finished writing it shows up as a data race under
+// -fsanitize=thread, and as a bad sequence or payload otherwise.
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "spsc_queue.h"
+
+namespace {
+
+struct Item {
+    uint64_t mSequence;
+    std::vector<uint64_t> mPayload;
+};
+
+enum {
+    ITEM_COUNT = 1000000,
+    QUEUE_CAPACITY = 64,
+};
+
+}
+
+int main()
+{
+    SPSCQueue<Item> queue(QUEUE_CAPACITY);
+    std::atomic<bool> producerDone(false);
+    uint64_t fullCount = 0;
+
+    std::thread producer([&] {
+        for (uint64_t i = 0; i < ITEM_COUNT; ++i) {
+            Item item;
+            item.mSequence = i;
+            item.mPayload.assign(1 + i % 7, i);
+            while (!queue.push(std::move(item))) {
+                ++fullCount;
+                std::this_thread::yield();
+            }
+        }
+        producerDone.store(true, std::memory_order_release);
+    });
+
+    uint64_t expected = 0;
+    uint64_t errors = 0;
+    Item item;
+    for (;;) {
+        if (!queue.pop(item)) {
+            if (producerDone.load(std::memory_order_acquire) && queue.empty()) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.mSequence != expected || item.mPayload.size() != 1 + expected % 7) {
+            ++errors;
+        } else {
+            for (auto v : item.mPayload) {
+                if (v != expected) {
+                    ++errors;
+                    break;
+                }
+            }
+        }
+        ++expected;
+    }
+    producer.join();
+
+    if (expected != ITEM_COUNT || errors != 0) {
+        printf("FAIL: %llu of %u items received, %llu out of order or corrupt\n",
+            (unsigned long long) expected, (unsigned) ITEM_COUNT, (unsigned long long) errors);
+        return 1;
+    }
+    printf("PASS: %u items through a %u-slot queue, producer found it full %llu times\n",
+        (unsigned) ITEM_COUNT, (unsigned) queue.capacity(), (unsigned long long) fullCount);
+    return 0;
+}
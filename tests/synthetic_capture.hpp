@@ -0,0 +1,224 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Writes captures of synthetic fullscreen flip presents, for the tests and
+// benchmarks of capture analysis and the sharded consumer: each process presents on its own thread at
+// its own rate through DXGI Present_Start, DxgKrnl Flip and QueueSubmit,
+// DXGI Present_Stop, MMIOFlip and VSyncDPC.  Every seventh present of a
+// process is occluded (discarded at Present_Stop).  The schemas are seeded
+// on the calling thread as TDH would have built them, so this works on any
+// platform.
+
+#pragma once
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "EventCapture.hpp"
+#include "EventReplay.hpp"
+#include "PresentMonTraceConsumer.hpp"
+#include "RuntimeConstants.hpp"
+#include "TraceConsumer.hpp"
+
+namespace synthetic {
+
+enum : int64_t { QPC_FREQUENCY = 10000000 };
+
+// The process raising the DWM side of composed presents.
+enum : uint32_t { DWM_PROCESS_ID = 900, DWM_THREAD_ID = 904 };
+
+struct Event {
+    GUID ProviderId;
+    uint16_t Id;
+    uint32_t ProcessId;
+    uint32_t ThreadId;
+    int64_t TimeStamp;
+    std::vector<uint8_t> UserData;
+
+    template <typename T>
+    Event& Put(T value)
+    {
+        auto p = (uint8_t const*) &value;
+        UserData.insert(UserData.end(), p, p + sizeof(value));
+        return *this;
+    }
+};
+
+inline EVENT_RECORD MakeRecord(Event& e)
+{
+    EVENT_RECORD record;
+    memset(&record, 0, sizeof(record));
+    record.EventHeader.ProviderId = e.ProviderId;
+    record.EventHeader.EventDescriptor.Id = e.Id;
+    record.EventHeader.ProcessId = e.ProcessId;
+    record.EventHeader.ThreadId = e.ThreadId;
+    record.EventHeader.TimeStamp.QuadPart = e.TimeStamp;
+    record.UserData = e.UserData.data();
+    record.UserDataLength = (USHORT) e.UserData.size();
+    return record;
+}
+
+inline EventSchema Schema(std::initializer_list<std::pair<wchar_t const*, uint32_t>> fields)
+{
+    EventSchema schema;
+    for (auto const& f : fields) {
+        schema.AddProperty(f.first, f.second, 1);
+    }
+    return schema;
+}
+
+inline void SeedSchema(GUID const& providerId, uint16_t id, EventSchema const& schema)
+{
+    Event e = { providerId, id };
+    auto record = MakeRecord(e);
+    SeedEventSchema(GetEventSchemaKey(&record), schema, L"");
+}
+
+inline void SeedSchemas()
+{
+    SeedSchema(DXGI_PROVIDER_GUID, DXGIPresent_Start, Schema({ { L"pIDXGISwapChain", 8 }, { L"Flags", 4 }, { L"SyncInterval", 4 } }));
+    SeedSchema(DXGI_PROVIDER_GUID, DXGIPresent_Stop, Schema({ { L"Result", 4 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_Flip, Schema({ { L"pDmaBuffer", 8 }, { L"VidPnSourceId", 4 }, { L"FlipToAllocation", 8 },
+                                                            { L"FlipInterval", 4 }, { L"MMIOFlip", 4 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_QueueSubmit, Schema({ { L"hContext", 8 }, { L"PacketType", 4 }, { L"SubmitSequence", 4 },
+                                                                   { L"DmaBufferSize", 8 }, { L"bPresent", 4 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_MMIOFlip, Schema({ { L"pDxgAdapter", 8 }, { L"VidPnSourceId", 4 }, { L"FlipSubmitSequence", 4 },
+                                                                { L"FlipToDriverAllocation", 8 }, { L"Flags", 4 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_VSyncDPC, Schema({ { L"pDxgAdapter", 8 }, { L"VidPnTargetId", 4 }, { L"ScannedPhysicalAddress", 8 },
+                                                                { L"VidPnSourceId", 4 }, { L"FrameNumber", 4 }, { L"FrameQPCTime", 8 },
+                                                                { L"hFlipDevice", 8 }, { L"FlipType", 4 }, { L"FlipFenceId", 8 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_SubmitPresentHistory, Schema({ { L"hAdapter", 8 }, { L"Token", 8 }, { L"TokenData", 8 }, { L"Model", 4 } }));
+    SeedSchema(DXGKRNL_PROVIDER_GUID, DxgKrnl_PropagatePresentHistory, Schema({ { L"hAdapter", 8 }, { L"Token", 8 } }));
+    SeedSchema(WIN32K_PROVIDER_GUID, Win32K_TokenCompositionSurfaceObject, Schema({ { L"CompositionSurfaceLuid", 8 }, { L"PresentCount", 8 },
+                                                                                 { L"BindId", 8 } }));
+    SeedSchema(WIN32K_PROVIDER_GUID, Win32K_TokenStateChanged, Schema({ { L"CompositionSurfaceLuid", 8 }, { L"PresentCount", 4 }, { L"BindId", 8 },
+                                                                      { L"NewState", 4 }, { L"IndependentFlip", 4 } }));
+}
+
+// The events of processCount processes presenting for the given time, in
+// timestamp order.  Process i presents every 1/(30 + 17 i mod 150) s.
+inline std::vector<Event> Generate(uint32_t processCount, double seconds)
+{
+    std::vector<Event> events;
+    uint32_t submitSequence = 1;
+    uint32_t frameNumber = 1;
+    auto end = (int64_t) (seconds * QPC_FREQUENCY);
+    for (uint32_t i = 0; i < processCount; ++i) {
+        auto processId = 1000 + 4 * i;
+        auto threadId = 5000 + 4 * i;
+        auto swapChain = 0x10000ull * (i + 1);
+        auto interval = QPC_FREQUENCY / (30 + (17 * i) % 150);
+        uint32_t n = 0;
+        for (int64_t t = 1000 + 37 * i; t < end; t += interval, ++n) {
+            auto sequence = submitSequence++;
+            auto occluded = n % 7 == 6;
+            events.push_back(Event { DXGI_PROVIDER_GUID, DXGIPresent_Start, processId, threadId, t });
+            events.back().Put<uint64_t>(swapChain).Put<uint32_t>(0).Put<int32_t>(1);
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_Flip, processId, threadId, t + 100 });
+            events.back().Put<uint64_t>(0).Put<uint32_t>(0).Put<uint64_t>(0).Put<uint32_t>(1).Put<uint32_t>(1);
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_QueueSubmit, processId, threadId, t + 200 });
+            events.back().Put<uint64_t>(0xc0000 + i).Put<uint32_t>(3).Put<uint32_t>(sequence).Put<uint64_t>(0).Put<uint32_t>(1);
+            events.push_back(Event { DXGI_PROVIDER_GUID, DXGIPresent_Stop, processId, threadId, t + 300 });
+            events.back().Put<uint32_t>(occluded ? DXGI_STATUS_OCCLUDED : 0);
+            if (occluded) {
+                continue;
+            }
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_MMIOFlip, 4, 8, t + 20000 + 13 * i });
+            events.back().Put<uint64_t>(0).Put<uint32_t>(0).Put<uint32_t>(sequence).Put<uint64_t>(0).Put<uint32_t>(4);
+            auto vsync = t + 50000 + 13 * i;
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_VSyncDPC, 0, 0, vsync });
+            events.back().Put<uint64_t>(0).Put<uint32_t>(1).Put<uint64_t>(0).Put<uint32_t>(0).Put<uint32_t>(frameNumber++)
+                         .Put<uint64_t>(vsync).Put<uint64_t>(0).Put<uint32_t>(0).Put<uint64_t>((uint64_t) sequence << 32);
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](Event const& a, Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    return events;
+}
+
+// The events of processCount windowed processes presenting through DWM
+// composition for the given time, in timestamp order: DXGI Present_Start,
+// Win32K TokenCompositionSurfaceObject, DxgKrnl SubmitPresentHistory, DXGI
+// Present_Stop, then PropagatePresentHistory and the token's InFrame,
+// Confirmed, Retired and Discarded state changes from DWM.  Process i
+// presents every 1/(60 + 13 i mod 90) s.
+inline std::vector<Event> GenerateComposed(uint32_t processCount, double seconds)
+{
+    enum { IN_FRAME = 3, CONFIRMED = 4, RETIRED = 5, DISCARDED = 6 };
+
+    std::vector<Event> events;
+    auto end = (int64_t) (seconds * QPC_FREQUENCY);
+    for (uint32_t i = 0; i < processCount; ++i) {
+        auto processId = 2000 + 4 * i;
+        auto threadId = 6000 + 4 * i;
+        auto swapChain = 0x20000000ull + 0x10000ull * i;
+        auto surfaceLuid = 0x500ull + i;
+        auto interval = QPC_FREQUENCY / (60 + (13 * i) % 90);
+        uint32_t n = 0;
+        for (int64_t t = 2000 + 41 * i; t < end; t += interval, ++n) {
+            auto token = 0xa0000000ull + 0x100000ull * i + n;
+            events.push_back(Event { DXGI_PROVIDER_GUID, DXGIPresent_Start, processId, threadId, t });
+            events.back().Put<uint64_t>(swapChain).Put<uint32_t>(0).Put<int32_t>(1);
+            events.push_back(Event { WIN32K_PROVIDER_GUID, Win32K_TokenCompositionSurfaceObject, processId, threadId, t + 50 });
+            events.back().Put<uint64_t>(surfaceLuid).Put<uint64_t>(n + 1).Put<uint64_t>(7);
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_SubmitPresentHistory, processId, threadId, t + 100 });
+            events.back().Put<uint64_t>(0).Put<uint64_t>(token).Put<uint64_t>(0).Put<uint32_t>(2 /* D3DKMT_PM_REDIRECTED_FLIP */);
+            events.push_back(Event { DXGI_PROVIDER_GUID, DXGIPresent_Stop, processId, threadId, t + 300 });
+            events.back().Put<uint32_t>(0);
+            events.push_back(Event { DXGKRNL_PROVIDER_GUID, DxgKrnl_PropagatePresentHistory, DWM_PROCESS_ID, DWM_THREAD_ID, t + 20000 + 11 * i });
+            events.back().Put<uint64_t>(0).Put<uint64_t>(token);
+            uint32_t const states[] = { IN_FRAME, CONFIRMED, RETIRED, DISCARDED };
+            for (uint32_t s = 0; s < 4; ++s) {
+                events.push_back(Event { WIN32K_PROVIDER_GUID, Win32K_TokenStateChanged, DWM_PROCESS_ID, DWM_THREAD_ID, t + 30000 + 11 * i + 5000 * (s / 2) + s });
+                events.back().Put<uint64_t>(surfaceLuid).Put<uint32_t>(n + 1).Put<uint64_t>(7).Put<uint32_t>(states[s]).Put<uint32_t>(0);
+            }
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](Event const& a, Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    return events;
+}
+
+// Returns the number of events written, 0 on error.  composedProcessCount
+// more processes present through DWM composition (GenerateComposed()).
+inline uint64_t WriteCapture(char const* path, uint32_t processCount, double seconds, uint32_t composedProcessCount = 0)
+{
+    SeedSchemas();
+    EventCaptureWriter writer;
+    if (!writer.Open(path, QPC_FREQUENCY)) {
+        return 0;
+    }
+    auto events = Generate(processCount, seconds);
+    if (composedProcessCount != 0) {
+        auto composed = GenerateComposed(composedProcessCount, seconds);
+        events.insert(events.end(), composed.begin(), composed.end());
+        std::stable_sort(events.begin(), events.end(), [](Event const& a, Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    }
+    for (auto& e : events) {
+        auto record = MakeRecord(e);
+        HandleCaptureEvent(&record, &writer);
+    }
+    writer.Close();
+    return writer.GetFailedWriteCount() == 0 ? writer.GetEventCount() : 0;
+}
+
+}
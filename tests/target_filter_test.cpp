@@ -0,0 +1,181 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// A PMTraceConsumer tracking a single target process must report the same
+// presents for the target, and for DWM, as one tracking every process.
+// DWM's own present-path events are only kept once its pid is known, from
+// the caller or from its process start event.
+
+#include <algorithm>
+#include <stdio.h>
+#include <tuple>
+
+#include "PresentMonTraceConsumer.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(_Cond) do { \
+    if (!(_Cond)) { \
+        printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #_Cond); \
+        ++failures; \
+    } \
+} while (0)
+
+// Fullscreen flips of 5 processes, the first of them DWM, which presents
+// without going through a runtime, and 3 processes composed through DWM.
+std::vector<synthetic::Event> GenerateEvents()
+{
+    std::vector<synthetic::Event> events;
+    for (auto& e : synthetic::Generate(5, 1.0)) {
+        if (e.ProcessId == 1000) {
+            if (IsEqualGUID(e.ProviderId, DXGI_PROVIDER_GUID)) {
+                continue;
+            }
+            e.ProcessId = synthetic::DWM_PROCESS_ID;
+            e.ThreadId = synthetic::DWM_THREAD_ID + 4;
+        }
+        events.push_back(e);
+    }
+    auto composed = synthetic::GenerateComposed(3, 1.0);
+    events.insert(events.end(), composed.begin(), composed.end());
+    std::stable_sort(events.begin(), events.end(), [](synthetic::Event const& a, synthetic::Event const& b) { return a.TimeStamp < b.TimeStamp; });
+    return events;
+}
+
+// Microsoft-Windows-Kernel-Process ProcessStart, trimmed to the fields read.
+synthetic::Event KernelProcessStart(uint32_t processId, char const* imageName)
+{
+    synthetic::Event e = { KERNEL_PROCESS_PROVIDER_GUID, KernelProcess_ProcessStart, 4, 8, 0 };
+    e.Put<uint32_t>(processId);
+    do {
+        e.Put<uint16_t>((uint16_t) *imageName);
+    } while (*imageName++ != 0);
+
+    EventSchema schema;
+    schema.AddField(L"ProcessID", EventSchema::FieldKind::Scalar, 4);
+    schema.AddField(L"ImageName", EventSchema::FieldKind::UnicodeString, 0);
+    auto record = synthetic::MakeRecord(e);
+    SeedEventSchema(GetEventSchemaKey(&record), schema, L"ProcessStart");
+    return e;
+}
+
+std::vector<CompletedFrame> Run(std::vector<synthetic::Event>& events, uint32_t targetProcessId, uint32_t dwmProcessId,
+                                char const* startImageName = nullptr)
+{
+    PMTraceConsumer consumer(false);
+    consumer.mTargetProcessId = targetProcessId;
+    consumer.mDwmProcessId = dwmProcessId;
+
+    if (startImageName != nullptr) {
+        auto start = KernelProcessStart(synthetic::DWM_PROCESS_ID, startImageName);
+        auto record = synthetic::MakeRecord(start);
+        HandleKernelProcessEvent(&record, &consumer);
+    }
+
+    for (auto& e : events) {
+        // The session drops other processes' runtime events before they
+        // reach the consumer.
+        if (targetProcessId != 0 && IsEqualGUID(e.ProviderId, DXGI_PROVIDER_GUID) && e.ProcessId != targetProcessId) {
+            continue;
+        }
+        auto record = synthetic::MakeRecord(e);
+        if (IsEqualGUID(e.ProviderId, DXGI_PROVIDER_GUID)) {
+            HandleDXGIEvent(&record, &consumer);
+        } else if (IsEqualGUID(e.ProviderId, DXGKRNL_PROVIDER_GUID)) {
+            HandleDXGKEvent(&record, &consumer);
+        } else {
+            HandleWin32kEvent(&record, &consumer);
+        }
+    }
+
+    std::vector<CompletedFrame> presents;
+    consumer.DequeuePresents(presents);
+    std::sort(presents.begin(), presents.end(), [](CompletedFrame const& a, CompletedFrame const& b) {
+        return std::tie(a.ProcessId, a.SwapChainAddress, a.QpcTime) < std::tie(b.ProcessId, b.SwapChainAddress, b.QpcTime);
+    });
+    return presents;
+}
+
+std::vector<CompletedFrame> OfProcesses(std::vector<CompletedFrame> const& presents, uint32_t processId1, uint32_t processId2)
+{
+    std::vector<CompletedFrame> out;
+    for (auto const& p : presents) {
+        if (p.ProcessId == processId1 || p.ProcessId == processId2) {
+            out.push_back(p);
+        }
+    }
+    return out;
+}
+
+bool SameFrames(std::vector<CompletedFrame> const& a, std::vector<CompletedFrame> const& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].QpcTime != b[i].QpcTime ||
+            a[i].SwapChainAddress != b[i].SwapChainAddress ||
+            a[i].ProcessId != b[i].ProcessId ||
+            a[i].ReadyTime != b[i].ReadyTime ||
+            a[i].ScreenTime != b[i].ScreenTime ||
+            a[i].PresentMode != b[i].PresentMode ||
+            a[i].FinalState != b[i].FinalState) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t CountOf(std::vector<CompletedFrame> const& presents, uint32_t processId)
+{
+    return (size_t) std::count_if(presents.begin(), presents.end(), [=](CompletedFrame const& p) { return p.ProcessId == processId; });
+}
+
+}
+
+int main()
+{
+    synthetic::SeedSchemas();
+    auto events = GenerateEvents();
+    auto all = Run(events, 0, 0);
+
+    auto const dwm = (uint32_t) synthetic::DWM_PROCESS_ID;
+    CHECK(CountOf(all, dwm) > 0);
+
+    for (uint32_t target : { 1004u, 1016u, 2000u, 2008u }) {
+        CHECK(CountOf(all, target) > 0);
+        auto expected = OfProcesses(all, target, dwm);
+        CHECK(SameFrames(Run(events, target, dwm), expected));
+        CHECK(SameFrames(Run(events, target, 0, "\\Device\\HarddiskVolume2\\Windows\\System32\\DWM.EXE"), expected));
+
+        // DWM's pid unknown: its present-path kernel events are dropped.
+        auto unknown = Run(events, target, 0, "notdwm.exe");
+        CHECK(SameFrames(OfProcesses(unknown, target, target), OfProcesses(all, target, target)));
+        CHECK(CountOf(unknown, dwm) == 0);
+    }
+
+    printf(failures == 0 ? "PASS\n" : "FAIL\n");
+    return failures == 0 ? 0 : 1;
+}
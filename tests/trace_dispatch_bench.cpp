@@ -0,0 +1,187 @@
+/*
+Copyright 2017 Intel Corporation
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Times TraceSession's event dispatch on a composed-present stream with the
+// providers PresentMon enables: the hashed provider lookup it replaced, the
+// flat table, and the flat table with the id filters PresentMon installs.
+// Each DxgKrnl event is accompanied by two with ids no handler switches on,
+// as a live DxgKrnl session is; the handler only counts what reaches it.
+// The stream is small enough to stay in cache and is dispatched PASSES times,
+// so the timings are of the dispatch rather than of reading the records.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <unordered_map>
+
+#include "../src/PresentMon/TraceDispatch.hpp"
+#include "synthetic_capture.hpp"
+
+namespace {
+
+enum {
+    PROCESS_COUNT = 4,
+    SECONDS = 1,
+    PASSES = 200,
+    RUNS = 5,
+    UNHANDLED_ID_0 = 1,
+    UNHANDLED_ID_1 = 2,
+};
+
+GUID const PROVIDERS[] = {
+    DXGI_PROVIDER_GUID,
+    D3D9_PROVIDER_GUID,
+    DXGKRNL_PROVIDER_GUID,
+    WIN32K_PROVIDER_GUID,
+    DWM_PROVIDER_GUID,
+    Win7::DWM_PROVIDER_GUID,
+    NT_PROCESS_EVENT_GUID,
+    KERNEL_PROCESS_PROVIDER_GUID,
+    Win7::DXGKBLT_GUID,
+    Win7::DXGKFLIP_GUID,
+    Win7::DXGKPRESENTHISTORY_GUID,
+    Win7::DXGKQUEUEPACKET_GUID,
+    Win7::DXGKVSYNCDPC_GUID,
+    Win7::DXGKMMIOFLIP_GUID,
+};
+
+void CountEvent(EVENT_RECORD*, void* pContext)
+{
+    ++*(uint64_t*) pContext;
+}
+
+struct GUIDHash {
+    size_t operator()(GUID const& g) const
+    {
+        auto p = (size_t const*) &g;
+        auto h = (size_t) 0;
+        for (size_t i = 0; i < sizeof(g) / sizeof(size_t); ++i) {
+            h ^= p[i];
+        }
+        return h;
+    }
+};
+
+struct GUIDEqual {
+    bool operator()(GUID const& lhs, GUID const& rhs) const { return IsEqualGUID(lhs, rhs) != FALSE; }
+};
+
+void SetIdFilter(TraceDispatchTable::Entry* e, std::initializer_list<uint16_t> eventIds)
+{
+    e->hasIdFilter_ = true;
+    for (auto eventId : eventIds) {
+        e->idFilter_[eventId >> 6] |= 1ull << (eventId & 63);
+    }
+}
+
+TraceDispatchTable MakeTable(uint64_t* counter, bool idFilters)
+{
+    TraceDispatchTable table;
+    for (auto const& providerId : PROVIDERS) {
+        TraceDispatchTable::Entry e = {};
+        memcpy(e.id_, &providerId, sizeof(e.id_));
+        e.handlerCount_ = 1;
+        e.handlers_[0].fn_ = &CountEvent;
+        e.handlers_[0].ctxt_ = counter;
+        if (idFilters) {
+            if (IsEqualGUID(providerId, DXGI_PROVIDER_GUID)) {
+                SetIdFilter(&e, { DXGIPresent_Start, DXGIPresent_Stop, DXGIPresentMPO_Start, DXGIPresentMPO_Stop });
+            } else if (IsEqualGUID(providerId, DXGKRNL_PROVIDER_GUID)) {
+                SetIdFilter(&e, { DxgKrnl_Flip, DxgKrnl_FlipMPO, DxgKrnl_QueueSubmit, DxgKrnl_QueueComplete,
+                                  DxgKrnl_MMIOFlip, DxgKrnl_MMIOFlipMPO, DxgKrnl_HSyncDPC, DxgKrnl_VSyncDPC,
+                                  DxgKrnl_Present, DxgKrnl_PresentHistoryDetailed, DxgKrnl_SubmitPresentHistory,
+                                  DxgKrnl_PropagatePresentHistory, DxgKrnl_Blit });
+            } else if (IsEqualGUID(providerId, WIN32K_PROVIDER_GUID)) {
+                SetIdFilter(&e, { Win32K_TokenCompositionSurfaceObject, Win32K_TokenStateChanged });
+            }
+        }
+        table.entries_.push_back(e);
+    }
+    return table;
+}
+
+template <typename DispatchFn>
+double Time(std::vector<EVENT_RECORD>& records, uint64_t* counter, DispatchFn dispatch)
+{
+    double best = 0.0;
+    for (int run = 0; run < RUNS; ++run) {
+        *counter = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int pass = 0; pass < PASSES; ++pass) {
+            for (auto& record : records) {
+                dispatch(&record);
+            }
+        }
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = run == 0 ? ns : std::min(best, ns);
+    }
+    return best / ((double) records.size() * PASSES);
+}
+
+}
+
+int main()
+{
+    auto events = synthetic::GenerateComposed(PROCESS_COUNT, SECONDS);
+    std::vector<EVENT_RECORD> records;
+    for (auto& e : events) {
+        records.push_back(synthetic::MakeRecord(e));
+        if (IsEqualGUID(e.ProviderId, DXGKRNL_PROVIDER_GUID)) {
+            for (auto id : { UNHANDLED_ID_0, UNHANDLED_ID_1 }) {
+                auto record = records.back();
+                record.EventHeader.EventDescriptor.Id = (USHORT) id;
+                records.push_back(record);
+            }
+        }
+    }
+    printf("%zu events, %u processes, %u s, %zu providers\n", records.size(), PROCESS_COUNT, SECONDS,
+           sizeof(PROVIDERS) / sizeof(PROVIDERS[0]));
+
+    uint64_t counter = 0;
+
+    std::unordered_map<GUID, TraceDispatchTable::Handler, GUIDHash, GUIDEqual> hashed;
+    for (auto const& providerId : PROVIDERS) {
+        hashed[providerId] = TraceDispatchTable::Handler { &CountEvent, &counter };
+    }
+    auto hashedNs = Time(records, &counter, [&](EVENT_RECORD* pEventRecord) {
+        auto iter = hashed.find(pEventRecord->EventHeader.ProviderId);
+        if (iter != hashed.end()) {
+            (*iter->second.fn_)(pEventRecord, iter->second.ctxt_);
+        }
+    });
+    auto hashedCount = counter;
+
+    auto flat = MakeTable(&counter, false);
+    size_t flatLast = 0;
+    auto flatNs = Time(records, &counter, [&](EVENT_RECORD* pEventRecord) { flat.Dispatch(pEventRecord, &flatLast); });
+    auto flatCount = counter;
+
+    auto filtered = MakeTable(&counter, true);
+    size_t filteredLast = 0;
+    auto filteredNs = Time(records, &counter, [&](EVENT_RECORD* pEventRecord) { filtered.Dispatch(pEventRecord, &filteredLast); });
+    auto filteredCount = counter;
+
+    printf("hashed lookup:      %6.2f ns/event  (%llu handled)\n", hashedNs, (unsigned long long) hashedCount);
+    printf("flat table:         %6.2f ns/event  (%llu handled)  %.2fx\n", flatNs, (unsigned long long) flatCount, hashedNs / flatNs);
+    printf("flat + id filters:  %6.2f ns/event  (%llu handled)  %.2fx\n", filteredNs, (unsigned long long) filteredCount, hashedNs / filteredNs);
+    return 0;
+}